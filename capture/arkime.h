@@ -245,6 +245,11 @@ typedef struct arkime_field_info {
     char                     *aliases;
 } ArkimeFieldInfo_t;
 
+// First block of a session's field arena, comes from the arena pool.  Most
+// sessions only set a handful of fields, the ones that set more grow it with
+// malloc'd blocks, so this is kept small since every live session holds one
+#define ARKIME_FIELD_ARENA_SIZE 384
+
 typedef struct {
     union {
         char                     *str;
@@ -260,6 +265,7 @@ typedef struct {
         struct in6_addr          *ip;
     };
     uint32_t                   jsonSize;
+    uint8_t                    arena;       // Values live in the session's field arena
 } ArkimeField_t;
 
 #define ARKIME_FIELD_OP_SET           0
@@ -558,9 +564,18 @@ struct arkime_pcap_sf_pkthdr {
 #define ARKIME_PACKET_TUNNEL_GENEVE     0x80
 // Increase tunnel size below
 
+/* Reader owned memory that uncopied packets point into, such as a tpacketv3 block.
+ * release is called from whichever thread drops the last reference.
+ */
+typedef struct arkime_packet_block {
+    uint32_t       refs;
+    void         (*release)(struct arkime_packet_block *block);
+} ArkimePacketBlock_t;
+
 typedef struct arkimepacket_t
 {
     struct arkimepacket_t   *packet_next, *packet_prev;
+    ArkimePacketBlock_t     *block;     // set if pkt points into reader memory
     struct timeval ts;                  // timestamp
     uint8_t       *pkt;                 // full packet
     uint64_t       writerFilePos;       // where in output file
@@ -600,6 +615,7 @@ typedef struct
     ArkimePacketHead_t    packetQ[ARKIME_MAX_PACKET_THREADS];
     int                   count;
     uint8_t               readerPos;
+    int16_t               ringId;
 } ArkimePacketBatch_t;
 /******************************************************************************/
 typedef struct arkime_tcp_data {
@@ -633,12 +649,41 @@ typedef enum {
     ARKIME_TCPFLAG_DST_ZERO,
     ARKIME_TCPFLAG_MAX
 } ArkimeSesTcpFlags;
+/******************************************************************************/
+/*
+ * wheel.c
+ */
+typedef struct arkime_wheel_entry {
+    struct arkime_wheel_entry *tw_next, *tw_prev;
+    void                      *tw_slot;
+    uint32_t                   expire;
+    uint8_t                    type;
+} ArkimeWheelEntry_t;
+
+typedef enum {
+    ARKIME_WHEEL_SESSION,
+    ARKIME_WHEEL_SESSION_SAVE,
+    ARKIME_WHEEL_PQ,
+    ARKIME_WHEEL_MAX
+} ArkimeWheelType;
+
+typedef void (*ArkimeWheelCb)(ArkimeWheelEntry_t *entry, int thread, uint32_t now);
+
+void     arkime_wheel_init();
+void     arkime_wheel_register(ArkimeWheelType type, ArkimeWheelCb cb);
+void     arkime_wheel_add(int thread, ArkimeWheelEntry_t *entry, uint32_t expire);
+void     arkime_wheel_remove(int thread, ArkimeWheelEntry_t *entry);
+int      arkime_wheel_run(int thread, uint32_t now, int max);
+uint32_t arkime_wheel_count(int thread);
+void     arkime_wheel_exit();
+
 /******************************************************************************/
 /*
  * SPI Data Storage
  */
+struct arkimepqitem;
+
 typedef struct arkime_session {
-    struct arkime_session *tcp_next, *tcp_prev;
     struct arkime_session *q_next, *q_prev;
     struct arkime_session *h_next, *h_prev;
     int                    h_bucket;
@@ -647,6 +692,7 @@ typedef struct arkime_session {
     uint8_t                sessionId[ARKIME_SESSIONID_LEN];
 
     ArkimeField_t        **fields;
+    struct arkime_field_arena *arena;
 
     void                  **pluginData;
 
@@ -661,6 +707,11 @@ typedef struct arkime_session {
     GArray                *fileNumArray;
     char                  *rootId;
 
+    ArkimeWheelEntry_t     timer;
+    ArkimeWheelEntry_t     saveTimer;
+    struct arkimepqitem   *pqItems;
+    struct arkime_session_counts *midSaveCounts;
+
     struct timeval         firstPacket;
     struct timeval         lastPacket;
     struct in6_addr        addr1;
@@ -707,17 +758,16 @@ typedef struct arkime_session {
     uint16_t               ackedUnseenSegment: 2;
     uint16_t               stopYara: 1;
     uint16_t               diskOverload: 1;
-    uint16_t               pq: 1;
     uint16_t               synSet: 2;
     uint16_t               inStoppedSave: 1;
+    uint16_t               elephant: 1;
+    uint16_t               midSaveWait: 1;
 } ArkimeSession_t;
 
 typedef struct arkime_session_head {
-    struct arkime_session *tcp_next, *tcp_prev;
     struct arkime_session *q_next, *q_prev;
     struct arkime_session *h_next, *h_prev;
     int                    h_bucket;
-    int                    tcp_count;
     int                    q_count;
     int                    h_count;
 } ArkimeSessionHead_t;
@@ -876,6 +926,7 @@ void arkime_config_monitor_files(char *desc, char **names, ArkimeFilesChange_cb
  * db.c
  */
 void     arkime_db_init();
+void     arkime_db_js0n_self_test(int rounds);
 char    *arkime_db_create_file(time_t firstPacket, const char *name, uint64_t size, int locked, uint32_t *id);
 char    *arkime_db_create_file_full(time_t firstPacket, const char *name, uint64_t size, int locked, uint32_t *id, ...);
 void     arkime_db_save_session(ArkimeSession_t *session, int final);
@@ -900,6 +951,29 @@ typedef void (* ArkimeDbSendBulkFunc) (char *json, int len);
 void     arkime_db_set_send_bulk2(ArkimeDbSendBulkFunc func, gboolean bulkHeader, gboolean indexInDoc, uint16_t maxDocs);
 void     arkime_db_set_send_bulk(ArkimeDbSendBulkFunc func);
 
+// What a serializer gets besides the session, fields must not be freed by it
+typedef struct {
+    const char      *indexSuffix;     // date part of the sessions3 index name
+    const char      *id;              // doc id, NULL if the db should make one
+    const short     *sortedFields;    // field positions sorted by full db name
+    int              sortedFieldsCnt;
+    uint64_t         timestamp;       // ms
+    gboolean         indexInDoc;
+} ArkimeDbSaveInfo_t;
+
+typedef void (* ArkimeDbSerializeFunc) (BSB *bsb, ArkimeSession_t *session, const ArkimeDbSaveInfo_t *info);
+
+// How sessions are encoded into the send bulk buffer, "json" is the default and "cbor" is built in.
+// header is optional and only called when bulkHeader is set.
+typedef struct {
+    const char            *name;
+    ArkimeDbSerializeFunc  header;
+    ArkimeDbSerializeFunc  body;
+} ArkimeDbSerializer_t;
+
+void     arkime_db_add_serializer(const ArkimeDbSerializer_t *serializer);
+void     arkime_db_set_serializer(const char *name);
+
 /******************************************************************************/
 /*
  * dedup.c
@@ -908,6 +982,30 @@ void     arkime_db_set_send_bulk(ArkimeDbSendBulkFunc func);
 void arkime_dedup_init();
 void arkime_dedup_exit();
 int arkime_dedup_should_drop(const ArkimePacket_t *packet, int headerLen);
+uint64_t arkime_dedup_collisions();
+
+/******************************************************************************/
+/*
+ * pool.c
+ */
+typedef enum {
+    ARKIME_POOL_PACKET,
+    ARKIME_POOL_TCPDATA,
+    ARKIME_POOL_SESSION,
+    ARKIME_POOL_FIELD,
+    ARKIME_POOL_ARENA,
+    ARKIME_POOL_MAX
+} ArkimePoolType;
+
+void  arkime_pool_init();
+void *arkime_pool_alloc(ArkimePoolType type, int zero);
+void  arkime_pool_free(ArkimePoolType type, void *mem);
+void  arkime_pool_stats(ArkimePoolType type, uint64_t *inUse, uint64_t *highWater, uint64_t *memory);
+const char *arkime_pool_name(ArkimePoolType type);
+
+#define ARKIME_POOL_ALLOC(pool)      arkime_pool_alloc(pool, 0)
+#define ARKIME_POOL_ALLOC0(pool)     arkime_pool_alloc(pool, 1)
+#define ARKIME_POOL_FREE(pool, mem)  arkime_pool_free(pool, mem)
 
 /******************************************************************************/
 /*
@@ -918,15 +1016,19 @@ typedef struct arkimedrophashitem_t  ArkimeDropHashItem_t;
 typedef struct arkimedrophash_t      ArkimeDropHash_t;
 typedef struct arkimedrophashgroup_t ArkimeDropHashGroup_t;
 struct arkimedrophashgroup_t {
-    ArkimeDropHashItem_t *dhg_next, *dhg_prev;
-    int                   dhg_count;
+    ArkimeDropHash_t     *hash;
+    ArkimeDropHash_t     *retired;
+    uint64_t              ports[0x10000 / 64];
     int                   changed;
+    int                   saving;
     char                 *file;
     char                  keyLen;
-    ArkimeDropHash_t     *drops[0x10000];
     ARKIME_LOCK_EXTERN(lock);
 };
 
+// Quick check before arkime_drophash_should_drop if anything uses the port
+#define ARKIME_DROPHASH_HAS_PORT(group, port) ((group)->ports[(port) >> 6] & (1ULL << ((port) & 63)))
+
 
 void arkime_drophash_init(ArkimeDropHashGroup_t *group, char *file, int keyLen);
 int arkime_drophash_add (ArkimeDropHashGroup_t *group, int port, const void *key, uint32_t current, uint32_t goodFor);
@@ -934,6 +1036,21 @@ int arkime_drophash_should_drop (ArkimeDropHashGroup_t *group, int port, void *k
 void arkime_drophash_delete (ArkimeDropHashGroup_t *group, int port, void *key);
 void arkime_drophash_save(ArkimeDropHashGroup_t *group);
 
+/******************************************************************************/
+/*
+ * lpm.c
+ */
+typedef struct arkimelpm_t ArkimeLpm_t;
+struct _patricia_tree_t;
+struct _patricia_node_t;
+
+ArkimeLpm_t *arkime_lpm_new(int maxbits, void (*freeFunc)(void *));
+struct _patricia_tree_t *arkime_lpm_tree(ArkimeLpm_t *lpm);
+void arkime_lpm_compile(ArkimeLpm_t *lpm);
+struct _patricia_node_t *arkime_lpm_search_best(const ArkimeLpm_t *lpm, const uint8_t *addr);
+int arkime_lpm_search_all(const ArkimeLpm_t *lpm, const uint8_t *addr, struct _patricia_node_t **results, int resultsize);
+void arkime_lpm_free(ArkimeLpm_t *lpm);
+
 /******************************************************************************/
 /*
  * parsers.c
@@ -1018,12 +1135,14 @@ uint8_t *arkime_http_get(void *server, char *key, int key_len, size_t *mlen);
 void arkime_http_exit();
 int arkime_http_queue_length(void *server);
 uint64_t arkime_http_dropped_count(void *server);
+void arkime_http_time_stats(void *server, uint64_t *compressUS, uint64_t *sendUS);
 
 void *arkime_http_create_server(const char *hostnames, int maxConns, int maxOutstandingRequests, int compress);
 void arkime_http_set_retries(void *server, uint16_t retries);
 void arkime_http_set_client_cert(void *serverV, char *clientCert, char *clientKey, char *clientKeyPass);
 void arkime_http_set_print_errors(void *server);
 void arkime_http_set_headers(void *server, char **headers);
+void arkime_http_set_compression_level(void *server, int level);
 void arkime_http_set_header_cb(void *server, ArkimeHttpHeader_cb cb);
 void arkime_http_free_server(void *server);
 
@@ -1069,6 +1188,7 @@ void     arkime_session_process_commands(int thread);
 
 int      arkime_session_need_save_outstanding();
 int      arkime_session_cmd_outstanding();
+int      arkime_session_cmd_queue_length(int thread);
 
 typedef enum {
     ARKIME_SES_CMD_FUNC
@@ -1076,6 +1196,7 @@ typedef enum {
 typedef void (*ArkimeCmd_func)(ArkimeSession_t *session, gpointer uw1, gpointer uw2);
 
 void arkime_session_add_cmd(ArkimeSession_t *session, ArkimeSesCmd sesCmd, gpointer uw1, gpointer uw2, ArkimeCmd_func func);
+void arkime_session_add_cmds(ArkimeSession_t **sessions, int num, ArkimeSesCmd sesCmd, gpointer uw1, gpointer uw2, ArkimeCmd_func func);
 void arkime_session_add_cmd_thread(int thread, gpointer uw1, gpointer uw2, ArkimeCmd_func func);
 
 void arkime_session_set_stop_saving(ArkimeSession_t *session);
@@ -1112,6 +1233,9 @@ int      arkime_packet_frags_size();
 uint64_t arkime_packet_dropped_frags();
 uint64_t arkime_packet_dropped_overload();
 uint64_t arkime_packet_total_bytes();
+uint64_t arkime_packet_elephant_flows();
+uint32_t arkime_packet_thread_queue_length(int thread);
+uint32_t arkime_packet_thread_cpu(int thread);
 void     arkime_packet_thread_wake(int thread);
 void     arkime_packet_flush();
 void     arkime_packet_process_data(ArkimeSession_t *session, const uint8_t *data, int len, int which);
@@ -1122,6 +1246,8 @@ void     arkime_packet_batch_init(ArkimePacketBatch_t *batch);
 void     arkime_packet_batch_flush(ArkimePacketBatch_t *batch);
 void     arkime_packet_batch(ArkimePacketBatch_t *batch, ArkimePacket_t *const packet);
 void     arkime_packet_batch_process(ArkimePacketBatch_t *batch, ArkimePacket_t *const packet, int thread);
+void     arkime_packet_copy(ArkimePacket_t *const packet);
+void     arkime_packet_block_unref(ArkimePacketBlock_t *block);
 
 void     arkime_packet_set_dltsnap(int dlt, int snaplen);
 uint32_t arkime_packet_dlt_to_linktype(int dlt);
@@ -1184,6 +1310,7 @@ typedef void (* ArkimePluginHttpFunc) (ArkimeSession_t *session, http_parser *hp
 typedef void (* ArkimePluginSMTPHeaderFunc) (ArkimeSession_t *session, const char *field, size_t field_len, const char *value, size_t value_len);
 typedef void (* ArkimePluginSMTPFunc) (ArkimeSession_t *session);
 typedef uint32_t (* ArkimePluginOutstandingFunc) ();
+typedef void (* ArkimePluginStatsFunc) (GString *str);
 
 #define ARKIME_PLUGIN_SAVE         0x00000001
 #define ARKIME_PLUGIN_IP           0x00000002
@@ -1249,7 +1376,11 @@ void arkime_plugins_set_smtp_cb(const char                 *name,
 void arkime_plugins_set_outstanding_cb(const char                 *name,
                                        ArkimePluginOutstandingFunc outstandingFunc);
 
+void arkime_plugins_set_stats_cb(const char                 *name,
+                                 ArkimePluginStatsFunc       statsFunc);
+
 uint32_t arkime_plugins_outstanding();
+void arkime_plugins_stats(GString *str);
 
 void arkime_plugins_cb_pre_save(ArkimeSession_t *session, int final);
 void arkime_plugins_cb_save(ArkimeSession_t *session, int final);
@@ -1309,6 +1440,8 @@ void arkime_field_macoui_add(ArkimeSession_t *session, int macField, int ouiFiel
 int  arkime_field_count(int pos, ArkimeSession_t *session);
 void arkime_field_certsinfo_free (ArkimeCertsInfo_t *certs);
 void arkime_field_free(ArkimeSession_t *session);
+void arkime_field_free_pos(ArkimeSession_t *session, int pos);
+void arkime_field_string_swap(ArkimeSession_t *session, int pos, char **value, char *newstr);
 void arkime_field_exit();
 
 void arkime_field_ops_init(ArkimeFieldOps_t *ops, int numOps, uint16_t flags);
@@ -1331,11 +1464,17 @@ typedef uint32_t (*ArkimeWriterQueueLength)();
 typedef void (*ArkimeWriterWrite)(const ArkimeSession_t *const session, ArkimePacket_t *const packet);
 typedef void (*ArkimeWriterExit)();
 typedef void (*ArkimeWriterIndex)(ArkimeSession_t *session);
+/* Fix up the first len filePosArray entries before the session is saved.
+ * Returns FALSE if they aren't ready yet, func is then queued as a session
+ * cmd with len as uw1 once they are.
+ */
+typedef gboolean (*ArkimeWriterResolve)(ArkimeSession_t *session, guint len, ArkimeCmd_func func);
 
 extern ArkimeWriterQueueLength arkime_writer_queue_length;
 extern ArkimeWriterWrite arkime_writer_write;
 extern ArkimeWriterExit arkime_writer_exit;
 extern ArkimeWriterIndex arkime_writer_index;
+extern ArkimeWriterResolve arkime_writer_resolve;
 
 
 void arkime_writers_init();
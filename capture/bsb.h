@@ -231,13 +231,13 @@ do {                                              \
 do {                                              \
     if ((b).ptr && (b).ptr + 8 <= (b).end) {      \
         x = ((uint64_t)((b).ptr)[0]) << 56 |      \
-            ((uint64_t)((b).ptr)[0]) << 48 |      \
-            ((uint64_t)((b).ptr)[0]) << 40 |      \
-            ((uint64_t)((b).ptr)[0]) << 32 |      \
-            ((uint64_t)((b).ptr)[0]) << 24 |      \
-            ((uint64_t)((b).ptr)[1]) << 16 |      \
-            ((uint64_t)((b).ptr)[2]) << 8  |      \
-            ((uint64_t)((b).ptr)[3]);             \
+            ((uint64_t)((b).ptr)[1]) << 48 |      \
+            ((uint64_t)((b).ptr)[2]) << 40 |      \
+            ((uint64_t)((b).ptr)[3]) << 32 |      \
+            ((uint64_t)((b).ptr)[4]) << 24 |      \
+            ((uint64_t)((b).ptr)[5]) << 16 |      \
+            ((uint64_t)((b).ptr)[6]) << 8  |      \
+            ((uint64_t)((b).ptr)[7]);             \
         (b).ptr += 8;                             \
     } else                                        \
         BSB_SET_ERROR(b);                         \
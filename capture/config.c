@@ -760,8 +760,9 @@ void arkime_config_load()
     config.pcapDirAlgorithm = arkime_config_str(keyfile, "pcapDirAlgorithm", "round-robin");
     if (strcmp(config.pcapDirAlgorithm, "round-robin") != 0
         && strcmp(config.pcapDirAlgorithm, "max-free-percent") != 0
-        && strcmp(config.pcapDirAlgorithm, "max-free-bytes") != 0) {
-        CONFIGEXIT("'%s' is not a valid value for pcapDirAlgorithm.  Supported algorithms are round-robin, max-free-percent, and max-free-bytes.", config.pcapDirAlgorithm);
+        && strcmp(config.pcapDirAlgorithm, "max-free-bytes") != 0
+        && strcmp(config.pcapDirAlgorithm, "least-open") != 0) {
+        CONFIGEXIT("'%s' is not a valid value for pcapDirAlgorithm.  Supported algorithms are round-robin, max-free-percent, max-free-bytes, and least-open.", config.pcapDirAlgorithm);
     }
 
     config.maxFileSizeG          = arkime_config_double(keyfile, "maxFileSizeG", 12, 0.01, 1024);
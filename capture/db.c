@@ -17,6 +17,11 @@
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <dirent.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "patricia.h"
 
 #include "maxminddb.h"
@@ -42,13 +47,13 @@ LOCAL char             *rirs[256];
 
 void                   *esServer = 0;
 
-LOCAL patricia_tree_t  *ipTree4 = 0;
-LOCAL patricia_tree_t  *ipTree6 = 0;
+LOCAL ArkimeLpm_t      *ipTree4 = 0;
+LOCAL ArkimeLpm_t      *ipTree6 = 0;
 
-LOCAL patricia_tree_t  *newipTree4 = 0;
-LOCAL patricia_tree_t  *newipTree6 = 0;
+LOCAL ArkimeLpm_t      *newipTree4 = 0;
+LOCAL ArkimeLpm_t      *newipTree6 = 0;
 
-LOCAL patricia_tree_t  *ouiTree = 0;
+LOCAL ArkimeLpm_t      *ouiTree = 0;
 
 extern char            *arkime_char_to_hex;
 extern uint8_t          arkime_char_to_hexstr[256][3];
@@ -57,6 +62,10 @@ extern uint8_t          arkime_hex_to_char[256][256];
 LOCAL uint32_t          nextFileNum;
 LOCAL ARKIME_LOCK_DEFINE(nextFileNum);
 
+// pcapDirAlgorithm=least-open, how many files are still being written per pcapDir, protected by nextFileNum lock
+LOCAL int              *pcapDirOpen;
+LOCAL GHashTable       *pcapDirFiles;
+
 LOCAL struct timespec   startHealthCheck;
 LOCAL uint64_t          esHealthMS;
 
@@ -71,21 +80,6 @@ extern uint64_t         packetStats[ARKIME_PACKET_MAX];
 /******************************************************************************/
 extern ArkimeConfig_t        config;
 
-/******************************************************************************/
-void arkime_db_add_override_ip(char *str, ArkimeIpInfo_t *ii)
-{
-    patricia_node_t *node;
-    if (!newipTree4) {
-        newipTree4 = New_Patricia(32);
-        newipTree6 = New_Patricia(128);
-    }
-    if (strchr(str, '.') != 0) {
-        node = make_and_lookup(newipTree4, str);
-    } else {
-        node = make_and_lookup(newipTree6, str);
-    }
-    node->data = ii;
-}
 /******************************************************************************/
 LOCAL void arkime_db_free_override_ip(ArkimeIpInfo_t *ii)
 {
@@ -106,18 +100,33 @@ LOCAL void arkime_db_free_override_ip(ArkimeIpInfo_t *ii)
     ARKIME_TYPE_FREE(ArkimeIpInfo_t, ii);
 }
 /******************************************************************************/
-LOCAL void arkime_db_free_override_ips(patricia_tree_t *tree)
+void arkime_db_add_override_ip(char *str, ArkimeIpInfo_t *ii)
 {
-    Destroy_Patricia(tree, (patricia_fn_data_t)arkime_db_free_override_ip);
+    patricia_node_t *node;
+    if (!newipTree4) {
+        newipTree4 = arkime_lpm_new(32, (patricia_fn_data_t)arkime_db_free_override_ip);
+        newipTree6 = arkime_lpm_new(128, (patricia_fn_data_t)arkime_db_free_override_ip);
+    }
+    if (strchr(str, '.') != 0) {
+        node = make_and_lookup(arkime_lpm_tree(newipTree4), str);
+    } else {
+        node = make_and_lookup(arkime_lpm_tree(newipTree6), str);
+    }
+    node->data = ii;
 }
 /******************************************************************************/
 void arkime_db_install_override_ip()
 {
-    arkime_free_later(ipTree4, (GDestroyNotify) arkime_db_free_override_ips);
+    if (newipTree4) {
+        arkime_lpm_compile(newipTree4);
+        arkime_lpm_compile(newipTree6);
+    }
+
+    arkime_free_later(ipTree4, (GDestroyNotify) arkime_lpm_free);
     ipTree4 = newipTree4;
     newipTree4 = 0;
 
-    arkime_free_later(ipTree6, (GDestroyNotify) arkime_db_free_override_ips);
+    arkime_free_later(ipTree6, (GDestroyNotify) arkime_lpm_free);
     ipTree6 = newipTree6;
     newipTree6 = 0;
 }
@@ -127,10 +136,10 @@ LOCAL ArkimeIpInfo_t *arkime_db_get_override_ip6(ArkimeSession_t *session, struc
     patricia_node_t *node;
 
     if (IN6_IS_ADDR_V4MAPPED(ip)) {
-        if ((node = patricia_search_best3 (ipTree4, ((u_char *)ip->s6_addr) + 12, 32)) == NULL)
+        if ((node = arkime_lpm_search_best(ipTree4, ip->s6_addr + 12)) == NULL)
             return 0;
     } else {
-        if ((node = patricia_search_best3 (ipTree6, (u_char *)ip->s6_addr, 128)) == NULL)
+        if ((node = arkime_lpm_search_best(ipTree6, ip->s6_addr)) == NULL)
             return 0;
     }
 
@@ -150,10 +159,74 @@ LOCAL ArkimeIpInfo_t *arkime_db_get_override_ip6(ArkimeSession_t *session, struc
 }
 
 /******************************************************************************/
-LOCAL void arkime_db_js0n_str(BSB *bsb, uint8_t *in, gboolean utf8)
+/* Length of the run at the start of in that can be copied as is, printable
+ * ascii other than the three characters that get escaped. Everything else,
+ * including all utf8 bytes, goes thru the byte at a time switch.
+ */
+#define JS0N_SAFE(c) ((c) >= 0x20 && (c) < 0x80 && (c) != '"' && (c) != '\\' && (c) != '/')
+
+LOCAL inline int arkime_db_js0n_safe_len(const uint8_t *in, int len)
 {
-    BSB_EXPORT_u08(*bsb, '"');
-    while (*in) {
+    int i = 0;
+
+#ifdef __AVX2__
+    const __m256i quote32 = _mm256_set1_epi8('"');
+    const __m256i bslash32 = _mm256_set1_epi8('\\');
+    const __m256i slash32 = _mm256_set1_epi8('/');
+    const __m256i space32 = _mm256_set1_epi8(0x20);
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        // Signed compare, so bytes >= 0x80 are less than space too
+        const __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi8(space32, v),
+                                            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote32),
+                                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, bslash32), _mm256_cmpeq_epi8(v, slash32))));
+        const uint32_t m = _mm256_movemask_epi8(bad);
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+#endif
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i space = _mm_set1_epi8(0x20);
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        // Signed compare, so bytes >= 0x80 are less than space too
+        const __m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, space),
+                                         _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                 _mm_or_si128(_mm_cmpeq_epi8(v, bslash), _mm_cmpeq_epi8(v, slash))));
+        const int m = _mm_movemask_epi8(bad);
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (!JS0N_SAFE(in[i]))
+            break;
+    }
+    return i;
+}
+/******************************************************************************/
+LOCAL void arkime_db_js0n_str_unquoted(BSB *bsb, uint8_t *in, int len, gboolean utf8)
+{
+
+    if (len == -1)
+        len = strlen((char *)in);
+
+    uint8_t *end = in + len;
+
+    while (in < end) {
+        const int safe = arkime_db_js0n_safe_len(in, end - in);
+        if (safe) {
+            BSB_EXPORT_ptr(*bsb, in, safe);
+            in += safe;
+            if (in >= end)
+                break;
+        }
+
         switch(*in) {
         case '\b':
             BSB_EXPORT_cstr(*bsb, "\\b");
@@ -181,18 +254,19 @@ LOCAL void arkime_db_js0n_str(BSB *bsb, uint8_t *in, gboolean utf8)
             break;
         default:
             if(*in < 32) {
-                BSB_EXPORT_sprintf(*bsb, "\\u%04x", *in);
+                BSB_EXPORT_cstr(*bsb, "\\u00");
+                BSB_EXPORT_ptr(*bsb, arkime_char_to_hexstr[*in], 2);
             } else if (utf8) {
                 if ((*in & 0xf0) == 0xf0) {
-                    if (!in[1] || !in[2] || !in[3]) goto end;
+                    if (!in[1] || !in[2] || !in[3]) return;
                     BSB_EXPORT_ptr(*bsb, in, 4);
                     in += 3;
                 } else if ((*in & 0xf0) == 0xe0) {
-                    if (!in[1] || !in[2]) goto end;
+                    if (!in[1] || !in[2]) return;
                     BSB_EXPORT_ptr(*bsb, in, 3);
                     in += 2;
                 } else if ((*in & 0xf0) == 0xd0) {
-                    if (!in[1]) goto end;
+                    if (!in[1]) return;
                     BSB_EXPORT_ptr(*bsb, in, 2);
                     in += 1;
                 } else {
@@ -210,13 +284,17 @@ LOCAL void arkime_db_js0n_str(BSB *bsb, uint8_t *in, gboolean utf8)
         }
         in++;
     }
-
-end:
+}
+/******************************************************************************/
+LOCAL void arkime_db_js0n_str(BSB *bsb, uint8_t *in, gboolean utf8)
+{
+    BSB_EXPORT_u08(*bsb, '"');
+    arkime_db_js0n_str_unquoted(bsb, in, -1, utf8);
     BSB_EXPORT_u08(*bsb, '"');
 }
-
 /******************************************************************************/
-LOCAL void arkime_db_js0n_str_unquoted(BSB *bsb, uint8_t *in, int len, gboolean utf8)
+/* The byte at a time version the above replaced, kept for --js0nselftest */
+LOCAL void arkime_db_js0n_str_unquoted_ref(BSB *bsb, uint8_t *in, int len, gboolean utf8)
 {
 
     if (len == -1)
@@ -282,7 +360,256 @@ LOCAL void arkime_db_js0n_str_unquoted(BSB *bsb, uint8_t *in, int len, gboolean
         in++;
     }
 }
+/******************************************************************************/
+SUPPRESS_UNSIGNED_INTEGER_OVERFLOW
+LOCAL inline uint64_t arkime_db_js0n_rand(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+/******************************************************************************/
+/* Random strings thru both versions, mostly ascii with escaped characters,
+ * control characters, NULs, latin1 and utf8 sequences mixed in, at every
+ * alignment and length up to a few vectors.
+ */
+void arkime_db_js0n_self_test(int rounds)
+{
+    uint8_t  buf[32 + 512 + 4];
+    uint8_t  out[2][512 * 6 + 16];
+    uint64_t seed = ((uint64_t)time(NULL) << 16) ^ getpid();
+    uint64_t state = seed;
+
+    if (config.debug)
+        LOG("js0n self test seed %" PRIu64, seed);
+
+    for (int r = 0; r < rounds; r++) {
+        const int off = arkime_db_js0n_rand(&state) % 32;
+        const int len = arkime_db_js0n_rand(&state) % 512;
+        const gboolean utf8 = arkime_db_js0n_rand(&state) & 1;
+        uint8_t *in = buf + off;
+
+        for (int i = 0; i < len; i++) {
+            const uint64_t v = arkime_db_js0n_rand(&state);
+            switch (v % 16) {
+            case 0:
+                in[i] = "\"\\/"[(v >> 8) % 3];
+                break;
+            case 1:
+                in[i] = (v >> 8) % 32;
+                break;
+            case 2:
+                in[i] = 0x80 | (v >> 8);
+                break;
+            case 3: {
+                const int n = 2 + (v >> 8) % 3;
+                const uint8_t lead[] = {0, 0, 0xd0, 0xe0, 0xf0};
+                in[i] = lead[n] | ((v >> 16) & (n == 4 ? 0x07 : 0x0f));
+                for (int j = 1; j < n && i + 1 < len; j++)
+                    in[++i] = 0x80 | ((v >> (24 + j * 6)) & 0x3f);
+                break;
+            }
+            default:
+                in[i] = 0x20 + (v >> 8) % 95;
+            }
+        }
+        memset(in + len, 0, 4);
+
+        for (int t = 0; t < 2; t++) {
+            BSB bsb[2];
+            BSB_INIT(bsb[0], out[0], sizeof(out[0]));
+            BSB_INIT(bsb[1], out[1], sizeof(out[1]));
+
+            if (t == 0) {
+                arkime_db_js0n_str_unquoted(&bsb[0], in, len, utf8);
+                arkime_db_js0n_str_unquoted_ref(&bsb[1], in, len, utf8);
+            } else {
+                arkime_db_js0n_str(&bsb[0], in, utf8);
+                BSB_EXPORT_u08(bsb[1], '"');
+                arkime_db_js0n_str_unquoted_ref(&bsb[1], in, -1, utf8);
+                BSB_EXPORT_u08(bsb[1], '"');
+            }
+
+            if (BSB_LENGTH(bsb[0]) != BSB_LENGTH(bsb[1]) || memcmp(out[0], out[1], BSB_LENGTH(bsb[0])) != 0) {
+                LOGEXIT("ERROR - js0n self test mismatch seed %" PRIu64 " round %d %s len %d utf8 %d\n%.*s\n%.*s",
+                        seed, r, t ? "quoted" : "unquoted", len, utf8,
+                        (int)BSB_LENGTH(bsb[0]), out[0], (int)BSB_LENGTH(bsb[1]), out[1]);
+            }
+        }
+    }
+    LOG("js0n self test passed %d rounds", rounds);
+}
+/******************************************************************************/
+/* Per packet thread cache of the country and ASN mmdb results, the
+ * mmdb lookups are done for both ends of every session save so the same
+ * few hundred thousand ips are resolved over and over. Each thread has
+ * its own table so there is no locking, it is set associative with
+ * GEO_CACHE_WAYS entries per set and LRU replacement inside a set.
+ *
+ * When every mmdb says the record covers at least the whole /24 (/48 for
+ * ipv6) the entry is stored under the masked prefix, so one entry serves
+ * every ip in that prefix, otherwise under the exact ip. Lookups probe
+ * the prefix entry first and then the exact one.
+ *
+ * The strings point into the mmdb files, entries are stamped with
+ * geoGeneration which is bumped on every reload so an old entry is never
+ * used once its mmdb has been replaced and queued to be freed.
+ */
+#define GEO_CACHE_WAYS      4
+#define GEO_CACHE_PREFIX4   24
+#define GEO_CACHE_PREFIX6   48
+
+typedef struct {
+    struct in6_addr addr;
+    char           *g;
+    char           *asStr;
+    uint32_t        asNum;
+    int             asLen;
+    uint32_t        generation;
+    uint32_t        used;
+    uint8_t         prefix;
+} ArkimeGeoCacheEntry_t;
+
+LOCAL struct {
+    ArkimeGeoCacheEntry_t *entries;
+    uint32_t               clock;
+    uint64_t               hits;
+    uint64_t               misses;
+} geoCache[ARKIME_MAX_PACKET_THREADS];
+
+LOCAL uint32_t          geoCacheSetMask;
+LOCAL uint32_t          geoGeneration = 1;
+
+/******************************************************************************/
+SUPPRESS_UNSIGNED_INTEGER_OVERFLOW
+LOCAL inline uint32_t arkime_db_geo_cache_hash(const struct in6_addr *addr, int prefix)
+{
+    uint64_t a, b;
+    memcpy(&a, addr->s6_addr, 8);
+    memcpy(&b, addr->s6_addr + 8, 8);
+
+    uint64_t h = (a * 0x9e3779b97f4a7c15ULL) ^ (b * 0xbf58476d1ce4e5b9ULL) ^ prefix;
+    h ^= h >> 29;
+    h *= 0x94d049bb133111ebULL;
+    return (h >> 32) & geoCacheSetMask;
+}
+/******************************************************************************/
+LOCAL void arkime_db_geo_cache_mask(struct in6_addr *addr, gboolean isV4)
+{
+    if (isV4) {
+        addr->s6_addr[15] = 0;
+    } else {
+        memset(addr->s6_addr + GEO_CACHE_PREFIX6 / 8, 0, 16 - GEO_CACHE_PREFIX6 / 8);
+    }
+}
+/******************************************************************************/
+LOCAL ArkimeGeoCacheEntry_t *arkime_db_geo_cache_find(int thread, const struct in6_addr *addr, int prefix, uint32_t generation)
+{
+    ArkimeGeoCacheEntry_t *set = geoCache[thread].entries + arkime_db_geo_cache_hash(addr, prefix) * GEO_CACHE_WAYS;
+
+    for (int i = 0; i < GEO_CACHE_WAYS; i++) {
+        if (set[i].generation == generation && set[i].prefix == prefix &&
+            memcmp(&set[i].addr, addr, sizeof(*addr)) == 0) {
+            set[i].used = ++geoCache[thread].clock;
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+/******************************************************************************/
+LOCAL ArkimeGeoCacheEntry_t *arkime_db_geo_cache_add(int thread, const struct in6_addr *addr, int prefix, uint32_t generation)
+{
+    ArkimeGeoCacheEntry_t *set = geoCache[thread].entries + arkime_db_geo_cache_hash(addr, prefix) * GEO_CACHE_WAYS;
+    ArkimeGeoCacheEntry_t *entry = &set[0];
+
+    for (int i = 0; i < GEO_CACHE_WAYS; i++) {
+        if (set[i].generation != generation) {
+            entry = &set[i];
+            break;
+        }
+        if ((int32_t)(set[i].used - entry->used) < 0)
+            entry = &set[i];
+    }
+
+    entry->addr       = *addr;
+    entry->prefix     = prefix;
+    entry->generation = generation;
+    entry->used       = ++geoCache[thread].clock;
+    return entry;
+}
+/******************************************************************************/
+// Returns the netmask of the record in bits of the address family looked up
+LOCAL int arkime_db_geo_netmask(const MMDB_s *mmdb, const MMDB_lookup_result_s *result, gboolean isV4)
+{
+    if (isV4 && mmdb->metadata.ip_version == 6)
+        return result->netmask >= 96 ? result->netmask - 96 : 0;
+    return result->netmask;
+}
+/******************************************************************************/
+// Fill entry from the mmdb files, returns the smallest netmask of the records used
+LOCAL int arkime_db_geo_mmdb(MMDB_s *country, MMDB_s *asn, const struct sockaddr *sa, gboolean isV4, ArkimeGeoCacheEntry_t *entry)
+{
+    int netmask = isV4 ? 32 : 128;
+    int error = 0;
+
+    entry->g = entry->asStr = 0;
+    entry->asNum = 0;
+    entry->asLen = 0;
+
+    if (country) {
+        MMDB_lookup_result_s result = MMDB_lookup_sockaddr(country, sa, &error);
+        if (error == MMDB_SUCCESS) {
+            netmask = MIN(netmask, arkime_db_geo_netmask(country, &result, isV4));
+            if (result.found_entry) {
+                MMDB_entry_data_s entry_data;
+                static const char *countryPath[] = {"country", "iso_code", NULL};
+
+                int status = MMDB_aget_value(&result.entry, &entry_data, countryPath);
+                if (status == MMDB_SUCCESS) {
+                    entry->g = (char *)entry_data.utf8_string;
+                }
+            }
+        } else {
+            netmask = 128;
+        }
+    }
 
+    if (asn) {
+        MMDB_lookup_result_s result = MMDB_lookup_sockaddr(asn, sa, &error);
+        if (error == MMDB_SUCCESS) {
+            netmask = MIN(netmask, arkime_db_geo_netmask(asn, &result, isV4));
+            if (result.found_entry) {
+                MMDB_entry_data_s org;
+                MMDB_entry_data_s num;
+
+                static const char *asoPath[]     = {"autonomous_system_organization", NULL};
+                int status = MMDB_aget_value(&result.entry, &org, asoPath);
+
+                static const char *asnPath[]     = {"autonomous_system_number", NULL};
+                status += MMDB_aget_value(&result.entry, &num, asnPath);
+
+                if (status == MMDB_SUCCESS) {
+                    entry->asNum = num.uint32;
+                    entry->asStr = (char *)org.utf8_string;
+                    entry->asLen = org.data_size;
+                }
+            }
+        } else {
+            netmask = 128;
+        }
+    }
+    return netmask;
+}
+/******************************************************************************/
+LOCAL void arkime_db_geo_cache_stats(uint64_t *hits, uint64_t *misses)
+{
+    *hits = *misses = 0;
+    for (int t = 0; t < config.packetThreads; t++) {
+        *hits += geoCache[t].hits;
+        *misses += geoCache[t].misses;
+    }
+}
 /******************************************************************************/
 void arkime_db_geo_lookup6(ArkimeSession_t *session, struct in6_addr addr, char **g, uint32_t *asNum, char **asStr, int *asLen, char **rir)
 {
@@ -302,8 +629,9 @@ void arkime_db_geo_lookup6(ArkimeSession_t *session, struct in6_addr addr, char
     struct sockaddr    *sa;
     struct sockaddr_in  sin;
     struct sockaddr_in6 sin6;
+    const gboolean      isV4 = IN6_IS_ADDR_V4MAPPED(&addr);
 
-    if (IN6_IS_ADDR_V4MAPPED(&addr)) {
+    if (isV4) {
         sin.sin_family = AF_INET;
         sin.sin_addr.s_addr   = ARKIME_V6_TO_V4(addr);
         sa = (struct sockaddr *)&sin;
@@ -317,38 +645,56 @@ void arkime_db_geo_lookup6(ArkimeSession_t *session, struct in6_addr addr, char
         sa = (struct sockaddr *)&sin6;
     }
 
-    int error = 0;
-    if (!*g && geoCountry) {
-        MMDB_lookup_result_s result = MMDB_lookup_sockaddr(geoCountry, sa, &error);
-        if (error == MMDB_SUCCESS && result.found_entry) {
-            MMDB_entry_data_s entry_data;
-            static const char *countryPath[] = {"country", "iso_code", NULL};
+    if (*g && *asStr)
+        return;
 
-            int status = MMDB_aget_value(&result.entry, &entry_data, countryPath);
-            if (status == MMDB_SUCCESS) {
-                *g = (char *)entry_data.utf8_string;
-            }
-        }
-    }
+    // Read the generation before the mmdb pointers, a reload in between just means the entry is never used
+    const uint32_t generation = geoGeneration;
+    __sync_synchronize();
+    MMDB_s *country = geoCountry;
+    MMDB_s *asn = geoASN;
 
-    if (!*asStr && geoASN) {
-        MMDB_lookup_result_s result = MMDB_lookup_sockaddr(geoASN, sa, &error);
-        if (error == MMDB_SUCCESS && result.found_entry) {
-            MMDB_entry_data_s org;
-            MMDB_entry_data_s num;
+    if (!country && !asn)
+        return;
 
-            static const char *asoPath[]     = {"autonomous_system_organization", NULL};
-            int status = MMDB_aget_value(&result.entry, &org, asoPath);
+    ArkimeGeoCacheEntry_t  local;
+    ArkimeGeoCacheEntry_t *entry = NULL;
+    const int              thread = session->thread;
 
-            static const char *asnPath[]     = {"autonomous_system_number", NULL};
-            status += MMDB_aget_value(&result.entry, &num, asnPath);
+    if (geoCache[thread].entries) {
+        struct in6_addr masked = addr;
+        arkime_db_geo_cache_mask(&masked, isV4);
+        entry = arkime_db_geo_cache_find(thread, &masked, 1, generation);
+        if (!entry)
+            entry = arkime_db_geo_cache_find(thread, &addr, 0, generation);
 
-            if (status == MMDB_SUCCESS) {
-                *asNum = num.uint32;
-                *asStr = (char *)org.utf8_string;
-                *asLen = org.data_size;
-            }
+        if (entry) {
+            geoCache[thread].hits++;
+        } else {
+            geoCache[thread].misses++;
+            const int netmask = arkime_db_geo_mmdb(country, asn, sa, isV4, &local);
+            if (netmask <= (isV4 ? GEO_CACHE_PREFIX4 : GEO_CACHE_PREFIX6))
+                entry = arkime_db_geo_cache_add(thread, &masked, 1, generation);
+            else
+                entry = arkime_db_geo_cache_add(thread, &addr, 0, generation);
+            entry->g     = local.g;
+            entry->asStr = local.asStr;
+            entry->asNum = local.asNum;
+            entry->asLen = local.asLen;
         }
+    } else {
+        arkime_db_geo_mmdb(country, asn, sa, isV4, &local);
+        entry = &local;
+    }
+
+    if (!*g) {
+        *g = entry->g;
+    }
+
+    if (!*asStr && entry->asStr) {
+        *asNum = entry->asNum;
+        *asStr = entry->asStr;
+        *asLen = entry->asLen;
     }
 }
 /******************************************************************************/
@@ -463,12 +809,9 @@ LOCAL ARKIME_LOCK_DEFINE(outputed);
 #define SAVE_STRING_HEAD(HEAD, STR) \
 if (HEAD.s_count > 0) { \
     BSB_EXPORT_cstr(jbsb, "\"" STR "\":["); \
-    while (HEAD.s_count > 0) { \
-	DLL_POP_HEAD(s_, &HEAD, string); \
+    DLL_FOREACH(s_, &HEAD, string) { \
 	arkime_db_js0n_str(&jbsb, (uint8_t *)string->str, string->utf8); \
 	BSB_EXPORT_u08(jbsb, ','); \
-	g_free(string->str); \
-	ARKIME_TYPE_FREE(ArkimeString_t, string); \
     } \
     BSB_EXPORT_rewind(jbsb, 1); \
     BSB_EXPORT_u08(jbsb, ']'); \
@@ -502,244 +845,107 @@ int arkime_db_field_sort(const void *a, const void *b) {
     return strcmp(config.fields[*(short *)a]->dbFieldFull, config.fields[*(short *)b]->dbFieldFull);
 }
 
-void arkime_db_save_session(ArkimeSession_t *session, int final)
+/******************************************************************************/
+LOCAL void arkime_db_ip_str(const struct in6_addr *addr, char *str, int len)
+{
+    if (IN6_IS_ADDR_V4MAPPED(addr)) {
+        uint32_t ip = ARKIME_V6_TO_V4(*addr);
+        snprintf(str, len, "%u.%u.%u.%u", ip & 0xff, (ip >> 8) & 0xff, (ip >> 16) & 0xff, (ip >> 24) & 0xff);
+    } else {
+        inet_ntop(AF_INET6, addr, str, len);
+    }
+}
+/******************************************************************************/
+LOCAL void arkime_db_json_header(BSB *bsb, ArkimeSession_t *UNUSED(session), const ArkimeDbSaveInfo_t *info)
+{
+    if (info->id) {
+        BSB_EXPORT_sprintf(*bsb, "{\"index\":{\"_index\":\"%ssessions3-%s\", \"_id\": \"%s\"}}\n", config.prefix, info->indexSuffix, info->id);
+    } else {
+        BSB_EXPORT_sprintf(*bsb, "{\"index\":{\"_index\":\"%ssessions3-%s\"}}\n", config.prefix, info->indexSuffix);
+    }
+}
+/******************************************************************************/
+LOCAL void arkime_db_json_body(BSB *bsb, ArkimeSession_t *session, const ArkimeDbSaveInfo_t *info)
 {
     uint32_t               i;
-    char                   id[100];
-    uint32_t               id_len;
-    uuid_t                 uuid;
     ArkimeString_t        *hstring;
     ArkimeInt_t           *hint;
     ArkimeStringHashStd_t *shash;
     ArkimeIntHashStd_t    *ihash;
     GHashTable            *ghash;
     GHashTableIter         iter;
-    uint8_t               *startPtr;
-    uint8_t               *dataPtr;
-    uint32_t               jsonSize;
     gpointer               ikey;
     gpointer               ival;
     char                   ipsrc[INET6_ADDRSTRLEN];
     char                   ipdst[INET6_ADDRSTRLEN];
 
-    /* Let the plugins finish */
-    if (pluginsCbs & ARKIME_PLUGIN_SAVE)
-        arkime_plugins_cb_save(session, final);
+    BSB jbsb = *bsb;
 
-    /* Don't save spi data for session */
-    if (session->stopSPI)
-        return;
+    uint32_t timediff = (uint32_t) ((session->lastPacket.tv_sec - session->firstPacket.tv_sec) * 1000 +
+                                    (session->lastPacket.tv_usec - session->firstPacket.tv_usec) / 1000);
 
-    /* No Packets */
-    if (!config.dryRun && !session->filePosArray->len)
-        return;
+    BSB_EXPORT_sprintf(jbsb,
+                       "{\"firstPacket\":%" PRIu64 ","
+                       "\"lastPacket\":%" PRIu64 ","
+                       "\"length\":%u,"
+                       "\"ipProtocol\":%u,",
+                       ((uint64_t)session->firstPacket.tv_sec) * 1000 + ((uint64_t)session->firstPacket.tv_usec) / 1000,
+                       ((uint64_t)session->lastPacket.tv_sec) * 1000 + ((uint64_t)session->lastPacket.tv_usec) / 1000,
+                       timediff,
+                       session->ipProtocol);
 
-    /* Not enough packets */
-    if (session->packets[0] + session->packets[1] < session->minSaving) {
-        return;
+    if (info->indexInDoc) {
+        BSB_EXPORT_sprintf(jbsb, "\"index\":\"%ssessions3-%s\",", config.prefix, info->indexSuffix);
     }
+    if (session->ipProtocol == IPPROTO_TCP) {
+        BSB_EXPORT_sprintf(jbsb,
+                           "\"tcpflags\":{"
+                           "\"syn\":%d,"
+                           "\"syn-ack\":%d,"
+                           "\"ack\":%d,"
+                           "\"psh\":%d,"
+                           "\"fin\":%d,"
+                           "\"rst\":%d,"
+                           "\"urg\":%d,"
+                           "\"srcZero\":%d,"
+                           "\"dstZero\":%d"
+                           "},",
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_SYN],
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_SYN_ACK],
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_ACK],
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_PSH],
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_FIN],
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_RST],
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_URG],
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_SRC_ZERO],
+                           session->tcpFlagCnt[ARKIME_TCPFLAG_DST_ZERO]
+                          );
 
-    if (arkime_writer_index) {
-        arkime_writer_index(session);
-    }
+        if (session->synTime && session->ackTime) {
+            BSB_EXPORT_sprintf(jbsb, "\"initRTT\":%u,", ((session->ackTime - session->synTime) / 2000));
+        }
 
-    /* jsonSize is an estimate of how much space it will take to encode the session */
-    jsonSize = 1300 + session->filePosArray->len * 17 + 11 * session->fileNumArray->len;
-    if (config.enablePacketLen) {
-        jsonSize += 10 * session->fileLenArray->len;
     }
 
-    for (int pos = 0; pos < session->maxFields; pos++) {
-        if (session->fields[pos]) {
-            jsonSize += session->fields[pos]->jsonSize;
+    if (session->firstBytesLen[0] > 0) {
+        BSB_EXPORT_cstr(jbsb, "\"srcPayload8\":\"");
+        for (i = 0; i < session->firstBytesLen[0]; i++) {
+            BSB_EXPORT_ptr(jbsb, arkime_char_to_hexstr[(uint8_t)session->firstBytes[0][i]], 2);
         }
+        BSB_EXPORT_cstr(jbsb, "\",");
     }
 
-    ARKIME_THREAD_INCR(totalSessions);
-    session->segments++;
-
-    const int thread = session->thread;
-
-    /* Rebuild field order, we keep a sort list of fields per thread */
-    if (session->maxFields > dbInfo[thread].sortedFieldsIndexCnt) {
-        for (int f = 0; f < session->maxFields; f++) {
-            dbInfo[thread].sortedFieldsIndex[f] = f;
+    if (session->firstBytesLen[1] > 0) {
+        BSB_EXPORT_cstr(jbsb, "\"dstPayload8\":\"");
+        for (i = 0; i < session->firstBytesLen[1]; i++) {
+            BSB_EXPORT_ptr(jbsb, arkime_char_to_hexstr[(uint8_t)session->firstBytes[1][i]], 2);
         }
-        qsort(&dbInfo[thread].sortedFieldsIndex, session->maxFields, 2, arkime_db_field_sort);
-        dbInfo[thread].sortedFieldsIndexCnt = session->maxFields;
-    }
-
-    /* figure out ES index name per thread, can change every second */
-    if (dbInfo[thread].prefixTime != session->lastPacket.tv_sec) {
-        dbInfo[thread].prefixTime = session->lastPacket.tv_sec;
-
-        struct tm tmp;
-        gmtime_r(&dbInfo[thread].prefixTime, &tmp);
-
-        switch(config.rotate) {
-        case ARKIME_ROTATE_HOURLY:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, tmp.tm_hour);
-            break;
-        case ARKIME_ROTATE_HOURLY2:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 2) * 2);
-            break;
-        case ARKIME_ROTATE_HOURLY3:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 3) * 3);
-            break;
-        case ARKIME_ROTATE_HOURLY4:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 4) * 4);
-            break;
-        case ARKIME_ROTATE_HOURLY6:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 6) * 6);
-            break ;
-        case ARKIME_ROTATE_HOURLY8:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 8) * 8);
-            break;
-        case ARKIME_ROTATE_HOURLY12:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 12) * 12);
-            break;
-        case ARKIME_ROTATE_DAILY:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday);
-            break;
-        case ARKIME_ROTATE_WEEKLY:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02dw%02d", tmp.tm_year % 100, tmp.tm_yday / 7);
-            break;
-        case ARKIME_ROTATE_MONTHLY:
-            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02dm%02d", tmp.tm_year % 100, tmp.tm_mon + 1);
-            break;
-        }
-    }
-
-    if (!config.autoGenerateId || session->rootId == (void *)1L) {
-        id_len = snprintf(id, sizeof(id), "%s-", dbInfo[thread].prefix);
-
-        uuid_generate(uuid);
-        gint state = 0, save = 0;
-        id_len += g_base64_encode_step((guchar *)&myPid, 2, FALSE, id + id_len, &state, &save);
-        id_len += g_base64_encode_step(uuid, sizeof(uuid_t), FALSE, id + id_len, &state, &save);
-        id_len += g_base64_encode_close(FALSE, id + id_len, &state, &save);
-        id[id_len] = 0;
-
-        for (i = 0; i < id_len; i++) {
-            if (id[i] == '+') id[i] = '-';
-            else if (id[i] == '/') id[i] = '_';
-        }
-
-        if (session->rootId == (void * )1L)
-            session->rootId = g_strdup(id);
-    }
-
-    struct timeval currentTime;
-    gettimeofday(&currentTime, NULL);
-
-    ARKIME_LOCK(dbInfo[thread].lock);
-    /* If no room left to add, send the buffer */
-    if (dbInfo[thread].json && ((uint32_t)BSB_REMAINING(dbInfo[thread].bsb) < jsonSize || dbInfo[thread].cnt >= sendMaxDocs)) {
-        if (BSB_LENGTH(dbInfo[thread].bsb) > 0) {
-            sendBulkFunc(dbInfo[thread].json, BSB_LENGTH(dbInfo[thread].bsb));
-        } else {
-            arkime_http_free_buffer(dbInfo[thread].json);
-        }
-        dbInfo[thread].json = 0;
-        dbInfo[thread].cnt = 0;
-        dbInfo[thread].lastSave = currentTime.tv_sec;
-    }
-    dbInfo[thread].cnt++;
-
-    /* Allocate a new buffer using the max of the bulk size or estimated size. */
-    if (!dbInfo[thread].json) {
-        const int size = MAX(config.dbBulkSize, jsonSize);
-        dbInfo[thread].json = arkime_http_get_buffer(size);
-        BSB_INIT(dbInfo[thread].bsb, dbInfo[thread].json, size);
-    }
-
-    uint32_t timediff = (uint32_t) ((session->lastPacket.tv_sec - session->firstPacket.tv_sec) * 1000 +
-                                    (session->lastPacket.tv_usec - session->firstPacket.tv_usec) / 1000);
-
-    BSB jbsb = dbInfo[thread].bsb;
-
-    startPtr = BSB_WORK_PTR(jbsb);
-
-    if (sendBulkHeader) {
-        if (config.autoGenerateId) {
-            BSB_EXPORT_sprintf(jbsb, "{\"index\":{\"_index\":\"%ssessions3-%s\"}}\n", config.prefix, dbInfo[thread].prefix);
-        } else {
-            BSB_EXPORT_sprintf(jbsb, "{\"index\":{\"_index\":\"%ssessions3-%s\", \"_id\": \"%s\"}}\n", config.prefix, dbInfo[thread].prefix, id);
-        }
-    }
-
-    if (session->firstPacket.tv_sec < 10) {
-        session->firstPacket.tv_sec += 10;
-        session->lastPacket.tv_sec += 10;
-    } else if (session->lastPacket.tv_sec < 10) {
-        session->lastPacket.tv_sec += 10;
-    }
-
-    dataPtr = BSB_WORK_PTR(jbsb);
-
-    BSB_EXPORT_sprintf(jbsb,
-                       "{\"firstPacket\":%" PRIu64 ","
-                       "\"lastPacket\":%" PRIu64 ","
-                       "\"length\":%u,"
-                       "\"ipProtocol\":%u,",
-                       ((uint64_t)session->firstPacket.tv_sec) * 1000 + ((uint64_t)session->firstPacket.tv_usec) / 1000,
-                       ((uint64_t)session->lastPacket.tv_sec) * 1000 + ((uint64_t)session->lastPacket.tv_usec) / 1000,
-                       timediff,
-                       session->ipProtocol);
-
-    if (sendIndexInDoc) {
-        BSB_EXPORT_sprintf(jbsb, "\"index\":\"%ssessions3-%s\",", config.prefix, dbInfo[thread].prefix);
-    }
-
-    if (session->ipProtocol == IPPROTO_TCP) {
-        BSB_EXPORT_sprintf(jbsb,
-                           "\"tcpflags\":{"
-                           "\"syn\":%d,"
-                           "\"syn-ack\":%d,"
-                           "\"ack\":%d,"
-                           "\"psh\":%d,"
-                           "\"fin\":%d,"
-                           "\"rst\":%d,"
-                           "\"urg\":%d,"
-                           "\"srcZero\":%d,"
-                           "\"dstZero\":%d"
-                           "},",
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_SYN],
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_SYN_ACK],
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_ACK],
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_PSH],
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_FIN],
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_RST],
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_URG],
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_SRC_ZERO],
-                           session->tcpFlagCnt[ARKIME_TCPFLAG_DST_ZERO]
-                          );
-
-        if (session->synTime && session->ackTime) {
-            BSB_EXPORT_sprintf(jbsb, "\"initRTT\":%u,", ((session->ackTime - session->synTime) / 2000));
-        }
-
-    }
-
-    if (session->firstBytesLen[0] > 0) {
-        BSB_EXPORT_cstr(jbsb, "\"srcPayload8\":\"");
-        for (i = 0; i < session->firstBytesLen[0]; i++) {
-            BSB_EXPORT_ptr(jbsb, arkime_char_to_hexstr[(uint8_t)session->firstBytes[0][i]], 2);
-        }
-        BSB_EXPORT_cstr(jbsb, "\",");
-    }
-
-    if (session->firstBytesLen[1] > 0) {
-        BSB_EXPORT_cstr(jbsb, "\"dstPayload8\":\"");
-        for (i = 0; i < session->firstBytesLen[1]; i++) {
-            BSB_EXPORT_ptr(jbsb, arkime_char_to_hexstr[(uint8_t)session->firstBytes[1][i]], 2);
-        }
-        BSB_EXPORT_cstr(jbsb, "\",");
+        BSB_EXPORT_cstr(jbsb, "\",");
     }
 
     BSB_EXPORT_sprintf(jbsb,
                        "\"@timestamp\":%" PRIu64 ",",
-                       ((uint64_t)currentTime.tv_sec) * 1000 + ((uint64_t)currentTime.tv_usec) / 1000);
+                       info->timestamp);
 
     if (session->ipProtocol) {
         if (IN6_IS_ADDR_V4MAPPED(&session->addr1)) {
@@ -962,8 +1168,8 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
     }
 
     int inGroupNum = 0;
-    for (int sortedFieldsIndexPos = 0; sortedFieldsIndexPos < dbInfo[thread].sortedFieldsIndexCnt; sortedFieldsIndexPos++) {
-        const int pos = dbInfo[thread].sortedFieldsIndex[sortedFieldsIndexPos];
+    for (int sortedFieldsIndexPos = 0; sortedFieldsIndexPos < info->sortedFieldsCnt; sortedFieldsIndexPos++) {
+        const int pos = info->sortedFields[sortedFieldsIndexPos];
         if (pos >= session->maxFields || !session->fields[pos])
             continue;
 
@@ -971,8 +1177,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
         if (flags & (ARKIME_FIELD_FLAG_DISABLED | ARKIME_FIELD_FLAG_NOSAVE))
             continue;
 
-        const int freeField = final || ((flags & ARKIME_FIELD_FLAG_LINKED_SESSIONS) == 0);
-
         if (inGroupNum != config.fields[pos]->dbGroupNum) {
             if (inGroupNum != 0) {
                 BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
@@ -996,9 +1200,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
                                (uint8_t *)session->fields[pos]->str,
                                flags & ARKIME_FIELD_FLAG_FORCE_UTF8);
             BSB_EXPORT_u08(jbsb, ',');
-            if (freeField) {
-                g_free(session->fields[pos]->str);
-            }
             break;
         case ARKIME_FIELD_TYPE_FLOAT:
             BSB_EXPORT_sprintf(jbsb, "\"%s\":%f", config.fields[pos]->dbField, session->fields[pos]->f);
@@ -1015,9 +1216,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
             }
             BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
             BSB_EXPORT_cstr(jbsb, "],");
-            if (freeField) {
-                g_array_free(session->fields[pos]->iarray, TRUE);
-            }
             break;
         case ARKIME_FIELD_TYPE_STR_ARRAY:
             if (flags & ARKIME_FIELD_FLAG_CNT) {
@@ -1032,19 +1230,9 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
             }
             BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
             BSB_EXPORT_cstr(jbsb, "],");
-            if (freeField) {
-                g_ptr_array_free(session->fields[pos]->sarray, TRUE);
-            }
             break;
         case ARKIME_FIELD_TYPE_STR_HASH:
             SAVE_FIELD_STR_HASH(pos, flags);
-            if (freeField) {
-                HASH_FORALL_POP_HEAD2(s_, *shash, hstring) {
-                    g_free(hstring->str);
-                    ARKIME_TYPE_FREE(ArkimeString_t, hstring);
-                }
-                ARKIME_TYPE_FREE(ArkimeStringHashStd_t, shash);
-            }
             break;
         case ARKIME_FIELD_TYPE_STR_GHASH:
             ghash = session->fields[pos]->ghash;
@@ -1057,10 +1245,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
                 arkime_db_js0n_str(&jbsb, ikey, flags & ARKIME_FIELD_FLAG_FORCE_UTF8);
                 BSB_EXPORT_u08(jbsb, ',');
             }
-
-            if (freeField) {
-                g_hash_table_destroy(ghash);
-            }
             BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
             BSB_EXPORT_cstr(jbsb, "],");
             break;
@@ -1074,12 +1258,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
                 BSB_EXPORT_sprintf(jbsb, "%u", hint->i_hash);
                 BSB_EXPORT_u08(jbsb, ',');
             }
-            if (freeField) {
-                HASH_FORALL_POP_HEAD2(i_, *ihash, hint) {
-                    ARKIME_TYPE_FREE(ArkimeInt_t, hint);
-                }
-                ARKIME_TYPE_FREE(ArkimeIntHashStd_t, ihash);
-            }
             BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
             BSB_EXPORT_cstr(jbsb, "],");
             break;
@@ -1094,10 +1272,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
                 BSB_EXPORT_sprintf(jbsb, "%u", (unsigned int)(long)ikey);
                 BSB_EXPORT_u08(jbsb, ',');
             }
-
-            if (freeField) {
-                g_hash_table_destroy(ghash);
-            }
             BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
             BSB_EXPORT_cstr(jbsb, "],");
             break;
@@ -1112,9 +1286,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
             }
             BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
             BSB_EXPORT_cstr(jbsb, "],");
-            if (freeField) {
-                g_array_free(session->fields[pos]->farray, TRUE);
-            }
             break;
         case ARKIME_FIELD_TYPE_FLOAT_GHASH:
             ghash = session->fields[pos]->ghash;
@@ -1127,10 +1298,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
                 BSB_EXPORT_sprintf(jbsb, "%f", POINTER_TO_FLOAT(ikey));
                 BSB_EXPORT_u08(jbsb, ',');
             }
-
-            if (freeField) {
-                g_hash_table_destroy(ghash);
-            }
             BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
             BSB_EXPORT_cstr(jbsb, "],");
             break;
@@ -1173,9 +1340,6 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
             }
             BSB_EXPORT_sprintf(jbsb, "\"%s\":\"%s\",", config.fields[pos]->dbField, ipsrc);
 
-            if (freeField) {
-                g_free(session->fields[pos]->ip);
-            }
         }
         break;
         case ARKIME_FIELD_TYPE_IP_GHASH: {
@@ -1246,98 +1410,993 @@ void arkime_db_save_session(ArkimeSession_t *session, int final)
             }
             BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
             BSB_EXPORT_cstr(jbsb, "],");
+            break;
+        }
+        case ARKIME_FIELD_TYPE_CERTSINFO: {
+            ArkimeCertsInfoHashStd_t *cihash = session->fields[pos]->cihash;
+
+            BSB_EXPORT_sprintf(jbsb, "\"certCnt\":%d,", HASH_COUNT(t_, *cihash));
+            BSB_EXPORT_cstr(jbsb, "\"cert\":[");
+
+            ArkimeCertsInfo_t *certs;
+            ArkimeString_t *string;
+
+            HASH_FORALL2(t_, *cihash, certs) {
+                BSB_EXPORT_u08(jbsb, '{');
+
+                BSB_EXPORT_sprintf(jbsb, "\"hash\":\"%s\",", certs->hash);
+
+                if (certs->publicAlgorithm)
+                    BSB_EXPORT_sprintf(jbsb, "\"publicAlgorithm\":\"%s\",", certs->publicAlgorithm);
+                if (certs->curve)
+                    BSB_EXPORT_sprintf(jbsb, "\"curve\":\"%s\",", certs->curve);
+
+                SAVE_STRING_HEAD(certs->issuer.commonName, "issuerCN");
+                SAVE_STRING_HEAD(certs->issuer.orgName, "issuerON");
+                SAVE_STRING_HEAD(certs->issuer.orgUnit, "issuerOU");
+                SAVE_STRING_HEAD(certs->subject.commonName, "subjectCN");
+                SAVE_STRING_HEAD(certs->subject.orgName, "subjectON");
+                SAVE_STRING_HEAD(certs->subject.orgUnit, "subjectOU");
+
+                if (certs->serialNumber) {
+                    int k;
+                    BSB_EXPORT_cstr(jbsb, "\"serial\":\"");
+                    for (k = 0; k < certs->serialNumberLen; k++) {
+                        BSB_EXPORT_sprintf(jbsb, "%02x", certs->serialNumber[k]);
+                    }
+                    BSB_EXPORT_u08(jbsb, '"');
+                    BSB_EXPORT_u08(jbsb, ',');
+                }
+
+                SAVE_STRING_HEAD_CNT(certs->alt, "altCnt");
+                SAVE_STRING_HEAD(certs->alt, "alt");
+
+                BSB_EXPORT_sprintf(jbsb, "\"notBefore\":%" PRId64 ",", certs->notBefore * 1000);
+                BSB_EXPORT_sprintf(jbsb, "\"notAfter\":%" PRId64 ",", certs->notAfter * 1000);
+                if (certs->notAfter < ((uint64_t)session->firstPacket.tv_sec)) {
+                    BSB_EXPORT_sprintf(jbsb, "\"remainingDays\":%" PRId64 ",", ((int64_t)0));
+                    BSB_EXPORT_sprintf(jbsb, "\"remainingSeconds\":%" PRId64 ",", ((int64_t)0));
+                } else {
+                    BSB_EXPORT_sprintf(jbsb, "\"remainingDays\":%" PRId64 ",", ((int64_t)certs->notAfter - ((uint64_t)session->firstPacket.tv_sec)) / (60 * 60 * 24));
+                    BSB_EXPORT_sprintf(jbsb, "\"remainingSeconds\":%" PRId64 ",", ((int64_t)certs->notAfter - ((uint64_t)session->firstPacket.tv_sec)));
+                }
+                BSB_EXPORT_sprintf(jbsb, "\"validDays\":%" PRId64 ",", ((int64_t)certs->notAfter - (int64_t)certs->notBefore) / (60 * 60 * 24));
+                BSB_EXPORT_sprintf(jbsb, "\"validSeconds\":%" PRId64 ",", ((int64_t)certs->notAfter - (int64_t)certs->notBefore));
+
+                if (certs->extra) {
+                    g_hash_table_iter_init (&iter, certs->extra);
+                    while (g_hash_table_iter_next (&iter, &ikey, &ival)) {
+                        BSB_EXPORT_sprintf(jbsb, "\"%s\":\"%s\",", (char *)ikey, (char *)ival);
+                    }
+                }
+
+                BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
+
+                BSB_EXPORT_u08(jbsb, '}');
+                BSB_EXPORT_u08(jbsb, ',');
+            }
+            BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
+            BSB_EXPORT_cstr(jbsb, "],");
+        }
+        } /* switch */
+    }
+
+    if (inGroupNum) {
+        BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
+        BSB_EXPORT_cstr(jbsb, "},");
+    }
+
+    BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
+    BSB_EXPORT_cstr(jbsb, "}\n");
+
+    *bsb = jbsb;
+}
+/******************************************************************************/
+/* CBOR (RFC 8949) version of the session document for sinks that don't need
+ * JSON. Same names and nesting as the JSON so consumers can map it the same
+ * way, but numbers are binary and nothing needs escaping. Maps and arrays
+ * use the indefinite length forms so, like the JSON, nothing is counted first.
+ */
+#define CBOR_UINT           0
+#define CBOR_NEGINT         1
+#define CBOR_TEXT           3
+
+#define CBOR_MAP_START(b)   BSB_EXPORT_u08(b, 0xbf)
+#define CBOR_ARRAY_START(b) BSB_EXPORT_u08(b, 0x9f)
+#define CBOR_BREAK(b)       BSB_EXPORT_u08(b, 0xff)
+#define CBOR_KEY(b, STR)    arkime_db_cbor_text(&(b), STR, sizeof(STR) - 1)
+
+LOCAL inline void arkime_db_cbor_head(BSB *bsb, int major, uint64_t v)
+{
+    major <<= 5;
+    if (v < 24) {
+        BSB_EXPORT_u08(*bsb, major | v);
+    } else if (v <= 0xff) {
+        BSB_EXPORT_u08(*bsb, major | 24);
+        BSB_EXPORT_u08(*bsb, v);
+    } else if (v <= 0xffff) {
+        BSB_EXPORT_u08(*bsb, major | 25);
+        BSB_EXPORT_u16(*bsb, v);
+    } else if (v <= 0xffffffff) {
+        BSB_EXPORT_u08(*bsb, major | 26);
+        BSB_EXPORT_u32(*bsb, v);
+    } else {
+        BSB_EXPORT_u08(*bsb, major | 27);
+        BSB_EXPORT_u32(*bsb, v >> 32);
+        BSB_EXPORT_u32(*bsb, v);
+    }
+}
+/******************************************************************************/
+LOCAL inline void arkime_db_cbor_uint(BSB *bsb, uint64_t v)
+{
+    arkime_db_cbor_head(bsb, CBOR_UINT, v);
+}
+/******************************************************************************/
+LOCAL inline void arkime_db_cbor_int(BSB *bsb, int64_t v)
+{
+    if (v < 0)
+        arkime_db_cbor_head(bsb, CBOR_NEGINT, (uint64_t)(-(v + 1)));
+    else
+        arkime_db_cbor_head(bsb, CBOR_UINT, v);
+}
+/******************************************************************************/
+LOCAL inline void arkime_db_cbor_float(BSB *bsb, float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    BSB_EXPORT_u08(*bsb, 0xfa);
+    BSB_EXPORT_u32(*bsb, bits);
+}
+/******************************************************************************/
+LOCAL inline void arkime_db_cbor_text(BSB *bsb, const char *str, int len)
+{
+    arkime_db_cbor_head(bsb, CBOR_TEXT, len);
+    BSB_EXPORT_ptr(*bsb, str, len);
+}
+/******************************************************************************/
+// Text made of two parts, used for the generated key names like fooCnt and fooGEO
+LOCAL void arkime_db_cbor_text2(BSB *bsb, const char *str, int len, const char *str2)
+{
+    const int len2 = strlen(str2);
+    arkime_db_cbor_head(bsb, CBOR_TEXT, len + len2);
+    BSB_EXPORT_ptr(*bsb, str, len);
+    BSB_EXPORT_ptr(*bsb, str2, len2);
+}
+/******************************************************************************/
+// Same rules as arkime_db_js0n_str, strings not known to be utf8 are treated as latin1
+LOCAL void arkime_db_cbor_str(BSB *bsb, const uint8_t *in, gboolean utf8)
+{
+    const int len = strlen((char *)in);
+    int high = 0;
+
+    if (!utf8) {
+        for (int i = 0; i < len; i++)
+            high += in[i] >> 7;
+    }
+
+    arkime_db_cbor_head(bsb, CBOR_TEXT, len + high);
+    if (!high) {
+        BSB_EXPORT_ptr(*bsb, in, len);
+        return;
+    }
+
+    for (int i = 0; i < len; i++) {
+        if (in[i] & 0x80) {
+            BSB_EXPORT_u08(*bsb, (0xc0 | (in[i] >> 6)));
+            BSB_EXPORT_u08(*bsb, (0x80 | (in[i] & 0x3f)));
+        } else {
+            BSB_EXPORT_u08(*bsb, in[i]);
+        }
+    }
+}
+/******************************************************************************/
+LOCAL void arkime_db_cbor_hex(BSB *bsb, const uint8_t *data, int len)
+{
+    arkime_db_cbor_head(bsb, CBOR_TEXT, len * 2);
+    for (int i = 0; i < len; i++) {
+        BSB_EXPORT_ptr(*bsb, arkime_char_to_hexstr[data[i]], 2);
+    }
+}
+/******************************************************************************/
+LOCAL void arkime_db_cbor_asn(BSB *bsb, uint32_t asNum, const char *asStr, int asLen)
+{
+    const int numLen = snprintf(NULL, 0, "AS%u ", asNum);
+    arkime_db_cbor_head(bsb, CBOR_TEXT, numLen + asLen);
+    BSB_EXPORT_sprintf(*bsb, "AS%u ", asNum);
+    BSB_EXPORT_ptr(*bsb, asStr, asLen);
+}
+/******************************************************************************/
+LOCAL void arkime_db_cbor_str_hash(BSB *bsb, ArkimeSession_t *session, int pos, int flags)
+{
+    ArkimeStringHashStd_t *shash = session->fields[pos]->shash;
+    ArkimeString_t        *hstring;
+    const ArkimeFieldInfo_t *field = config.fields[pos];
+
+    if (flags & ARKIME_FIELD_FLAG_CNT) {
+        arkime_db_cbor_text2(bsb, field->dbField, field->dbFieldLen, "Cnt");
+        arkime_db_cbor_uint(bsb, HASH_COUNT(s_, *shash));
+    }
+    if (flags & ARKIME_FIELD_FLAG_ECS_CNT) {
+        arkime_db_cbor_text2(bsb, field->dbField, field->dbFieldLen, "-cnt");
+        arkime_db_cbor_uint(bsb, HASH_COUNT(s_, *shash));
+    }
+    arkime_db_cbor_text(bsb, field->dbField, field->dbFieldLen);
+    CBOR_ARRAY_START(*bsb);
+    HASH_FORALL2(s_, *shash, hstring) {
+        arkime_db_cbor_str(bsb, (uint8_t *)hstring->str, hstring->utf8 || flags & ARKIME_FIELD_FLAG_FORCE_UTF8);
+    }
+    CBOR_BREAK(*bsb);
+}
+/******************************************************************************/
+// The source or destination map, returns the rir for the address
+LOCAL char *arkime_db_cbor_endpoint(BSB *bsb, ArkimeSession_t *session, int which)
+{
+    char *g = NULL, *asStr = NULL, *rir = NULL;
+    uint32_t asNum;
+    int asLen;
+
+    struct in6_addr *addr = which ? &session->addr2 : &session->addr1;
+    const int macField = which ? mac2Field : mac1Field;
+
+    CBOR_MAP_START(*bsb);
+    if (session->ipProtocol) {
+        char ip[INET6_ADDRSTRLEN];
+        arkime_db_ip_str(addr, ip, sizeof(ip));
+        arkime_db_geo_lookup6(session, *addr, &g, &asNum, &asStr, &asLen, &rir);
+
+        CBOR_KEY(*bsb, "ip");
+        arkime_db_cbor_text(bsb, ip, strlen(ip));
+        CBOR_KEY(*bsb, "port");
+        arkime_db_cbor_uint(bsb, which ? session->port2 : session->port1);
+    }
+    CBOR_KEY(*bsb, "bytes");
+    arkime_db_cbor_uint(bsb, session->bytes[which]);
+    CBOR_KEY(*bsb, "packets");
+    arkime_db_cbor_uint(bsb, session->packets[which]);
+
+    if (g) {
+        CBOR_KEY(*bsb, "geo");
+        CBOR_MAP_START(*bsb);
+        CBOR_KEY(*bsb, "country_iso_code");
+        arkime_db_cbor_text(bsb, g, strnlen(g, 2));
+        CBOR_BREAK(*bsb);
+    }
+
+    if (asStr) {
+        CBOR_KEY(*bsb, "as");
+        CBOR_MAP_START(*bsb);
+        CBOR_KEY(*bsb, "number");
+        arkime_db_cbor_uint(bsb, asNum);
+        CBOR_KEY(*bsb, "full");
+        arkime_db_cbor_asn(bsb, asNum, asStr, asLen);
+        CBOR_KEY(*bsb, "organization");
+        CBOR_MAP_START(*bsb);
+        CBOR_KEY(*bsb, "name");
+        arkime_db_cbor_text(bsb, asStr, asLen);
+        CBOR_BREAK(*bsb);
+        CBOR_BREAK(*bsb);
+    }
+
+    if (session->fields[macField]) {
+        arkime_db_cbor_str_hash(bsb, session, macField, ARKIME_FIELD_FLAG_ECS_CNT);
+    }
+    CBOR_BREAK(*bsb);
+
+    return rir;
+}
+/******************************************************************************/
+#define CBOR_STRING_HEAD(HEAD, STR) \
+if (HEAD.s_count > 0) { \
+    CBOR_KEY(cbsb, STR); \
+    CBOR_ARRAY_START(cbsb); \
+    DLL_FOREACH(s_, &HEAD, string) { \
+        arkime_db_cbor_str(&cbsb, (uint8_t *)string->str, string->utf8); \
+    } \
+    CBOR_BREAK(cbsb); \
+}
+
+LOCAL void arkime_db_cbor_body(BSB *bsb, ArkimeSession_t *session, const ArkimeDbSaveInfo_t *info)
+{
+    uint32_t               i;
+    ArkimeInt_t           *hint;
+    ArkimeIntHashStd_t    *ihash;
+    GHashTable            *ghash;
+    GHashTableIter         iter;
+    gpointer               ikey;
+    gpointer               ival;
+    char                   ipstr[INET6_ADDRSTRLEN];
+
+    BSB cbsb = *bsb;
+
+    CBOR_MAP_START(cbsb);
+
+    CBOR_KEY(cbsb, "firstPacket");
+    arkime_db_cbor_uint(&cbsb, ((uint64_t)session->firstPacket.tv_sec) * 1000 + ((uint64_t)session->firstPacket.tv_usec) / 1000);
+    CBOR_KEY(cbsb, "lastPacket");
+    arkime_db_cbor_uint(&cbsb, ((uint64_t)session->lastPacket.tv_sec) * 1000 + ((uint64_t)session->lastPacket.tv_usec) / 1000);
+    CBOR_KEY(cbsb, "length");
+    arkime_db_cbor_uint(&cbsb, (uint32_t) ((session->lastPacket.tv_sec - session->firstPacket.tv_sec) * 1000 +
+                                          (session->lastPacket.tv_usec - session->firstPacket.tv_usec) / 1000));
+    CBOR_KEY(cbsb, "ipProtocol");
+    arkime_db_cbor_uint(&cbsb, session->ipProtocol);
+
+    if (info->indexInDoc) {
+        char index[200];
+        CBOR_KEY(cbsb, "index");
+        arkime_db_cbor_text(&cbsb, index, snprintf(index, sizeof(index), "%ssessions3-%s", config.prefix, info->indexSuffix));
+    }
+
+    if (session->ipProtocol == IPPROTO_TCP) {
+        CBOR_KEY(cbsb, "tcpflags");
+        CBOR_MAP_START(cbsb);
+        CBOR_KEY(cbsb, "syn");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_SYN]);
+        CBOR_KEY(cbsb, "syn-ack");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_SYN_ACK]);
+        CBOR_KEY(cbsb, "ack");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_ACK]);
+        CBOR_KEY(cbsb, "psh");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_PSH]);
+        CBOR_KEY(cbsb, "fin");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_FIN]);
+        CBOR_KEY(cbsb, "rst");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_RST]);
+        CBOR_KEY(cbsb, "urg");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_URG]);
+        CBOR_KEY(cbsb, "srcZero");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_SRC_ZERO]);
+        CBOR_KEY(cbsb, "dstZero");
+        arkime_db_cbor_uint(&cbsb, session->tcpFlagCnt[ARKIME_TCPFLAG_DST_ZERO]);
+        CBOR_BREAK(cbsb);
+
+        if (session->synTime && session->ackTime) {
+            CBOR_KEY(cbsb, "initRTT");
+            arkime_db_cbor_uint(&cbsb, (session->ackTime - session->synTime) / 2000);
+        }
+    }
+
+    if (session->firstBytesLen[0] > 0) {
+        CBOR_KEY(cbsb, "srcPayload8");
+        arkime_db_cbor_hex(&cbsb, (uint8_t *)session->firstBytes[0], session->firstBytesLen[0]);
+    }
+
+    if (session->firstBytesLen[1] > 0) {
+        CBOR_KEY(cbsb, "dstPayload8");
+        arkime_db_cbor_hex(&cbsb, (uint8_t *)session->firstBytes[1], session->firstBytesLen[1]);
+    }
+
+    CBOR_KEY(cbsb, "@timestamp");
+    arkime_db_cbor_uint(&cbsb, info->timestamp);
+
+    CBOR_KEY(cbsb, "source");
+    char *rir1 = arkime_db_cbor_endpoint(&cbsb, session, 0);
+    CBOR_KEY(cbsb, "destination");
+    char *rir2 = arkime_db_cbor_endpoint(&cbsb, session, 1);
+
+    if (rir1) {
+        CBOR_KEY(cbsb, "srcRIR");
+        arkime_db_cbor_text(&cbsb, rir1, strlen(rir1));
+    }
+
+    if (rir2) {
+        CBOR_KEY(cbsb, "dstRIR");
+        arkime_db_cbor_text(&cbsb, rir2, strlen(rir2));
+    }
+
+    CBOR_KEY(cbsb, "network");
+    CBOR_MAP_START(cbsb);
+    CBOR_KEY(cbsb, "packets");
+    arkime_db_cbor_uint(&cbsb, session->packets[0] + session->packets[1]);
+    CBOR_KEY(cbsb, "bytes");
+    arkime_db_cbor_uint(&cbsb, session->bytes[0] + session->bytes[1]);
+
+    // Currently don't do communityId for ICMP because it requires magic
+    if (session->ses != SESSION_ICMP && session->ses != SESSION_OTHER) {
+        char *communityId = arkime_db_community_id(session);
+        CBOR_KEY(cbsb, "community_id");
+        arkime_db_cbor_text2(&cbsb, "1:", 2, communityId);
+        g_free(communityId);
+    }
+
+    if (session->fields[vlanField]) {
+        ghash = session->fields[vlanField]->ghash;
+        CBOR_KEY(cbsb, "vlan");
+        CBOR_MAP_START(cbsb);
+        CBOR_KEY(cbsb, "id-cnt");
+        arkime_db_cbor_uint(&cbsb, g_hash_table_size(ghash));
+        CBOR_KEY(cbsb, "id");
+        CBOR_ARRAY_START(cbsb);
+        g_hash_table_iter_init (&iter, ghash);
+        while (g_hash_table_iter_next (&iter, &ikey, NULL)) {
+            arkime_db_cbor_uint(&cbsb, (unsigned int)(long)ikey);
+        }
+        CBOR_BREAK(cbsb);
+        CBOR_BREAK(cbsb);
+    }
+    CBOR_BREAK(cbsb); /* network */
+
+    CBOR_KEY(cbsb, "client");
+    CBOR_MAP_START(cbsb);
+    CBOR_KEY(cbsb, "bytes");
+    arkime_db_cbor_uint(&cbsb, session->databytes[0]);
+    CBOR_BREAK(cbsb);
+
+    CBOR_KEY(cbsb, "server");
+    CBOR_MAP_START(cbsb);
+    CBOR_KEY(cbsb, "bytes");
+    arkime_db_cbor_uint(&cbsb, session->databytes[1]);
+    CBOR_BREAK(cbsb);
+
+    CBOR_KEY(cbsb, "totDataBytes");
+    arkime_db_cbor_uint(&cbsb, session->databytes[0] + session->databytes[1]);
+    CBOR_KEY(cbsb, "segmentCnt");
+    arkime_db_cbor_uint(&cbsb, session->segments);
+    CBOR_KEY(cbsb, "node");
+    arkime_db_cbor_text(&cbsb, config.nodeName, strlen(config.nodeName));
+
+    if (session->rootId) {
+        CBOR_KEY(cbsb, "rootId");
+        arkime_db_cbor_text(&cbsb, session->rootId, strlen(session->rootId));
+    }
+
+    // Same values as the JSON, including the gap encoding
+    CBOR_KEY(cbsb, "packetPos");
+    CBOR_ARRAY_START(cbsb);
+    if (config.gapPacketPos) {
+        int64_t last = 0;
+        int64_t lastgap = 0;
+        for(i = 0; i < session->filePosArray->len; i++) {
+            int64_t fpos = (int64_t)g_array_index(session->filePosArray, int64_t, i);
+            if (fpos < 0) {
+                last = 0;
+                lastgap = 0;
+                arkime_db_cbor_int(&cbsb, fpos);
+            } else {
+                if (fpos - last == lastgap) {
+                    arkime_db_cbor_uint(&cbsb, 0);
+                } else {
+                    lastgap = fpos - last;
+                    arkime_db_cbor_int(&cbsb, lastgap);
+                }
+                last = fpos;
+            }
+        }
+    } else {
+        for(i = 0; i < session->filePosArray->len; i++) {
+            arkime_db_cbor_int(&cbsb, (int64_t)g_array_index(session->filePosArray, int64_t, i));
+        }
+    }
+    CBOR_BREAK(cbsb);
+
+    if (config.enablePacketLen) {
+        CBOR_KEY(cbsb, "packetLen");
+        CBOR_ARRAY_START(cbsb);
+        for(i = 0; i < session->fileLenArray->len; i++) {
+            arkime_db_cbor_uint(&cbsb, (uint16_t)g_array_index(session->fileLenArray, uint16_t, i));
+        }
+        CBOR_BREAK(cbsb);
+    }
+
+    CBOR_KEY(cbsb, "fileId");
+    CBOR_ARRAY_START(cbsb);
+    for (i = 0; i < session->fileNumArray->len; i++) {
+        arkime_db_cbor_uint(&cbsb, (uint32_t)g_array_index(session->fileNumArray, uint32_t, i));
+    }
+    CBOR_BREAK(cbsb);
+
+    if (ecsEventProvider || ecsEventDataset) {
+        CBOR_KEY(cbsb, "event");
+        CBOR_MAP_START(cbsb);
+        if (ecsEventProvider) {
+            CBOR_KEY(cbsb, "provider");
+            arkime_db_cbor_text(&cbsb, ecsEventProvider, strlen(ecsEventProvider));
+        }
+        if (ecsEventDataset) {
+            CBOR_KEY(cbsb, "dataset");
+            arkime_db_cbor_text(&cbsb, ecsEventDataset, strlen(ecsEventDataset));
+        }
+        CBOR_BREAK(cbsb);
+    }
+
+    int inGroupNum = 0;
+    for (int sortedFieldsIndexPos = 0; sortedFieldsIndexPos < info->sortedFieldsCnt; sortedFieldsIndexPos++) {
+        const int pos = info->sortedFields[sortedFieldsIndexPos];
+        if (pos >= session->maxFields || !session->fields[pos])
+            continue;
+
+        const ArkimeFieldInfo_t *field = config.fields[pos];
+        const int flags = field->flags;
+        if (flags & (ARKIME_FIELD_FLAG_DISABLED | ARKIME_FIELD_FLAG_NOSAVE))
+            continue;
 
-            if (freeField) {
-                g_hash_table_destroy(ghash);
+        if (inGroupNum != field->dbGroupNum) {
+            if (inGroupNum != 0) {
+                CBOR_BREAK(cbsb);
+            }
+            inGroupNum = field->dbGroupNum;
+
+            if (inGroupNum) {
+                arkime_db_cbor_text(&cbsb, field->dbGroup, field->dbGroupLen);
+                CBOR_MAP_START(cbsb);
+            }
+        }
+
+        switch(field->type) {
+        case ARKIME_FIELD_TYPE_INT:
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            arkime_db_cbor_int(&cbsb, session->fields[pos]->i);
+            break;
+        case ARKIME_FIELD_TYPE_STR:
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            arkime_db_cbor_str(&cbsb, (uint8_t *)session->fields[pos]->str, flags & ARKIME_FIELD_FLAG_FORCE_UTF8);
+            break;
+        case ARKIME_FIELD_TYPE_FLOAT:
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            arkime_db_cbor_float(&cbsb, session->fields[pos]->f);
+            break;
+        case ARKIME_FIELD_TYPE_INT_ARRAY:
+            if (flags & ARKIME_FIELD_FLAG_CNT) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen, "Cnt");
+                arkime_db_cbor_uint(&cbsb, session->fields[pos]->iarray->len);
+            }
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            CBOR_ARRAY_START(cbsb);
+            for(i = 0; i < session->fields[pos]->iarray->len; i++) {
+                arkime_db_cbor_uint(&cbsb, g_array_index(session->fields[pos]->iarray, uint32_t, i));
+            }
+            CBOR_BREAK(cbsb);
+            break;
+        case ARKIME_FIELD_TYPE_STR_ARRAY:
+            if (flags & ARKIME_FIELD_FLAG_CNT) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen, "Cnt");
+                arkime_db_cbor_uint(&cbsb, session->fields[pos]->sarray->len);
+            }
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            CBOR_ARRAY_START(cbsb);
+            for(i = 0; i < session->fields[pos]->sarray->len; i++) {
+                arkime_db_cbor_str(&cbsb, g_ptr_array_index(session->fields[pos]->sarray, i), flags & ARKIME_FIELD_FLAG_FORCE_UTF8);
+            }
+            CBOR_BREAK(cbsb);
+            break;
+        case ARKIME_FIELD_TYPE_STR_HASH:
+            arkime_db_cbor_str_hash(&cbsb, session, pos, flags);
+            break;
+        case ARKIME_FIELD_TYPE_INT_HASH:
+            ihash = session->fields[pos]->ihash;
+            if (flags & ARKIME_FIELD_FLAG_CNT) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen, "Cnt");
+                arkime_db_cbor_uint(&cbsb, HASH_COUNT(i_, *ihash));
+            }
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            CBOR_ARRAY_START(cbsb);
+            HASH_FORALL2(i_, *ihash, hint) {
+                arkime_db_cbor_uint(&cbsb, hint->i_hash);
+            }
+            CBOR_BREAK(cbsb);
+            break;
+        case ARKIME_FIELD_TYPE_FLOAT_ARRAY:
+            if (flags & ARKIME_FIELD_FLAG_CNT) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen, "Cnt");
+                arkime_db_cbor_uint(&cbsb, session->fields[pos]->farray->len);
+            }
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            CBOR_ARRAY_START(cbsb);
+            for(i = 0; i < session->fields[pos]->farray->len; i++) {
+                arkime_db_cbor_float(&cbsb, g_array_index(session->fields[pos]->farray, float, i));
+            }
+            CBOR_BREAK(cbsb);
+            break;
+        case ARKIME_FIELD_TYPE_STR_GHASH:
+        case ARKIME_FIELD_TYPE_INT_GHASH:
+        case ARKIME_FIELD_TYPE_FLOAT_GHASH:
+            ghash = session->fields[pos]->ghash;
+            if (flags & ARKIME_FIELD_FLAG_CNT) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen, "Cnt");
+                arkime_db_cbor_uint(&cbsb, g_hash_table_size(ghash));
+            }
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            CBOR_ARRAY_START(cbsb);
+            g_hash_table_iter_init (&iter, ghash);
+            while (g_hash_table_iter_next (&iter, &ikey, NULL)) {
+                if (field->type == ARKIME_FIELD_TYPE_STR_GHASH)
+                    arkime_db_cbor_str(&cbsb, ikey, flags & ARKIME_FIELD_FLAG_FORCE_UTF8);
+                else if (field->type == ARKIME_FIELD_TYPE_INT_GHASH)
+                    arkime_db_cbor_uint(&cbsb, (unsigned int)(long)ikey);
+                else
+                    arkime_db_cbor_float(&cbsb, POINTER_TO_FLOAT(ikey));
+            }
+            CBOR_BREAK(cbsb);
+            break;
+        case ARKIME_FIELD_TYPE_IP: {
+            uint32_t              asNum;
+            char                 *asStr;
+            int                   asLen;
+            char                 *g;
+            char                 *rir;
+
+            struct in6_addr *ip = session->fields[pos]->ip;
+            arkime_db_geo_lookup6(session, *ip, &g, &asNum, &asStr, &asLen, &rir);
+            if (g) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen - 2, "GEO");
+                arkime_db_cbor_text(&cbsb, g, strnlen(g, 2));
+            }
+
+            if (asStr) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen - 2, "ASN");
+                arkime_db_cbor_asn(&cbsb, asNum, asStr, asLen);
+            }
+
+            if (rir) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen - 2, "RIR");
+                arkime_db_cbor_text(&cbsb, rir, strlen(rir));
+            }
+
+            arkime_db_ip_str(ip, ipstr, sizeof(ipstr));
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            arkime_db_cbor_text(&cbsb, ipstr, strlen(ipstr));
+        }
+        break;
+        case ARKIME_FIELD_TYPE_IP_GHASH: {
+            ghash = session->fields[pos]->ghash;
+            if (flags & ARKIME_FIELD_FLAG_CNT) {
+                arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen, "Cnt");
+                arkime_db_cbor_uint(&cbsb, g_hash_table_size(ghash));
+            }
+
+            uint32_t              asNum[MAX_IPS];
+            char                 *asStr[MAX_IPS];
+            int                   asLen[MAX_IPS];
+            char                 *g[MAX_IPS];
+            char                 *rir[MAX_IPS];
+            uint32_t              cnt = 0;
+
+            arkime_db_cbor_text(&cbsb, field->dbField, field->dbFieldLen);
+            CBOR_ARRAY_START(cbsb);
+            g_hash_table_iter_init (&iter, ghash);
+            while (cnt < MAX_IPS && g_hash_table_iter_next (&iter, &ikey, NULL)) {
+                arkime_db_geo_lookup6(session, *(struct in6_addr *)ikey, &g[cnt], &asNum[cnt], &asStr[cnt], &asLen[cnt], &rir[cnt]);
+                cnt++;
+
+                arkime_db_ip_str(ikey, ipstr, sizeof(ipstr));
+                arkime_db_cbor_text(&cbsb, ipstr, strlen(ipstr));
+            }
+            CBOR_BREAK(cbsb);
+
+            arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen - 2, "GEO");
+            CBOR_ARRAY_START(cbsb);
+            for (i = 0; i < cnt; i++) {
+                if (g[i])
+                    arkime_db_cbor_text(&cbsb, g[i], strnlen(g[i], 2));
+                else
+                    CBOR_KEY(cbsb, "---");
+            }
+            CBOR_BREAK(cbsb);
+
+            arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen - 2, "ASN");
+            CBOR_ARRAY_START(cbsb);
+            for (i = 0; i < cnt; i++) {
+                if (asStr[i])
+                    arkime_db_cbor_asn(&cbsb, asNum[i], asStr[i], asLen[i]);
+                else
+                    CBOR_KEY(cbsb, "---");
+            }
+            CBOR_BREAK(cbsb);
+
+            arkime_db_cbor_text2(&cbsb, field->dbField, field->dbFieldLen - 2, "RIR");
+            CBOR_ARRAY_START(cbsb);
+            for (i = 0; i < cnt; i++) {
+                if (rir[i])
+                    arkime_db_cbor_text(&cbsb, rir[i], strlen(rir[i]));
+                else
+                    CBOR_KEY(cbsb, "");
             }
-
+            CBOR_BREAK(cbsb);
             break;
         }
         case ARKIME_FIELD_TYPE_CERTSINFO: {
             ArkimeCertsInfoHashStd_t *cihash = session->fields[pos]->cihash;
+            ArkimeCertsInfo_t        *certs;
+            ArkimeString_t           *string;
 
-            BSB_EXPORT_sprintf(jbsb, "\"certCnt\":%d,", HASH_COUNT(t_, *cihash));
-            BSB_EXPORT_cstr(jbsb, "\"cert\":[");
-
-            ArkimeCertsInfo_t *certs;
-            ArkimeString_t *string;
+            CBOR_KEY(cbsb, "certCnt");
+            arkime_db_cbor_uint(&cbsb, HASH_COUNT(t_, *cihash));
+            CBOR_KEY(cbsb, "cert");
+            CBOR_ARRAY_START(cbsb);
 
-            HASH_FORALL_POP_HEAD2(t_, *cihash, certs) {
-                BSB_EXPORT_u08(jbsb, '{');
+            HASH_FORALL2(t_, *cihash, certs) {
+                CBOR_MAP_START(cbsb);
 
-                BSB_EXPORT_sprintf(jbsb, "\"hash\":\"%s\",", certs->hash);
+                CBOR_KEY(cbsb, "hash");
+                arkime_db_cbor_text(&cbsb, (char *)certs->hash, strlen((char *)certs->hash));
 
-                if (certs->publicAlgorithm)
-                    BSB_EXPORT_sprintf(jbsb, "\"publicAlgorithm\":\"%s\",", certs->publicAlgorithm);
-                if (certs->curve)
-                    BSB_EXPORT_sprintf(jbsb, "\"curve\":\"%s\",", certs->curve);
+                if (certs->publicAlgorithm) {
+                    CBOR_KEY(cbsb, "publicAlgorithm");
+                    arkime_db_cbor_text(&cbsb, certs->publicAlgorithm, strlen(certs->publicAlgorithm));
+                }
+                if (certs->curve) {
+                    CBOR_KEY(cbsb, "curve");
+                    arkime_db_cbor_text(&cbsb, certs->curve, strlen(certs->curve));
+                }
 
-                SAVE_STRING_HEAD(certs->issuer.commonName, "issuerCN");
-                SAVE_STRING_HEAD(certs->issuer.orgName, "issuerON");
-                SAVE_STRING_HEAD(certs->issuer.orgUnit, "issuerOU");
-                SAVE_STRING_HEAD(certs->subject.commonName, "subjectCN");
-                SAVE_STRING_HEAD(certs->subject.orgName, "subjectON");
-                SAVE_STRING_HEAD(certs->subject.orgUnit, "subjectOU");
+                CBOR_STRING_HEAD(certs->issuer.commonName, "issuerCN");
+                CBOR_STRING_HEAD(certs->issuer.orgName, "issuerON");
+                CBOR_STRING_HEAD(certs->issuer.orgUnit, "issuerOU");
+                CBOR_STRING_HEAD(certs->subject.commonName, "subjectCN");
+                CBOR_STRING_HEAD(certs->subject.orgName, "subjectON");
+                CBOR_STRING_HEAD(certs->subject.orgUnit, "subjectOU");
 
                 if (certs->serialNumber) {
-                    int k;
-                    BSB_EXPORT_cstr(jbsb, "\"serial\":\"");
-                    for (k = 0; k < certs->serialNumberLen; k++) {
-                        BSB_EXPORT_sprintf(jbsb, "%02x", certs->serialNumber[k]);
-                    }
-                    BSB_EXPORT_u08(jbsb, '"');
-                    BSB_EXPORT_u08(jbsb, ',');
+                    CBOR_KEY(cbsb, "serial");
+                    arkime_db_cbor_hex(&cbsb, (uint8_t *)certs->serialNumber, certs->serialNumberLen);
                 }
 
-                SAVE_STRING_HEAD_CNT(certs->alt, "altCnt");
-                SAVE_STRING_HEAD(certs->alt, "alt");
-
-                BSB_EXPORT_sprintf(jbsb, "\"notBefore\":%" PRId64 ",", certs->notBefore * 1000);
-                BSB_EXPORT_sprintf(jbsb, "\"notAfter\":%" PRId64 ",", certs->notAfter * 1000);
-                if (certs->notAfter < ((uint64_t)session->firstPacket.tv_sec)) {
-                    BSB_EXPORT_sprintf(jbsb, "\"remainingDays\":%" PRId64 ",", ((int64_t)0));
-                    BSB_EXPORT_sprintf(jbsb, "\"remainingSeconds\":%" PRId64 ",", ((int64_t)0));
-                } else {
-                    BSB_EXPORT_sprintf(jbsb, "\"remainingDays\":%" PRId64 ",", ((int64_t)certs->notAfter - ((uint64_t)session->firstPacket.tv_sec)) / (60 * 60 * 24));
-                    BSB_EXPORT_sprintf(jbsb, "\"remainingSeconds\":%" PRId64 ",", ((int64_t)certs->notAfter - ((uint64_t)session->firstPacket.tv_sec)));
+                if (certs->alt.s_count > 0) {
+                    CBOR_KEY(cbsb, "altCnt");
+                    arkime_db_cbor_uint(&cbsb, certs->alt.s_count);
                 }
-                BSB_EXPORT_sprintf(jbsb, "\"validDays\":%" PRId64 ",", ((int64_t)certs->notAfter - (int64_t)certs->notBefore) / (60 * 60 * 24));
-                BSB_EXPORT_sprintf(jbsb, "\"validSeconds\":%" PRId64 ",", ((int64_t)certs->notAfter - (int64_t)certs->notBefore));
+                CBOR_STRING_HEAD(certs->alt, "alt");
+
+                const int64_t firstPacket = session->firstPacket.tv_sec;
+                const int64_t remaining = ((int64_t)certs->notAfter < firstPacket) ? 0 : (int64_t)certs->notAfter - firstPacket;
+                const int64_t valid = (int64_t)certs->notAfter - (int64_t)certs->notBefore;
+
+                CBOR_KEY(cbsb, "notBefore");
+                arkime_db_cbor_int(&cbsb, certs->notBefore * 1000);
+                CBOR_KEY(cbsb, "notAfter");
+                arkime_db_cbor_int(&cbsb, certs->notAfter * 1000);
+                CBOR_KEY(cbsb, "remainingDays");
+                arkime_db_cbor_int(&cbsb, remaining / (60 * 60 * 24));
+                CBOR_KEY(cbsb, "remainingSeconds");
+                arkime_db_cbor_int(&cbsb, remaining);
+                CBOR_KEY(cbsb, "validDays");
+                arkime_db_cbor_int(&cbsb, valid / (60 * 60 * 24));
+                CBOR_KEY(cbsb, "validSeconds");
+                arkime_db_cbor_int(&cbsb, valid);
 
                 if (certs->extra) {
                     g_hash_table_iter_init (&iter, certs->extra);
                     while (g_hash_table_iter_next (&iter, &ikey, &ival)) {
-                        BSB_EXPORT_sprintf(jbsb, "\"%s\":\"%s\",", (char *)ikey, (char *)ival);
+                        arkime_db_cbor_text(&cbsb, ikey, strlen(ikey));
+                        arkime_db_cbor_text(&cbsb, ival, strlen(ival));
                     }
                 }
 
-                BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
+                CBOR_BREAK(cbsb);
+            }
+            CBOR_BREAK(cbsb);
+        }
+        } /* switch */
+    }
+
+    if (inGroupNum) {
+        CBOR_BREAK(cbsb);
+    }
 
-                arkime_field_certsinfo_free(certs);
-                i++;
+    CBOR_BREAK(cbsb);
 
-                BSB_EXPORT_u08(jbsb, '}');
-                BSB_EXPORT_u08(jbsb, ',');
-            }
-            ARKIME_TYPE_FREE(ArkimeCertsInfoHashStd_t, cihash);
+    *bsb = cbsb;
+}
+/******************************************************************************/
+/* Free what the save consumed, fields of linked sessions are kept until the
+ * final save. Cert info is always consumed.
+ */
+LOCAL void arkime_db_free_saved_fields(ArkimeSession_t *session, int final)
+{
+    for (int pos = 0; pos < session->maxFields; pos++) {
+        if (!session->fields[pos])
+            continue;
 
-            BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
-            BSB_EXPORT_cstr(jbsb, "],");
+        const int flags = config.fields[pos]->flags;
+        if (flags & (ARKIME_FIELD_FLAG_DISABLED | ARKIME_FIELD_FLAG_NOSAVE))
+            continue;
+
+        if (!final && (flags & ARKIME_FIELD_FLAG_LINKED_SESSIONS) && config.fields[pos]->type != ARKIME_FIELD_TYPE_CERTSINFO)
+            continue;
+
+        arkime_field_free_pos(session, pos);
+    }
+}
+/******************************************************************************/
+#define ARKIME_DB_MAX_SERIALIZERS 8
+
+LOCAL const ArkimeDbSerializer_t  jsonSerializer = {"json", arkime_db_json_header, arkime_db_json_body};
+LOCAL const ArkimeDbSerializer_t  cborSerializer = {"cbor", NULL, arkime_db_cbor_body};
+
+LOCAL const ArkimeDbSerializer_t *serializers[ARKIME_DB_MAX_SERIALIZERS] = {&jsonSerializer, &cborSerializer};
+LOCAL int                         numSerializers = 2;
+LOCAL const ArkimeDbSerializer_t *dbSerializer = &jsonSerializer;
+
+/******************************************************************************/
+void arkime_db_add_serializer(const ArkimeDbSerializer_t *serializer)
+{
+    if (numSerializers >= ARKIME_DB_MAX_SERIALIZERS)
+        LOGEXIT("ERROR - Too many session serializers, can't add %s", serializer->name);
+    serializers[numSerializers++] = serializer;
+}
+/******************************************************************************/
+void arkime_db_set_serializer(const char *name)
+{
+    for (int i = 0; i < numSerializers; i++) {
+        if (strcmp(serializers[i]->name, name) == 0) {
+            dbSerializer = serializers[i];
+            if (config.debug)
+                LOG("Using %s session serializer", name);
+            return;
         }
-        } /* switch */
-        if (freeField) {
-            ARKIME_TYPE_FREE(ArkimeField_t, session->fields[pos]);
-            session->fields[pos] = 0;
+    }
+    CONFIGEXIT("Unknown session serializer '%s'", name);
+}
+/******************************************************************************/
+void arkime_db_save_session(ArkimeSession_t *session, int final)
+{
+    uint32_t               i;
+    char                   id[100];
+    uint32_t               id_len;
+    uuid_t                 uuid;
+    uint8_t               *startPtr;
+    uint8_t               *dataPtr;
+    uint32_t               jsonSize;
+
+    /* Let the plugins finish */
+    if (pluginsCbs & ARKIME_PLUGIN_SAVE)
+        arkime_plugins_cb_save(session, final);
+
+    /* Don't save spi data for session */
+    if (session->stopSPI)
+        return;
+
+    /* No Packets */
+    if (!config.dryRun && !session->filePosArray->len)
+        return;
+
+    /* Not enough packets */
+    if (session->packets[0] + session->packets[1] < session->minSaving) {
+        return;
+    }
+
+    if (arkime_writer_index) {
+        arkime_writer_index(session);
+    }
+
+    /* jsonSize is an estimate of how much space it will take to encode the session */
+    jsonSize = 1300 + session->filePosArray->len * 17 + 11 * session->fileNumArray->len;
+    if (config.enablePacketLen) {
+        jsonSize += 10 * session->fileLenArray->len;
+    }
+
+    for (int pos = 0; pos < session->maxFields; pos++) {
+        if (session->fields[pos]) {
+            jsonSize += session->fields[pos]->jsonSize;
         }
     }
 
-    if (inGroupNum) {
-        BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
-        BSB_EXPORT_cstr(jbsb, "},");
+    ARKIME_THREAD_INCR(totalSessions);
+    session->segments++;
+
+    const int thread = session->thread;
+
+    /* Rebuild field order, we keep a sort list of fields per thread */
+    if (session->maxFields > dbInfo[thread].sortedFieldsIndexCnt) {
+        for (int f = 0; f < session->maxFields; f++) {
+            dbInfo[thread].sortedFieldsIndex[f] = f;
+        }
+        qsort(&dbInfo[thread].sortedFieldsIndex, session->maxFields, 2, arkime_db_field_sort);
+        dbInfo[thread].sortedFieldsIndexCnt = session->maxFields;
     }
 
-    BSB_EXPORT_rewind(jbsb, 1); // Remove last comma
-    BSB_EXPORT_cstr(jbsb, "}\n");
+    /* figure out ES index name per thread, can change every second */
+    if (dbInfo[thread].prefixTime != session->lastPacket.tv_sec) {
+        dbInfo[thread].prefixTime = session->lastPacket.tv_sec;
+
+        struct tm tmp;
+        gmtime_r(&dbInfo[thread].prefixTime, &tmp);
+
+        switch(config.rotate) {
+        case ARKIME_ROTATE_HOURLY:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, tmp.tm_hour);
+            break;
+        case ARKIME_ROTATE_HOURLY2:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 2) * 2);
+            break;
+        case ARKIME_ROTATE_HOURLY3:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 3) * 3);
+            break;
+        case ARKIME_ROTATE_HOURLY4:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 4) * 4);
+            break;
+        case ARKIME_ROTATE_HOURLY6:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 6) * 6);
+            break ;
+        case ARKIME_ROTATE_HOURLY8:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 8) * 8);
+            break;
+        case ARKIME_ROTATE_HOURLY12:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02dh%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday, (tmp.tm_hour / 12) * 12);
+            break;
+        case ARKIME_ROTATE_DAILY:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02d%02d%02d", tmp.tm_year % 100, tmp.tm_mon + 1, tmp.tm_mday);
+            break;
+        case ARKIME_ROTATE_WEEKLY:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02dw%02d", tmp.tm_year % 100, tmp.tm_yday / 7);
+            break;
+        case ARKIME_ROTATE_MONTHLY:
+            snprintf(dbInfo[thread].prefix, sizeof(dbInfo[thread].prefix), "%02dm%02d", tmp.tm_year % 100, tmp.tm_mon + 1);
+            break;
+        }
+    }
+
+    if (!config.autoGenerateId || session->rootId == (void *)1L) {
+        id_len = snprintf(id, sizeof(id), "%s-", dbInfo[thread].prefix);
+
+        uuid_generate(uuid);
+        gint state = 0, save = 0;
+        id_len += g_base64_encode_step((guchar *)&myPid, 2, FALSE, id + id_len, &state, &save);
+        id_len += g_base64_encode_step(uuid, sizeof(uuid_t), FALSE, id + id_len, &state, &save);
+        id_len += g_base64_encode_close(FALSE, id + id_len, &state, &save);
+        id[id_len] = 0;
+
+        for (i = 0; i < id_len; i++) {
+            if (id[i] == '+') id[i] = '-';
+            else if (id[i] == '/') id[i] = '_';
+        }
+
+        if (session->rootId == (void * )1L)
+            session->rootId = g_strdup(id);
+    }
+
+    struct timeval currentTime;
+    gettimeofday(&currentTime, NULL);
+
+    ARKIME_LOCK(dbInfo[thread].lock);
+    /* If no room left to add, send the buffer */
+    if (dbInfo[thread].json && ((uint32_t)BSB_REMAINING(dbInfo[thread].bsb) < jsonSize || dbInfo[thread].cnt >= sendMaxDocs)) {
+        if (BSB_LENGTH(dbInfo[thread].bsb) > 0) {
+            sendBulkFunc(dbInfo[thread].json, BSB_LENGTH(dbInfo[thread].bsb));
+        } else {
+            arkime_http_free_buffer(dbInfo[thread].json);
+        }
+        dbInfo[thread].json = 0;
+        dbInfo[thread].cnt = 0;
+        dbInfo[thread].lastSave = currentTime.tv_sec;
+    }
+    dbInfo[thread].cnt++;
+
+    /* Allocate a new buffer using the max of the bulk size or estimated size. */
+    if (!dbInfo[thread].json) {
+        const int size = MAX(config.dbBulkSize, jsonSize);
+        dbInfo[thread].json = arkime_http_get_buffer(size);
+        BSB_INIT(dbInfo[thread].bsb, dbInfo[thread].json, size);
+    }
+
+    BSB jbsb = dbInfo[thread].bsb;
+
+    const ArkimeDbSaveInfo_t info = {
+        .indexSuffix = dbInfo[thread].prefix,
+        .id = config.autoGenerateId ? NULL : id,
+        .sortedFields = dbInfo[thread].sortedFieldsIndex,
+        .sortedFieldsCnt = dbInfo[thread].sortedFieldsIndexCnt,
+        .timestamp = ((uint64_t)currentTime.tv_sec) * 1000 + ((uint64_t)currentTime.tv_usec) / 1000,
+        .indexInDoc = sendIndexInDoc
+    };
+
+    startPtr = BSB_WORK_PTR(jbsb);
+
+    if (sendBulkHeader && dbSerializer->header) {
+        dbSerializer->header(&jbsb, session, &info);
+    }
+
+    if (session->firstPacket.tv_sec < 10) {
+        session->firstPacket.tv_sec += 10;
+        session->lastPacket.tv_sec += 10;
+    } else if (session->lastPacket.tv_sec < 10) {
+        session->lastPacket.tv_sec += 10;
+    }
+
+    dataPtr = BSB_WORK_PTR(jbsb);
+
+    dbSerializer->body(&jbsb, session, &info);
+
+    arkime_db_free_saved_fields(session, final);
 
     if (BSB_IS_ERROR(jbsb)) {
         LOG("ERROR - Ran out of memory creating DB record supposed to be %u", jsonSize);
@@ -1534,7 +2593,12 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
     static uint64_t       lastFragsDropped[NUMBER_OF_STATS];
     static uint64_t       lastOverloadDropped[NUMBER_OF_STATS];
     static uint64_t       lastESDropped[NUMBER_OF_STATS];
+    static uint64_t       lastESCompressUS[NUMBER_OF_STATS];
+    static uint64_t       lastESSendUS[NUMBER_OF_STATS];
     static uint64_t       lastDupDropped[NUMBER_OF_STATS];
+    static uint64_t       lastDupCollisions[NUMBER_OF_STATS];
+    static uint64_t       lastGeoCacheHits[NUMBER_OF_STATS];
+    static uint64_t       lastGeoCacheMisses[NUMBER_OF_STATS];
     static struct rusage  lastUsage[NUMBER_OF_STATS];
     static struct timeval lastTime[NUMBER_OF_STATS];
     static int            intervals[NUMBER_OF_STATS] = {1, 5, 60, 600};
@@ -1543,7 +2607,12 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
     uint64_t              totalSpaceM = 0;
     int                   i;
 
-    char *json = arkime_http_get_buffer(ARKIME_HTTP_BUFFER_SIZE);
+    // Counters from plugins that have a stats cb, like the wise lookups, these can be big so the buffer grows with them
+    GString *pluginStats = g_string_sized_new(1000);
+    arkime_plugins_stats(pluginStats);
+
+    const int jsonSize = ARKIME_HTTP_BUFFER_SIZE + pluginStats->len;
+    char *json = arkime_http_get_buffer(jsonSize);
     struct timeval currentTime;
 
     gettimeofday(&currentTime, NULL);
@@ -1560,8 +2629,13 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
     uint64_t totalDropped    = arkime_packet_dropped_packets();
     uint64_t fragsDropped    = arkime_packet_dropped_frags();
     uint64_t dupDropped      = packetStats[ARKIME_PACKET_DUPLICATE_DROPPED];
+    uint64_t dupCollisions   = arkime_dedup_collisions();
     uint64_t esDropped       = arkime_http_dropped_count(esServer);
+    uint64_t esCompressUS, esSendUS;
+    arkime_http_time_stats(esServer, &esCompressUS, &esSendUS);
     uint64_t totalBytes      = arkime_packet_total_bytes();
+    uint64_t geoCacheHits, geoCacheMisses;
+    arkime_db_geo_cache_stats(&geoCacheHits, &geoCacheMisses);
 
     // If totalDropped wrapped we pretend no drops this time
     if (totalDropped < lastDropped[n]) {
@@ -1602,6 +2676,44 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
     double   memMax = arkime_db_memory_max();
     float    memUse = mem / memMax * 100.0;
 
+    char pools[600];
+    BSB pbsb;
+    BSB_INIT(pbsb, pools, sizeof(pools));
+    BSB_EXPORT_u08(pbsb, '{');
+    for (i = 0; i < ARKIME_POOL_MAX; i++) {
+        uint64_t inUse, highWater, memory;
+        arkime_pool_stats(i, &inUse, &highWater, &memory);
+        BSB_EXPORT_sprintf(pbsb, "%s\"%s\":{\"inUse\":%" PRIu64 ",\"highWater\":%" PRIu64 ",\"memory\":%" PRIu64 "}",
+                           i == 0 ? "" : ",", arkime_pool_name(i), inUse, highWater, memory);
+    }
+    BSB_EXPORT_u08(pbsb, '}');
+    BSB_EXPORT_u08(pbsb, 0);
+
+    // Session commands waiting, packets waiting and cpu percent for each packet thread
+    char cmdQueues[400];
+    uint32_t cmdQueue = 0;
+    BSB cbsb;
+    BSB_INIT(cbsb, cmdQueues, sizeof(cmdQueues));
+    BSB_EXPORT_u08(cbsb, '[');
+    for (i = 0; i < config.packetThreads; i++) {
+        const int len = arkime_session_cmd_queue_length(i);
+        cmdQueue += len;
+        BSB_EXPORT_sprintf(cbsb, "%s%d", i == 0 ? "" : ",", len);
+    }
+    BSB_EXPORT_u08(cbsb, ']');
+    BSB_EXPORT_u08(cbsb, 0);
+
+    char packetThreads[1200];
+    BSB tbsb;
+    BSB_INIT(tbsb, packetThreads, sizeof(packetThreads));
+    BSB_EXPORT_u08(tbsb, '[');
+    for (i = 0; i < config.packetThreads; i++) {
+        BSB_EXPORT_sprintf(tbsb, "%s{\"queue\":%u,\"cpu\":%u}", i == 0 ? "" : ",",
+                           arkime_packet_thread_queue_length(i), arkime_packet_thread_cpu(i));
+    }
+    BSB_EXPORT_u08(tbsb, ']');
+    BSB_EXPORT_u08(tbsb, 0);
+
 #ifndef __SANITIZE_ADDRESS__
     if (config.maxMemPercentage != 100 && memUse > config.maxMemPercentage) {
         LOG("Aborting, max memory percentage reached: %.2f > %u", memUse, config.maxMemPercentage);
@@ -1611,7 +2723,7 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
     }
 #endif
 
-    int json_len = snprintf(json, ARKIME_HTTP_BUFFER_SIZE,
+    int json_len = snprintf(json, jsonSize,
                             "{"
                             "\"ver\": \"%s\","
                             "\"nodeName\": \"%s\","
@@ -1632,6 +2744,12 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
                             "\"frags\": %u,"
                             "\"needSave\": %u,"
                             "\"closeQueue\": %u,"
+                            "\"cmdQueue\": %u,"
+                            "\"cmdQueues\": %s,"
+                            "\"packetThreads\": %s,"
+                            "\"elephantFlows\": %" PRIu64 ","
+                            "\"pools\": %s,"
+                            "\"plugins\": %s,"
                             "\"totalPackets\": %" PRIu64 ","
                             "\"totalK\": %" PRIu64 ","
                             "\"totalSessions\": %" PRIu64 ","
@@ -1652,7 +2770,12 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
                             "\"deltaFragsDropped\": %" PRIu64 ","
                             "\"deltaOverloadDropped\": %" PRIu64 ","
                             "\"deltaESDropped\": %" PRIu64 ","
+                            "\"deltaESCompressMS\": %" PRIu64 ","
+                            "\"deltaESSendMS\": %" PRIu64 ","
                             "\"deltaDupDropped\": %" PRIu64 ","
+                            "\"deltaDupCollisions\": %" PRIu64 ","
+                            "\"deltaGeoCacheHits\": %" PRIu64 ","
+                            "\"deltaGeoCacheMisses\": %" PRIu64 ","
                             "\"esHealthMS\": %" PRIu64 ","
                             "\"deltaMS\": %" PRIu64 ","
                             "\"startTime\": %" PRIu64
@@ -1676,6 +2799,12 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
                             arkime_packet_frags_size(),
                             arkime_session_need_save_outstanding(),
                             arkime_session_close_outstanding(),
+                            cmdQueue,
+                            BSB_IS_ERROR(cbsb) ? "[]" : cmdQueues,
+                            BSB_IS_ERROR(tbsb) ? "[]" : packetThreads,
+                            arkime_packet_elephant_flows(),
+                            BSB_IS_ERROR(pbsb) ? "{}" : pools,
+                            pluginStats->str,
                             dbTotalPackets[n],
                             dbTotalK[n],
                             dbTotalSessions[n],
@@ -1696,10 +2825,16 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
                             (fragsDropped - lastFragsDropped[n]),
                             (overloadDropped - lastOverloadDropped[n]),
                             (esDropped - lastESDropped[n]),
+                            (esCompressUS - lastESCompressUS[n]) / 1000,
+                            (esSendUS - lastESSendUS[n]) / 1000,
                             (dupDropped - lastDupDropped[n]),
+                            (dupCollisions - lastDupCollisions[n]),
+                            (geoCacheHits - lastGeoCacheHits[n]),
+                            (geoCacheMisses - lastGeoCacheMisses[n]),
                             esHealthMS,
                             diffms,
                             (uint64_t)startTime.tv_sec);
+    g_string_free(pluginStats, TRUE);
 
     lastTime[n]            = currentTime;
     lastBytes[n]           = totalBytes;
@@ -1712,7 +2847,12 @@ LOCAL void arkime_db_update_stats(int n, gboolean sync)
     lastFragsDropped[n]    = fragsDropped;
     lastOverloadDropped[n] = overloadDropped;
     lastESDropped[n]       = esDropped;
+    lastESCompressUS[n]    = esCompressUS;
+    lastESSendUS[n]        = esSendUS;
     lastDupDropped[n]      = dupDropped;
+    lastDupCollisions[n]   = dupCollisions;
+    lastGeoCacheHits[n]    = geoCacheHits;
+    lastGeoCacheMisses[n]  = geoCacheMisses;
     lastUsage[n]           = usage;
 
     if (n == 0) {
@@ -2058,6 +3198,23 @@ char *arkime_db_create_file_full(time_t firstPacket, const char *name, uint64_t
             }
             if (config.debug)
                 LOG("%s has the most available space", config.pcapDir[config.pcapDirPos]);
+        } else if (strcmp(config.pcapDirAlgorithm, "least-open") == 0) {
+            // Select the next pcapDir with the fewest files still being written, so writes are spread across disks
+            int cnt = g_strv_length(config.pcapDir);
+            if (!pcapDirOpen) {
+                pcapDirOpen = g_new0(int, cnt);
+                pcapDirFiles = g_hash_table_new(g_direct_hash, g_direct_equal);
+            }
+            pcapDirOpen[config.pcapDirPos]++;
+            g_hash_table_insert(pcapDirFiles, GUINT_TO_POINTER(num), GINT_TO_POINTER(config.pcapDirPos + 1));
+
+            int best = -1;
+            for (int i = 1; i <= cnt; i++) {
+                int p = (config.pcapDirPos + i) % cnt;
+                if (best == -1 || pcapDirOpen[p] < pcapDirOpen[best])
+                    best = p;
+            }
+            config.pcapDirPos = best;
         } else {
             // Select pcapDir by round robin
             config.pcapDirPos++;
@@ -2218,6 +3375,7 @@ LOCAL void arkime_db_load_geo_country(char *name)
         arkime_free_later(geoCountry, (GDestroyNotify) arkime_db_free_mmdb);
     }
     geoCountry = country;
+    __sync_add_and_fetch(&geoGeneration, 1);
 }
 /******************************************************************************/
 LOCAL void arkime_db_load_geo_asn(char *name)
@@ -2232,6 +3390,7 @@ LOCAL void arkime_db_load_geo_asn(char *name)
         arkime_free_later(geoASN, (GDestroyNotify) arkime_db_free_mmdb);
     }
     geoASN = asn;
+    __sync_add_and_fetch(&geoGeneration, 1);
 }
 /******************************************************************************/
 LOCAL void arkime_db_load_rir(char *name)
@@ -2280,18 +3439,13 @@ LOCAL void arkime_db_load_rir(char *name)
     fclose(fp);
 }
 /******************************************************************************/
-LOCAL void arkime_db_free_oui(patricia_tree_t *oui)
-{
-    Destroy_Patricia(oui, g_free);
-}
-/******************************************************************************/
 LOCAL void arkime_db_load_oui(char *name)
 {
     if (ouiTree)
         LOG("Loading new version of oui file");
 
     // Load the data
-    patricia_tree_t *oui = New_Patricia(48); // 48 - Ethernet Size
+    ArkimeLpm_t *oui = arkime_lpm_new(48, g_free); // 48 - Ethernet Size
     FILE *fp;
     char line[2000];
     if (!(fp = fopen(name, "r"))) {
@@ -2354,17 +3508,18 @@ LOCAL void arkime_db_load_oui(char *name)
         patricia_node_t *node;
 
         prefix = New_Prefix2(AF_INET6, buf, bitlen, NULL);
-        node = patricia_lookup(oui, prefix);
+        node = patricia_lookup(arkime_lpm_tree(oui), prefix);
         Deref_Prefix(prefix);
         node->data = g_strdup(str);
 
         g_strfreev(parts);
     }
     fclose(fp);
+    arkime_lpm_compile(oui);
 
     // Save old tree to free later and flip to new tree
     if (ouiTree)
-        arkime_free_later(ouiTree, (GDestroyNotify) arkime_db_free_oui);
+        arkime_free_later(ouiTree, (GDestroyNotify) arkime_lpm_free);
     ouiTree = oui;
 }
 /******************************************************************************/
@@ -2375,7 +3530,7 @@ void arkime_db_oui_lookup(int field, ArkimeSession_t *session, const uint8_t *ma
     if (!ouiTree)
         return;
 
-    if ((node = patricia_search_best3 (ouiTree, mac, 48)) == NULL)
+    if ((node = arkime_lpm_search_best(ouiTree, mac)) == NULL)
         return;
 
     arkime_field_string_add(field, session, node->data, -1, TRUE);
@@ -2536,6 +3691,16 @@ void arkime_db_update_filesize(uint32_t fileid, uint64_t filesize, uint64_t pack
     int                    key_len;
     int                    json_len;
 
+    if (pcapDirFiles) {
+        ARKIME_LOCK(nextFileNum);
+        int pos = GPOINTER_TO_INT(g_hash_table_lookup(pcapDirFiles, GUINT_TO_POINTER(fileid)));
+        if (pos) {
+            pcapDirOpen[pos - 1]--;
+            g_hash_table_remove(pcapDirFiles, GUINT_TO_POINTER(fileid));
+        }
+        ARKIME_UNLOCK(nextFileNum);
+    }
+
     if (config.dryRun)
         return;
 
@@ -2670,6 +3835,7 @@ void arkime_db_init()
     }
     if (!config.dryRun) {
         esServer = arkime_http_create_server(config.elasticsearch, config.maxESConns, config.maxESRequests, config.compressES);
+        arkime_http_set_compression_level(esServer, arkime_config_int(NULL, "compressESLevel", 6, 1, 9));
 
         static char *headers[4] = {"Content-Type: application/json", "Expect:", NULL, NULL};
 
@@ -2768,6 +3934,18 @@ void arkime_db_init()
         ARKIME_LOCK_INIT(dbInfo[thread].lock);
         dbInfo[thread].prefixTime = -1;
     }
+
+    // Number of geo results each packet thread caches, rounded up to a power of 2
+    uint32_t geoCacheSize = arkime_config_int(NULL, "geoCacheSize", 16384, 0, 0x400000);
+    if (geoCacheSize) {
+        uint32_t sets = 1;
+        while (sets * GEO_CACHE_WAYS < geoCacheSize)
+            sets <<= 1;
+        geoCacheSetMask = sets - 1;
+        for (thread = 0; thread < config.packetThreads; thread++) {
+            geoCache[thread].entries = g_new0(ArkimeGeoCacheEntry_t, sets * GEO_CACHE_WAYS);
+        }
+    }
 }
 /******************************************************************************/
 void arkime_db_exit()
@@ -2809,8 +3987,8 @@ void arkime_db_exit()
     }
 
     if (ipTree4) {
-        arkime_db_free_override_ips(ipTree4);
-        arkime_db_free_override_ips(ipTree6);
+        arkime_lpm_free(ipTree4);
+        arkime_lpm_free(ipTree6);
         ipTree4 = 0;
         ipTree6 = 0;
     }
@@ -2818,5 +3996,15 @@ void arkime_db_exit()
     if (config.debug) {
         LOG("totalPackets: %" PRId64 " totalSessions: %" PRId64 " writtenBytes: %" PRId64 " unwrittenBytes: %" PRId64,
             totalPackets, totalSessions, writtenBytes, unwrittenBytes);
+
+        uint64_t hits, misses;
+        arkime_db_geo_cache_stats(&hits, &misses);
+        if (hits + misses > 0)
+            LOG("geo cache hits: %" PRIu64 " misses: %" PRIu64 " hit rate: %.2f%%", hits, misses, hits * 100.0 / (hits + misses));
+    }
+
+    for (int thread = 0; thread < config.packetThreads; thread++) {
+        g_free(geoCache[thread].entries);
+        geoCache[thread].entries = NULL;
     }
 }
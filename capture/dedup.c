@@ -6,137 +6,239 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-/* Circular array of chained hashtable where space is preallocated and
- * there is a count array of elements per hashtable slot. We stop
- * searching the oldest hashtable and wipe its count array.
+/* One open addressed table of 64 bit fingerprints shared by all the
+ * reader threads, no locks. Each bucket is one cache line of
+ * DEDUP_BUCKET_SIZE entries and a packet only ever looks at its own
+ * bucket, so a lookup is a single pass over one cache line.
  *
- * We size the hashtable assuming DEDUP_SLOT_FACTOR elements per
- * slot, but actually allow DEDUP_SIZE_FACTOR elements.
+ * An entry is the top 48 bits of the packet hash with the low 16 bits
+ * holding the second it was seen in. Entries older than dedupSeconds are
+ * ignored by lookups and are reused by inserts. The stamp wraps every
+ * 65536 seconds, so an entry that is never reused would look live again,
+ * a sweep every DEDUP_SWEEP_SECONDS clears stale entries long before that. Inserts claim an entry with a CAS, if every
+ * entry in the bucket is still live the oldest one is replaced and
+ * counted as a collision.
  *
- * Currently use md5 on ip + tcp/udp hdr
+ * The hash is a fast non cryptographic 64 bit hash of the ip + tcp/udp
+ * header, skipping the fields that change hop to hop.
  */
 
 #include "arkime.h"
-#include <openssl/md5.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 extern ArkimeConfig_t       config;
 
-// How many items in each hashtable we expect to be used
-#define DEDUP_SLOT_FACTOR   15
-// How many items in each hashtable we actually allow, must be less then 256
-#define DEDUP_SIZE_FACTOR   20
+// How many fingerprints per bucket, 8 * 8 bytes is one cache line
+#define DEDUP_BUCKET_SIZE   8
+// How many of those we expect to be used when dedupPackets are seen every second
+#define DEDUP_BUCKET_FILL   6
+
+#define DEDUP_TIME_BITS     16
+#define DEDUP_TIME_MASK     ((1ULL << DEDUP_TIME_BITS) - 1)
+// Must be well under 1 << DEDUP_TIME_BITS
+#define DEDUP_SWEEP_SECONDS 3600
 
 LOCAL uint32_t              dedupSeconds;
-LOCAL uint32_t              dedupSlots;
 LOCAL uint32_t              dedupPackets;
-LOCAL uint32_t              dedupSize;
+LOCAL uint32_t              dedupBuckets;
+LOCAL uint32_t              dedupBucketMask;
 
-typedef struct dedupsecond DedupSeconds_t;
-struct dedupsecond {
-    uint8_t        *md5s;
-    uint8_t        *counts;
-    uint32_t        tv_sec;
-    uint32_t        count;
-    char            error;
-    ARKIME_LOCK_EXTERN(lock);
-};
+LOCAL uint64_t             *dedupTable;
 
-LOCAL DedupSeconds_t *seconds;
+LOCAL uint64_t              dedupCollisions;
+LOCAL uint64_t              dedupRaces;
+LOCAL guint                 dedupSweepTimer;
 
+/******************************************************************************/
+#define DEDUP_PRIME1 0x9e3779b97f4a7c15ULL
+#define DEDUP_PRIME2 0xbf58476d1ce4e5b9ULL
+#define DEDUP_PRIME3 0x94d049bb133111ebULL
+
+SUPPRESS_UNSIGNED_INTEGER_OVERFLOW
+LOCAL inline uint64_t arkime_dedup_round(uint64_t h, uint64_t v)
+{
+    h ^= v * DEDUP_PRIME1;
+    h = (h << 31) | (h >> 33);
+    return h * DEDUP_PRIME2;
+}
+/******************************************************************************/
+SUPPRESS_UNSIGNED_INTEGER_OVERFLOW
+LOCAL uint64_t arkime_dedup_update(uint64_t h, const uint8_t *data, int len)
+{
+    uint64_t v;
+
+    while (len >= 8) {
+        memcpy(&v, data, 8);
+        h = arkime_dedup_round(h, v);
+        data += 8;
+        len -= 8;
+    }
+
+    if (len > 0) {
+        v = 0;
+        memcpy(&v, data, len);
+        h = arkime_dedup_round(h, v ^ ((uint64_t)len << 59));
+    }
+    return h;
+}
+/******************************************************************************/
+SUPPRESS_UNSIGNED_INTEGER_OVERFLOW
+LOCAL inline uint64_t arkime_dedup_final(uint64_t h, int len)
+{
+    h ^= len;
+    h ^= h >> 30;
+    h *= DEDUP_PRIME2;
+    h ^= h >> 27;
+    h *= DEDUP_PRIME3;
+    h ^= h >> 31;
+    return h;
+}
+/******************************************************************************/
+LOCAL inline int arkime_dedup_live(uint64_t entry, uint32_t now)
+{
+    return entry != 0 && ((now - entry) & DEDUP_TIME_MASK) < dedupSeconds;
+}
 /******************************************************************************/
 int arkime_dedup_should_drop (const ArkimePacket_t *packet, int headerLen)
 {
     struct timespec currentTime;
     clock_gettime(CLOCK_REALTIME_COARSE, &currentTime);
-
-    uint32_t secondSlot = currentTime.tv_sec % dedupSeconds;
+    const uint32_t now = currentTime.tv_sec & DEDUP_TIME_MASK;
 
     // Create hash, headerLen should be length of ip & tcp/udp header
-    uint8_t md[16];
-    MD5_CTX ctx;
-    MD5_Init(&ctx);
-    uint8_t *const ptr = packet->pkt + packet->ipOffset;
+    uint64_t h = DEDUP_PRIME3;
+    const uint8_t *const ptr = packet->pkt + packet->ipOffset;
     if ((ptr[0] & 0xf0) == 0x40) {
-        MD5_Update(&ctx, ptr, 8);
+        h = arkime_dedup_update(h, ptr, 8);
         // Skip TTL (1 byte)
-        MD5_Update(&ctx, ptr + 9, 1);
+        h = arkime_dedup_update(h, ptr + 9, 1);
         // Skip Header checksum (2 byte)
-        MD5_Update(&ctx, ptr + 12, headerLen - 12);
+        h = arkime_dedup_update(h, ptr + 12, headerLen - 12);
     } else {
-        MD5_Update(&ctx, ptr, 7);
+        h = arkime_dedup_update(h, ptr, 7);
         // Skip HOP
-        MD5_Update(&ctx, ptr + 8, headerLen - 8);
+        h = arkime_dedup_update(h, ptr + 8, headerLen - 8);
     }
-    MD5_Final(md, &ctx);
-    int h = ((uint32_t *)md)[0] % dedupSlots;
-
-    // First see if we need to clean up old slot, and block all new folks while we do
-    // In theory no one should be using this slot because hadn't been searching it for a second.
-    if (seconds[secondSlot].tv_sec != currentTime.tv_sec) {
-        ARKIME_LOCK(seconds[secondSlot].lock);
-        if (seconds[secondSlot].tv_sec != currentTime.tv_sec) { // Check critical section again
-            if (seconds[secondSlot].error) {
-                LOG ("WARNING - Ran out of room, increase dedupPackets to %u or above. pcount: %u", dedupSlots * DEDUP_SLOT_FACTOR + 1, seconds[secondSlot].count);
-                seconds[secondSlot].error = 0;
-            }
-            memset(seconds[secondSlot].counts, 0, dedupSlots);
-            seconds[secondSlot].count = 0;
-            seconds[secondSlot].tv_sec = currentTime.tv_sec;
-        }
-        ARKIME_UNLOCK(seconds[secondSlot].lock);
-    }
-
-    // Search all valid slots
-    for (uint32_t s = 0; s < dedupSeconds; s++) {
-
-        // If slot is too old just skip it
-        if (currentTime.tv_sec - dedupSeconds + 1 >= seconds[s].tv_sec ) {
+    h = arkime_dedup_final(h, headerLen);
+
+    // Low bits pick the bucket, high bits are the fingerprint, never 0 so 0 can mean empty
+    uint64_t *bucket = dedupTable + (h & dedupBucketMask) * DEDUP_BUCKET_SIZE;
+    uint64_t  fp = (h & ~DEDUP_TIME_MASK) | (1ULL << DEDUP_TIME_BITS);
+
+    // Search the bucket
+    int i;
+#ifdef __SSE2__
+    const __m128i want = _mm_set1_epi64x(fp);
+    const __m128i mask = _mm_set1_epi64x(~DEDUP_TIME_MASK);
+    for (i = 0; i < DEDUP_BUCKET_SIZE; i += 2) {
+        __m128i e = _mm_and_si128(_mm_load_si128((const __m128i *)(bucket + i)), mask);
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi32(e, want));
+        if (m == 0)
             continue;
-        }
-
-        int count = seconds[s].counts[h];
-        for (int c = 0; c < count; c++) {
-            if (memcmp(md, seconds[s].md5s + 16 * (h * DEDUP_SIZE_FACTOR + c), 16) == 0) {
-                return 1;
+        if ((m & 0x00ff) == 0x00ff && arkime_dedup_live(bucket[i], now))
+            return 1;
+        if ((m & 0xff00) == 0xff00 && arkime_dedup_live(bucket[i + 1], now))
+            return 1;
+    }
+#else
+    for (i = 0; i < DEDUP_BUCKET_SIZE; i++) {
+        uint64_t entry = bucket[i];
+        if ((entry & ~DEDUP_TIME_MASK) == fp && arkime_dedup_live(entry, now))
+            return 1;
+    }
+#endif
+
+    // Not found, claim a free or stale entry, otherwise the oldest
+    const uint64_t newEntry = fp | now;
+    for (int tries = 0; tries < 2; tries++) {
+        int      oldest = 0;
+        uint32_t oldestAge = 0;
+        for (i = 0; i < DEDUP_BUCKET_SIZE; i++) {
+            uint64_t entry = bucket[i];
+            if (!arkime_dedup_live(entry, now)) {
+                oldest = i;
+                oldestAge = 0xffffffff;
+                break;
+            }
+            uint32_t age = (now - entry) & DEDUP_TIME_MASK;
+            if (age >= oldestAge) {
+                oldest = i;
+                oldestAge = age;
             }
         }
-    }
 
-    // Is there space to add
-    if (seconds[secondSlot].counts[h] == DEDUP_SIZE_FACTOR) {
-        seconds[secondSlot].error = 1;
-        return 0;
+        uint64_t entry = bucket[oldest];
+        if (__sync_bool_compare_and_swap(&bucket[oldest], entry, newEntry)) {
+            if (arkime_dedup_live(entry, now))
+                ARKIME_THREAD_INCR(dedupCollisions);
+            return 0;
+        }
     }
 
-    // For now ignore the race condition of search between incr and copy
-    int c = ARKIME_THREAD_INCROLD(seconds[secondSlot].counts[h]);
-    memcpy(seconds[secondSlot].md5s + 16 * (h * DEDUP_SIZE_FACTOR + c), md, 16);
-    ARKIME_THREAD_INCR(seconds[secondSlot].count);
-
+    // Lost the race twice with other readers on the same bucket, just don't remember this one
+    ARKIME_THREAD_INCR(dedupRaces);
     return 0;
 }
 /******************************************************************************/
+LOCAL gboolean arkime_dedup_sweep(gpointer UNUSED(user_data))
+{
+    struct timespec currentTime;
+    clock_gettime(CLOCK_REALTIME_COARSE, &currentTime);
+    const uint32_t now = currentTime.tv_sec & DEDUP_TIME_MASK;
+
+    const size_t entries = (size_t)dedupBuckets * DEDUP_BUCKET_SIZE;
+    for (size_t i = 0; i < entries; i++) {
+        uint64_t entry = dedupTable[i];
+        // If a reader just reused it the CAS fails and the new entry stays
+        if (entry != 0 && !arkime_dedup_live(entry, now))
+            __sync_bool_compare_and_swap(&dedupTable[i], entry, 0);
+    }
+    return G_SOURCE_CONTINUE;
+}
+/******************************************************************************/
+uint64_t arkime_dedup_collisions()
+{
+    return dedupCollisions;
+}
+/******************************************************************************/
 void arkime_dedup_init()
 {
     if (!config.enablePacketDedup)
         return;
 
-    dedupSeconds   = arkime_config_int(NULL, "dedupSeconds", 2, 0, 30) + 1; // + 1 because a slot isn't active before being replaced
+    dedupSeconds   = arkime_config_int(NULL, "dedupSeconds", 2, 0, 30) + 1; // + 1 because the current second is only partly done
     dedupPackets   = arkime_config_int(NULL, "dedupPackets", 0xfffff, 0xffff, 0xffffff);
-    dedupSlots     = arkime_get_next_prime(dedupPackets / DEDUP_SLOT_FACTOR);
-    dedupSize      = dedupSlots * DEDUP_SIZE_FACTOR;
+
+    uint64_t want  = ((uint64_t)dedupPackets * dedupSeconds + DEDUP_BUCKET_FILL - 1) / DEDUP_BUCKET_FILL;
+    dedupBuckets   = 1;
+    while (dedupBuckets < want)
+        dedupBuckets <<= 1;
+    dedupBucketMask = dedupBuckets - 1;
+
+    size_t size = (size_t)dedupBuckets * DEDUP_BUCKET_SIZE * sizeof(uint64_t);
 
     if (config.debug)
-        LOG("seconds = %u packets = %u slots = %u size = %u mem=%u", dedupSeconds, dedupPackets, dedupSlots, dedupSize, dedupSeconds * (dedupSlots + dedupSize * 16));
+        LOG("seconds = %u packets = %u buckets = %u mem = %zu", dedupSeconds, dedupPackets, dedupBuckets, size);
 
-    seconds = ARKIME_SIZE_ALLOC0("dedup seconds", sizeof(DedupSeconds_t) * dedupSeconds);
-    for (uint32_t i = 0; i < dedupSeconds; i++) {
-        ARKIME_LOCK_INIT(seconds[i].lock);
-        seconds[i].counts = ARKIME_SIZE_ALLOC("dedup counts", dedupSlots);
-        seconds[i].md5s = ARKIME_SIZE_ALLOC("dedup counts", dedupSize * 16);
-    }
+    if (posix_memalign((void **)&dedupTable, 64, size) != 0)
+        LOGEXIT("ERROR - Couldn't allocate dedup table of %zu bytes", size);
+    memset(dedupTable, 0, size);
+
+    dedupSweepTimer = g_timeout_add_seconds(DEDUP_SWEEP_SECONDS, arkime_dedup_sweep, 0);
 }
 /******************************************************************************/
 void arkime_dedup_exit()
 {
+    if (!config.enablePacketDedup)
+        return;
+
+    if (config.debug || dedupCollisions > dedupPackets)
+        LOG("dedup collisions: %" PRIu64 " races: %" PRIu64 "%s", dedupCollisions, dedupRaces,
+            dedupCollisions > dedupPackets ? ", increase dedupPackets" : "");
+
+    g_source_remove(dedupSweepTimer);
+    free(dedupTable);
+    dedupTable = NULL;
 }
@@ -1,38 +1,60 @@
-/* drophash.c - simple hash that locks on writes but not on reads
+/* drophash.c - open addressed hash that locks on writes but not on reads
  *              used for dropping packets by ip:port before the packet copy
  *
+ * Each group is one table of fixed size slots keyed by port and key, found
+ * with linear probing, plus a bitmap of the ports that have anything so most
+ * packets never look at the table.  A slot's key is written before its tag,
+ * and a slot is never reused while the table is live, deletes just leave a
+ * tombstone, so readers never need the lock.  When the table fills up with
+ * live entries or tombstones a new one is built without the tombstones or
+ * expired entries, swapped in and the old one freed later.
+ *
+ * Saving is done in a background thread that walks the live table like a
+ * reader, tables replaced while it runs are kept until it is done.  It writes
+ * to a temp file and renames it, so a crash never leaves a partial file.
+ * The file has fixed size records so loading just mmaps it.
+ *
  * Copyright 2018 AOL Inc. All rights reserved.
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
 #include "arkime.h"
-#include "dll.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /******************************************************************************/
 extern ArkimeConfig_t        config;
 
+#define DROPHASH_EMPTY       0
+#define DROPHASH_TOMBSTONE   1
+#define DROPHASH_MIN_SIZE    256
+#define DROPHASH_MAX_KEY     36
+
 /******************************************************************************/
 struct arkimedrophashitem_t {
-    ArkimeDropHashItem_t *dhg_next, *dhg_prev;
-    ArkimeDropHashItem_t *hnext;
-    uint8_t               key[ARKIME_SESSIONID_LEN - 1];
+    uint32_t              tag;
     uint32_t              last;
     uint32_t              goodFor;
     uint16_t              port;
     uint16_t              flags;
+    uint8_t               key[DROPHASH_MAX_KEY];
 };
 
 struct arkimedrophash_t {
-    ArkimeDropHashItem_t **heads;
-    uint32_t               cnt;
-    uint16_t               num;
+    ArkimeDropHash_t     *next;     // retired while saving
+    uint32_t              mask;
+    uint32_t              cnt;      // live entries
+    uint32_t              used;     // live entries and tombstones
+    ArkimeDropHashItem_t  items[];
 };
 
 /******************************************************************************/
-LOCAL inline uint32_t arkime_drophash_hash (const void *key, int len)
+LOCAL inline uint32_t arkime_drophash_hash (int port, const void *key, int len)
 {
-    uint32_t  h = 0;
+    uint32_t  h = port * 0x9e3779b1;
     uint32_t *p = (uint32_t *)key;
     uint32_t *end = p + len / 4;
     while (p < end) {
@@ -40,76 +62,119 @@ LOCAL inline uint32_t arkime_drophash_hash (const void *key, int len)
         h ^= h >> 16;
         p += 1;
     }
-    return h;
-}
 
+    // 0 and 1 are empty and tombstone
+    return h < 2 ? h + 2 : h;
+}
+/******************************************************************************/
+LOCAL ArkimeDropHash_t *arkime_drophash_alloc(uint32_t size)
+{
+    ArkimeDropHash_t *hash = g_malloc0(sizeof(ArkimeDropHash_t) + size * sizeof(ArkimeDropHashItem_t));
+    hash->mask = size - 1;
+    return hash;
+}
 /******************************************************************************/
-LOCAL void arkime_drophash_make(ArkimeDropHashGroup_t *group, int port)
+LOCAL ArkimeDropHashItem_t *arkime_drophash_find(const ArkimeDropHashGroup_t *group, ArkimeDropHash_t *hash, int port, const void *key, uint32_t tag)
 {
-    int size;
-
-    switch (port) {
-    case 80:
-    case 443:
-    case 25:
-        size = 7919;
-        break;
-    default:
-        size = 409;
-        break;
+    for (uint32_t i = tag & hash->mask; ; i = (i + 1) & hash->mask) {
+        ArkimeDropHashItem_t *item = &hash->items[i];
+        const uint32_t        itag = item->tag;
+
+        if (itag == DROPHASH_EMPTY)
+            return NULL;
+
+        if (itag == tag && item->port == port && memcmp(key, item->key, group->keyLen) == 0)
+            return item;
     }
+}
+/******************************************************************************/
+// Must hold the lock, there is always an empty slot since the table is never over 3/4 used
+LOCAL void arkime_drophash_insert(ArkimeDropHashGroup_t *group, ArkimeDropHash_t *hash, const ArkimeDropHashItem_t *from)
+{
+    uint32_t i = from->tag & hash->mask;
+    while (hash->items[i].tag != DROPHASH_EMPTY)
+        i = (i + 1) & hash->mask;
 
-    ARKIME_LOCK(group->lock);
-    if (group->drops[port])
-        goto done;
+    ArkimeDropHashItem_t *item = &hash->items[i];
+    item->last    = from->last;
+    item->goodFor = from->goodFor;
+    item->port    = from->port;
+    item->flags   = from->flags;
+    memcpy(item->key, from->key, group->keyLen);
 
-    ArkimeDropHash_t *hash;
+    // Everything else has to be visible before the tag is
+    __sync_synchronize();
+    item->tag = from->tag;
 
-    hash          = ARKIME_TYPE_ALLOC(ArkimeDropHash_t);
-    hash->num     = size;
-    hash->heads   = ARKIME_SIZE_ALLOC0("heads", size * sizeof(ArkimeDropHashItem_t *));
-    hash->cnt     = 0;
-    group->drops[port] = hash;
-done:
-    ARKIME_UNLOCK(group->lock);
+    hash->cnt++;
+    hash->used++;
+    group->ports[from->port >> 6] |= 1ULL << (from->port & 63);
 }
 /******************************************************************************/
-int arkime_drophash_add (ArkimeDropHashGroup_t *group, int port, const void *key, uint32_t current, uint32_t goodFor)
+LOCAL void arkime_drophash_free(void *ptr)
+{
+    g_free(ptr);
+}
+/******************************************************************************/
+// Must hold the lock, build a new table big enough for cnt more entries without tombstones or expired entries
+LOCAL void arkime_drophash_rebuild(ArkimeDropHashGroup_t *group, uint32_t cnt, uint32_t current)
 {
-    if (!group->drops[port]) {
-        arkime_drophash_make(group, port);
+    ArkimeDropHash_t *old = group->hash;
+
+    uint32_t size = DROPHASH_MIN_SIZE;
+    while (size * 3 / 8 < (old ? old->cnt : 0) + cnt)
+        size <<= 1;
+
+    ArkimeDropHash_t *hash = arkime_drophash_alloc(size);
+    uint64_t         *ports = g_malloc0(sizeof(group->ports));
+
+    if (old) {
+        for (uint32_t i = 0; i <= old->mask; i++) {
+            const ArkimeDropHashItem_t *item = &old->items[i];
+            if (item->tag < 2 || item->last + item->goodFor < current)
+                continue;
+            arkime_drophash_insert(group, hash, item);
+            ports[item->port >> 6] |= 1ULL << (item->port & 63);
+        }
     }
 
-    ArkimeDropHash_t *hash = group->drops[port];
+    __sync_synchronize();
+    group->hash = hash;
+    memcpy(group->ports, ports, sizeof(group->ports));
+    g_free(ports);
+
+    if (!old)
+        return;
+
+    if (group->saving) {
+        old->next = group->retired;
+        group->retired = old;
+    } else {
+        arkime_free_later(old, arkime_drophash_free);
+    }
+}
+/******************************************************************************/
+int arkime_drophash_add (ArkimeDropHashGroup_t *group, int port, const void *key, uint32_t current, uint32_t goodFor)
+{
+    ArkimeDropHashItem_t item;
 
-    ArkimeDropHashItem_t *item;
-    uint32_t              h;
-    if (group->keyLen == 4)
-        h = (*(uint32_t *)key) % hash->num;
-    else
-        h = arkime_drophash_hash(key, group->keyLen) % hash->num;
+    item.tag     = arkime_drophash_hash(port, key, group->keyLen);
+    item.last    = current;
+    item.goodFor = goodFor;
+    item.port    = port;
+    item.flags   = 0;
+    memcpy(item.key, key, group->keyLen);
 
     ARKIME_LOCK(group->lock);
-    if (hash->heads[h]) {
-        for (item = hash->heads[h]; item; item = item->hnext) {
-            if (memcmp(key, item->key, group->keyLen) == 0) {
-                ARKIME_UNLOCK(group->lock);
-                return 0;
-            }
-        }
+    if (arkime_drophash_find(group, group->hash, port, key, item.tag)) {
+        ARKIME_UNLOCK(group->lock);
+        return 0;
     }
 
-    item           = ARKIME_TYPE_ALLOC(ArkimeDropHashItem_t);
-    item->hnext    = hash->heads[h];
-    item->flags    = 0;
-    item->port     = port;
-    memcpy(item->key, key, group->keyLen);
-    item->last     = current;
-    item->goodFor  = goodFor;
-    hash->heads[h] = item;
-    hash->cnt++;
+    if ((group->hash->used + 1) * 4 > (group->hash->mask + 1) * 3)
+        arkime_drophash_rebuild(group, 1, current);
 
-    DLL_PUSH_TAIL(dhg_, group, item);
+    arkime_drophash_insert(group, group->hash, &item);
     group->changed++;
     ARKIME_UNLOCK(group->lock);
     return 1;
@@ -118,125 +183,84 @@ int arkime_drophash_add (ArkimeDropHashGroup_t *group, int port, const void *key
 /******************************************************************************/
 int arkime_drophash_should_drop (ArkimeDropHashGroup_t *group, int port, void *key, uint32_t current)
 {
-    ArkimeDropHash_t *hash = group->drops[port];
+    ArkimeDropHash_t     *hash = group->hash;
+    const uint32_t        tag = arkime_drophash_hash(port, key, group->keyLen);
+    ArkimeDropHashItem_t *item = arkime_drophash_find(group, hash, port, key, tag);
 
-    uint32_t              h;
-    if (group->keyLen == 4)
-        h = (*(uint32_t *)key) % hash->num;
-    else
-        h = arkime_drophash_hash(key, group->keyLen) % hash->num;
-
-    if (!hash->heads[h])
+    if (!item)
         return 0;
 
-    ArkimeDropHashItem_t *item;
-    for (item = hash->heads[h]; item; item = item->hnext) {
-        if (memcmp(key, item->key, group->keyLen) == 0) {
-
-            // Same time as last time, drop
-            if (likely(item->last == current))
-                return 1;
+    // Same time as last time, drop
+    if (likely(item->last == current))
+        return 1;
 
-            // Check if within the window, drop
-            if (item->last + item->goodFor >= current) {
-                item->last = current;
-                return 1;
-            }
-
-            // Outside the window, need to remove, don't drop
-            arkime_drophash_delete(group, port, key);
-            return 0;
-        }
+    // Check if within the window, drop
+    if (item->last + item->goodFor >= current) {
+        item->last = current;
+        return 1;
     }
+
+    // Outside the window, need to remove, don't drop
+    arkime_drophash_delete(group, port, key);
     return 0;
 }
 /******************************************************************************/
-void arkime_drophash_free(void *ptr)
-{
-    ARKIME_TYPE_FREE(ArkimeDropHashItem_t, ptr);
-}
-/******************************************************************************/
 void arkime_drophash_delete (ArkimeDropHashGroup_t *group, int port, void *key)
 {
-    ArkimeDropHash_t *hash = group->drops[port];
-
-    ArkimeDropHashItem_t *item, *parent = NULL;
-    uint32_t              h;
-    if (group->keyLen == 4)
-        h = (*(uint32_t *)key) % hash->num;
-    else
-        h = arkime_drophash_hash(key, group->keyLen) % hash->num;
-
-    if (!hash->heads[h])
-        return;
+    const uint32_t tag = arkime_drophash_hash(port, key, group->keyLen);
 
     ARKIME_LOCK(group->lock);
-    for (item = hash->heads[h]; item; parent = item, item = item->hnext) {
-        if (memcmp(key, item->key, group->keyLen) == 0) {
-            hash->cnt--;
-            if (parent) {
-                parent->hnext = item->hnext;
-            } else {
-                hash->heads[h] = item->hnext;
-            }
-            DLL_REMOVE(dhg_, group, item);
-            arkime_free_later(item, arkime_drophash_free);
-            group->changed++;
-            break;
-        }
+    ArkimeDropHashItem_t *item = arkime_drophash_find(group, group->hash, port, key, tag);
+    if (item) {
+        item->tag = DROPHASH_TOMBSTONE;
+        group->hash->cnt--;
+        group->changed++;
     }
     ARKIME_UNLOCK(group->lock);
 }
 
 /******************************************************************************/
-void arkime_drophash_init(ArkimeDropHashGroup_t *group, char *file, int keyLen)
-{
-    ARKIME_LOCK_INIT(group->lock);
-    group->keyLen = keyLen;
-    DLL_INIT(dhg_, group);
-
-    if (!file)
-        return;
-
-    group->file = g_strdup(file);
-
-    if (!g_file_test(file, G_FILE_TEST_EXISTS))
-        return;
+// Version 2 records are port, key, last, goodFor and flags packed together
+#define DROPHASH_RECORD_LEN(keyLen) (2 + (keyLen) + 4 + 4 + 2)
+#define DROPHASH_HEADER_LEN         (4 + 1 + 4)
 
+LOCAL void arkime_drophash_load(ArkimeDropHashGroup_t *group)
+{
     struct timespec currentTime;
     clock_gettime(CLOCK_REALTIME_COARSE, &currentTime);
 
-    int      cnt;
-    int      ver;
-    char     fkeyLen;
-    char     key[16];
-    uint32_t last;
-    uint32_t goodFor;
-    uint16_t flags;
-    uint16_t port;
-
-    FILE *fp;
-    if (!(fp = fopen(group->file, "r"))) {
+    int fd = open(group->file, O_RDONLY);
+    if (fd < 0) {
         LOG("ERROR - Couldn't open `%s` to load drophash", group->file);
         return;
     }
 
-    if (!fread(&ver, 4, 1, fp)) {
-        fclose(fp);
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size < DROPHASH_HEADER_LEN) {
+        close(fd);
         LOG("ERROR - `%s` corrupt", group->file);
         return;
     }
 
-    if (ver != 2) {
-        fclose(fp);
-        LOG("ERROR - Unknown save file version %d for `%s`", ver, group->file);
+    uint8_t *data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG("ERROR - Couldn't mmap `%s` to load drophash", group->file);
         return;
     }
+    madvise(data, sb.st_size, MADV_SEQUENTIAL);
 
-    if (!fread(&fkeyLen, 1, 1, fp)) {
-        fclose(fp);
-        LOG("ERROR - `%s` corrupt", group->file);
-        return;
+    int      ver;
+    char     fkeyLen;
+    uint32_t cnt;
+
+    memcpy(&ver, data, 4);
+    fkeyLen = data[4];
+    memcpy(&cnt, data + 5, 4);
+
+    if (ver != 2) {
+        LOG("ERROR - Unknown save file version %d for `%s`", ver, group->file);
+        goto done;
     }
 
     if (fkeyLen == 0)
@@ -244,64 +268,150 @@ void arkime_drophash_init(ArkimeDropHashGroup_t *group, char *file, int keyLen)
     else if (fkeyLen == 1)
         fkeyLen = 4;
 
-    if (fkeyLen != keyLen) {
-        fclose(fp);
-        LOG("ERROR - keyLen mismatch %d != %d", fkeyLen, keyLen);
-        return;
+    if (fkeyLen != group->keyLen) {
+        LOG("ERROR - keyLen mismatch %d != %d", fkeyLen, group->keyLen);
+        goto done;
     }
 
-    if (!fread(&cnt, 4, 1, fp)) {
-        fclose(fp);
+    const int recordLen = DROPHASH_RECORD_LEN(group->keyLen);
+    if ((uint64_t)sb.st_size < DROPHASH_HEADER_LEN + (uint64_t)cnt * recordLen) {
         LOG("ERROR - `%s` corrupt", group->file);
-        return;
+        cnt = (sb.st_size - DROPHASH_HEADER_LEN) / recordLen;
     }
-    for (int i = 0; i < cnt; i++) {
-        int read = 0;
-        read += fread(&port, 2, 1, fp);
-        read += fread(key, keyLen, 1, fp);
-        read += fread(&last, 4, 1, fp);
-        read += fread(&goodFor, 4, 1, fp);
-        read += fread(&flags, 2, 1, fp);
-
-        if (read != 5) {
-            LOG("ERROR - `%s` corrupt", group->file);
-            break;
-        }
+
+    // Size the table once for everything in the file
+    ARKIME_LOCK(group->lock);
+    arkime_drophash_rebuild(group, cnt, currentTime.tv_sec);
+    ARKIME_UNLOCK(group->lock);
+
+    const uint8_t *rec = data + DROPHASH_HEADER_LEN;
+    for (uint32_t i = 0; i < cnt; i++, rec += recordLen) {
+        uint16_t port;
+        uint32_t last;
+        uint32_t goodFor;
+        uint32_t key[9];    // records aren't aligned, the hash reads words
+
+        memcpy(&port, rec, 2);
+        memcpy(key, rec + 2, group->keyLen);
+        memcpy(&last, rec + 2 + group->keyLen, 4);
+        memcpy(&goodFor, rec + 2 + group->keyLen + 4, 4);
 
         if (last + goodFor >= currentTime.tv_sec)
             arkime_drophash_add(group, port, key, last, goodFor);
     }
+
+done:
+    munmap(data, sb.st_size);
+}
+/******************************************************************************/
+void arkime_drophash_init(ArkimeDropHashGroup_t *group, char *file, int keyLen)
+{
+    ARKIME_LOCK_INIT(group->lock);
+    group->keyLen = keyLen;
+
+    ARKIME_LOCK(group->lock);
+    arkime_drophash_rebuild(group, 0, 0);
+    ARKIME_UNLOCK(group->lock);
+
+    if (!file)
+        return;
+
+    group->file = g_strdup(file);
+
+    if (!g_file_test(file, G_FILE_TEST_EXISTS))
+        return;
+
+    arkime_drophash_load(group);
     group->changed = 0; // Reset changes so we don't save right away
-    fclose(fp);
 }
 
 /******************************************************************************/
-void arkime_drophash_save(ArkimeDropHashGroup_t *group)
+LOCAL gpointer arkime_drophash_save_thread(gpointer data)
 {
-    FILE *fp;
-    ArkimeDropHashItem_t *item;
+    ArkimeDropHashGroup_t *group = data;
+    ArkimeDropHash_t      *hash = group->hash;
+    char                   tmpFilename[PATH_MAX];
+    uint8_t                buf[0x10000];
+    int                    pos = 0;
+    uint32_t               cnt = 0;
+    const int              recordLen = DROPHASH_RECORD_LEN(group->keyLen);
+
+    snprintf(tmpFilename, sizeof(tmpFilename), "%s.tmp", group->file);
+
+    int fd = open(tmpFilename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        LOG("ERROR - Couldn't open `%s` to save drophash", tmpFilename);
+        goto done;
+    }
+
+    // Count is filled in at the end
+    int ver = 2;
+    memcpy(buf, &ver, 4);
+    buf[4] = group->keyLen;
+    memcpy(buf + 5, &cnt, 4);
+    pos = DROPHASH_HEADER_LEN;
+
+    for (uint32_t i = 0; i <= hash->mask; i++) {
+        const ArkimeDropHashItem_t *item = &hash->items[i];
+        if (item->tag < 2)
+            continue;
+
+        if (pos + recordLen > (int)sizeof(buf)) {
+            if (write(fd, buf, pos) != pos)
+                goto writeError;
+            pos = 0;
+        }
+
+        memcpy(buf + pos, &item->port, 2);
+        memcpy(buf + pos + 2, item->key, group->keyLen);
+        memcpy(buf + pos + 2 + group->keyLen, &item->last, 4);
+        memcpy(buf + pos + 2 + group->keyLen + 4, &item->goodFor, 4);
+        memcpy(buf + pos + 2 + group->keyLen + 8, &item->flags, 2);
+        pos += recordLen;
+        cnt++;
+    }
+
+    if (pos > 0 && write(fd, buf, pos) != pos)
+        goto writeError;
+
+    if (pwrite(fd, &cnt, 4, 5) != 4)
+        goto writeError;
+
+    close(fd);
+    if (rename(tmpFilename, group->file) != 0)
+        LOG("ERROR - Couldn't rename `%s` to `%s`", tmpFilename, group->file);
+    goto done;
 
+writeError:
+    LOG("ERROR - Couldn't write `%s` - %s", tmpFilename, strerror(errno));
+    close(fd);
+    unlink(tmpFilename);
+
+done:
+    ARKIME_LOCK(group->lock);
+    group->saving = 0;
+    while (group->retired) {
+        ArkimeDropHash_t *old = group->retired;
+        group->retired = old->next;
+        arkime_free_later(old, arkime_drophash_free);
+    }
+    ARKIME_UNLOCK(group->lock);
+    return NULL;
+}
+/******************************************************************************/
+void arkime_drophash_save(ArkimeDropHashGroup_t *group)
+{
     if (!group->file)
         return;
 
-    if (!(fp = fopen(group->file, "w"))) {
-        LOG("ERROR - Couldn't open `%s` to save drophash", group->file);
+    ARKIME_LOCK(group->lock);
+    if (group->saving) {
+        ARKIME_UNLOCK(group->lock);
         return;
     }
-    ARKIME_LOCK(group->lock);
+    group->saving = 1;
     group->changed = 0;
-    int ver = 2;
-
-    fwrite(&ver, 4, 1, fp);
-    fwrite(&group->keyLen, 1, 1, fp);
-    fwrite(&group->dhg_count, 4, 1, fp);
-    DLL_FOREACH(dhg_, group, item) {
-        fwrite(&item->port, 2, 1, fp);
-        fwrite(item->key, group->keyLen, 1, fp);
-        fwrite(&item->last, 4, 1, fp);
-        fwrite(&item->goodFor, 4, 1, fp);
-        fwrite(&item->flags, 2, 1, fp);
-    }
     ARKIME_UNLOCK(group->lock);
-    fclose(fp);
+
+    g_thread_unref(g_thread_new("arkime-drophash", &arkime_drophash_save_thread, group));
 }
@@ -537,6 +537,165 @@ void arkime_field_truncated(ArkimeSession_t *session, const ArkimeFieldInfo_t *i
     arkime_session_add_tag(session, str);
 }
 /******************************************************************************/
+/* Values of fields that every save consumes, so everything but linked session
+ * and nosave fields, are carved from a per session arena instead of being
+ * allocated one at a time.  The first block comes from the arena pool, later
+ * blocks from malloc at twice the size of the last.  Strings handed over with
+ * copy FALSE go on the owned list and are g_free'd with the arena.  Once the
+ * last arena field is freed, by a mid save or the session being freed, the
+ * arena is rewound to its first block.
+ */
+typedef struct arkime_field_arena_block {
+    struct arkime_field_arena_block *next;
+} ArkimeFieldArenaBlock_t;
+
+typedef struct arkime_field_owned {
+    struct arkime_field_owned       *next;
+    gpointer                         mem;
+} ArkimeFieldOwned_t;
+
+typedef struct arkime_field_arena {
+    uint8_t                         *pos;
+    uint8_t                         *end;
+    ArkimeFieldArenaBlock_t         *blocks;   // From malloc, freed on reset
+    ArkimeFieldOwned_t              *owned;
+    uint32_t                         nextSize;
+    uint32_t                         fields;   // Fields with arena set
+} ArkimeFieldArena_t;
+
+#define ARKIME_FIELD_ARENA_HDR       ((sizeof(ArkimeFieldArena_t) + 7) & ~7U)
+#define ARKIME_FIELD_ARENA_MAX_BLOCK (64 * 1024)
+
+#define ARKIME_FIELD_USE_ARENA(info) (!((info)->flags & (ARKIME_FIELD_FLAG_LINKED_SESSIONS | ARKIME_FIELD_FLAG_NOSAVE)))
+
+// Allocate a value node for field, from the arena or the slice allocator
+#define ARKIME_FIELD_TYPE_ALLOC(session, field, type) \
+    ((field)->arena ? (type *)arkime_field_arena_alloc(session, sizeof(type)) : ARKIME_TYPE_ALLOC(type))
+
+/******************************************************************************/
+LOCAL void arkime_field_arena_rewind(ArkimeFieldArena_t *arena)
+{
+    arena->pos = (uint8_t *)arena + ARKIME_FIELD_ARENA_HDR;
+    arena->end = (uint8_t *)arena + ARKIME_FIELD_ARENA_SIZE;
+    arena->nextSize = ARKIME_FIELD_ARENA_SIZE * 2;
+}
+/******************************************************************************/
+LOCAL void *arkime_field_arena_alloc(ArkimeSession_t *session, uint32_t size)
+{
+    ArkimeFieldArena_t *arena = session->arena;
+
+    if (!arena) {
+        arena = session->arena = ARKIME_POOL_ALLOC(ARKIME_POOL_ARENA);
+        arena->blocks = NULL;
+        arena->owned = NULL;
+        arena->fields = 0;
+        arkime_field_arena_rewind(arena);
+    }
+
+    size = (size + 7) & ~7U;
+    if (likely(arena->pos + size <= arena->end)) {
+        void *mem = arena->pos;
+        arena->pos += size;
+        return mem;
+    }
+
+    // Big values get a block to themselves so the current block isn't wasted
+    const uint32_t blockSize = size > arena->nextSize / 4 ? size : arena->nextSize;
+    ArkimeFieldArenaBlock_t *block = malloc(sizeof(ArkimeFieldArenaBlock_t) + blockSize);
+    if (!block)
+        LOGEXIT("ERROR - Couldn't allocate field arena block of %u", blockSize);
+    block->next = arena->blocks;
+    arena->blocks = block;
+
+    uint8_t *mem = (uint8_t *)(block + 1);
+    if (blockSize == arena->nextSize) {
+        arena->pos = mem + size;
+        arena->end = mem + blockSize;
+        if (arena->nextSize < ARKIME_FIELD_ARENA_MAX_BLOCK)
+            arena->nextSize *= 2;
+    }
+    return mem;
+}
+/******************************************************************************/
+// Give back mem if it was the last thing allocated
+LOCAL void arkime_field_arena_undo(ArkimeSession_t *session, void *mem, uint32_t size)
+{
+    if ((uint8_t *)mem + ((size + 7) & ~7U) == session->arena->pos)
+        session->arena->pos = mem;
+}
+/******************************************************************************/
+LOCAL void arkime_field_arena_own(ArkimeSession_t *session, gpointer mem)
+{
+    ArkimeFieldOwned_t *owned = arkime_field_arena_alloc(session, sizeof(ArkimeFieldOwned_t));
+    owned->mem = mem;
+    owned->next = session->arena->owned;
+    session->arena->owned = owned;
+}
+/******************************************************************************/
+LOCAL void arkime_field_arena_reset(ArkimeFieldArena_t *arena)
+{
+    ArkimeFieldOwned_t *owned;
+    for (owned = arena->owned; owned; owned = owned->next) {
+        g_free(owned->mem);
+    }
+    arena->owned = NULL;
+
+    while (arena->blocks) {
+        ArkimeFieldArenaBlock_t *block = arena->blocks;
+        arena->blocks = block->next;
+        free(block);
+    }
+
+    arkime_field_arena_rewind(arena);
+}
+/******************************************************************************/
+LOCAL ArkimeField_t *arkime_field_new(ArkimeSession_t *session, int pos, const ArkimeFieldInfo_t *info)
+{
+    ArkimeField_t *field = ARKIME_POOL_ALLOC(ARKIME_POOL_FIELD);
+    session->fields[pos] = field;
+    field->arena = ARKIME_FIELD_USE_ARENA(info);
+    if (field->arena) {
+        if (!session->arena)
+            arkime_field_arena_alloc(session, 0);
+        session->arena->fields++;
+    }
+    return field;
+}
+/******************************************************************************/
+/* The string value to store for field, copied if asked, otherwise the field
+ * takes ownership of string.
+ */
+LOCAL char *arkime_field_string_keep(ArkimeSession_t *session, const ArkimeField_t *field, const char *string, int len, gboolean copy)
+{
+    if (!field->arena)
+        return copy ? g_strndup(string, len) : (char *)string;
+
+    if (!copy) {
+        arkime_field_arena_own(session, (gpointer)string);
+        return (char *)string;
+    }
+
+    // Same as g_strndup, stops at a NUL and zero fills to len
+    char *str = arkime_field_arena_alloc(session, len + 1);
+    const char *nul = memchr(string, 0, len);
+    const int n = nul ? nul - string : len;
+    memcpy(str, string, n);
+    memset(str + n, 0, len + 1 - n);
+    return str;
+}
+/******************************************************************************/
+/* Replace a string value of field pos in place, the field takes ownership of
+ * newstr.  For plugins that rewrite values.
+ */
+void arkime_field_string_swap(ArkimeSession_t *session, int pos, char **value, char *newstr)
+{
+    if (session->fields[pos]->arena)
+        arkime_field_arena_own(session, newstr);
+    else
+        g_free(*value);
+    *value = newstr;
+}
+/******************************************************************************/
 const char *arkime_field_string_add(int pos, ArkimeSession_t *session, const char *string, int len, gboolean copy)
 {
     ArkimeField_t                    *field;
@@ -548,8 +707,7 @@ const char *arkime_field_string_add(int pos, ArkimeSession_t *session, const cha
         return NULL;
 
     if (!session->fields[pos]) {
-        field = ARKIME_TYPE_ALLOC(ArkimeField_t);
-        session->fields[pos] = field;
+        field = arkime_field_new(session, pos, info);
         if (len == -1)
             len = strlen(string);
 
@@ -559,21 +717,20 @@ const char *arkime_field_string_add(int pos, ArkimeSession_t *session, const cha
         }
 
         field->jsonSize = 6 + info->dbFieldLen + 2 * len;
-        if (copy)
-            string = g_strndup(string, len);
+        string = arkime_field_string_keep(session, field, string, len, copy);
         switch (info->type) {
         case ARKIME_FIELD_TYPE_STR:
             field->str = (char *)string;
             goto added;
         case ARKIME_FIELD_TYPE_STR_ARRAY:
-            field->sarray = g_ptr_array_new_with_free_func(g_free);
+            field->sarray = field->arena ? g_ptr_array_new() : g_ptr_array_new_with_free_func(g_free);
             g_ptr_array_add(field->sarray, (char *)string);
             goto added;
         case ARKIME_FIELD_TYPE_STR_HASH:
-            hash = ARKIME_TYPE_ALLOC(ArkimeStringHashStd_t);
+            hash = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeStringHashStd_t);
             HASH_INIT(s_, *hash, arkime_string_hash, arkime_string_ncmp);
             field->shash = hash;
-            hstring = ARKIME_TYPE_ALLOC(ArkimeString_t);
+            hstring = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeString_t);
             hstring->str = (char *)string;
             hstring->len = len;
             hstring->utf8 = 0;
@@ -581,7 +738,7 @@ const char *arkime_field_string_add(int pos, ArkimeSession_t *session, const cha
             HASH_ADD(s_, *hash, hstring->str, hstring);
             goto added;
         case ARKIME_FIELD_TYPE_STR_GHASH:
-            field->ghash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+            field->ghash = g_hash_table_new_full(g_str_hash, g_str_equal, field->arena ? NULL : g_free, NULL);
             g_hash_table_add(field->ghash, (gpointer)string);
             goto added;
         default:
@@ -605,14 +762,13 @@ const char *arkime_field_string_add(int pos, ArkimeSession_t *session, const cha
 
     switch (info->type) {
     case ARKIME_FIELD_TYPE_STR:
-        if (copy)
-            string = g_strndup(string, len);
-        g_free(field->str);
+        string = arkime_field_string_keep(session, field, string, len, copy);
+        if (!field->arena)
+            g_free(field->str);
         field->str = (char *)string;
         goto added;
     case ARKIME_FIELD_TYPE_STR_ARRAY:
-        if (copy)
-            string = g_strndup(string, len);
+        string = arkime_field_string_keep(session, field, string, len, copy);
         g_ptr_array_add(field->sarray, (char *)string);
         goto added;
     case ARKIME_FIELD_TYPE_STR_HASH:
@@ -622,9 +778,8 @@ const char *arkime_field_string_add(int pos, ArkimeSession_t *session, const cha
             field->jsonSize -= (6 + 2 * len);
             return NULL;
         }
-        hstring = ARKIME_TYPE_ALLOC(ArkimeString_t);
-        if (copy)
-            string = g_strndup(string, len);
+        hstring = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeString_t);
+        string = arkime_field_string_keep(session, field, string, len, copy);
         hstring->str = (char *)string;
         hstring->len = len;
         hstring->utf8 = 0;
@@ -632,13 +787,22 @@ const char *arkime_field_string_add(int pos, ArkimeSession_t *session, const cha
         HASH_ADD(s_, *(field->shash), hstring->str, hstring);
         goto added;
     case ARKIME_FIELD_TYPE_STR_GHASH:
-        if (copy)
-            string = g_strndup(string, len);
-        if (g_hash_table_lookup(field->ghash, string)) {
-            field->jsonSize -= (6 + 2 * len);
-            if (copy)
-                g_free((gpointer)string);
-            return NULL;
+        if (!copy) {
+            if (g_hash_table_lookup(field->ghash, string)) {
+                field->jsonSize -= (6 + 2 * len);
+                return NULL;
+            }
+            string = arkime_field_string_keep(session, field, string, len, copy);
+        } else {
+            string = arkime_field_string_keep(session, field, string, len, copy);
+            if (g_hash_table_lookup(field->ghash, string)) {
+                field->jsonSize -= (6 + 2 * len);
+                if (field->arena)
+                    arkime_field_arena_undo(session, (gpointer)string, len + 1);
+                else
+                    g_free((gpointer)string);
+                return NULL;
+            }
         }
         g_hash_table_add(field->ghash, (gpointer)string);
         goto added;
@@ -721,8 +885,7 @@ const char *arkime_field_string_uw_add(int pos, ArkimeSession_t *session, const
         return NULL;
 
     if (!session->fields[pos]) {
-        field = ARKIME_TYPE_ALLOC(ArkimeField_t);
-        session->fields[pos] = field;
+        field = arkime_field_new(session, pos, info);
         if (len == -1)
             len = strlen(string);
         if (len > ARKIME_FIELD_MAX_ELEMENT_SIZE) {
@@ -730,14 +893,13 @@ const char *arkime_field_string_uw_add(int pos, ArkimeSession_t *session, const
             arkime_field_truncated(session, info);
         }
         field->jsonSize = 6 + info->dbFieldLen + 2 * len;
-        if (copy)
-            string = g_strndup(string, len);
+        string = arkime_field_string_keep(session, field, string, len, copy);
         switch (info->type) {
         case ARKIME_FIELD_TYPE_STR_HASH:
-            hash = ARKIME_TYPE_ALLOC(ArkimeStringHashStd_t);
+            hash = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeStringHashStd_t);
             HASH_INIT(s_, *hash, arkime_string_hash, arkime_string_ncmp);
             field->shash = hash;
-            hstring = ARKIME_TYPE_ALLOC(ArkimeString_t);
+            hstring = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeString_t);
             hstring->str = (char *)string;
             hstring->len = len;
             hstring->utf8 = 0;
@@ -773,9 +935,8 @@ const char *arkime_field_string_uw_add(int pos, ArkimeSession_t *session, const
             field->jsonSize -= (6 + 2 * len);
             return NULL;
         }
-        hstring = ARKIME_TYPE_ALLOC(ArkimeString_t);
-        if (copy)
-            string = g_strndup(string, len);
+        hstring = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeString_t);
+        string = arkime_field_string_keep(session, field, string, len, copy);
         hstring->str = (char *)string;
         hstring->len = len;
         hstring->utf8 = 0;
@@ -800,8 +961,7 @@ gboolean arkime_field_int_add(int pos, ArkimeSession_t *session, int i)
         return FALSE;
 
     if (!session->fields[pos]) {
-        field = ARKIME_TYPE_ALLOC(ArkimeField_t);
-        session->fields[pos] = field;
+        field = arkime_field_new(session, pos, info);
         field->jsonSize = 13 + info->dbFieldLen;
         switch (info->type) {
         case ARKIME_FIELD_TYPE_INT:
@@ -812,10 +972,10 @@ gboolean arkime_field_int_add(int pos, ArkimeSession_t *session, int i)
             g_array_append_val(field->iarray, i);
             goto added;
         case ARKIME_FIELD_TYPE_INT_HASH:
-            hash = ARKIME_TYPE_ALLOC(ArkimeIntHashStd_t);
+            hash = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeIntHashStd_t);
             HASH_INIT(i_, *hash, arkime_int_hash, arkime_int_cmp);
             field->ihash = hash;
-            hint = ARKIME_TYPE_ALLOC(ArkimeInt_t);
+            hint = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeInt_t);
             HASH_ADD(i_, *hash, (void *)(long)i, hint);
             goto added;
         case ARKIME_FIELD_TYPE_INT_GHASH:
@@ -842,7 +1002,7 @@ gboolean arkime_field_int_add(int pos, ArkimeSession_t *session, int i)
             field->jsonSize -= 13;
             return FALSE;
         }
-        hint = ARKIME_TYPE_ALLOC(ArkimeInt_t);
+        hint = ARKIME_FIELD_TYPE_ALLOC(session, field, ArkimeInt_t);
         HASH_ADD(i_, *(field->ihash), (void *)(long)i, hint);
         goto added;
     case ARKIME_FIELD_TYPE_INT_GHASH:
@@ -872,8 +1032,7 @@ gboolean arkime_field_float_add(int pos, ArkimeSession_t *session, float f)
         return FALSE;
 
     if (!session->fields[pos]) {
-        field = ARKIME_TYPE_ALLOC(ArkimeField_t);
-        session->fields[pos] = field;
+        field = arkime_field_new(session, pos, info);
         field->jsonSize = 15 + info->dbFieldLen;
         switch (info->type) {
         case ARKIME_FIELD_TYPE_FLOAT:
@@ -943,30 +1102,45 @@ guint arkime_field_ip_hash (gconstpointer v)
 }
 
 /******************************************************************************/
-void *arkime_field_parse_ip(const char *str) {
-
-    struct in6_addr *v = g_malloc(sizeof(struct in6_addr));
-
+LOCAL gboolean arkime_field_parse_ip_to(const char *str, struct in6_addr *v)
+{
     if (strchr(str, '.')) {
         struct in_addr addr;
-        if (inet_aton(str, &addr) == 0) {
-            g_free(v);
-            return NULL;
-        }
+        if (inet_aton(str, &addr) == 0)
+            return FALSE;
 
         memset(v->s6_addr, 0, 8);
         ((uint32_t *)v->s6_addr)[2] = htonl(0xffff);
         ((uint32_t *)v->s6_addr)[3] = addr.s_addr;
     } else {
-        if (inet_pton(AF_INET6, str, v) == 0) {
-            g_free(v);
-            return NULL;
-        }
+        if (inet_pton(AF_INET6, str, v) == 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+/******************************************************************************/
+void *arkime_field_parse_ip(const char *str) {
+
+    struct in6_addr *v = g_malloc(sizeof(struct in6_addr));
+
+    if (!arkime_field_parse_ip_to(str, v)) {
+        g_free(v);
+        return NULL;
     }
 
     return v;
 }
 /******************************************************************************/
+// Space for an ip value of field pos, from the arena when the field uses it
+LOCAL struct in6_addr *arkime_field_ip_alloc(ArkimeSession_t *session, int pos, const ArkimeFieldInfo_t *info)
+{
+    const int arena = session->fields[pos] ? session->fields[pos]->arena : ARKIME_FIELD_USE_ARENA(info);
+    if (arena)
+        return arkime_field_arena_alloc(session, sizeof(struct in6_addr));
+    return g_malloc(sizeof(struct in6_addr));
+}
+/******************************************************************************/
 gboolean arkime_field_ip_add_str(int pos, ArkimeSession_t *session, char *str)
 {
     ArkimeField_t                    *field;
@@ -976,22 +1150,24 @@ gboolean arkime_field_ip_add_str(int pos, ArkimeSession_t *session, char *str)
         return FALSE;
 
     int len = strlen(str);
-    struct in6_addr *v = arkime_field_parse_ip(str);
+    struct in6_addr ip;
 
-    if (!v) {
+    if (!arkime_field_parse_ip_to(str, &ip)) {
         return FALSE;
     }
 
+    struct in6_addr *v = arkime_field_ip_alloc(session, pos, info);
+    *v = ip;
+
     if (!session->fields[pos]) {
-        field = ARKIME_TYPE_ALLOC(ArkimeField_t);
-        session->fields[pos] = field;
+        field = arkime_field_new(session, pos, info);
         field->jsonSize = 3 + info->dbFieldLen + len + 100;
         switch (info->type) {
         case ARKIME_FIELD_TYPE_IP:
             field->ip = v;
             goto added;
         case ARKIME_FIELD_TYPE_IP_GHASH:
-            field->ghash = g_hash_table_new_full(arkime_field_ip_hash, arkime_field_ip_equal, g_free, NULL);
+            field->ghash = g_hash_table_new_full(arkime_field_ip_hash, arkime_field_ip_equal, field->arena ? NULL : g_free, NULL);
             g_hash_table_add(field->ghash, v);
             goto added;
         default:
@@ -1003,7 +1179,8 @@ gboolean arkime_field_ip_add_str(int pos, ArkimeSession_t *session, char *str)
     field->jsonSize += (3 + len + 100);
     switch (info->type) {
     case ARKIME_FIELD_TYPE_IP:
-        g_free(field->ip);
+        if (!field->arena)
+            g_free(field->ip);
         field->ip = v;
         goto added;
     case ARKIME_FIELD_TYPE_IP_GHASH:
@@ -1033,22 +1210,21 @@ gboolean arkime_field_ip4_add(int pos, ArkimeSession_t *session, uint32_t i)
     if (info->flags & ARKIME_FIELD_FLAG_DISABLED || pos >= session->maxFields)
         return FALSE;
 
-    struct in6_addr *v = g_malloc(sizeof(struct in6_addr));
+    struct in6_addr *v = arkime_field_ip_alloc(session, pos, info);
 
     memset(v->s6_addr, 0, 8);
     ((uint32_t *)v->s6_addr)[2] = htonl(0xffff);
     ((uint32_t *)v->s6_addr)[3] = i;
 
     if (!session->fields[pos]) {
-        field = ARKIME_TYPE_ALLOC(ArkimeField_t);
-        session->fields[pos] = field;
+        field = arkime_field_new(session, pos, info);
         field->jsonSize = 3 + info->dbFieldLen + 15 + 100;
         switch (info->type) {
         case ARKIME_FIELD_TYPE_IP:
             field->ip = v;
             goto added;
         case ARKIME_FIELD_TYPE_IP_GHASH:
-            field->ghash = g_hash_table_new_full(arkime_field_ip_hash, arkime_field_ip_equal, g_free, NULL);
+            field->ghash = g_hash_table_new_full(arkime_field_ip_hash, arkime_field_ip_equal, field->arena ? NULL : g_free, NULL);
             g_hash_table_add(field->ghash, v);
             goto added;
         default:
@@ -1061,7 +1237,8 @@ gboolean arkime_field_ip4_add(int pos, ArkimeSession_t *session, uint32_t i)
     field->jsonSize += (3 + 15 + 100);
     switch (info->type) {
     case ARKIME_FIELD_TYPE_IP:
-        g_free(field->ip);
+        if (!field->arena)
+            g_free(field->ip);
         field->ip = v;
         goto added;
     case ARKIME_FIELD_TYPE_IP_GHASH:
@@ -1092,18 +1269,18 @@ gboolean arkime_field_ip6_add(int pos, ArkimeSession_t *session, const uint8_t *
     if (info->flags & ARKIME_FIELD_FLAG_DISABLED || pos >= session->maxFields)
         return FALSE;
 
-    struct in6_addr *v = g_memdup(val, sizeof(struct in6_addr));
+    struct in6_addr *v = arkime_field_ip_alloc(session, pos, info);
+    memcpy(v, val, sizeof(struct in6_addr));
 
     if (!session->fields[pos]) {
-        field = ARKIME_TYPE_ALLOC(ArkimeField_t);
-        session->fields[pos] = field;
+        field = arkime_field_new(session, pos, info);
         field->jsonSize = 3 + info->dbFieldLen + 30 + 100;
         switch (info->type) {
         case ARKIME_FIELD_TYPE_IP:
             field->ip = v;
             goto added;
         case ARKIME_FIELD_TYPE_IP_GHASH:
-            field->ghash = g_hash_table_new_full(arkime_field_ip_hash, arkime_field_ip_equal, g_free, NULL);
+            field->ghash = g_hash_table_new_full(arkime_field_ip_hash, arkime_field_ip_equal, field->arena ? NULL : g_free, NULL);
             g_hash_table_add(field->ghash, v);
             goto added;
         default:
@@ -1116,7 +1293,8 @@ gboolean arkime_field_ip6_add(int pos, ArkimeSession_t *session, const uint8_t *
     field->jsonSize += (3 + 30 + 100);
     switch (info->type) {
     case ARKIME_FIELD_TYPE_IP:
-        g_free(field->ip);
+        if (!field->arena)
+            g_free(field->ip);
         field->ip = v;
         goto added;
     case ARKIME_FIELD_TYPE_IP_GHASH:
@@ -1241,8 +1419,7 @@ gboolean arkime_field_certsinfo_add(int pos, ArkimeSession_t *session, ArkimeCer
     ArkimeCertsInfo_t          *hci;
 
     if (!session->fields[pos]) {
-        field = ARKIME_TYPE_ALLOC(ArkimeField_t);
-        session->fields[pos] = field;
+        field = arkime_field_new(session, pos, config.fields[pos]);
         field->jsonSize = 3 + config.fields[pos]->dbFieldLen + 120 + len;
         switch (config.fields[pos]->type) {
         case ARKIME_FIELD_TYPE_CERTSINFO:
@@ -1286,9 +1463,9 @@ void arkime_field_macoui_add(ArkimeSession_t *session, int macField, int ouiFiel
         arkime_db_oui_lookup(ouiField, session, mac);
 }
 /******************************************************************************/
-void arkime_field_free(ArkimeSession_t *session)
+void arkime_field_free_pos(ArkimeSession_t *session, int pos)
 {
-    int                       pos;
+    ArkimeField_t            *field = session->fields[pos];
     ArkimeString_t           *hstring;
     ArkimeStringHashStd_t    *shash;
     ArkimeInt_t              *hint;
@@ -1296,65 +1473,85 @@ void arkime_field_free(ArkimeSession_t *session)
     ArkimeCertsInfo_t        *hci;
     ArkimeCertsInfoHashStd_t *cihash;
 
-    for (pos = 0; pos < session->maxFields; pos++) {
-        ArkimeField_t        *field;
-
-        if (!(field = session->fields[pos]))
-            continue;
-
-        switch (config.fields[pos]->type) {
-        case ARKIME_FIELD_TYPE_STR:
+    switch (config.fields[pos]->type) {
+    case ARKIME_FIELD_TYPE_STR:
+        if (!field->arena)
             g_free(field->str);
+        break;
+    case ARKIME_FIELD_TYPE_STR_ARRAY:
+        g_ptr_array_free(field->sarray, TRUE);
+        break;
+    case ARKIME_FIELD_TYPE_STR_HASH:
+        if (field->arena)
             break;
-        case ARKIME_FIELD_TYPE_STR_ARRAY:
-            g_ptr_array_free(field->sarray, TRUE);
-            break;
-        case ARKIME_FIELD_TYPE_STR_HASH:
-            shash = session->fields[pos]->shash;
-            HASH_FORALL_POP_HEAD2(s_, *shash, hstring) {
-                g_free(hstring->str);
-                ARKIME_TYPE_FREE(ArkimeString_t, hstring);
-            }
-            ARKIME_TYPE_FREE(ArkimeStringHashStd_t, shash);
-            break;
-        case ARKIME_FIELD_TYPE_INT:
-            break;
-        case ARKIME_FIELD_TYPE_INT_ARRAY:
-            g_array_free(field->iarray, TRUE);
-            break;
-        case ARKIME_FIELD_TYPE_INT_HASH:
-            ihash = session->fields[pos]->ihash;
-            HASH_FORALL_POP_HEAD2(i_, *ihash, hint) {
-                ARKIME_TYPE_FREE(ArkimeInt_t, hint);
-            }
-            ARKIME_TYPE_FREE(ArkimeIntHashStd_t, ihash);
-            break;
-        case ARKIME_FIELD_TYPE_FLOAT:
-            break;
-        case ARKIME_FIELD_TYPE_FLOAT_ARRAY:
-            g_array_free(field->farray, TRUE);
-            break;
-        case ARKIME_FIELD_TYPE_IP:
-            g_free(session->fields[pos]->ip);
-            break;
-        case ARKIME_FIELD_TYPE_IP_GHASH:
-        case ARKIME_FIELD_TYPE_INT_GHASH:
-        case ARKIME_FIELD_TYPE_STR_GHASH:
-        case ARKIME_FIELD_TYPE_FLOAT_GHASH:
-            g_hash_table_destroy(session->fields[pos]->ghash);
-            break;
-        case ARKIME_FIELD_TYPE_CERTSINFO:
-            cihash = session->fields[pos]->cihash;
-            HASH_FORALL_POP_HEAD2(t_, *cihash, hci) {
-                arkime_field_certsinfo_free(hci);
-            }
-            ARKIME_TYPE_FREE(ArkimeCertsInfoHashStd_t, cihash);
+        shash = field->shash;
+        HASH_FORALL_POP_HEAD2(s_, *shash, hstring) {
+            g_free(hstring->str);
+            ARKIME_TYPE_FREE(ArkimeString_t, hstring);
+        }
+        ARKIME_TYPE_FREE(ArkimeStringHashStd_t, shash);
+        break;
+    case ARKIME_FIELD_TYPE_INT:
+        break;
+    case ARKIME_FIELD_TYPE_INT_ARRAY:
+        g_array_free(field->iarray, TRUE);
+        break;
+    case ARKIME_FIELD_TYPE_INT_HASH:
+        if (field->arena)
             break;
-        } // switch
-        ARKIME_TYPE_FREE(ArkimeField_t, session->fields[pos]);
+        ihash = field->ihash;
+        HASH_FORALL_POP_HEAD2(i_, *ihash, hint) {
+            ARKIME_TYPE_FREE(ArkimeInt_t, hint);
+        }
+        ARKIME_TYPE_FREE(ArkimeIntHashStd_t, ihash);
+        break;
+    case ARKIME_FIELD_TYPE_FLOAT:
+        break;
+    case ARKIME_FIELD_TYPE_FLOAT_ARRAY:
+        g_array_free(field->farray, TRUE);
+        break;
+    case ARKIME_FIELD_TYPE_IP:
+        if (!field->arena)
+            g_free(field->ip);
+        break;
+    case ARKIME_FIELD_TYPE_IP_GHASH:
+    case ARKIME_FIELD_TYPE_INT_GHASH:
+    case ARKIME_FIELD_TYPE_STR_GHASH:
+    case ARKIME_FIELD_TYPE_FLOAT_GHASH:
+        g_hash_table_destroy(field->ghash);
+        break;
+    case ARKIME_FIELD_TYPE_CERTSINFO:
+        cihash = field->cihash;
+        HASH_FORALL_POP_HEAD2(t_, *cihash, hci) {
+            arkime_field_certsinfo_free(hci);
+        }
+        ARKIME_TYPE_FREE(ArkimeCertsInfoHashStd_t, cihash);
+        break;
+    } // switch
+
+    if (field->arena && --session->arena->fields == 0)
+        arkime_field_arena_reset(session->arena);
+
+    ARKIME_POOL_FREE(ARKIME_POOL_FIELD, field);
+    session->fields[pos] = 0;
+}
+/******************************************************************************/
+void arkime_field_free(ArkimeSession_t *session)
+{
+    int pos;
+
+    for (pos = 0; pos < session->maxFields; pos++) {
+        if (session->fields[pos])
+            arkime_field_free_pos(session, pos);
     }
     ARKIME_SIZE_FREE(fields, session->fields);
     session->fields = 0;
+
+    if (session->arena) {
+        arkime_field_arena_reset(session->arena);
+        ARKIME_POOL_FREE(ARKIME_POOL_ARENA, session->arena);
+        session->arena = NULL;
+    }
 }
 /******************************************************************************/
 void arkime_field_certsinfo_free (ArkimeCertsInfo_t *certs)
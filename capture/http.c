@@ -113,13 +113,34 @@ struct arkimehttpserver_t {
     int                      multiRunning;
 
     ArkimeHttpHeader_cb      headerCb;
+
+    // Easy handles from finished requests, they keep the options that don't change
+    ARKIME_LOCK_EXTERN(easyPool);
+    CURL                   **easyPool;
+    int                      easyPoolCnt;
+    int                      easyPoolMax;
+
+    // Default headers, and default headers plus Content-Encoding, for requests without their own headers
+    struct curl_slist       *defaultList;
+    struct curl_slist       *defaultGzipList;
+
+    int                      compressLevel;
+    uint64_t                 compressUS;
+    uint64_t                 sendUS;
 };
 
-LOCAL z_stream z_strm;
-LOCAL ARKIME_LOCK_DEFINE(z_strm);
+// Each thread that schedules requests has its own compressor, so no locking
+typedef struct {
+    z_stream                 z_strm;
+    int                      level;
+    char                     inited;
+} ArkimeHttpCompress_t;
+
+LOCAL __thread ArkimeHttpCompress_t httpCompress;
 
 LOCAL gboolean arkime_http_send_timer_callback(gpointer);
 LOCAL void arkime_http_add_request(ArkimeHttpServer_t *server, ArkimeHttpRequest_t *request, int priority);
+LOCAL void arkime_http_easy_put(ArkimeHttpServer_t *server, CURL *easy);
 
 /******************************************************************************/
 LOCAL int arkime_http_conn_cmp(const void *keyv, const ArkimeHttpConn_t *conn)
@@ -366,6 +387,10 @@ LOCAL void arkime_http_curlm_check_multi_info(ArkimeHttpServer_t *server)
             long   responseCode;
             curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &responseCode);
 
+            double sendTime;
+            curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME, &sendTime);
+            server->sendUS += sendTime * 1000000;
+
             if (config.logESRequests || (server->printErrors && responseCode / 100 != 2)) {
                 double totalTime;
                 double connectTime;
@@ -430,7 +455,7 @@ LOCAL void arkime_http_curlm_check_multi_info(ArkimeHttpServer_t *server)
                 ARKIME_TYPE_FREE(ArkimeHttpRequest_t, request);
 
                 curl_multi_remove_handle(server->multi, easy);
-                curl_easy_cleanup(easy);
+                arkime_http_easy_put(server, easy);
                 ARKIME_LOCK(requests);
                 server->outstanding--;
                 ARKIME_UNLOCK(requests);
@@ -701,6 +726,103 @@ int arkime_http_curl_close_callback(void *snameV, curl_socket_t fd)
     return 0;
 }
 /******************************************************************************/
+/* Get an easy handle for the server, reusing one from a finished request if
+ * possible. Only the per request options are set by the caller.
+ */
+LOCAL CURL *arkime_http_easy_get(ArkimeHttpServer_t *server)
+{
+    CURL *easy = NULL;
+
+    ARKIME_LOCK(server->easyPool);
+    if (server->easyPoolCnt > 0)
+        easy = server->easyPool[--server->easyPoolCnt];
+    ARKIME_UNLOCK(server->easyPool);
+
+    if (easy)
+        return easy;
+
+    easy = curl_easy_init();
+    if (config.debug >= 2) {
+        curl_easy_setopt(easy, CURLOPT_VERBOSE, 1);
+    }
+
+    if (config.insecure) {
+        curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 0L);
+        curl_easy_setopt(easy, CURLOPT_SSL_VERIFYHOST, 0L);
+    }
+
+    if (config.caTrustFile) {
+        curl_easy_setopt(easy, CURLOPT_CAINFO, config.caTrustFile);
+    }
+
+    // Send client certs if so configured
+    if(server->clientAuth) {
+        curl_easy_setopt(easy, CURLOPT_SSLCERT, server->clientAuth->clientCert);
+        curl_easy_setopt(easy, CURLOPT_SSLKEY, server->clientAuth->clientKey);
+        if(server->clientAuth->clientKeyPass) {
+            curl_easy_setopt(easy, CURLOPT_SSLKEYPASSWD, server->clientAuth->clientKeyPass);
+        }
+    }
+
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, arkime_http_curl_write_callback);
+    curl_easy_setopt(easy, CURLOPT_OPENSOCKETFUNCTION, arkime_http_curl_open_callback);
+    curl_easy_setopt(easy, CURLOPT_CLOSESOCKETFUNCTION, arkime_http_curl_close_callback);
+    curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, ""); // https://curl.haxx.se/libcurl/c/CURLOPT_ACCEPT_ENCODING.html
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_USERAGENT, "arkime");
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT, 120L);
+
+    return easy;
+}
+/******************************************************************************/
+LOCAL void arkime_http_easy_put(ArkimeHttpServer_t *server, CURL *easy)
+{
+    ARKIME_LOCK(server->easyPool);
+    if (server->easyPoolCnt < server->easyPoolMax) {
+        server->easyPool[server->easyPoolCnt++] = easy;
+        easy = NULL;
+    }
+    ARKIME_UNLOCK(server->easyPool);
+
+    if (easy)
+        curl_easy_cleanup(easy);
+}
+/******************************************************************************/
+/* Gzip data into buf using this thread's compressor, returns the compressed
+ * length or 0 if it didn't fit in data_len.
+ */
+LOCAL uint32_t arkime_http_compress(ArkimeHttpServer_t *server, const char *data, uint32_t data_len, char *buf)
+{
+    ArkimeHttpCompress_t *c = &httpCompress;
+    struct timespec       start, end;
+    uint32_t              outlen = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!c->inited) {
+        c->level = server->compressLevel;
+        deflateInit2(&c->z_strm, c->level, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY);
+        c->inited = 1;
+    } else if (c->level != server->compressLevel) {
+        c->level = server->compressLevel;
+        deflateParams(&c->z_strm, c->level, Z_DEFAULT_STRATEGY);
+    }
+
+    c->z_strm.avail_in   = data_len;
+    c->z_strm.next_in    = (uint8_t *)data;
+    c->z_strm.avail_out  = data_len;
+    c->z_strm.next_out   = (uint8_t *)buf;
+    if (deflate(&c->z_strm, Z_FINISH) == Z_STREAM_END)
+        outlen = data_len - c->z_strm.avail_out;
+    deflateReset(&c->z_strm);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    __sync_add_and_fetch(&server->compressUS, (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+
+    return outlen;
+}
+/******************************************************************************/
 LOCAL gboolean arkime_http_send_timer_callback(gpointer UNUSED(unused))
 {
     while (1) {
@@ -767,13 +889,6 @@ gboolean arkime_http_schedule(void *serverV, const char *method, const char *key
 
     ArkimeHttpRequest_t       *request = ARKIME_TYPE_ALLOC0(ArkimeHttpRequest_t);
 
-    if (headers) {
-        int i;
-        for (i = 0; headers[i]; i++) {
-            request->headerList = curl_slist_append(request->headerList, headers[i]);
-        }
-    }
-
     request->priority = priority;
 
     if (priority == ARKIME_HTTP_PRIORITY_DROPABLE)
@@ -781,35 +896,38 @@ gboolean arkime_http_schedule(void *serverV, const char *method, const char *key
     else
         request->retries = server->maxRetries;
 
-    if (server->defaultHeaders) {
-        int i;
-        for (i = 0; server->defaultHeaders[i]; i++) {
-            request->headerList = curl_slist_append(request->headerList, server->defaultHeaders[i]);
-        }
-    }
-
     // Do we need to compress item
+    gboolean gzipped = FALSE;
     if (server->compress && data && data_len > 860) {
-        char            *buf = arkime_http_get_buffer(data_len);
-        int              ret;
-
-        ARKIME_LOCK(z_strm);
-        z_strm.avail_in   = data_len;
-        z_strm.next_in    = (uint8_t *)data;
-        z_strm.avail_out  = data_len;
-        z_strm.next_out   = (uint8_t *)buf;
-        ret = deflate(&z_strm, Z_FINISH);
-        if (ret == Z_STREAM_END) {
-            request->headerList = curl_slist_append(request->headerList, "Content-Encoding: gzip");
+        char *buf = arkime_http_get_buffer(data_len);
+        uint32_t outlen = arkime_http_compress(server, data, data_len, buf);
+
+        if (outlen) {
             ARKIME_SIZE_FREE(buffer, data);
-            data_len = data_len - z_strm.avail_out;
+            data_len = outlen;
             data     = buf;
+            gzipped  = TRUE;
         } else {
             ARKIME_SIZE_FREE(buffer, buf);
         }
+    }
 
-        deflateReset(&z_strm);
-        ARKIME_UNLOCK(z_strm);
+    // Only build a header list when the request has its own headers
+    struct curl_slist *headerList = gzipped ? server->defaultGzipList : server->defaultList;
+    if (headers) {
+        int i;
+        for (i = 0; headers[i]; i++) {
+            request->headerList = curl_slist_append(request->headerList, headers[i]);
+        }
+        if (server->defaultHeaders) {
+            for (i = 0; server->defaultHeaders[i]; i++) {
+                request->headerList = curl_slist_append(request->headerList, server->defaultHeaders[i]);
+            }
+        }
+        if (gzipped) {
+            request->headerList = curl_slist_append(request->headerList, "Content-Encoding: gzip");
+        }
+        headerList = request->headerList;
     }
 
     request->server     = server;
@@ -818,41 +936,11 @@ gboolean arkime_http_schedule(void *serverV, const char *method, const char *key
     request->dataOut    = data;
     request->dataOutLen = data_len;
 
-    request->easy = curl_easy_init();
-    if (config.debug >= 2) {
-        curl_easy_setopt(request->easy, CURLOPT_VERBOSE, 1);
-    }
-
-    if (config.insecure) {
-        curl_easy_setopt(request->easy, CURLOPT_SSL_VERIFYPEER, 0L);
-        curl_easy_setopt(request->easy, CURLOPT_SSL_VERIFYHOST, 0L);
-    }
-
-    if (config.caTrustFile) {
-        curl_easy_setopt(request->easy, CURLOPT_CAINFO, config.caTrustFile);
-    }
-
-    // Send client certs if so configured
-    if(server->clientAuth) {
-        curl_easy_setopt(request->easy, CURLOPT_SSLCERT, server->clientAuth->clientCert);
-        curl_easy_setopt(request->easy, CURLOPT_SSLKEY, server->clientAuth->clientKey);
-        if(server->clientAuth->clientKeyPass) {
-            curl_easy_setopt(request->easy, CURLOPT_SSLKEYPASSWD, server->clientAuth->clientKeyPass);
-        }
-    }
+    request->easy = arkime_http_easy_get(server);
 
-    curl_easy_setopt(request->easy, CURLOPT_WRITEFUNCTION, arkime_http_curl_write_callback);
     curl_easy_setopt(request->easy, CURLOPT_WRITEDATA, (void *)request);
     curl_easy_setopt(request->easy, CURLOPT_PRIVATE, (void *)request);
-    curl_easy_setopt(request->easy, CURLOPT_OPENSOCKETFUNCTION, arkime_http_curl_open_callback);
-    curl_easy_setopt(request->easy, CURLOPT_CLOSESOCKETFUNCTION, arkime_http_curl_close_callback);
-    curl_easy_setopt(request->easy, CURLOPT_ACCEPT_ENCODING, ""); // https://curl.haxx.se/libcurl/c/CURLOPT_ACCEPT_ENCODING.html
-    curl_easy_setopt(request->easy, CURLOPT_TCP_KEEPALIVE, 1L);
-    curl_easy_setopt(request->easy, CURLOPT_USERAGENT, "arkime");
-
-    if (request->headerList) {
-        curl_easy_setopt(request->easy, CURLOPT_HTTPHEADER, request->headerList);
-    }
+    curl_easy_setopt(request->easy, CURLOPT_HTTPHEADER, headerList);
 
     if (method[0] != 'G') {
         curl_easy_setopt(request->easy, CURLOPT_CUSTOMREQUEST, method);
@@ -868,11 +956,11 @@ gboolean arkime_http_schedule(void *serverV, const char *method, const char *key
     if (server->headerCb) {
         curl_easy_setopt(request->easy, CURLOPT_HEADERFUNCTION, arkime_http_curlm_header_function);
         curl_easy_setopt(request->easy, CURLOPT_HEADERDATA, request);
+    } else {
+        curl_easy_setopt(request->easy, CURLOPT_HEADERFUNCTION, NULL);
+        curl_easy_setopt(request->easy, CURLOPT_HEADERDATA, NULL);
     }
 
-    curl_easy_setopt(request->easy, CURLOPT_CONNECTTIMEOUT, 10L);
-    curl_easy_setopt(request->easy, CURLOPT_TIMEOUT, 120L);
-
     memcpy(request->key, key, key_len);
     request->key[key_len] = 0;
 
@@ -901,6 +989,14 @@ uint64_t arkime_http_dropped_count(void *serverV)
     return server ? server->dropped : 0;
 }
 /******************************************************************************/
+void arkime_http_time_stats(void *serverV, uint64_t *compressUS, uint64_t *sendUS)
+{
+    ArkimeHttpServer_t        *server = serverV;
+
+    *compressUS = server ? server->compressUS : 0;
+    *sendUS     = server ? server->sendUS : 0;
+}
+/******************************************************************************/
 void arkime_http_set_header_cb(void *serverV, ArkimeHttpHeader_cb cb)
 {
     ArkimeHttpServer_t        *server = serverV;
@@ -921,6 +1017,14 @@ void arkime_http_free_server(void *serverV)
         arkime_http_curlm_check_multi_info(server);
     }
 
+    for (int i = 0; i < server->easyPoolCnt; i++) {
+        curl_easy_cleanup(server->easyPool[i]);
+    }
+    free(server->easyPool);
+
+    curl_slist_free_all(server->defaultList);
+    curl_slist_free_all(server->defaultGzipList);
+
     // Free sync info
     if (server->syncRequest.easy) {
         curl_easy_cleanup(server->syncRequest.easy);
@@ -947,11 +1051,34 @@ void arkime_http_free_server(void *serverV)
     ARKIME_TYPE_FREE(ArkimeHttpServer_t, server);
 }
 /******************************************************************************/
+/* Should be called before any requests are sent, since the cached header lists
+ * are rebuilt.
+ */
 void arkime_http_set_headers(void *serverV, char **headers)
 {
     ArkimeHttpServer_t        *server = serverV;
 
     server->defaultHeaders = headers;
+
+    curl_slist_free_all(server->defaultList);
+    curl_slist_free_all(server->defaultGzipList);
+    server->defaultList = NULL;
+    server->defaultGzipList = NULL;
+
+    if (headers) {
+        for (int i = 0; headers[i]; i++) {
+            server->defaultList = curl_slist_append(server->defaultList, headers[i]);
+            server->defaultGzipList = curl_slist_append(server->defaultGzipList, headers[i]);
+        }
+    }
+    server->defaultGzipList = curl_slist_append(server->defaultGzipList, "Content-Encoding: gzip");
+}
+/******************************************************************************/
+void arkime_http_set_compression_level(void *serverV, int level)
+{
+    ArkimeHttpServer_t        *server = serverV;
+
+    server->compressLevel = level;
 }
 /******************************************************************************/
 void arkime_http_set_retries(void *serverV, uint16_t retries)
@@ -1007,6 +1134,7 @@ void *arkime_http_create_server(const char *hostnames, int maxConns, int maxOuts
     server->maxConns = maxConns;
     server->maxOutstandingRequests = maxOutstandingRequests;
     server->compress = compress;
+    server->compressLevel = Z_DEFAULT_COMPRESSION;
     server->maxRetries = 2;
     server->clientAuth = NULL;
 
@@ -1039,16 +1167,16 @@ void *arkime_http_create_server(const char *hostnames, int maxConns, int maxOuts
 
     ARKIME_LOCK_INIT(server->syncRequest);
 
+    ARKIME_LOCK_INIT(server->easyPool);
+    server->easyPoolMax = maxConns + maxConns / 2;
+    server->easyPool = malloc(server->easyPoolMax * sizeof(CURL *));
+    server->defaultGzipList = curl_slist_append(NULL, "Content-Encoding: gzip");
+
     return server;
 }
 /******************************************************************************/
 void arkime_http_init()
 {
-    z_strm.zalloc = Z_NULL;
-    z_strm.zfree  = Z_NULL;
-    z_strm.opaque = Z_NULL;
-    deflateInit2(&z_strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY);
-
     curl_global_init(CURL_GLOBAL_SSL);
 
     HASH_INIT(h_, connections, arkime_session_hash, (HASH_CMP_FUNC)arkime_http_conn_cmp);
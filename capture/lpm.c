@@ -0,0 +1,291 @@
+/* lpm.c  -- compiled longest prefix match tables
+ *
+ * Tables are built with the patricia tree code, which owns the prefixes
+ * and data, and then compiled into a flat multibit trie that is only
+ * read. The root table is indexed by the first 4, 8 or 16 bits of the key,
+ * depending on how many prefixes there are, and every table below it by
+ * the next 4 bits, prefixes are expanded to fill every slot they cover.
+ * Child tables are only 16 slots so a long prefix costs a few 64 byte
+ * tables instead of 1k ones.
+ *
+ * Only the first 32 bits are compiled. A prefix longer than that, ipv6
+ * hosts or long oui entries, marks the slot its first 32 bits land in and
+ * lookups that reach the mark walk the patricia tree instead. So ipv4 is
+ * always answered from the slots and ipv6 only falls back for addresses
+ * in a /32 that has longer prefixes.
+ *
+ * A slot is 0 for no match, LPM_CHILD plus the offset of the child table,
+ * LPM_TREE for use the patricia tree, or the leaf number + 1. Each leaf has
+ * the patricia node of the longest prefix and the list of every prefix
+ * with data that covers it, shortest first, which is what
+ * patricia_search_all2 would have returned.
+ *
+ * Compiled tables are never changed, a new one is made and swapped in
+ * and the old one freed with arkime_free_later.
+ *
+ * Copyright 2024 All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "arkime.h"
+#include "patricia.h"
+
+extern ArkimeConfig_t        config;
+
+#define LPM_CHILD           0x80000000
+#define LPM_TREE            0x40000000
+// Bits below the root table each level uses
+#define LPM_STRIDE          4
+#define LPM_STRIDE_SLOTS    (1 << LPM_STRIDE)
+// Prefixes longer than this are looked up in the patricia tree
+#define LPM_MAX_BITS        32
+// Use an 8 bit root table once there are more prefixes than this, and 16 bit after that
+#define LPM_ROOT8_MIN       8
+#define LPM_ROOT16_MIN      1024
+
+typedef struct {
+    patricia_node_t  *best;
+    uint32_t          allStart;
+    uint32_t          allCnt;
+} ArkimeLpmLeaf_t;
+
+struct arkimelpm_t {
+    uint32_t           *slots;
+    ArkimeLpmLeaf_t    *leaves;
+    patricia_node_t   **all;
+    patricia_tree_t    *tree;
+    patricia_fn_data_t  freeFunc;
+    uint32_t            slotsLen;
+    uint32_t            slotsSize;
+    uint32_t            allLen;
+    uint8_t             rootBits;
+};
+
+/******************************************************************************/
+ArkimeLpm_t *arkime_lpm_new(int maxbits, void (*freeFunc)(void *))
+{
+    ArkimeLpm_t *lpm = ARKIME_TYPE_ALLOC0(ArkimeLpm_t);
+    lpm->tree = New_Patricia(maxbits);
+    lpm->freeFunc = freeFunc;
+    return lpm;
+}
+/******************************************************************************/
+patricia_tree_t *arkime_lpm_tree(ArkimeLpm_t *lpm)
+{
+    return lpm->tree;
+}
+/******************************************************************************/
+LOCAL inline uint32_t arkime_lpm_root_idx(const ArkimeLpm_t *lpm, const uint8_t *addr)
+{
+    switch (lpm->rootBits) {
+    case 16:
+        return (addr[0] << 8) | addr[1];
+    case 8:
+        return addr[0];
+    default:
+        return addr[0] >> 4;
+    }
+}
+/******************************************************************************/
+// The 4 bits of addr starting at bit, which is always a multiple of 4
+LOCAL inline uint32_t arkime_lpm_nibble(const uint8_t *addr, int bit)
+{
+    return (addr[bit >> 3] >> (~bit & 4)) & 0x0f;
+}
+/******************************************************************************/
+LOCAL inline uint32_t arkime_lpm_find(const ArkimeLpm_t *lpm, const uint8_t *addr)
+{
+    uint32_t v = lpm->slots[arkime_lpm_root_idx(lpm, addr)];
+    int      bit = lpm->rootBits;
+
+    // Child tables only exist above LPM_MAX_BITS, so bit never passes it
+    while (v & LPM_CHILD) {
+        v = lpm->slots[(v & ~LPM_CHILD) + arkime_lpm_nibble(addr, bit)];
+        bit += LPM_STRIDE;
+    }
+    return v;
+}
+/******************************************************************************/
+LOCAL uint32_t arkime_lpm_child(ArkimeLpm_t *lpm, uint32_t fill)
+{
+    if (lpm->slotsLen + LPM_STRIDE_SLOTS > lpm->slotsSize) {
+        lpm->slotsSize *= 2;
+        lpm->slots = g_renew(uint32_t, lpm->slots, lpm->slotsSize);
+    }
+
+    uint32_t child = lpm->slotsLen;
+    for (int i = 0; i < LPM_STRIDE_SLOTS; i++)
+        lpm->slots[child + i] = fill;
+    lpm->slotsLen += LPM_STRIDE_SLOTS;
+    return child;
+}
+/******************************************************************************/
+LOCAL void arkime_lpm_insert(ArkimeLpm_t *lpm, const uint8_t *addr, int bitlen, uint32_t value)
+{
+    uint32_t table = 0;
+    uint32_t idx = arkime_lpm_root_idx(lpm, addr);
+    int      end = lpm->rootBits;
+
+    if (bitlen > LPM_MAX_BITS)
+        bitlen = LPM_MAX_BITS;
+
+    while (1) {
+        if (bitlen <= end) {
+            // Prefixes are added shortest first so nothing in the range has a child table yet
+            const uint32_t span = 1U << (end - bitlen);
+            const uint32_t first = idx & ~(span - 1);
+            for (uint32_t s = first; s < first + span; s++)
+                lpm->slots[table + s] = value;
+            return;
+        }
+
+        uint32_t v = lpm->slots[table + idx];
+        if (!(v & LPM_CHILD)) {
+            const uint32_t child = arkime_lpm_child(lpm, v);
+            v = lpm->slots[table + idx] = child | LPM_CHILD;
+        }
+        table = v & ~LPM_CHILD;
+        idx = arkime_lpm_nibble(addr, end);
+        end += LPM_STRIDE;
+    }
+}
+/******************************************************************************/
+LOCAL int arkime_lpm_node_cmp(const void *a, const void *b)
+{
+    const patricia_node_t *na = *(const patricia_node_t **)a;
+    const patricia_node_t *nb = *(const patricia_node_t **)b;
+    return (int)na->prefix->bitlen - (int)nb->prefix->bitlen;
+}
+/******************************************************************************/
+void arkime_lpm_compile(ArkimeLpm_t *lpm)
+{
+    patricia_node_t *node;
+    GPtrArray       *nodes = g_ptr_array_new();
+
+    PATRICIA_WALK(lpm->tree->head, node) {
+        g_ptr_array_add(nodes, node);
+    } PATRICIA_WALK_END;
+
+    g_free(lpm->slots);
+    g_free(lpm->leaves);
+    g_free(lpm->all);
+    lpm->slots = NULL;
+    lpm->leaves = NULL;
+    lpm->all = NULL;
+    lpm->allLen = 0;
+
+    if (nodes->len == 0) {
+        g_ptr_array_free(nodes, TRUE);
+        return;
+    }
+
+    g_ptr_array_sort(nodes, arkime_lpm_node_cmp);
+
+    if (nodes->len > LPM_ROOT16_MIN)
+        lpm->rootBits = 16;
+    else if (nodes->len > LPM_ROOT8_MIN)
+        lpm->rootBits = 8;
+    else
+        lpm->rootBits = 4;
+    lpm->slotsLen  = 1U << lpm->rootBits;
+    lpm->slotsSize = lpm->slotsLen + LPM_STRIDE_SLOTS * 4;
+    lpm->slots     = g_new0(uint32_t, lpm->slotsSize);
+    lpm->leaves    = g_new0(ArkimeLpmLeaf_t, nodes->len);
+
+    uint32_t allSize = nodes->len + 1;
+    lpm->all = g_new(patricia_node_t *, allSize);
+
+    uint32_t longCnt = 0;
+    for (uint32_t n = 0; n < nodes->len; n++) {
+        node = g_ptr_array_index(nodes, n);
+        const uint8_t *addr = prefix_touchar(node->prefix);
+        ArkimeLpmLeaf_t *leaf = &lpm->leaves[n];
+
+        // Sorted, so every compiled prefix is already in when the long ones mark their slots
+        if (node->prefix->bitlen > LPM_MAX_BITS) {
+            arkime_lpm_insert(lpm, addr, node->prefix->bitlen, LPM_TREE);
+            longCnt++;
+            continue;
+        }
+
+        // Before adding, whatever matches addr is the longest shorter prefix that covers this one
+        const uint32_t parent = arkime_lpm_find(lpm, addr);
+        const uint32_t parentCnt = parent ? lpm->leaves[parent - 1].allCnt : 0;
+
+        if (lpm->allLen + parentCnt + 1 > allSize) {
+            allSize = (lpm->allLen + parentCnt + 1) * 2;
+            lpm->all = g_renew(patricia_node_t *, lpm->all, allSize);
+        }
+
+        leaf->best = node;
+        leaf->allStart = lpm->allLen;
+        if (parentCnt) {
+            memcpy(lpm->all + lpm->allLen, lpm->all + lpm->leaves[parent - 1].allStart, parentCnt * sizeof(patricia_node_t *));
+            lpm->allLen += parentCnt;
+        }
+        if (node->data)
+            lpm->all[lpm->allLen++] = node;
+        leaf->allCnt = lpm->allLen - leaf->allStart;
+
+        arkime_lpm_insert(lpm, addr, node->prefix->bitlen, n + 1);
+    }
+
+    // Only keep what was used
+    lpm->slotsSize = lpm->slotsLen;
+    lpm->slots = g_renew(uint32_t, lpm->slots, lpm->slotsSize);
+    if (lpm->allLen) {
+        lpm->all = g_renew(patricia_node_t *, lpm->all, lpm->allLen);
+    } else {
+        g_free(lpm->all);
+        lpm->all = NULL;
+    }
+
+    if (config.debug > 1)
+        LOG("%u prefixes, %u in tree, %u root bits, %u slots", nodes->len, longCnt, lpm->rootBits, lpm->slotsLen);
+
+    g_ptr_array_free(nodes, TRUE);
+}
+/******************************************************************************/
+patricia_node_t *arkime_lpm_search_best(const ArkimeLpm_t *lpm, const uint8_t *addr)
+{
+    if (!lpm || !lpm->slots)
+        return NULL;
+
+    const uint32_t v = arkime_lpm_find(lpm, addr);
+    if (!v)
+        return NULL;
+    if (v == LPM_TREE)
+        return patricia_search_best3(lpm->tree, addr, lpm->tree->maxbits);
+    return lpm->leaves[v - 1].best;
+}
+/******************************************************************************/
+int arkime_lpm_search_all(const ArkimeLpm_t *lpm, const uint8_t *addr, patricia_node_t **results, int resultsize)
+{
+    if (!lpm || !lpm->slots)
+        return 0;
+
+    const uint32_t v = arkime_lpm_find(lpm, addr);
+    if (!v)
+        return 0;
+    if (v == LPM_TREE)
+        return patricia_search_all2(lpm->tree, (u_char *)addr, lpm->tree->maxbits, results, resultsize);
+
+    const ArkimeLpmLeaf_t *leaf = &lpm->leaves[v - 1];
+    const int cnt = MIN((int)leaf->allCnt, resultsize);
+    if (cnt)
+        memcpy(results, lpm->all + leaf->allStart, cnt * sizeof(patricia_node_t *));
+    return cnt;
+}
+/******************************************************************************/
+void arkime_lpm_free(ArkimeLpm_t *lpm)
+{
+    if (!lpm)
+        return;
+
+    Destroy_Patricia(lpm->tree, lpm->freeFunc);
+    g_free(lpm->slots);
+    g_free(lpm->leaves);
+    g_free(lpm->all);
+    ARKIME_TYPE_FREE(ArkimeLpm_t, lpm);
+}
@@ -40,6 +40,7 @@ ARKIME_LOCK_DEFINE(LOG);
 
 /******************************************************************************/
 LOCAL  gboolean showVersion    = FALSE;
+LOCAL  int      js0nSelfTest   = 0;
 
 #define FREE_LATER_SIZE 32768
 LOCAL int freeLaterFront;
@@ -111,6 +112,7 @@ LOCAL  GOptionEntry entries[] =
     { "ignoreerrors", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE,           &config.ignoreErrors,  "Ignore most errors and continue", NULL },
     { "dumpConfig",  0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE,           &config.dumpConfig,    "Display the config.", NULL },
     { "regressionTests",  0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE,      &config.regressionTests, "Regression Tests", NULL },
+    { "js0nselftest", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT,           &js0nSelfTest,         "With --tests check N random strings against the old json escaping and exit", NULL },
     { NULL,          0, 0,                                    0,           NULL, NULL, NULL }
 };
 
@@ -782,6 +784,8 @@ LLVMFuzzerInitialize(int *UNUSED(argc), char ***UNUSED(argv))
     arkime_hex_init();
     arkime_http_init();
     arkime_config_init();
+    arkime_pool_init();
+    arkime_wheel_init();
     arkime_writers_init();
     arkime_writers_start("null");
     arkime_readers_init();
@@ -829,7 +833,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 
         // LOG("Packet %llu %d", fuzzloch_sessionid, len);
 
-        ArkimePacket_t *packet = ARKIME_TYPE_ALLOC0(ArkimePacket_t);
+        ArkimePacket_t *packet = ARKIME_POOL_ALLOC0(ARKIME_POOL_PACKET);
         packet->pktlen         = len;
         packet->pkt            = ptr;
         packet->ts.tv_sec      = ts >> 4;
@@ -867,8 +871,16 @@ int main(int argc, char **argv)
 
     arkime_free_later_init();
     arkime_hex_init();
+    if (js0nSelfTest) {
+        if (!config.tests)
+            CONFIGEXIT("--js0nselftest requires --tests");
+        arkime_db_js0n_self_test(js0nSelfTest);
+        exit(0);
+    }
     arkime_http_init();
     arkime_config_init();
+    arkime_pool_init();
+    arkime_wheel_init();
     arkime_dedup_init();
     arkime_writers_init();
     arkime_readers_init();
@@ -906,6 +918,7 @@ int main(int argc, char **argv)
     arkime_field_exit();
     arkime_readers_exit();
     arkime_dedup_exit();
+    arkime_wheel_exit();
     arkime_config_exit();
     arkime_rules_exit();
     arkime_yara_exit();
@@ -52,10 +52,10 @@ time_t                       currentTime[ARKIME_MAX_PACKET_THREADS];
 time_t                       lastPacketSecs[ARKIME_MAX_PACKET_THREADS];
 LOCAL int                    inProgress[ARKIME_MAX_PACKET_THREADS];
 
-LOCAL patricia_tree_t       *ipTree4 = 0;
-LOCAL patricia_tree_t       *ipTree6 = 0;
-LOCAL patricia_tree_t       *newipTree4 = 0;
-LOCAL patricia_tree_t       *newipTree6 = 0;
+LOCAL ArkimeLpm_t           *ipTree4 = 0;
+LOCAL ArkimeLpm_t           *ipTree6 = 0;
+LOCAL ArkimeLpm_t           *newipTree4 = 0;
+LOCAL ArkimeLpm_t           *newipTree6 = 0;
 
 extern ArkimeFieldOps_t      readerFieldOps[256];
 
@@ -78,8 +78,61 @@ LOCAL  ArkimePacketHead_t    packetQ[ARKIME_MAX_PACKET_THREADS];
 LOCAL  uint32_t              overloadDrops[ARKIME_MAX_PACKET_THREADS];
 LOCAL  uint32_t              overloadDropTimes[ARKIME_MAX_PACKET_THREADS];
 
+/******************************************************************************/
+/* Elephant flows - sessions live in their packet thread's tables and a flow
+ * can't change threads without splitting it, so when a packet thread falls
+ * behind its big flows are moved to a light path instead.  Light sessions
+ * keep being counted and written but parsers and tcp reassembly are dropped.
+ * A thread is hot while its queue is past elephantQueuePercent of
+ * maxPacketsInQueue, or a quarter of that while it is using all of a cpu, and
+ * stays hot until the queue is back under the quarter.
+ */
+LOCAL  uint32_t              elephantPackets;
+LOCAL  uint32_t              elephantHighWater;
+LOCAL  uint32_t              elephantLowWater;
+LOCAL  uint64_t              elephantFlows;
+LOCAL  uint8_t               packetThreadHot[ARKIME_MAX_PACKET_THREADS];
+LOCAL  uint8_t               elephantAlwaysHot;                           // Only with --tests
+LOCAL  int                   packetThreadClockSet[ARKIME_MAX_PACKET_THREADS];
+LOCAL  clockid_t             packetThreadClock[ARKIME_MAX_PACKET_THREADS];
+LOCAL  uint64_t              packetThreadCpuNs[ARKIME_MAX_PACKET_THREADS];
+LOCAL  uint32_t              packetThreadCpu[ARKIME_MAX_PACKET_THREADS];  // Percent of a cpu over the last second
+
 LOCAL  ARKIME_LOCK_DEFINE(frags);
 
+/******************************************************************************/
+/* packetQueueMode=ring - Each reader batch gets its own single producer/single
+ * consumer ring per packet thread, so neither side takes a lock for normal
+ * operation.  The packet thread only grabs packetQ[].lock to park when idle.
+ */
+#define ARKIME_PACKET_MAX_RINGS  64
+#define ARKIME_PACKET_RING_BATCH 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ARKIME_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define ARKIME_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define ARKIME_CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+typedef struct {
+    uint32_t               head;        // Only written by the packet thread
+    char                   pad1[60];
+    uint32_t               tail;        // Only written by the reader
+    char                   pad2[60];
+    ArkimePacket_t       **slots;
+} ArkimePacketRing_t;
+
+LOCAL  int                   packetQueueRing;
+LOCAL  uint32_t              packetRingSize;
+LOCAL  uint32_t              packetRingMask;
+LOCAL  uint32_t              packetRingSpin;
+LOCAL  int                   numPacketRings;
+LOCAL  ArkimePacketRing_t   *packetRings[ARKIME_MAX_PACKET_THREADS][ARKIME_PACKET_MAX_RINGS];
+LOCAL  uint32_t              packetRingCount[ARKIME_MAX_PACKET_THREADS];
+LOCAL  int                   packetRingParked[ARKIME_MAX_PACKET_THREADS];
+
 LOCAL ArkimePacketRC arkime_packet_ip4(ArkimePacketBatch_t *batch, ArkimePacket_t *const packet, const uint8_t *data, int len);
 LOCAL ArkimePacketRC arkime_packet_ip6(ArkimePacketBatch_t *batch, ArkimePacket_t *const packet, const uint8_t *data, int len);
 LOCAL ArkimePacketRC arkime_packet_frame_relay(ArkimePacketBatch_t *batch, ArkimePacket_t *const packet, const uint8_t *data, int len);
@@ -119,14 +172,42 @@ LOCAL ArkimeDropHashGroup_t      packetDrop6S;
 #define IPPROTO_IPV4            4
 #endif
 
+/******************************************************************************/
+void arkime_packet_block_unref(ArkimePacketBlock_t *block)
+{
+    if (__sync_sub_and_fetch(&block->refs, 1) == 0) {
+        block->release(block);
+    }
+}
+/******************************************************************************/
+/* Make sure the packet owns its data, called when the packet will be held
+ * longer then the reader memory it points into can be.
+ */
+void arkime_packet_copy(ArkimePacket_t *const packet)
+{
+    if (packet->copied)
+        return;
+
+    uint8_t *pkt = malloc(packet->pktlen);
+    memcpy(pkt, packet->pkt, packet->pktlen);
+    packet->pkt = pkt;
+    packet->copied = 1;
+
+    if (packet->block) {
+        arkime_packet_block_unref(packet->block);
+        packet->block = NULL;
+    }
+}
 /******************************************************************************/
 void arkime_packet_free(ArkimePacket_t *packet)
 {
     if (packet->copied) {
         free(packet->pkt);
+    } else if (packet->block) {
+        arkime_packet_block_unref(packet->block);
     }
     packet->pkt = 0;
-    ARKIME_TYPE_FREE(ArkimePacket_t, packet);
+    ARKIME_POOL_FREE(ARKIME_POOL_PACKET, packet);
 }
 /******************************************************************************/
 void arkime_packet_process_data(ArkimeSession_t *session, const uint8_t *data, int len, int which)
@@ -153,6 +234,98 @@ void arkime_packet_process_data(ArkimeSession_t *session, const uint8_t *data, i
     }
 }
 /******************************************************************************/
+/* Number of packets waiting for a packet thread, ring count is only
+ * decremented after the packets have been processed.
+ */
+LOCAL inline uint32_t arkime_packet_queue_length(int thread)
+{
+    return DLL_COUNT(packet_, &packetQ[thread]) + packetRingCount[thread];
+}
+/******************************************************************************/
+uint32_t arkime_packet_thread_queue_length(int thread)
+{
+    return arkime_packet_queue_length(thread);
+}
+/******************************************************************************/
+uint32_t arkime_packet_thread_cpu(int thread)
+{
+    return packetThreadCpu[thread];
+}
+/******************************************************************************/
+uint64_t arkime_packet_elephant_flows()
+{
+    return elephantFlows;
+}
+/******************************************************************************/
+LOCAL void arkime_packet_thread_clock(int thread)
+{
+    if (pthread_getcpuclockid(pthread_self(), &packetThreadClock[thread]) == 0)
+        packetThreadClockSet[thread] = 1;
+}
+/******************************************************************************/
+// Every second on the main thread, sample each packet thread's cpu and queue
+LOCAL gboolean arkime_packet_thread_load(gpointer UNUSED(user_data))
+{
+    static struct timespec lastTs;
+    struct timespec        ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t wallNs = (ts.tv_sec - lastTs.tv_sec) * 1000000000ULL + ts.tv_nsec - lastTs.tv_nsec;
+    const int first = lastTs.tv_sec == 0;
+    lastTs = ts;
+
+    for (int t = 0; t < config.packetThreads; t++) {
+        if (packetThreadClockSet[t] && clock_gettime(packetThreadClock[t], &ts) == 0) {
+            const uint64_t ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+            if (!first && wallNs > 0)
+                packetThreadCpu[t] = (ns - packetThreadCpuNs[t]) * 100 / wallNs;
+            packetThreadCpuNs[t] = ns;
+        }
+
+        if (elephantAlwaysHot)
+            continue;
+
+        const uint32_t len = arkime_packet_queue_length(t);
+        int hot;
+        if (packetThreadHot[t])
+            hot = len > elephantLowWater;
+        else
+            hot = len > elephantHighWater || (packetThreadCpu[t] >= 95 && len > elephantLowWater);
+
+        if (hot != packetThreadHot[t] && config.debug)
+            LOG("Packet thread %d is %s, queue %u cpu %u%%", t, hot ? "hot" : "cool", len, packetThreadCpu[t]);
+        packetThreadHot[t] = hot;
+    }
+    return G_SOURCE_CONTINUE;
+}
+/******************************************************************************/
+/* Move a big session on a hot thread to the light path, protocol state is
+ * flushed and freed first so anything already reassembled is still parsed.
+ */
+LOCAL void arkime_packet_elephant(ArkimeSession_t *session)
+{
+    session->elephant = 1;
+    session->stopYara = 1;
+    ARKIME_THREAD_INCR(elephantFlows);
+    arkime_session_add_tag(session, "elephant-flow");
+
+    if (mProtocols[session->mProtocol].sFree)
+        mProtocols[session->mProtocol].sFree(session);
+    session->stopTCP = 1;
+
+    // Parsers only write some state out when saved, so save like a mid save before freeing
+    for (int i = 0; i < session->parserNum; i++) {
+        if (session->parserInfo[i].parserSaveFunc)
+            session->parserInfo[i].parserSaveFunc(session, session->parserInfo[i].uw, FALSE);
+    }
+
+    for (int i = 0; i < session->parserNum; i++) {
+        if (session->parserInfo[i].parserFreeFunc)
+            session->parserInfo[i].parserFreeFunc(session, session->parserInfo[i].uw);
+    }
+    session->parserNum = 0;
+}
+/******************************************************************************/
 void arkime_packet_thread_wake(int thread)
 {
     ARKIME_LOCK(packetQ[thread].lock);
@@ -172,7 +345,7 @@ void arkime_packet_flush()
 
         for (t = 0; t < config.packetThreads; t++) {
             ARKIME_LOCK(packetQ[t].lock);
-            if (DLL_COUNT(packet_, &packetQ[t]) > 0) {
+            if (arkime_packet_queue_length(t) > 0) {
                 flushed = 0;
             }
             ARKIME_UNLOCK(packetQ[t].lock);
@@ -265,6 +438,10 @@ LOCAL void arkime_packet_process(ArkimePacket_t *packet, int thread)
 
     uint32_t packets = session->packets[0] + session->packets[1];
 
+    if (unlikely(packets >= elephantPackets) && packetThreadHot[thread] && !session->elephant) {
+        arkime_packet_elephant(session);
+    }
+
     if (packets <= session->stopSaving) {
         arkime_writer_write(session, packet);
 
@@ -421,6 +598,8 @@ LOCAL void *arkime_packet_thread(void *threadp)
     const uint32_t maxPackets75 = config.maxPackets * 0.75;
     uint32_t skipCount = 0;
 
+    arkime_packet_thread_clock(thread);
+
     while (1) {
         ArkimePacket_t  *packet;
 
@@ -458,6 +637,126 @@ LOCAL void *arkime_packet_thread(void *threadp)
 
     return NULL;
 }
+/******************************************************************************/
+/* Grab up to ARKIME_PACKET_RING_BATCH packets, starting at a different ring each
+ * time so a busy reader can't starve the others.  Packets from batches that
+ * couldn't get a ring are still on the locked packetQ.
+ */
+LOCAL int arkime_packet_ring_dequeue(int thread, ArkimePacket_t **packets, int *ringCnt)
+{
+    static __thread uint32_t start;
+
+    int cnt = 0;
+    int num = __atomic_load_n(&numPacketRings, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < num && cnt < ARKIME_PACKET_RING_BATCH; i++) {
+        ArkimePacketRing_t *ring = __atomic_load_n(&packetRings[thread][(start + i) % num], __ATOMIC_ACQUIRE);
+        if (!ring)
+            continue;
+
+        uint32_t head = ring->head;
+        const uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        while (head != tail && cnt < ARKIME_PACKET_RING_BATCH) {
+            packets[cnt++] = ring->slots[head & packetRingMask];
+            head++;
+        }
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+    start++;
+    *ringCnt = cnt;
+
+    if (cnt < ARKIME_PACKET_RING_BATCH && DLL_COUNT(packet_, &packetQ[thread]) > 0) {
+        ARKIME_LOCK(packetQ[thread].lock);
+        inProgress[thread] = 1;
+        while (cnt < ARKIME_PACKET_RING_BATCH && DLL_POP_HEAD(packet_, &packetQ[thread], packets[cnt])) {
+            cnt++;
+        }
+        ARKIME_UNLOCK(packetQ[thread].lock);
+    }
+
+    return cnt;
+}
+/******************************************************************************/
+LOCAL void *arkime_packet_ring_thread(void *threadp)
+{
+    int thread = (long)threadp;
+    const uint32_t maxPackets75 = config.maxPackets * 0.75;
+    uint32_t skipCount = 0;
+    uint32_t spinMax = packetRingSpin;
+    ArkimePacket_t *packets[ARKIME_PACKET_RING_BATCH];
+
+    arkime_packet_thread_clock(thread);
+
+    while (1) {
+        int ringCnt;
+        int cnt = arkime_packet_ring_dequeue(thread, packets, &ringCnt);
+
+        if (cnt == 0) {
+            uint32_t spin;
+            for (spin = 0; spin < spinMax; spin++) {
+                ARKIME_CPU_RELAX();
+                if ((cnt = arkime_packet_ring_dequeue(thread, packets, &ringCnt)) > 0)
+                    break;
+            }
+
+            // Spin longer next time if spinning paid off, shorter if it didn't,
+            // but keep spinning some so it can grow again
+            if (cnt > 0) {
+                spinMax = MIN(spinMax * 2 + 1, packetRingSpin);
+            } else if (spinMax > 1) {
+                spinMax /= 2;
+            }
+        }
+
+        if (cnt == 0) {
+            struct timespec ts;
+            ARKIME_LOCK(packetQ[thread].lock);
+            inProgress[thread] = 0;
+            clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+            currentTime[thread] = ts.tv_sec;
+            ts.tv_sec++;
+
+            // Readers check parked after publishing, we check the queue after parking
+            packetRingParked[thread] = 1;
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (arkime_packet_queue_length(thread) == 0) {
+                ARKIME_COND_TIMEDWAIT(packetQ[thread].lock, ts);
+            }
+            packetRingParked[thread] = 0;
+
+            // Woken up for packets, spinning longer would have saved the wake up
+            if (arkime_packet_queue_length(thread) > 0) {
+                spinMax = MIN(spinMax * 2 + 1, packetRingSpin);
+            }
+
+            // See arkime_packet_thread
+            if (!config.pcapReadOffline && arkime_packet_queue_length(thread) == 0 && ts.tv_sec - 10 > lastPacketSecs[thread]) {
+                lastPacketSecs[thread] = ts.tv_sec - 10;
+            }
+            ARKIME_UNLOCK(packetQ[thread].lock);
+
+            arkime_session_process_commands(thread);
+            continue;
+        }
+
+        // Only process commands if the packetQ is less then 75% full or every 8 batches
+        if (likely(arkime_packet_queue_length(thread) < maxPackets75) || (skipCount & 0x7) == 0) {
+            arkime_session_process_commands(thread);
+        } else {
+            skipCount++;
+        }
+
+        for (int i = 0; i < cnt; i++) {
+            arkime_packet_process(packets[i], thread);
+        }
+
+        inProgress[thread] = 0;
+        if (ringCnt > 0)
+            __sync_sub_and_fetch(&packetRingCount[thread], ringCnt);
+    }
+
+    return NULL;
+}
 #endif
 /******************************************************************************/
 static FILE *unknownPacketFile[3];
@@ -637,12 +936,7 @@ LOCAL void arkime_packet_frags4(ArkimePacketBatch_t *batch, ArkimePacket_t *cons
     ArkimeFrags_t *frags;
 
     // ALW - Should change frags_process to make the copy when needed
-    if (!packet->copied) {
-        uint8_t *pkt = malloc(packet->pktlen);
-        memcpy(pkt, packet->pkt, packet->pktlen);
-        packet->pkt = pkt;
-        packet->copied = 1;
-    }
+    arkime_packet_copy(packet);
 
     ARKIME_LOCK(frags);
     // Remove expired entries
@@ -751,10 +1045,10 @@ LOCAL ArkimePacketRC arkime_packet_ip4(ArkimePacketBatch_t *batch, ArkimePacket_
     if (ipTree4) {
         patricia_node_t *node;
 
-        if ((node = patricia_search_best3 (ipTree4, (u_char * )&ip4->ip_src, 32)) && node->data == NULL)
+        if ((node = arkime_lpm_search_best(ipTree4, (uint8_t *)&ip4->ip_src)) && node->data == NULL)
             return ARKIME_PACKET_IP_DROPPED;
 
-        if ((node = patricia_search_best3 (ipTree4, (u_char * )&ip4->ip_dst, 32)) && node->data == NULL)
+        if ((node = arkime_lpm_search_best(ipTree4, (uint8_t *)&ip4->ip_dst)) && node->data == NULL)
             return ARKIME_PACKET_IP_DROPPED;
     }
 
@@ -794,13 +1088,13 @@ LOCAL ArkimePacketRC arkime_packet_ip4(ArkimePacketBatch_t *batch, ArkimePacket_
 
         tcphdr = (struct tcphdr *)((char *)ip4 + ip_hdr_len);
 
-        if (packetDrop4.drops[tcphdr->th_sport] &&
+        if (ARKIME_DROPHASH_HAS_PORT(&packetDrop4, tcphdr->th_sport) &&
             arkime_drophash_should_drop(&packetDrop4, tcphdr->th_sport, &ip4->ip_src.s_addr, packet->ts.tv_sec)) {
 
             return ARKIME_PACKET_IPPORT_DROPPED;
         }
 
-        if (packetDrop4.drops[tcphdr->th_dport] &&
+        if (ARKIME_DROPHASH_HAS_PORT(&packetDrop4, tcphdr->th_dport) &&
             arkime_drophash_should_drop(&packetDrop4, tcphdr->th_dport, &ip4->ip_dst.s_addr, packet->ts.tv_sec)) {
 
             return ARKIME_PACKET_IPPORT_DROPPED;
@@ -814,8 +1108,8 @@ LOCAL ArkimePacketRC arkime_packet_ip4(ArkimePacketBatch_t *batch, ArkimePacket_
         packet->mProtocol = tcpMProtocol;
 
         const int dropPort = ((uint32_t)tcphdr->th_dport * (uint32_t)tcphdr->th_sport) & 0xffff;
-        if (packetDrop4S.drops[dropPort] &&
-            arkime_drophash_should_drop(&packetDrop4, dropPort, sessionId + 1, packet->ts.tv_sec)) {
+        if (ARKIME_DROPHASH_HAS_PORT(&packetDrop4S, dropPort) &&
+            arkime_drophash_should_drop(&packetDrop4S, dropPort, sessionId + 1, packet->ts.tv_sec)) {
 
             return ARKIME_PACKET_IPPORT_DROPPED;
         }
@@ -888,10 +1182,10 @@ LOCAL ArkimePacketRC arkime_packet_ip6(ArkimePacketBatch_t *batch, ArkimePacket_
     if (ipTree6) {
         patricia_node_t *node;
 
-        if ((node = patricia_search_best3 (ipTree6, (u_char * )&ip6->ip6_src, 128)) && node->data == NULL)
+        if ((node = arkime_lpm_search_best(ipTree6, (uint8_t *)&ip6->ip6_src)) && node->data == NULL)
             return ARKIME_PACKET_IP_DROPPED;
 
-        if ((node = patricia_search_best3 (ipTree6, (u_char * )&ip6->ip6_dst, 128)) && node->data == NULL)
+        if ((node = arkime_lpm_search_best(ipTree6, (uint8_t *)&ip6->ip6_dst)) && node->data == NULL)
             return ARKIME_PACKET_IP_DROPPED;
     }
 
@@ -974,13 +1268,13 @@ LOCAL ArkimePacketRC arkime_packet_ip6(ArkimePacketBatch_t *batch, ArkimePacket_
             tcphdr = (struct tcphdr *)(data + ip_hdr_len);
 
 
-            if (packetDrop6.drops[tcphdr->th_sport] &&
+            if (ARKIME_DROPHASH_HAS_PORT(&packetDrop6, tcphdr->th_sport) &&
                 arkime_drophash_should_drop(&packetDrop6, tcphdr->th_sport, &ip6->ip6_src, packet->ts.tv_sec)) {
 
                 return ARKIME_PACKET_IPPORT_DROPPED;
             }
 
-            if (packetDrop6.drops[tcphdr->th_dport] &&
+            if (ARKIME_DROPHASH_HAS_PORT(&packetDrop6, tcphdr->th_dport) &&
                 arkime_drophash_should_drop(&packetDrop6, tcphdr->th_dport, &ip6->ip6_dst, packet->ts.tv_sec)) {
 
                 return ARKIME_PACKET_IPPORT_DROPPED;
@@ -993,8 +1287,8 @@ LOCAL ArkimePacketRC arkime_packet_ip6(ArkimePacketBatch_t *batch, ArkimePacket_
                                ip6->ip6_dst.s6_addr, tcphdr->th_dport);
 
             const int dropPort = ((uint32_t)tcphdr->th_dport * (uint32_t)tcphdr->th_sport) & 0xffff;
-            if (packetDrop6S.drops[dropPort] &&
-                arkime_drophash_should_drop(&packetDrop6, dropPort, sessionId + 1, packet->ts.tv_sec)) {
+            if (ARKIME_DROPHASH_HAS_PORT(&packetDrop6S, dropPort) &&
+                arkime_drophash_should_drop(&packetDrop6S, dropPort, sessionId + 1, packet->ts.tv_sec)) {
 
                 return ARKIME_PACKET_IPPORT_DROPPED;
             }
@@ -1243,6 +1537,76 @@ void arkime_packet_batch_init(ArkimePacketBatch_t *batch)
         DLL_INIT(packet_, &batch->packetQ[t]);
     }
     batch->count = 0;
+    batch->ringId = -2; // Assigned on first packet, since readers may init before us
+}
+/******************************************************************************/
+/* Called from the reader thread that owns the batch the first time it is used */
+LOCAL void arkime_packet_ring_assign(ArkimePacketBatch_t *batch)
+{
+    batch->ringId = -1;
+
+#ifndef FUZZLOCH
+    static int ringsAllocated;
+
+    if (!packetQueueRing)
+        return;
+
+    int ringId = __sync_fetch_and_add(&ringsAllocated, 1);
+    if (ringId >= ARKIME_PACKET_MAX_RINGS) {
+        LOG("WARNING - More than %d packet batches, using locked packet queue for the rest", ARKIME_PACKET_MAX_RINGS);
+        return;
+    }
+
+    for (int t = 0; t < config.packetThreads; t++) {
+        ArkimePacketRing_t *ring = ARKIME_TYPE_ALLOC0(ArkimePacketRing_t);
+        ring->slots = malloc(packetRingSize * sizeof(ArkimePacket_t *));
+        __atomic_store_n(&packetRings[t][ringId], ring, __ATOMIC_RELEASE);
+    }
+
+    // Packet threads skip rings that aren't filled in yet
+    int num;
+    do {
+        num = __atomic_load_n(&numPacketRings, __ATOMIC_ACQUIRE);
+    } while (num <= ringId && !__sync_bool_compare_and_swap(&numPacketRings, num, ringId + 1));
+
+    batch->ringId = ringId;
+#endif
+}
+/******************************************************************************/
+/* Is there room in this batch's ring for one more packet, counting what is
+ * already waiting in the batch.
+ */
+LOCAL inline int arkime_packet_ring_full(const ArkimePacketBatch_t *batch, int thread)
+{
+    if (batch->ringId < 0)
+        return 0;
+
+    const ArkimePacketRing_t *ring = packetRings[thread][batch->ringId];
+    uint32_t used = ring->tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return used + DLL_COUNT(packet_, &batch->packetQ[thread]) >= packetRingSize;
+}
+/******************************************************************************/
+LOCAL void arkime_packet_ring_flush(ArkimePacketBatch_t *batch, int t)
+{
+    ArkimePacketRing_t *ring = packetRings[t][batch->ringId];
+    ArkimePacket_t     *packet;
+    uint32_t            tail = ring->tail;
+
+    // Count before publishing so the packet thread never sees more packets than the count
+    __sync_add_and_fetch(&packetRingCount[t], DLL_COUNT(packet_, &batch->packetQ[t]));
+
+    while (DLL_POP_HEAD(packet_, &batch->packetQ[t], packet)) {
+        ring->slots[tail & packetRingMask] = packet;
+        tail++;
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (packetRingParked[t]) {
+        ARKIME_LOCK(packetQ[t].lock);
+        ARKIME_COND_SIGNAL(packetQ[t].lock);
+        ARKIME_UNLOCK(packetQ[t].lock);
+    }
 }
 /******************************************************************************/
 void arkime_packet_batch_flush(ArkimePacketBatch_t *batch)
@@ -1251,6 +1615,10 @@ void arkime_packet_batch_flush(ArkimePacketBatch_t *batch)
 
     for (t = 0; t < config.packetThreads; t++) {
         if (DLL_COUNT(packet_, &batch->packetQ[t]) > 0) {
+            if (batch->ringId >= 0) {
+                arkime_packet_ring_flush(batch, t);
+                continue;
+            }
             ARKIME_LOCK(packetQ[t].lock);
             DLL_PUSH_TAIL_DLL(packet_, &packetQ[t], &batch->packetQ[t]);
             ARKIME_COND_SIGNAL(packetQ[t].lock);
@@ -1370,7 +1738,10 @@ void arkime_packet_batch(ArkimePacketBatch_t *batch, ArkimePacket_t *const packe
 
     totalBytes[thread] += packet->pktlen;
 
-    if (DLL_COUNT(packet_, &packetQ[thread]) >= config.maxPacketsInQueue) {
+    if (unlikely(batch->ringId == -2))
+        arkime_packet_ring_assign(batch);
+
+    if (arkime_packet_queue_length(thread) >= config.maxPacketsInQueue || arkime_packet_ring_full(batch, thread)) {
         ARKIME_LOCK(packetQ[thread].lock);
         overloadDrops[thread]++;
         if ((overloadDrops[thread] % 10000) == 1 && (overloadDropTimes[thread] + 60) < packet->ts.tv_sec) {
@@ -1384,11 +1755,9 @@ void arkime_packet_batch(ArkimePacketBatch_t *batch, ArkimePacket_t *const packe
         return;
     }
 
-    if (!packet->copied) {
-        uint8_t *pkt = malloc(packet->pktlen);
-        memcpy(pkt, packet->pkt, packet->pktlen);
-        packet->pkt = pkt;
-        packet->copied = 1;
+    // Packets still in reader memory are only copied if something needs to hold them
+    if (!packet->block) {
+        arkime_packet_copy(packet);
     }
 
 #ifdef FUZZLOCH
@@ -1406,7 +1775,7 @@ int arkime_packet_outstanding()
     int t;
 
     for (t = 0; t < config.packetThreads; t++) {
-        count += DLL_COUNT(packet_, &packetQ[t]);
+        count += arkime_packet_queue_length(t);
         count += inProgress[t];
     }
     return count;
@@ -1732,6 +2101,33 @@ void arkime_packet_init()
                         "fieldECS", "network.community_id",
                         (char *)NULL);
 
+    char *strQueueMode = arkime_config_str(NULL, "packetQueueMode", "lock");
+    if (strcmp(strQueueMode, "lock") == 0) {
+        packetQueueRing = 0;
+    } else if (strcmp(strQueueMode, "ring") == 0) {
+        packetQueueRing = 1;
+        packetRingSize = arkime_get_next_powerof2(arkime_config_int(NULL, "packetQueueRingSize", config.maxPacketsInQueue, 1024, 0x1000000));
+        packetRingMask = packetRingSize - 1;
+        packetRingSpin = arkime_config_int(NULL, "packetQueueSpin", 2000, 0, 1000000);
+    } else {
+        CONFIGEXIT("Unknown packetQueueMode '%s'", strQueueMode);
+    }
+    g_free(strQueueMode);
+
+    // Offline readers wait for the packet threads instead of dropping, so off by default
+    elephantPackets = arkime_config_int(NULL, "elephantPackets", config.pcapReadOffline ? 0 : 2000, 0, 0x7fffffff);
+    if (elephantPackets == 0)
+        elephantPackets = 0xffffffff;
+    const uint32_t elephantQueuePercent = arkime_config_int(NULL, "elephantQueuePercent", 50, 1, 100);
+    elephantHighWater = (uint64_t)config.maxPacketsInQueue * elephantQueuePercent / 100;
+    elephantLowWater = elephantHighWater / 4;
+    // Lets tests run sessions thru the light path without overloading a thread
+    if (config.tests)
+        elephantAlwaysHot = arkime_config_boolean(NULL, "elephantAlwaysHot", FALSE);
+    if (elephantAlwaysHot)
+        memset(packetThreadHot, 1, sizeof(packetThreadHot));
+    g_timeout_add_seconds(1, arkime_packet_thread_load, 0);
+
     int t;
     for (t = 0; t < config.packetThreads; t++) {
         char name[100];
@@ -1740,7 +2136,7 @@ void arkime_packet_init()
         ARKIME_COND_INIT(packetQ[t].lock);
         snprintf(name, sizeof(name), "arkime-pkt%d", t);
 #ifndef FUZZLOCH
-        g_thread_unref(g_thread_new(name, &arkime_packet_thread, (gpointer)(long)t));
+        g_thread_unref(g_thread_new(name, packetQueueRing ? &arkime_packet_ring_thread : &arkime_packet_thread, (gpointer)(long)t));
 #endif
     }
 
@@ -1800,29 +2196,29 @@ void arkime_packet_add_packet_ip(char *ipstr, int mode)
 {
     patricia_node_t *node;
     if (strchr(ipstr, '.') != 0) {
-        if (!ipTree4)
-            newipTree4 = New_Patricia(32);
-        node = make_and_lookup(newipTree4, ipstr);
+        if (!newipTree4)
+            newipTree4 = arkime_lpm_new(32, NULL);
+        node = make_and_lookup(arkime_lpm_tree(newipTree4), ipstr);
     } else {
-        if (!ipTree6)
-            newipTree6 = New_Patricia(128);
-        node = make_and_lookup(newipTree6, ipstr);
+        if (!newipTree6)
+            newipTree6 = arkime_lpm_new(128, NULL);
+        node = make_and_lookup(arkime_lpm_tree(newipTree6), ipstr);
     }
     node->data = (void *)(long)mode;
 }
 /******************************************************************************/
-LOCAL void arkime_packet_free_packet_ips(patricia_tree_t *tree)
-{
-    Destroy_Patricia(tree, NULL);
-}
-/******************************************************************************/
 void arkime_packet_install_packet_ip()
 {
-    arkime_free_later(ipTree4, (GDestroyNotify) arkime_packet_free_packet_ips);
+    if (newipTree4)
+        arkime_lpm_compile(newipTree4);
+    if (newipTree6)
+        arkime_lpm_compile(newipTree6);
+
+    arkime_free_later(ipTree4, (GDestroyNotify) arkime_lpm_free);
     ipTree4 = newipTree4;
     newipTree4 = 0;
 
-    arkime_free_later(ipTree6, (GDestroyNotify) arkime_packet_free_packet_ips);
+    arkime_free_later(ipTree6, (GDestroyNotify) arkime_lpm_free);
     ipTree6 = newipTree6;
     newipTree6 = 0;
 }
@@ -1907,12 +2303,12 @@ void arkime_packet_drophash_add(ArkimeSession_t *session, int which, int min)
 void arkime_packet_exit()
 {
     if (ipTree4) {
-        Destroy_Patricia(ipTree4, NULL);
+        arkime_lpm_free(ipTree4);
         ipTree4 = 0;
     }
 
     if (ipTree6) {
-        Destroy_Patricia(ipTree6, NULL);
+        arkime_lpm_free(ipTree6);
         ipTree6 = 0;
     }
     arkime_packet_log(SESSION_TCP);
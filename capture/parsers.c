@@ -10,6 +10,9 @@
 #include "gmodule.h"
 #include "magic.h"
 #include "bsb.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 //#define DEBUG_PARSERS 1
 
@@ -27,6 +30,9 @@ enum ArkimeMagicMode { ARKIME_MAGICMODE_LIBMAGIC, ARKIME_MAGICMODE_BOTH, ARKIME_
 
 LOCAL enum ArkimeMagicMode magicMode;
 
+LOCAL int                  classifyBenchmark;
+LOCAL void arkime_parsers_classify_bench_exit();
+
 /******************************************************************************/
 typedef struct {
     GPtrArray *funcs;
@@ -38,296 +44,347 @@ LOCAL uint16_t           namedFuncsMax = 0;
 LOCAL ArkimeNamedInfo_t *namedFuncsArr[MAX_NAMED_FUNCS];
 LOCAL GHashTable        *namedFuncsHash;
 /******************************************************************************/
-#define MAGIC_MATCH(offset, needle) memcmp(data+offset, needle, sizeof(needle)-1) == 0
-#define MAGIC_MATCH_LEN(offset, needle) ((len > (int)sizeof(needle)-1+offset) && (memcmp(data+offset, needle, sizeof(needle)-1) == 0))
+/* Basic magic is table driven.  Signatures are bucketed by their first byte,
+ * in the order they should be tried, and the first 16 bytes of the data are
+ * compared against each candidate with one masked 16 byte compare.  Parts of
+ * a signature past the first 16 bytes, substring searches and the odd extra
+ * check are only looked at after the 16 byte compare passes.  Signatures in
+ * the MAGIC_ANY bucket are tried for any first byte if nothing else matched.
+ */
+#define MAGIC_ANY        256
+#define MAGIC_CASE       0x01
 
-#define MAGIC_MEMSTR(offset, needle) arkime_memstr(data+offset, len-offset, needle, sizeof(needle)-1)
-#define MAGIC_MEMSTR_LEN(offset, needle) ((len > (int)sizeof(needle)-1+offset) && (arkime_memstr(data+offset, len-offset, needle, sizeof(needle)-1)))
+typedef struct {
+    uint16_t     first;                 // data[0] or MAGIC_ANY
+    uint16_t     flags;
+    uint16_t     minLen;                // len must be at least this
+    uint16_t     offset1;
+    const char  *match1;
+    uint16_t     len1;
+    uint16_t     offset2;
+    const char  *match2;
+    uint16_t     len2;
+    uint16_t     containsOffset;        // memstr of contains must be found starting at containsOffset
+    const char  *contains;
+    uint16_t     containsLen;
+    int        (*check)(const char *data, int len);
+    const char  *result;
+    uint16_t     resultLen;
+} ArkimeMagicSig_t;
 
-#define MAGIC_STRCASE(offset, needle) strncasecmp(data+offset, needle, sizeof(needle)-1) == 0
-#define MAGIC_STRCASE_LEN(offset, needle) ((len > (int)sizeof(needle)-1+offset) && (strncasecmp(data+offset, needle, sizeof(needle)-1) == 0))
+typedef struct {
+    uint8_t      value[16];
+    uint8_t      mask[16];
+    uint16_t     tailOffset[2];         // Parts of match1/match2 past the first 16 bytes
+    uint16_t     tailLen[2];
+    const char  *tail[2];
+} ArkimeMagicCompiled_t;
+
+#define MAGIC_SIG(first, flags, minLen, off1, m1, off2, m2, coff, c, check, result) \
+    {(first) == MAGIC_ANY ? MAGIC_ANY : (uint8_t)(first), flags, minLen, off1, m1, sizeof(m1) - 1, off2, m2, sizeof(m2) - 1, coff, c, sizeof(c) - 1, check, result, sizeof(result) - 1}
+
+// match at offset, len is at least the end of the match, MAGIC_MATCH
+#define MAGIC_M(first, off, m, result)             MAGIC_SIG(first, 0, (off) + sizeof(m) - 1, off, m, 0, "", 0, "", NULL, result)
+// match at offset, len is past the end of the match, MAGIC_MATCH_LEN
+#define MAGIC_ML(first, off, m, result)            MAGIC_SIG(first, 0, (off) + sizeof(m), off, m, 0, "", 0, "", NULL, result)
+// case insensitive match
+#define MAGIC_C(first, m, minLen, result)          MAGIC_SIG(first, MAGIC_CASE, minLen, 0, m, 0, "", 0, "", NULL, result)
+// match and then memstr of c past coff
+#define MAGIC_MS(first, flags, m, coff, c, result) MAGIC_SIG(first, flags, sizeof(m) - 1, 0, m, 0, "", coff, c, NULL, result)
+
+LOCAL int arkime_parsers_magic_json(const char *data, int UNUSED(len))
+{
+    return isalpha(data[2]);
+}
 
-#define MAGIC_RESULT(str) arkime_field_string_add(field, session, str, sizeof(str)-1, TRUE), str
-const char *arkime_parsers_magic_basic(ArkimeSession_t *session, int field, const char *data, int len)
+LOCAL ArkimeMagicSig_t magicSigs[] = {
+    MAGIC_SIG(0, 0, 11, 4, "ftypqt", 0, "", 0, "", NULL, "video/quicktime"),
+    MAGIC_SIG(0, 0, 11, 4, "ftyp3g", 0, "", 0, "", NULL, "video/3gpp"),
+    MAGIC_M(0, 0, "\000\001\000\000\000", "application/x-font-ttf"),
+    MAGIC_M(0, 0, "\000\000\002\000\001\000", "image/x-win-bitmap"),
+
+    MAGIC_MS('\032', 0, "\x1a\x45\xdf\xa3", 4, "webm", "video/webm"),
+    MAGIC_MS('\032', 0, "\x1a\x45\xdf\xa3", 4, "matroska", "video/x-matroska"),
+
+    MAGIC_M('\037', 0, "\037\213", "application/x-gzip"),
+    MAGIC_M('\037', 0, "\037\235", "application/x-compress"),
+
+    MAGIC_ML('!', 1, "<arch>\ndebian-binary", "application/x-debian-package"),
+
+    MAGIC_MS('#', 0, "#!", 3, "node", "application/javascript"),
+    MAGIC_MS('#', 0, "#!", 3, "perl", "text/x-perl"),
+    MAGIC_MS('#', 0, "#!", 3, "ruby", "text/x-ruby"),
+    MAGIC_MS('#', 0, "#!", 3, "python", "text/x-python"),
+    MAGIC_M('#', 0, "#!", "text/x-shellscript"),
+
+    MAGIC_M('%', 0, "%PDF-", "application/pdf"),
+
+    MAGIC_C('<', "<!doctype html", 15, "text/html"),
+    MAGIC_C('<', "<!doctype svg", 14, "text/svg+xml"),
+    MAGIC_MS('<', MAGIC_CASE, "<?xml", 5, "<svg", "image/svg+xml"),
+    MAGIC_C('<', "<?xml", 5, "text/xml"),
+    MAGIC_C('<', "<?php", 6, "text/x-php"),
+    MAGIC_C('<', "<? php", 7, "text/x-php"),
+    MAGIC_C('<', "<body", 5, "text/html"),
+    MAGIC_C('<', "<head", 5, "text/html"),
+    MAGIC_C('<', "<html", 5, "text/html"),
+    MAGIC_C('<', "<svg", 4, "image/svg"),
+
+    MAGIC_SIG('{', 0, 3, 0, "{\"", 0, "", 0, "", arkime_parsers_magic_json, "application/json"),
+
+    MAGIC_M('8', 0, "8BPS", "image/vnd.adobe.photoshop"),
+
+    MAGIC_M('B', 0, "BM", "application/x-ms-bmp"),
+    MAGIC_M('B', 0, "BZh", "application/x-bzip2"),
+
+    MAGIC_M('C', 0, "CWS", "application/x-shockwave-flash"),
+
+    MAGIC_M('F', 0, "FLV\001", "video/x-flv"),
+
+    MAGIC_M('G', 0, "GIF8", "image/gif"),
+    MAGIC_SIG('G', 0, 189, 2, "\000", 188, "G", 0, "", NULL, "video/mp2t"),
+
+    MAGIC_M('i', 0, "icns", "image/x-icns"),
+
+    MAGIC_M('I', 0, "ID3", "audio/mpeg"),
+
+    MAGIC_M('M', 0, "MZ", "application/x-dosexec"),
+    MAGIC_ML('M', 0, "MSCF\000\000", "application/vnd.ms-cab-compressed"),
+
+    // https://speex.org/docs/manual/speex-manual/node8.html
+    MAGIC_SIG('O', 0, 41, 0, "OggS", 28, "Speex   ", 0, "", NULL, "audio/ogg"),
+    // https://xiph.org/flac/ogg_mapping.html
+    MAGIC_SIG('O', 0, 41, 0, "OggS", 29, "FLAC", 0, "", NULL, "audio/ogg"),
+    // https://xiph.org/vorbis/doc/Vorbis_I_spec.html
+    MAGIC_SIG('O', 0, 41, 0, "OggS", 28, "\001vorbis", 0, "", NULL, "audio/ogg"),
+    // https://www.theora.org/doc/Theora.pdf
+    MAGIC_SIG('O', 0, 41, 0, "OggS", 28, "\x80theora", 0, "", NULL, "video/ogg"),
+    MAGIC_M('O', 0, "OTTO", "application/vnd.ms-opentype"),
+
+    MAGIC_M('P', 0, "PK\003\004", "application/zip"),
+    MAGIC_M('P', 0, "PK\005\006", "application/zip"),
+    MAGIC_ML('P', 0, "PK\007\0008PK", "application/zip"),
+
+    MAGIC_M('R', 0, "RIFF", "audio/x-wav"),
+    MAGIC_M('R', 0, "Rar!\x1a", "application/x-rar"),
+
+    MAGIC_M('W', 0, "WAVE", "audio/x-wav"),
+
+    MAGIC_ML('d', 0, "d8:announce", "application/x-bittorrent"),
+
+    MAGIC_M('w', 0, "wOFF", "application/font-woff"),
+    MAGIC_M('w', 0, "wOF2", "application/font-woff2"),
+
+    MAGIC_M('\x89', 0, "\x89PNG", "image/png"),
+
+    MAGIC_ML('\375', 0, "\3757zXZ", "application/x-xz"),
+
+    MAGIC_SIG('\377', 0, 11, 0, "\377\330\377", 0, "", 0, "", NULL, "image/jpeg"),
+
+    MAGIC_SIG('\xed', 0, 11, 0, "\xed\xab\xee\xdb", 0, "", 0, "", NULL, "application/x-rpm"),
+
+    MAGIC_ML(MAGIC_ANY, 257, "ustar", "application/x-tar"),
+    MAGIC_SIG(MAGIC_ANY, 0, 0, 0, "", 0, "", 0, "document.write", NULL, "text/javascript"),
+    MAGIC_SIG(MAGIC_ANY, 0, 0, 0, "", 0, "", 0, "'use strict'", NULL, "text/javascript")
+};
+
+#define MAGIC_SIGS_CNT (int)(sizeof(magicSigs) / sizeof(magicSigs[0]))
+
+LOCAL ArkimeMagicCompiled_t magicCompiled[MAGIC_SIGS_CNT];
+LOCAL uint8_t               magicOrder[MAGIC_SIGS_CNT];
+LOCAL uint8_t               magicBucketStart[MAGIC_ANY + 2];
+
+/******************************************************************************/
+LOCAL void arkime_parsers_magic_compile_part(ArkimeMagicCompiled_t *mc, int part, int caseless, int offset, const char *match, int len)
 {
-    switch (data[0]) {
-    case 0:
-        if (len > 10 && MAGIC_MATCH(4, "ftyp")) {
-            if (MAGIC_MATCH(8, "qt")) {
-                return MAGIC_RESULT("video/quicktime");
-            }
-            if (MAGIC_MATCH(8, "3g")) {
-                return MAGIC_RESULT("video/3gpp");
-            }
-        }
-        if (MAGIC_MATCH(0, "\000\001\000\000\000")) {
-            return MAGIC_RESULT("application/x-font-ttf");
-        }
-        if (MAGIC_MATCH(0, "\000\000\002\000\001\000")) {
-            return MAGIC_RESULT("image/x-win-bitmap");
-        }
-        break;
-    case '\032':
-        if (MAGIC_MATCH(0, "\x1a\x45\xdf\xa3")) {
-            if (MAGIC_MEMSTR_LEN(4, "webm")) {
-                return MAGIC_RESULT("video/webm");
-            }
-            if (MAGIC_MEMSTR_LEN(4, "matroska")) {
-                return MAGIC_RESULT("video/x-matroska");
-            }
-        }
-        break;
-    case '\037':
-        if (data[1] == '\213') {
-            return MAGIC_RESULT("application/x-gzip");
-        }
-        if (data[1] == '\235') {
-            return MAGIC_RESULT("application/x-compress");
+    for (int i = 0; i < len; i++) {
+        int pos = offset + i;
+        if (pos >= 16) {
+            mc->tailOffset[part] = pos;
+            mc->tail[part] = match + i;
+            mc->tailLen[part] = len - i;
+            return;
         }
-        break;
-#ifdef OID_DECODE_SOMEDAY
-    case 0x30:
-        if (len > 100 && (gchar)data[1] == (gchar)0x82) {
-            ArkimeASNSeq_t seq[5];
-            int i;
-            int num = arkime_parsers_asn_get_sequence(seq, 5, (uint8_t *)data, len, TRUE);
-            for (i = 0; i < num; i++) {
-                if (seq[i].pc && seq[i].tag == 16) {
-                    BSB tbsb;
-                    BSB_INIT(tbsb, seq[i].value, seq[i].len);
-                    uint32_t ipc, itag, ilen;
-                    uint8_t *ivalue;
-                    ivalue = arkime_parsers_asn_get_tlv(&tbsb, &ipc, &itag, &ilen);
-                    if (itag != 6)
-                        continue;
-                    char oid[100];
-                    arkime_parsers_asn_decode_oid(oid, sizeof(oid), ivalue, ilen);
-                    printf("%s ", oid);
-                    arkime_print_hex_string(ivalue, ilen);
-                    if (ilen == 9 && MAGIC_MATCH(ivalue, "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x05")) {
-                    }
-                }
-            }
+        uint8_t c = match[i];
+        if (caseless && isalpha(c)) {
+            mc->mask[pos] = 0xdf;
+            mc->value[pos] = c & 0xdf;
+        } else {
+            mc->mask[pos] = 0xff;
+            mc->value[pos] = c;
         }
-        break;
+    }
+}
+/******************************************************************************/
+LOCAL void arkime_parsers_magic_compile()
+{
+    int cnt[MAGIC_ANY + 1];
+    int i;
+
+    memset(cnt, 0, sizeof(cnt));
+    for (i = 0; i < MAGIC_SIGS_CNT; i++) {
+        const ArkimeMagicSig_t *sig = &magicSigs[i];
+        ArkimeMagicCompiled_t  *mc = &magicCompiled[i];
+
+        memset(mc, 0, sizeof(*mc));
+        arkime_parsers_magic_compile_part(mc, 0, sig->flags & MAGIC_CASE, sig->offset1, sig->match1, sig->len1);
+        arkime_parsers_magic_compile_part(mc, 1, sig->flags & MAGIC_CASE, sig->offset2, sig->match2, sig->len2);
+        cnt[sig->first]++;
+    }
+
+    // Stable bucket sort so signatures keep their table order in each bucket
+    magicBucketStart[0] = 0;
+    for (i = 0; i <= MAGIC_ANY; i++)
+        magicBucketStart[i + 1] = magicBucketStart[i] + cnt[i];
+
+    memset(cnt, 0, sizeof(cnt));
+    for (i = 0; i < MAGIC_SIGS_CNT; i++) {
+        int first = magicSigs[i].first;
+        magicOrder[magicBucketStart[first] + cnt[first]++] = i;
+    }
+}
+/******************************************************************************/
+LOCAL inline int arkime_parsers_magic_prefix(const uint8_t *prefix, const ArkimeMagicCompiled_t *mc)
+{
+#ifdef __SSE2__
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)prefix), _mm_loadu_si128((const __m128i *)mc->mask));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_loadu_si128((const __m128i *)mc->value))) == 0xffff;
+#else
+    uint64_t p[2], m[2], v[2];
+    memcpy(p, prefix, 16);
+    memcpy(m, mc->mask, 16);
+    memcpy(v, mc->value, 16);
+    return ((p[0] & m[0]) == v[0]) & ((p[1] & m[1]) == v[1]);
 #endif
-    case '!':
-        if (MAGIC_MATCH_LEN(1, "<arch>\ndebian-binary")) {
-            return MAGIC_RESULT("application/x-debian-package");
-        }
-        break;
-    case '#':
-        if (data[1] == '!') {
-            if (MAGIC_MEMSTR_LEN(3, "node")) {
-                return MAGIC_RESULT("application/javascript");
-            } else if (MAGIC_MEMSTR_LEN(3, "perl")) {
-                return MAGIC_RESULT("text/x-perl");
-            } else if (MAGIC_MEMSTR_LEN(3, "ruby")) {
-                return MAGIC_RESULT("text/x-ruby");
-            } else if (MAGIC_MEMSTR_LEN(3, "python")) {
-                return MAGIC_RESULT("text/x-python");
-            }
-            return MAGIC_RESULT("text/x-shellscript");
-        }
-        break;
-    case '%':
-        if (MAGIC_MATCH(0, "%PDF-")) {
-            return MAGIC_RESULT("application/pdf");
-        }
-        break;
-    case '<':
-        switch(data[1]) {
-        case '!':
-            if (MAGIC_STRCASE_LEN(0, "<!doctype html")) {
-                return MAGIC_RESULT("text/html");
-            }
-            if (MAGIC_STRCASE_LEN(0, "<!doctype svg")) {
-                return MAGIC_RESULT("text/svg+xml");
-            }
-            break;
-        case '?':
-            if (MAGIC_STRCASE(0, "<?xml")) {
-                if (MAGIC_MEMSTR_LEN(5, "<svg")) {
-                    return MAGIC_RESULT("image/svg+xml");
-                }
-                return MAGIC_RESULT("text/xml");
-            }
-            if (MAGIC_STRCASE_LEN(2, "php") || MAGIC_STRCASE_LEN(2, " php")) {
-                return MAGIC_RESULT("text/x-php");
-            }
-            break;
-        case 'B':
-        case 'b':
-            if (MAGIC_STRCASE(0, "<body")) {
-                return MAGIC_RESULT("text/html");
-            }
-            break;
-        case 'H':
-        case 'h':
-            if (MAGIC_STRCASE(0, "<head")) {
-                return MAGIC_RESULT("text/html");
-            }
-            if (MAGIC_STRCASE(0, "<html")) {
-                return MAGIC_RESULT("text/html");
-            }
-            break;
-        case 's':
-        case 'S':
-            if (MAGIC_STRCASE(0, "<svg")) {
-                return MAGIC_RESULT("image/svg");
-            }
-            break;
-        }
-        break;
-    case '{':
-        if (data[1] == '"' && isalpha(data[2])) {
-            return MAGIC_RESULT("application/json");
-        }
-        break;
-    case '8':
-        if (MAGIC_MATCH(0, "8BPS")) {
-            return MAGIC_RESULT("image/vnd.adobe.photoshop");
-        }
-        break;
-    case 'B':
-        if (data[1] == 'M') {
-            return MAGIC_RESULT("application/x-ms-bmp");
-        }
+}
+/******************************************************************************/
+LOCAL const ArkimeMagicSig_t *arkime_parsers_magic_bucket(int bucket, const uint8_t *prefix, const char *data, int len)
+{
+    for (int o = magicBucketStart[bucket]; o < magicBucketStart[bucket + 1]; o++) {
+        const int                    i = magicOrder[o];
+        const ArkimeMagicSig_t      *sig = &magicSigs[i];
+        const ArkimeMagicCompiled_t *mc = &magicCompiled[i];
 
-        if (MAGIC_MATCH(0, "BZh")) {
-            return MAGIC_RESULT("application/x-bzip2");
-        }
-        break;
-    case 'C':
-        if (MAGIC_MATCH(0, "CWS")) {
-            return MAGIC_RESULT("application/x-shockwave-flash");
-        }
-        break;
-    case 'F':
-        if (MAGIC_MATCH(0, "FLV\001")) {
-            return MAGIC_RESULT("video/x-flv");
-        }
-        break;
-    case 'G':
-        if (MAGIC_MATCH(0, "GIF8")) {
-            return MAGIC_RESULT("image/gif");
-        }
-        if (len > 188 && data[2] == 0 && data[188] == 'G') {
-            return MAGIC_RESULT("video/mp2t");
-        }
-        break;
-    case 'i':
-        if (MAGIC_MATCH(0, "icns")) {
-            return MAGIC_RESULT("image/x-icns");
-        }
-        break;
-    case 'I':
-        if (MAGIC_MATCH(0, "ID3")) {
-            return MAGIC_RESULT("audio/mpeg");
-        }
-        break;
-    case 'M':
-        if (data[1] == 'Z') {
-            return MAGIC_RESULT("application/x-dosexec");
-        }
-        if (MAGIC_MATCH_LEN(0, "MSCF\000\000")) {
-            return MAGIC_RESULT("application/vnd.ms-cab-compressed");
-        }
-        break;
-    case 'O':
-        if (len > 40 && MAGIC_MATCH(0, "OggS")) {
-            // https://speex.org/docs/manual/speex-manual/node8.html
-            if (MAGIC_MATCH(28, "Speex   ")) {
-                return MAGIC_RESULT("audio/ogg");
-            }
+        if (len < sig->minLen || !arkime_parsers_magic_prefix(prefix, mc))
+            continue;
 
-            // https://xiph.org/flac/ogg_mapping.html
-            if (MAGIC_MATCH(29, "FLAC")) {
-                return MAGIC_RESULT("audio/ogg");
-            }
+        if (mc->tailLen[0] && (len < mc->tailOffset[0] + mc->tailLen[0] || memcmp(data + mc->tailOffset[0], mc->tail[0], mc->tailLen[0]) != 0))
+            continue;
 
-            // https://xiph.org/vorbis/doc/Vorbis_I_spec.html
-            if (MAGIC_MATCH(28, "\001vorbis")) {
-                return MAGIC_RESULT("audio/ogg");
-            }
+        if (mc->tailLen[1] && (len < mc->tailOffset[1] + mc->tailLen[1] || memcmp(data + mc->tailOffset[1], mc->tail[1], mc->tailLen[1]) != 0))
+            continue;
 
-            // https://www.theora.org/doc/Theora.pdf
-            if (MAGIC_MATCH(28, "\x80theora")) {
-                return MAGIC_RESULT("video/ogg");
-            }
-        } else if (MAGIC_MATCH(0, "OTTO")) {
-            return MAGIC_RESULT("application/vnd.ms-opentype");
-        }
-        break;
-    case 'P':
-        if (MAGIC_MATCH(0, "PK\003\004")) {
-            return MAGIC_RESULT("application/zip");
-        }
-        if (MAGIC_MATCH(0, "PK\005\006")) {
-            return MAGIC_RESULT("application/zip");
-        }
-        if (MAGIC_MATCH_LEN(0, "PK\007\008PK")) {
-            return MAGIC_RESULT("application/zip");
-        }
-        break;
-    case 'R':
-        if (MAGIC_MATCH(0, "RIFF")) {
-            return MAGIC_RESULT("audio/x-wav");
-        }
-        if (MAGIC_MATCH(0, "Rar!\x1a")) {
-            return MAGIC_RESULT("application/x-rar");
-        }
-        break;
-    case 'W':
-        if (MAGIC_MATCH(0, "WAVE")) {
-            return MAGIC_RESULT("audio/x-wav");
-        }
-        break;
-    case 'd':
-        if (MAGIC_MATCH_LEN(0, "d8:announce")) {
-            return MAGIC_RESULT("application/x-bittorrent");
-        }
-        break;
-    case 'w':
-        if (MAGIC_MATCH(0, "wOFF")) {
-            return MAGIC_RESULT("application/font-woff");
-        }
-        if (MAGIC_MATCH(0, "wOF2")) {
-            return MAGIC_RESULT("application/font-woff2");
-        }
-        break;
-    case '\x89':
-        if (MAGIC_MATCH(0, "\x89PNG")) {
-            return MAGIC_RESULT("image/png");
-        }
-        break;
-    case '\375':
-        if (MAGIC_MATCH_LEN(0, "\3757zXZ")) {
-            return MAGIC_RESULT("application/x-xz");
-        }
-        break;
-    case '\377':
-        if (len > 10 && MAGIC_MATCH(0, "\377\330\377")) {
-            return MAGIC_RESULT("image/jpeg");
-        }
-        break;
-    case '\xed':
-        if (len > 10 && MAGIC_MATCH(0, "\xed\xab\xee\xdb")) {
-            return MAGIC_RESULT("application/x-rpm");
-        }
-        break;
-    } /* switch */
+        if (sig->containsLen && (len <= sig->containsOffset + sig->containsLen ||
+                                 !arkime_memstr(data + sig->containsOffset, len - sig->containsOffset, sig->contains, sig->containsLen)))
+            continue;
 
-    if (MAGIC_MATCH_LEN(257, "ustar")) {
-        return MAGIC_RESULT("application/x-tar");
-    }
-    if (MAGIC_MEMSTR_LEN(0, "document.write") ||
-        MAGIC_MEMSTR_LEN(0, "'use strict'")) {
-        return MAGIC_RESULT("text/javascript");
+        if (sig->check && !sig->check(data, len))
+            continue;
+
+        return sig;
     }
     return NULL;
 }
 /******************************************************************************/
+const char *arkime_parsers_magic_basic(ArkimeSession_t *session, int field, const char *data, int len)
+{
+    uint8_t prefix[16];
+
+    if (len >= 16) {
+        memcpy(prefix, data, 16);
+    } else {
+        memcpy(prefix, data, len);
+        memset(prefix + len, 0, 16 - len);
+    }
+
+    const ArkimeMagicSig_t *sig = arkime_parsers_magic_bucket(prefix[0], prefix, data, len);
+    if (!sig)
+        sig = arkime_parsers_magic_bucket(MAGIC_ANY, prefix, data, len);
+    if (!sig)
+        return NULL;
+
+    arkime_field_string_add(field, session, sig->result, sig->resultLen, TRUE);
+    return sig->result;
+}
+/******************************************************************************/
+/* libmagic only looks at the first MAGIC_CACHE_BYTES, so its answer is cached
+ * per packet thread keyed on exactly those bytes.  Answers are interned since
+ * the buffer libmagic returns is reused.
+ */
+#define MAGIC_CACHE_BYTES 50
+
+typedef struct {
+    const char  *result;                // NULL is a cached unknown
+    uint16_t     resultLen;
+    uint8_t      len;                   // 0 is an empty entry
+    uint8_t      data[MAGIC_CACHE_BYTES];
+} ArkimeMagicCacheEntry_t;
+
+typedef struct {
+    ArkimeMagicCacheEntry_t *entries;
+    uint64_t                 hits;
+    uint64_t                 misses;
+} ArkimeMagicCache_t;
+
+LOCAL uint32_t              magicCacheSize;
+LOCAL ArkimeMagicCache_t    magicCache[ARKIME_MAX_PACKET_THREADS];
+LOCAL GHashTable           *magicStrings;
+LOCAL ARKIME_LOCK_DEFINE(magicStrings);
+
+/******************************************************************************/
+LOCAL const char *arkime_parsers_magic_libmagic(ArkimeSession_t *session, int field, const char *data, int len)
+{
+    const int                mlen = MIN(len, MAGIC_CACHE_BYTES);
+    ArkimeMagicCache_t      *cache = &magicCache[session->thread];
+    ArkimeMagicCacheEntry_t *entry = NULL;
+
+    if (cache->entries) {
+        entry = &cache->entries[arkime_string_hash_len(data, mlen) & (magicCacheSize - 1)];
+        if (entry->len == mlen && memcmp(entry->data, data, mlen) == 0) {
+            cache->hits++;
+            if (!entry->result)
+                return NULL;
+            return arkime_field_string_add(field, session, entry->result, entry->resultLen, TRUE);
+        }
+        cache->misses++;
+    }
+
+    const char *m = magic_buffer(cookie[session->thread], data, mlen);
+    int         resultLen = 0;
+    if (m) {
+        char *semi = strchr(m, ';');
+        if (semi) {
+            resultLen = semi - m;
+        } else {
+            resultLen = strlen(m);
+        }
+    }
+
+    if (entry) {
+        const char *result = NULL;
+        if (m) {
+            char *key = g_strndup(m, resultLen);
+            ARKIME_LOCK(magicStrings);
+            result = g_hash_table_lookup(magicStrings, key);
+            if (!result) {
+                g_hash_table_add(magicStrings, key);
+                result = key;
+            } else {
+                g_free(key);
+            }
+            ARKIME_UNLOCK(magicStrings);
+        }
+        entry->result = result;
+        entry->resultLen = resultLen;
+        entry->len = mlen;
+        memcpy(entry->data, data, mlen);
+    }
+
+    if (!m)
+        return NULL;
+    return arkime_field_string_add(field, session, m, resultLen, TRUE);
+}
+/******************************************************************************/
 const char *arkime_parsers_magic(ArkimeSession_t *session, int field, const char *data, int len)
 {
     const char *m;
@@ -345,18 +402,7 @@ const char *arkime_parsers_magic(ArkimeSession_t *session, int field, const char
 
     // Fall thru
     case ARKIME_MAGICMODE_LIBMAGIC:
-        m = magic_buffer(cookie[session->thread], data, MIN(len, 50));
-        if (m) {
-            int mlen;
-            char *semi = strchr(m, ';');
-            if (semi) {
-                mlen = semi - m;
-            } else {
-                mlen = strlen(m);
-            }
-            return arkime_field_string_add(field, session, m, mlen, TRUE);
-        }
-        return NULL;
+        return arkime_parsers_magic_libmagic(session, field, data, len);
     case ARKIME_MAGICMODE_NONE:
     default:
         return NULL;
@@ -627,6 +673,10 @@ void arkime_parsers_init()
                                     "category", "user",
                                     (char *)NULL);
 
+    // Hidden and only with --tests, save first payloads and replay them thru the classify DFA and linear matcher at exit
+    if (config.tests)
+        classifyBenchmark = arkime_config_int(NULL, "classifyBenchmark", 0, 0, 1000000);
+
     int flags = MAGIC_MIME;
 
     char *strMagicMode = arkime_config_str(NULL, "magicMode", "both");
@@ -662,6 +712,8 @@ void arkime_parsers_init()
     flags |= MAGIC_NO_CHECK_CDF;
 #endif
 
+    arkime_parsers_magic_compile();
+
     if (magicMode == ARKIME_MAGICMODE_LIBMAGIC || magicMode == ARKIME_MAGICMODE_BOTH) {
         int t;
         for (t = 0; t < config.packetThreads; t++) {
@@ -672,6 +724,16 @@ void arkime_parsers_init()
                 magic_load(cookie[t], NULL);
             }
         }
+
+        // Number of libmagic answers to remember per packet thread, 0 to disable
+        magicCacheSize = arkime_config_int(NULL, "magicCacheSize", 4096, 0, 0x100000);
+        if (magicCacheSize) {
+            magicCacheSize = 1U << (32 - __builtin_clz((magicCacheSize - 1) | 1));
+            magicStrings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+            for (t = 0; t < config.packetThreads; t++) {
+                magicCache[t].entries = ARKIME_SIZE_ALLOC0("magic cache", sizeof(ArkimeMagicCacheEntry_t) * magicCacheSize);
+            }
+        }
     }
 
     ArkimeStringHashStd_t loaded;
@@ -845,11 +907,21 @@ void arkime_parsers_init()
 }
 /******************************************************************************/
 void arkime_parsers_exit() {
+    if (classifyBenchmark)
+        arkime_parsers_classify_bench_exit();
+
     if (magicMode == ARKIME_MAGICMODE_LIBMAGIC || magicMode == ARKIME_MAGICMODE_BOTH) {
         int t;
         for (t = 0; t < config.packetThreads; t++) {
             magic_close(cookie[t]);
+            if (magicCache[t].entries) {
+                if (config.debug)
+                    LOG("magic cache thread %d hits: %" PRIu64 " misses: %" PRIu64, t, magicCache[t].hits, magicCache[t].misses);
+                ARKIME_SIZE_FREE("magic cache", magicCache[t].entries);
+            }
         }
+        if (magicStrings)
+            g_hash_table_destroy(magicStrings);
     }
 }
 /******************************************************************************/
@@ -929,6 +1001,17 @@ void  arkime_parsers_unregister(ArkimeSession_t *session, void *uw)
     }
 }
 /******************************************************************************/
+/* Fixed offset classifiers are kept in one list per protocol and compiled into
+ * a DFA the first time they are needed after a registration.  A DFA state is
+ * the depth plus the set of patterns still possible and the set already
+ * matched, so walking the first bytes of a payload once lands on a state that
+ * knows every classifier to call.  Bytes are mapped to classes first, all the
+ * bytes that no pattern uses share class 0, which keeps the rows small.
+ *
+ * Classifiers are called in the same order as before the DFA, patterns with an
+ * offset or no bytes first, then 1 byte patterns, then longer ones, each group
+ * in registration order.
+ */
 typedef struct arkime_classify_t
 {
     const char          *name;
@@ -937,6 +1020,7 @@ typedef struct arkime_classify_t
     const uint8_t       *match;
     int                  matchlen;
     int                  minlen;
+    uint32_t             order;
     ArkimeClassifyFunc   func;
 } ArkimeClassify_t;
 
@@ -947,17 +1031,37 @@ typedef struct
     short               cnt;
 } ArkimeClassifyHead_t;
 
-LOCAL ArkimeClassifyHead_t classifersTcp0;
-LOCAL ArkimeClassifyHead_t classifersTcp1[256];
-LOCAL ArkimeClassifyHead_t classifersTcp2[256][256];
+typedef struct
+{
+    uint32_t            *next;          // Indexed by byte class, 0 is stop, NULL if nothing else can match
+    ArkimeClassify_t   **matches;
+    int                  matchCnt;
+} ArkimeClassifyState_t;
+
+typedef struct
+{
+    uint8_t                byteClass[256];
+    int                    numClasses;
+    int                    numStates;
+    ArkimeClassifyState_t *states;      // 0 is unused, 1 is the start state
+} ArkimeClassifyDfa_t;
+
+LOCAL ArkimeClassifyHead_t classifersTcp;
 LOCAL ArkimeClassifyHead_t classifersTcpPortSrc[0x10000];
 LOCAL ArkimeClassifyHead_t classifersTcpPortDst[0x10000];
+LOCAL ArkimeClassifyDfa_t *classifyTcpDfa;
 
-LOCAL ArkimeClassifyHead_t classifersUdp0;
-LOCAL ArkimeClassifyHead_t classifersUdp1[256];
-LOCAL ArkimeClassifyHead_t classifersUdp2[256][256];
+LOCAL ArkimeClassifyHead_t classifersUdp;
 LOCAL ArkimeClassifyHead_t classifersUdpPortSrc[0x10000];
 LOCAL ArkimeClassifyHead_t classifersUdpPortDst[0x10000];
+LOCAL ArkimeClassifyDfa_t *classifyUdpDfa;
+
+LOCAL ARKIME_LOCK_DEFINE(classifyDfa);
+LOCAL uint32_t             classifyOrder;
+
+LOCAL GPtrArray           *classifyBenchTcp;
+LOCAL GPtrArray           *classifyBenchUdp;
+LOCAL ARKIME_LOCK_DEFINE(classifyBench);
 
 /******************************************************************************/
 void arkime_parsers_classifier_add(ArkimeClassifyHead_t *ch, ArkimeClassify_t *c)
@@ -990,6 +1094,315 @@ void arkime_parsers_classifier_add(ArkimeClassifyHead_t *ch, ArkimeClassify_t *c
     ch->cnt++;
 }
 /******************************************************************************/
+LOCAL void arkime_parsers_classify_dfa_free(gpointer data)
+{
+    ArkimeClassifyDfa_t *dfa = data;
+
+    for (int s = 0; s < dfa->numStates; s++) {
+        g_free(dfa->states[s].next);
+        g_free(dfa->states[s].matches);
+    }
+    g_free(dfa->states);
+    ARKIME_TYPE_FREE(ArkimeClassifyDfa_t, dfa);
+}
+/******************************************************************************/
+LOCAL int arkime_parsers_classify_order_cmp(const void *a, const void *b)
+{
+    const ArkimeClassify_t *ca = *(const ArkimeClassify_t **)a;
+    const ArkimeClassify_t *cb = *(const ArkimeClassify_t **)b;
+
+    return (ca->order > cb->order) - (ca->order < cb->order);
+}
+/******************************************************************************/
+typedef struct
+{
+    GHashTable          *seen;
+    GPtrArray           *keys;
+} ArkimeClassifyBuild_t;
+
+/* State keys are [depth, aliveCnt, alive ids..., matched ids...] */
+LOCAL uint32_t arkime_parsers_classify_state(ArkimeClassifyBuild_t *build, const int *key, int keyLen)
+{
+    GBytes   *bytes = g_bytes_new(key, keyLen * sizeof(int));
+    gpointer  num;
+
+    if (g_hash_table_lookup_extended(build->seen, bytes, NULL, &num)) {
+        g_bytes_unref(bytes);
+        return GPOINTER_TO_UINT(num);
+    }
+
+    num = GUINT_TO_POINTER(build->keys->len);
+    g_ptr_array_add(build->keys, bytes);
+    g_hash_table_insert(build->seen, g_bytes_ref(bytes), num);
+    return GPOINTER_TO_UINT(num);
+}
+/******************************************************************************/
+LOCAL ArkimeClassifyDfa_t *arkime_parsers_classify_compile(const ArkimeClassifyHead_t *ch)
+{
+    ArkimeClassifyDfa_t *dfa = ARKIME_TYPE_ALLOC0(ArkimeClassifyDfa_t);
+    const int            n = ch->cnt;
+    ArkimeClassify_t   **pats = g_malloc(sizeof(ArkimeClassify_t *) * MAX(n, 1));
+    uint8_t              classByte[257];
+    int                  i, j;
+
+    if (n > 0)
+        memcpy(pats, ch->arr, sizeof(ArkimeClassify_t *) * n);
+    qsort(pats, n, sizeof(ArkimeClassify_t *), arkime_parsers_classify_order_cmp);
+
+    // Every byte used by a pattern gets its own class, everything else is class 0
+    dfa->numClasses = 1;
+    classByte[0] = 0;
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < pats[i]->matchlen; j++) {
+            uint8_t b = pats[i]->match[j];
+            if (!dfa->byteClass[b]) {
+                classByte[dfa->numClasses] = b;
+                dfa->byteClass[b] = dfa->numClasses++;
+            }
+        }
+    }
+
+    ArkimeClassifyBuild_t build;
+    build.seen = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, (GDestroyNotify)g_bytes_unref, NULL);
+    build.keys = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+    g_ptr_array_add(build.keys, g_bytes_new(NULL, 0)); // state 0 is stop
+
+    int *key = g_malloc(sizeof(int) * (n + 2));
+    int *added = g_malloc(sizeof(int) * MAX(n, 1));
+
+    // Start state, patterns with no bytes at offset 0 always match
+    int aliveCnt = 0, matchCnt = 0;
+    for (i = 0; i < n; i++) {
+        if (pats[i]->minlen > 0)
+            key[2 + aliveCnt++] = i;
+    }
+    for (i = 0; i < n; i++) {
+        if (pats[i]->minlen == 0)
+            key[2 + aliveCnt + matchCnt++] = i;
+    }
+    key[0] = 0;
+    key[1] = aliveCnt;
+    arkime_parsers_classify_state(&build, key, 2 + aliveCnt + matchCnt);
+
+    GArray *states = g_array_new(FALSE, TRUE, sizeof(ArkimeClassifyState_t));
+    g_array_set_size(states, 2);
+
+    for (guint s = 1; s < build.keys->len; s++) {
+        gsize      keyBytes;
+        const int *cur = g_bytes_get_data(g_ptr_array_index(build.keys, s), &keyBytes);
+        const int  depth = cur[0];
+        const int  curAliveCnt = cur[1];
+        const int *curAlive = cur + 2;
+        const int *curMatch = cur + 2 + curAliveCnt;
+        const int  curMatchCnt = keyBytes / sizeof(int) - 2 - curAliveCnt;
+
+        ArkimeClassifyState_t state;
+        memset(&state, 0, sizeof(state));
+
+        state.matchCnt = curMatchCnt;
+        if (curMatchCnt > 0) {
+            state.matches = g_malloc(sizeof(ArkimeClassify_t *) * curMatchCnt);
+            for (i = 0; i < curMatchCnt; i++)
+                state.matches[i] = pats[curMatch[i]];
+        }
+
+        if (curAliveCnt > 0) {
+            state.next = g_malloc0(sizeof(uint32_t) * dfa->numClasses);
+
+            for (int c = 0; c < dfa->numClasses; c++) {
+                int addedCnt = 0;
+                aliveCnt = 0;
+                for (i = 0; i < curAliveCnt; i++) {
+                    const ArkimeClassify_t *p = pats[curAlive[i]];
+                    if (depth >= p->offset && (c == 0 || p->match[depth - p->offset] != classByte[c]))
+                        continue;
+                    if (p->minlen == depth + 1)
+                        added[addedCnt++] = curAlive[i];
+                    else
+                        key[2 + aliveCnt++] = curAlive[i];
+                }
+
+                if (aliveCnt == 0 && addedCnt == 0)
+                    continue;
+
+                // Merge the newly matched into the already matched, both are sorted
+                int a = 0, b = 0;
+                matchCnt = 0;
+                while (a < curMatchCnt || b < addedCnt) {
+                    if (b >= addedCnt || (a < curMatchCnt && curMatch[a] < added[b]))
+                        key[2 + aliveCnt + matchCnt++] = curMatch[a++];
+                    else
+                        key[2 + aliveCnt + matchCnt++] = added[b++];
+                }
+
+                key[0] = depth + 1;
+                key[1] = aliveCnt;
+                state.next[c] = arkime_parsers_classify_state(&build, key, 2 + aliveCnt + matchCnt);
+            }
+        }
+
+        g_array_index(states, ArkimeClassifyState_t, s) = state;
+        if (states->len < build.keys->len)
+            g_array_set_size(states, build.keys->len);
+    }
+
+    dfa->numStates = states->len;
+    dfa->states = (ArkimeClassifyState_t *)g_array_free(states, FALSE);
+
+    if (config.debug)
+        LOG("Compiled %d classifiers into %d states with %d byte classes", n, dfa->numStates, dfa->numClasses);
+
+    g_free(added);
+    g_free(key);
+    g_free(pats);
+    g_ptr_array_free(build.keys, TRUE);
+    g_hash_table_destroy(build.seen);
+    return dfa;
+}
+/******************************************************************************/
+LOCAL ArkimeClassifyDfa_t *arkime_parsers_classify_dfa(ArkimeClassifyDfa_t **dfap, const ArkimeClassifyHead_t *ch)
+{
+    ARKIME_LOCK(classifyDfa);
+    if (!*dfap) {
+        ArkimeClassifyDfa_t *dfa = arkime_parsers_classify_compile(ch);
+        __sync_synchronize();
+        *dfap = dfa;
+    }
+    ArkimeClassifyDfa_t *dfa = *dfap;
+    ARKIME_UNLOCK(classifyDfa);
+    return dfa;
+}
+/******************************************************************************/
+LOCAL void arkime_parsers_classifier_add_pattern(ArkimeClassifyHead_t *ch, ArkimeClassifyDfa_t **dfap, ArkimeClassify_t *c)
+{
+    // Match the order of the old offset/1 byte/2 byte tables
+    uint32_t group = (c->matchlen == 0 || c->offset != 0) ? 0 : (c->matchlen == 1 ? 1 : 2);
+
+    ARKIME_LOCK(classifyDfa);
+    c->order = (group << 24) | (classifyOrder++ & 0xffffff);
+    arkime_parsers_classifier_add(ch, c);
+    ArkimeClassifyDfa_t *old = *dfap;
+    *dfap = NULL;
+    ARKIME_UNLOCK(classifyDfa);
+
+    if (old)
+        arkime_free_later(old, arkime_parsers_classify_dfa_free);
+}
+/******************************************************************************/
+LOCAL inline const ArkimeClassifyState_t *arkime_parsers_classify_walk(const ArkimeClassifyDfa_t *dfa, const uint8_t *data, int remaining)
+{
+    const ArkimeClassifyState_t *state = &dfa->states[1];
+
+    for (int i = 0; i < remaining && state->next; i++) {
+        uint32_t next = state->next[dfa->byteClass[data[i]]];
+        if (!next)
+            break;
+        state = &dfa->states[next];
+    }
+    return state;
+}
+/******************************************************************************/
+LOCAL void arkime_parsers_classify_bench_save(GPtrArray **samples, const uint8_t *data, int remaining)
+{
+    int len = MIN(remaining, 256);
+    GByteArray *sample = g_byte_array_sized_new(len + sizeof(int));
+
+    g_byte_array_append(sample, (guint8 *)&remaining, sizeof(int));
+    g_byte_array_append(sample, data, len);
+
+    ARKIME_LOCK(classifyBench);
+    if (!*samples)
+        *samples = g_ptr_array_new_with_free_func((GDestroyNotify)g_byte_array_unref);
+    g_ptr_array_add(*samples, sample);
+    ARKIME_UNLOCK(classifyBench);
+}
+/******************************************************************************/
+/* The old way of checking every pattern against the payload, pats must be in
+ * call order. Only used to check the DFA with classifyBenchmark.
+ */
+LOCAL int arkime_parsers_classify_linear(ArkimeClassify_t **pats, int n, const uint8_t *data, int remaining, ArkimeClassify_t **matches)
+{
+    int cnt = 0;
+
+    for (int i = 0; i < n; i++) {
+        const ArkimeClassify_t *c = pats[i];
+        if (remaining >= c->minlen && (c->matchlen == 0 || memcmp(data + c->offset, c->match, c->matchlen) == 0))
+            matches[cnt++] = pats[i];
+    }
+    return cnt;
+}
+/******************************************************************************/
+LOCAL void arkime_parsers_classify_bench_run(const char *name, ArkimeClassifyDfa_t **dfap, const ArkimeClassifyHead_t *ch, GPtrArray *samples)
+{
+    struct timespec startTime, endTime;
+
+    if (!samples || samples->len == 0) {
+        LOG("classify %s: no payloads seen", name);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    const ArkimeClassifyDfa_t *dfa = arkime_parsers_classify_dfa(dfap, ch);
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+    uint64_t compileNs = (endTime.tv_sec - startTime.tv_sec) * 1000000000ULL + endTime.tv_nsec - startTime.tv_nsec;
+
+    uint64_t matches = 0;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (int r = 0; r < classifyBenchmark; r++) {
+        for (guint i = 0; i < samples->len; i++) {
+            const GByteArray *sample = g_ptr_array_index(samples, i);
+            int remaining;
+            memcpy(&remaining, sample->data, sizeof(int));
+            remaining = MIN(remaining, (int)(sample->len - sizeof(int)));
+            matches += arkime_parsers_classify_walk(dfa, sample->data + sizeof(int), remaining)->matchCnt;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    uint64_t ns = (endTime.tv_sec - startTime.tv_sec) * 1000000000ULL + endTime.tv_nsec - startTime.tv_nsec;
+    uint64_t total = (uint64_t)samples->len * classifyBenchmark;
+
+    // Every payload must call the same classifiers in the same order as checking each pattern
+    ArkimeClassify_t **pats = g_malloc(sizeof(ArkimeClassify_t *) * MAX(ch->cnt, 1));
+    ArkimeClassify_t **linear = g_malloc(sizeof(ArkimeClassify_t *) * MAX(ch->cnt, 1));
+    if (ch->cnt > 0)
+        memcpy(pats, ch->arr, sizeof(ArkimeClassify_t *) * ch->cnt);
+    qsort(pats, ch->cnt, sizeof(ArkimeClassify_t *), arkime_parsers_classify_order_cmp);
+
+    uint32_t mismatches = 0;
+    for (guint i = 0; i < samples->len; i++) {
+        const GByteArray *sample = g_ptr_array_index(samples, i);
+        int remaining;
+        memcpy(&remaining, sample->data, sizeof(int));
+        remaining = MIN(remaining, (int)(sample->len - sizeof(int)));
+
+        const ArkimeClassifyState_t *state = arkime_parsers_classify_walk(dfa, sample->data + sizeof(int), remaining);
+        int cnt = arkime_parsers_classify_linear(pats, ch->cnt, sample->data + sizeof(int), remaining, linear);
+        if (cnt != state->matchCnt || (cnt > 0 && memcmp(linear, state->matches, sizeof(ArkimeClassify_t *) * cnt) != 0)) {
+            if (mismatches++ < 10) {
+                char hex[101];
+                LOG("classify %s: payload %s dfa matched %d linear matched %d", name,
+                    arkime_sprint_hex_string(hex, sample->data + sizeof(int), MIN(remaining, 50)), state->matchCnt, cnt);
+            }
+        }
+    }
+    g_free(linear);
+    g_free(pats);
+
+    LOG("classify %s: %d classifiers, %d states, %d byte classes, compile %.3fms, %u payloads x %d, %" PRIu64 " matches, %.1fns per payload, %u mismatches",
+        name, ch->cnt, dfa->numStates, dfa->numClasses, compileNs / 1000000.0,
+        samples->len, classifyBenchmark, matches / classifyBenchmark, (double)ns / total, mismatches);
+
+    if (mismatches)
+        LOGEXIT("ERROR - classify %s DFA doesn't match the linear classifiers for %u payloads", name, mismatches);
+}
+/******************************************************************************/
+LOCAL void arkime_parsers_classify_bench_exit()
+{
+    arkime_parsers_classify_bench_run("tcp", &classifyTcpDfa, &classifersTcp, classifyBenchTcp);
+    arkime_parsers_classify_bench_run("udp", &classifyUdpDfa, &classifersUdp, classifyBenchUdp);
+}
+/******************************************************************************/
 void arkime_parsers_classifier_register_port_internal(const char *name, void *uw, uint16_t port, uint32_t type, ArkimeClassifyFunc func, size_t sessionsize, int apiversion)
 {
     if (sizeof(ArkimeSession_t) != sessionsize) {
@@ -1050,15 +1463,7 @@ void arkime_parsers_classifier_register_tcp_internal(const char *name, void *uw,
         arkime_sprint_hex_string(hex, match, matchlen);
         LOG("adding %s matchlen:%d offset:%d match %s (0x%s)", name, matchlen, offset, match, hex);
     }
-    if (matchlen == 0 || offset != 0) {
-        arkime_parsers_classifier_add(&classifersTcp0, c);
-    } else if (matchlen == 1) {
-        arkime_parsers_classifier_add(&classifersTcp1[(uint8_t)match[0]], c);
-    } else  {
-        c->match += 2;
-        c->matchlen -= 2;
-        arkime_parsers_classifier_add(&classifersTcp2[(uint8_t)match[0]][(uint8_t)match[1]], c);
-    }
+    arkime_parsers_classifier_add_pattern(&classifersTcp, &classifyTcpDfa, c);
 }
 /******************************************************************************/
 void arkime_parsers_classifier_register_udp_internal(const char *name, void *uw, int offset, const uint8_t *match, int matchlen, ArkimeClassifyFunc func, size_t sessionsize, int apiversion)
@@ -1071,6 +1476,9 @@ void arkime_parsers_classifier_register_udp_internal(const char *name, void *uw,
         CONFIGEXIT("Parser '%s' built with different version of arkime.h", name);
     }
 
+    if (!match && matchlen != 0)
+        CONFIGEXIT("Can't have a null match for %s", name);
+
     ArkimeClassify_t *c = ARKIME_TYPE_ALLOC0(ArkimeClassify_t);
     c->name     = name;
     c->uw       = uw;
@@ -1082,15 +1490,7 @@ void arkime_parsers_classifier_register_udp_internal(const char *name, void *uw,
 
     if (config.debug)
         LOG("adding %s matchlen:%d offset:%d match %s ", name, matchlen, offset, match);
-    if (matchlen == 0 || offset != 0) {
-        arkime_parsers_classifier_add(&classifersUdp0, c);
-    } else if (matchlen == 1) {
-        arkime_parsers_classifier_add(&classifersUdp1[(uint8_t)match[0]], c);
-    } else  {
-        c->match += 2;
-        c->matchlen -= 2;
-        arkime_parsers_classifier_add(&classifersUdp2[(uint8_t)match[0]][(uint8_t)match[1]], c);
-    }
+    arkime_parsers_classifier_add_pattern(&classifersUdp, &classifyUdpDfa, c);
 }
 /******************************************************************************/
 void arkime_parsers_classify_udp(ArkimeSession_t *session, const uint8_t *data, int remaining, int which)
@@ -1105,6 +1505,9 @@ void arkime_parsers_classify_udp(ArkimeSession_t *session, const uint8_t *data,
     LOG("len: %d direction: %d hex: %s data: %.*s", remaining, which, arkime_sprint_hex_string(buf, data, MIN(remaining, 50)), MIN(remaining, 50), data);
 #endif
 
+    if (unlikely(classifyBenchmark))
+        arkime_parsers_classify_bench_save(&classifyBenchUdp, data, remaining);
+
     for (i = 0; i < classifersUdpPortSrc[session->port1].cnt; i++) {
         classifersUdpPortSrc[session->port1].arr[i]->func(session, data, remaining, which, classifersUdpPortSrc[session->port1].arr[i]->uw);
     }
@@ -1113,21 +1516,13 @@ void arkime_parsers_classify_udp(ArkimeSession_t *session, const uint8_t *data,
         classifersUdpPortDst[session->port2].arr[i]->func(session, data, remaining, which, classifersUdpPortDst[session->port2].arr[i]->uw);
     }
 
-    for (i = 0; i < classifersUdp0.cnt; i++) {
-        ArkimeClassify_t *c = classifersUdp0.arr[i];
-        if (remaining >= c->minlen && memcmp(data + c->offset, c->match, c->matchlen) == 0) {
-            c->func(session, data, remaining, which, c->uw);
-        }
-    }
+    const ArkimeClassifyDfa_t *dfa = classifyUdpDfa;
+    if (unlikely(!dfa))
+        dfa = arkime_parsers_classify_dfa(&classifyUdpDfa, &classifersUdp);
 
-    for (i = 0; i < classifersUdp1[data[0]].cnt; i++)
-        classifersUdp1[data[0]].arr[i]->func(session, data, remaining, which, classifersUdp1[data[0]].arr[i]->uw);
-
-    for (i = 0; i < classifersUdp2[data[0]][data[1]].cnt; i++) {
-        ArkimeClassify_t *c = classifersUdp2[data[0]][data[1]].arr[i];
-        if (remaining >= c->minlen && memcmp(data + 2, c->match, c->matchlen) == 0) {
-            c->func(session, data, remaining, which, c->uw);
-        }
+    const ArkimeClassifyState_t *state = arkime_parsers_classify_walk(dfa, data, remaining);
+    for (i = 0; i < state->matchCnt; i++) {
+        state->matches[i]->func(session, data, remaining, which, state->matches[i]->uw);
     }
 
     arkime_rules_run_after_classify(session);
@@ -1147,6 +1542,9 @@ void arkime_parsers_classify_tcp(ArkimeSession_t *session, const uint8_t *data,
     if (remaining < 2)
         return;
 
+    if (unlikely(classifyBenchmark))
+        arkime_parsers_classify_bench_save(&classifyBenchTcp, data, remaining);
+
     for (i = 0; i < classifersTcpPortSrc[session->port1].cnt; i++) {
         classifersTcpPortSrc[session->port1].arr[i]->func(session, data, remaining, which, classifersTcpPortSrc[session->port1].arr[i]->uw);
     }
@@ -1155,22 +1553,13 @@ void arkime_parsers_classify_tcp(ArkimeSession_t *session, const uint8_t *data,
         classifersTcpPortDst[session->port2].arr[i]->func(session, data, remaining, which, classifersTcpPortDst[session->port2].arr[i]->uw);
     }
 
-    for (i = 0; i < classifersTcp0.cnt; i++) {
-        ArkimeClassify_t *c = classifersTcp0.arr[i];
-        if (remaining >= c->minlen && memcmp(data + c->offset, c->match, c->matchlen) == 0) {
-            c->func(session, data, remaining, which, c->uw);
-        }
-    }
-
-    for (i = 0; i < classifersTcp1[data[0]].cnt; i++) {
-        classifersTcp1[data[0]].arr[i]->func(session, data, remaining, which, classifersTcp1[data[0]].arr[i]);
-    }
+    const ArkimeClassifyDfa_t *dfa = classifyTcpDfa;
+    if (unlikely(!dfa))
+        dfa = arkime_parsers_classify_dfa(&classifyTcpDfa, &classifersTcp);
 
-    for (i = 0; i < classifersTcp2[data[0]][data[1]].cnt; i++) {
-        ArkimeClassify_t *c = classifersTcp2[data[0]][data[1]].arr[i];
-        if (remaining >= c->minlen && memcmp(data + 2, c->match, c->matchlen) == 0) {
-            c->func(session, data, remaining, which, c->uw);
-        }
+    const ArkimeClassifyState_t *state = arkime_parsers_classify_walk(dfa, data, remaining);
+    for (i = 0; i < state->matchCnt; i++) {
+        state->matches[i]->func(session, data, remaining, which, state->matches[i]->uw);
     }
 
     arkime_rules_run_after_classify(session);
@@ -19,7 +19,6 @@ extern ArkimeConfig_t        config;
 
 extern int                   tcpMProtocol;
 
-extern ArkimeSessionHead_t   tcpWriteQ[ARKIME_MAX_PACKET_THREADS];
 LOCAL int                    maxTcpOutOfOrderPackets;
 extern uint32_t              pluginsCbs;
 
@@ -41,7 +40,7 @@ void tcp_session_free(ArkimeSession_t *session)
     ArkimeTcpData_t *td;
     while (DLL_POP_HEAD(td_, &session->tcpData, td)) {
         arkime_packet_free(td->packet);
-        ARKIME_TYPE_FREE(ArkimeTcpData_t, td);
+        ARKIME_POOL_FREE(ARKIME_POOL_TCPDATA, td);
     }
 }
 
@@ -83,7 +82,7 @@ void tcp_packet_finish(ArkimeSession_t *session)
             if (tcpSeq >= ftd->seq + ftd->len) {
                 DLL_REMOVE(td_, tcpData, ftd);
                 arkime_packet_free(ftd->packet);
-                ARKIME_TYPE_FREE(ArkimeTcpData_t, ftd);
+                ARKIME_POOL_FREE(ARKIME_POOL_TCPDATA, ftd);
                 continue;
             }
 
@@ -116,8 +115,12 @@ void tcp_packet_finish(ArkimeSession_t *session)
 
             DLL_REMOVE(td_, tcpData, ftd);
             arkime_packet_free(ftd->packet);
-            ARKIME_TYPE_FREE(ArkimeTcpData_t, ftd);
+            ARKIME_POOL_FREE(ARKIME_POOL_TCPDATA, ftd);
         } else {
+            // Waiting on a missing segment, don't pin reader memory while we wait
+            for (; (void *)ftd != (void *)tcpData; ftd = ftd->td_next) {
+                arkime_packet_copy(ftd->packet);
+            }
             return;
         }
     }
@@ -149,8 +152,8 @@ int tcp_packet_process(ArkimeSession_t *const session, ArkimePacket_t *const pac
     }
 
     // add to the long open
-    if (!session->tcp_next) {
-        DLL_PUSH_TAIL(tcp_, &tcpWriteQ[session->thread], session);
+    if (!session->saveTimer.tw_slot && !session->closingQ) {
+        arkime_wheel_add(session->thread, &session->saveTimer, session->saveTime + 1);
     }
 
     if (tcphdr->th_flags & TH_SYN) {
@@ -265,7 +268,7 @@ int tcp_packet_process(ArkimeSession_t *const session, ArkimePacket_t *const pac
     if (session->haveTcpSession && diff <= 0)
         return 1;
 
-    ArkimeTcpData_t *ftd, *td = ARKIME_TYPE_ALLOC(ArkimeTcpData_t);
+    ArkimeTcpData_t *ftd, *td = ARKIME_POOL_ALLOC(ARKIME_POOL_TCPDATA);
     const uint32_t ack = ntohl(tcphdr->th_ack);
 
     td->packet = packet;
@@ -299,10 +302,10 @@ int tcp_packet_process(ArkimeSession_t *const session, ArkimePacket_t *const pac
 
                         DLL_REMOVE(td_, tcpData, ftd);
                         arkime_packet_free(ftd->packet);
-                        ARKIME_TYPE_FREE(ArkimeTcpData_t, ftd);
+                        ARKIME_POOL_FREE(ARKIME_POOL_TCPDATA, ftd);
                         ftd = td;
                     } else {
-                        ARKIME_TYPE_FREE(ArkimeTcpData_t, td);
+                        ARKIME_POOL_FREE(ARKIME_POOL_TCPDATA, td);
                         return 1;
                     }
                     break;
@@ -34,6 +34,7 @@ typedef struct arkime_plugin {
     ArkimePluginExitFunc         exitFunc;
     ArkimePluginReloadFunc       reloadFunc;
     ArkimePluginOutstandingFunc  outstandingFunc;
+    ArkimePluginStatsFunc        statsFunc;
 
     ArkimePluginHttpFunc         on_message_begin;
     ArkimePluginHttpDataFunc     on_url;
@@ -307,6 +308,20 @@ void arkime_plugins_set_outstanding_cb(const char                 *name,
     plugin->outstandingFunc = outstandingFunc;
 }
 /******************************************************************************/
+void arkime_plugins_set_stats_cb(const char                 *name,
+                                 ArkimePluginStatsFunc       statsFunc)
+{
+    ArkimePlugin_t *plugin;
+
+    HASH_FIND(p_, plugins, name, plugin);
+    if (!plugin) {
+        LOG("Can't find plugin with name %s", name);
+        return;
+    }
+
+    plugin->statsFunc = statsFunc;
+}
+/******************************************************************************/
 void arkime_plugins_cb_pre_save(ArkimeSession_t *session, int final)
 {
     ArkimePlugin_t *plugin;
@@ -493,3 +508,20 @@ uint32_t arkime_plugins_outstanding()
     }
     return outstanding;
 }
+/******************************************************************************/
+// Each plugin with a stats cb adds a "name":<json value> member to the object
+void arkime_plugins_stats(GString *str)
+{
+    ArkimePlugin_t *plugin;
+    int             first = 1;
+
+    g_string_append_c(str, '{');
+    HASH_FORALL2(p_, plugins, plugin) {
+        if (plugin->statsFunc) {
+            g_string_append_printf(str, "%s\"%s\":", first ? "" : ",", plugin->name);
+            plugin->statsFunc(str);
+            first = 0;
+        }
+    }
+    g_string_append_c(str, '}');
+}
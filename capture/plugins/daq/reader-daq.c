@@ -43,7 +43,7 @@ DAQ_Verdict reader_daq_packet_cb(void *batch, const DAQ_PktHdr_t *h, const uint8
         LOGEXIT("ERROR - Arkime requires full packet captures caplen: %d pktlen: %d", h->caplen, h->pktlen);
     }
 
-    ArkimePacket_t *packet = ARKIME_TYPE_ALLOC0(ArkimePacket_t);
+    ArkimePacket_t *packet = ARKIME_POOL_ALLOC0(ARKIME_POOL_PACKET);
 
     packet->pkt           = (u_char *)data;
     packet->ts            = h->ts;
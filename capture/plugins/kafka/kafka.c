@@ -228,6 +228,9 @@ void arkime_plugin_init()
         arkime_db_set_send_bulk2(kafka_send_session_bulk, TRUE, FALSE, 1);
     } else if (strcmp(kafkaMsgFormat, "doc") == 0) {
         arkime_db_set_send_bulk2(kafka_send_session_bulk, FALSE, TRUE, 1);
+    } else if (strcmp(kafkaMsgFormat, "cbor") == 0) {
+        arkime_db_set_send_bulk2(kafka_send_session_bulk, FALSE, TRUE, 1);
+        arkime_db_set_serializer("cbor");
     } else {
         LOGEXIT("Unknown config kafkaMsgFormat value '%s'", kafkaMsgFormat);
     }
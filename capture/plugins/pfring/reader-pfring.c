@@ -41,7 +41,7 @@ void reader_pfring_packet_cb(const struct pfring_pkthdr *h, const u_char *p, con
         LOGEXIT("ERROR - Arkime requires full packet captures caplen: %d pktlen: %d", h->caplen, h->len);
     }
 
-    ArkimePacket_t *packet = ARKIME_TYPE_ALLOC0(ArkimePacket_t);
+    ArkimePacket_t *packet = ARKIME_POOL_ALLOC0(ARKIME_POOL_PACKET);
 
     packet->pkt           = (u_char *)p;
     packet->ts            = h->ts;
@@ -50,28 +50,22 @@ LOCAL void scrubspi_plugin_save(ArkimeSession_t *session, int UNUSED(final))
         switch (field->type) {
         case ARKIME_FIELD_TYPE_STR:
             newstr = g_regex_replace(ss[s].search, session->fields[pos]->str, -1, 0, ss[s].replace, 0, NULL);
-            if (newstr) {
-                g_free(session->fields[pos]->str);
-                session->fields[pos]->str = newstr;
-            }
+            if (newstr)
+                arkime_field_string_swap(session, pos, &session->fields[pos]->str, newstr);
             break;
         case ARKIME_FIELD_TYPE_STR_ARRAY:
             for(i = 0; i < session->fields[pos]->sarray->len; i++) {
                 newstr = g_regex_replace(ss[s].search, g_ptr_array_index(session->fields[pos]->sarray, i), -1, 0, ss[s].replace, 0, NULL);
-                if (newstr) {
-                    g_free(g_ptr_array_index(session->fields[pos]->sarray, i));
-                    g_ptr_array_index(session->fields[pos]->sarray, i) = newstr;
-                }
+                if (newstr)
+                    arkime_field_string_swap(session, pos, (char **)&g_ptr_array_index(session->fields[pos]->sarray, i), newstr);
             }
             break;
         case ARKIME_FIELD_TYPE_STR_HASH:
             shash = session->fields[pos]->shash;
             HASH_FORALL2(s_, *shash, hstring) {
                 newstr = g_regex_replace(ss[s].search, hstring->str, -1, 0, ss[s].replace, 0, NULL);
-                if (newstr) {
-                    g_free(hstring->str);
-                    hstring->str = newstr;
-                }
+                if (newstr)
+                    arkime_field_string_swap(session, pos, &hstring->str, newstr);
             }
 
             break;
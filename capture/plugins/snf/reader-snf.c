@@ -89,7 +89,7 @@ LOCAL void *reader_snf_thread(gpointer posv)
             break;
         }
 
-        ArkimePacket_t *packet = ARKIME_TYPE_ALLOC0(ArkimePacket_t);
+        ArkimePacket_t *packet = ARKIME_POOL_ALLOC0(ARKIME_POOL_PACKET);
 
         packet->pkt           = (u_char *)req.pkt_addr;
         packet->ts.tv_sec     = req.timestamp / 1000000000;
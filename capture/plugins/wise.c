@@ -12,6 +12,9 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 extern ArkimeConfig_t        config;
 
@@ -20,7 +23,9 @@ LOCAL void                 *wiseService;
 LOCAL uint32_t              maxConns;
 LOCAL uint32_t              maxRequests;
 LOCAL uint32_t              maxCache;
+LOCAL uint32_t              maxCacheShard;
 LOCAL uint32_t              cacheSecs;
+LOCAL uint32_t              negativeCacheSecs;
 LOCAL char                  tcpTuple;
 LOCAL char                  udpTuple;
 LOCAL uint32_t              logEvery;
@@ -73,10 +78,30 @@ LOCAL const int validDNS[256] = {
 #define INTEL_STAT_REQUEST    2
 #define INTEL_STAT_INPROGRESS 3
 #define INTEL_STAT_FAIL       4
-#define INTEL_STAT_SIZE       5
+#define INTEL_STAT_NEGATIVE   5
+#define INTEL_STAT_SNAPSHOT   6
+#define INTEL_STAT_SIZE       7
 
-LOCAL uint32_t stats[INTEL_TYPE_SIZE][INTEL_STAT_SIZE];
+// Each packet thread counts its own lookups, summed when printed
+LOCAL uint32_t stats[ARKIME_MAX_PACKET_THREADS][INTEL_TYPE_SIZE][INTEL_STAT_SIZE];
+
+// log2 ms buckets of how long the wise server took to answer, only the main thread updates
+#define WISE_LATENCY_BUCKETS 16
+LOCAL uint32_t latency[INTEL_TYPE_SIZE][WISE_LATENCY_BUCKETS];
+
+// Coarse clock for cache expiry, updated by the flush timer
+LOCAL uint32_t wiseNow;
 /******************************************************************************/
+// Sessions waiting on an item that is being looked up
+#define WISE_WAITERS_CHUNK 30
+typedef struct wisewaiters {
+    struct wisewaiters   *next;
+    int                   num;
+    ArkimeSession_t      *sessions[WISE_WAITERS_CHUNK];
+} WiseWaiters_t;
+
+#define WISE_MAX_WAITERS 4096
+
 typedef struct wiseitem {
     struct wiseitem      *wih_next, *wih_prev;
     struct wiseitem      *wil_next, *wil_prev;
@@ -84,13 +109,14 @@ typedef struct wiseitem {
     uint32_t              wih_hash;
 
     ArkimeFieldOps_t      ops;
-    ArkimeSession_t     **sessions;
+    WiseWaiters_t        *waiters;
     char                 *key;
 
     uint32_t              loadTime;
-    uint16_t              sessionsSize;
     uint16_t              numSessions;
     char                  type;
+    uint8_t               shard;
+    uint8_t               negative; // wise had nothing for it
 } WiseItem_t;
 
 typedef struct wiseitem_head {
@@ -106,14 +132,13 @@ typedef struct wiserequest {
     BSB          bsb;
     WiseItem_t  *items[WISE_MAX_REQUEST_ITEMS];
     int          numItems;
+    uint64_t     sentMS;
 } WiseRequest_t;
 
-typedef HASH_VAR(h_, WiseItemHash_t, WiseItemHead_t, 199337);
+typedef HASHP_VAR(wih_, WiseItemHash_t, WiseItemHead_t);
 
 struct {
     char           *name;
-    WiseItemHash_t  itemHash;
-    WiseItemHead_t  itemList;
     int             fields[INTEL_TYPE_MAX_FIELDS];
     char            fieldsLen;
     char            nameLen;
@@ -121,12 +146,70 @@ struct {
 
 int            numTypes = INTEL_TYPE_NUM_PRE;
 
-LOCAL ARKIME_LOCK_DEFINE(item);
+/* The cache is split into shards by key hash, each with its own lock, so
+ * packet threads looking up different keys don't wait on each other. The
+ * lists are in load order so the oldest items are always at the tail.
+ */
+#define WISE_SHARDS        64
+#define WISE_SHARD_BUCKETS 3121
+typedef struct {
+    WiseItemHash_t  itemHash[INTEL_TYPE_SIZE];
+    WiseItemHead_t  itemList[INTEL_TYPE_SIZE];
+    WiseItemHead_t  negList[INTEL_TYPE_SIZE];
+    ARKIME_LOCK_EXTERN(lock);
+} WiseShard_t;
+
+LOCAL WiseShard_t   shards[WISE_SHARDS];
+
+LOCAL ARKIME_LOCK_DEFINE(fieldsMap);
 
 /******************************************************************************/
-LOCAL WiseRequest_t *iRequest = 0;
-LOCAL ARKIME_LOCK_DEFINE(iRequest);
-LOCAL char          *iBuf = 0;
+// Each packet thread batches its own lookups, the lock is only shared with the flush timer
+typedef struct {
+    WiseRequest_t *request;
+    char          *buf;
+    uint32_t       lookups;
+    ARKIME_LOCK_EXTERN(lock);
+} WiseThreadRequest_t;
+
+LOCAL WiseThreadRequest_t iRequests[ARKIME_MAX_PACKET_THREADS];
+
+/******************************************************************************/
+/* Snapshots are precompiled read only intel files that are mmapped and
+ * answered on the packet thread without asking the wise service.  Numbers
+ * are network order like the wise protocol and entries use the same ops.
+ *
+ *   header "ARKWISE1", u32 numFields, u32 numTypes, u64 fileSize
+ *   fields numFields of u16 len, field definition, len includes the NULL
+ *   types  numTypes of u8 nameLen, name, u8 flags, u32 numKeys, u64 indexOffset
+ *   index  numKeys of u64 entry offsets, sorted by key bytes with shorter first
+ *   entry  u16 keyLen, key, u8 numOps, numOps of u8 field, u8 len, value with NULL
+ *
+ * Types flagged complete have all their sources in the snapshot, so misses
+ * aren't sent to the wise service either.  The file is checked every second
+ * and a changed one is loaded and swapped in, the old one unmapped later.
+ * contrib/wiseSnapshot.pl builds snapshots from tagger files.
+ */
+#define WISE_SNAPSHOT_MAGIC      "ARKWISE1"
+#define WISE_SNAPSHOT_HEADER_LEN (8 + 4 + 4 + 8)
+#define WISE_SNAPSHOT_COMPLETE   0x01
+
+typedef struct {
+    const uint8_t  *index;
+    uint32_t        numKeys;
+    uint8_t         flags;
+} WiseSnapshotType_t;
+
+typedef struct {
+    uint8_t            *data;
+    uint64_t            size;
+    WiseSnapshotType_t  types[INTEL_TYPE_SIZE];
+    int                 fieldsMap[256];
+} WiseSnapshot_t;
+
+LOCAL WiseSnapshot_t  *snapshot;
+LOCAL char            *snapshotFile;
+LOCAL struct stat      snapshotStat;
 
 /******************************************************************************/
 LOCAL int wise_item_cmp(const void *keyv, const void *elementv)
@@ -137,19 +220,84 @@ LOCAL int wise_item_cmp(const void *keyv, const void *elementv)
     return strcmp(key, element->key) == 0;
 }
 /******************************************************************************/
+LOCAL void wise_sum_stats(int type, uint32_t *sum)
+{
+    memset(sum, 0, sizeof(uint32_t) * INTEL_STAT_SIZE);
+    for (int t = 0; t < config.packetThreads; t++) {
+        for (int s = 0; s < INTEL_STAT_SIZE; s++)
+            sum[s] += stats[t][type][s];
+    }
+}
+/******************************************************************************/
 LOCAL void wise_print_stats()
 {
     for (int i = 0; i < numTypes; i++) {
-        LOG("%8s lookups:%7d cache:%7d requests:%7d inprogress:%7d fail:%7d hash:%7d list:%7u",
+        uint32_t sum[INTEL_STAT_SIZE];
+        uint32_t hashCnt = 0, listCnt = 0, negCnt = 0;
+
+        wise_sum_stats(i, sum);
+
+        for (int s = 0; s < WISE_SHARDS; s++) {
+            hashCnt += HASH_COUNT(wih_, shards[s].itemHash[i]);
+            listCnt += DLL_COUNT(wil_, &shards[s].itemList[i]);
+            negCnt += DLL_COUNT(wil_, &shards[s].negList[i]);
+        }
+
+        char     buf[WISE_LATENCY_BUCKETS * 30];
+        BSB      bsb;
+        BSB_INIT(bsb, buf, sizeof(buf));
+        for (int b = 0; b < WISE_LATENCY_BUCKETS; b++) {
+            if (latency[i][b])
+                BSB_EXPORT_sprintf(bsb, " <%ums:%u", 1U << (b + 1), latency[i][b]);
+        }
+        BSB_EXPORT_u08(bsb, 0);
+
+        LOG("%8s lookups:%7u snapshot:%7u cache:%7u negative:%7u requests:%7u inprogress:%7u fail:%7u hash:%7u list:%7u neglist:%7u latency:%s",
             types[i].name,
-            stats[i][0],
-            stats[i][1],
-            stats[i][2],
-            stats[i][3],
-            stats[i][4],
-            HASH_COUNT(wih_, types[i].itemHash),
-            DLL_COUNT(wil_, &types[i].itemList));
+            sum[INTEL_STAT_LOOKUP],
+            sum[INTEL_STAT_SNAPSHOT],
+            sum[INTEL_STAT_CACHE],
+            sum[INTEL_STAT_NEGATIVE],
+            sum[INTEL_STAT_REQUEST],
+            sum[INTEL_STAT_INPROGRESS],
+            sum[INTEL_STAT_FAIL],
+            hashCnt,
+            listCnt,
+            negCnt,
+            BSB_IS_ERROR(bsb) ? "" : buf);
+    }
+}
+/******************************************************************************/
+// Added to the node stats as plugins.wise, only types that have been looked up.
+// latency[b] counts the answers that took less than 2^(b+1) ms
+LOCAL void wise_plugin_stats(GString *str)
+{
+    int first = 1;
+
+    g_string_append_c(str, '{');
+    for (int i = 0; i < numTypes; i++) {
+        uint32_t sum[INTEL_STAT_SIZE];
+
+        wise_sum_stats(i, sum);
+        if (sum[INTEL_STAT_LOOKUP] == 0)
+            continue;
+
+        g_string_append_printf(str, "%s\"%s\":{\"lookups\":%u,\"snapshot\":%u,\"cache\":%u,\"negative\":%u,\"requests\":%u,\"inprogress\":%u,\"fail\":%u,\"latency\":[",
+                               first ? "" : ",",
+                               types[i].name,
+                               sum[INTEL_STAT_LOOKUP],
+                               sum[INTEL_STAT_SNAPSHOT],
+                               sum[INTEL_STAT_CACHE],
+                               sum[INTEL_STAT_NEGATIVE],
+                               sum[INTEL_STAT_REQUEST],
+                               sum[INTEL_STAT_INPROGRESS],
+                               sum[INTEL_STAT_FAIL]);
+        for (int b = 0; b < WISE_LATENCY_BUCKETS; b++)
+            g_string_append_printf(str, "%s%u", b == 0 ? "" : ",", latency[i][b]);
+        g_string_append(str, "]}");
+        first = 0;
     }
+    g_string_append_c(str, '}');
 }
 /******************************************************************************/
 LOCAL void wise_load_fields()
@@ -223,19 +371,57 @@ LOCAL void wise_free_item(WiseItem_t *wi)
     ARKIME_TYPE_FREE(WiseItem_t, wi);
 }
 /******************************************************************************/
+// Hand the item to the waiting sessions, wi is NULL if the lookup failed
+LOCAL void wise_release_waiters(WiseItem_t *item, WiseItem_t *wi)
+{
+    WiseWaiters_t *waiters = item->waiters;
+
+    while (waiters) {
+        WiseWaiters_t *next = waiters->next;
+        arkime_session_add_cmds(waiters->sessions, waiters->num, ARKIME_SES_CMD_FUNC, wi, NULL, wise_session_cmd_cb);
+        ARKIME_TYPE_FREE(WiseWaiters_t, waiters);
+        waiters = next;
+    }
+    item->waiters = 0;
+    item->numSessions = 0;
+}
+/******************************************************************************/
+LOCAL void wise_add_waiter(WiseItem_t *wi, ArkimeSession_t *session)
+{
+    WiseWaiters_t *waiters = wi->waiters;
+
+    if (!waiters || waiters->num == WISE_WAITERS_CHUNK) {
+        waiters = ARKIME_TYPE_ALLOC(WiseWaiters_t);
+        waiters->num = 0;
+        waiters->next = wi->waiters;
+        wi->waiters = waiters;
+    }
+    waiters->sessions[waiters->num++] = session;
+    wi->numSessions++;
+    arkime_session_incr_outstanding(session);
+}
+/******************************************************************************/
+// Caller holds the shard lock and has taken the item off its list if on one
 LOCAL void wise_remove_item_locked(WiseItem_t *wi)
 {
-    HASH_REMOVE(wih_, types[(int)wi->type].itemHash, wi);
-    if (wi->sessions) {
-        for (int i = 0; i < wi->numSessions; i++) {
-            arkime_session_add_cmd(wi->sessions[i], ARKIME_SES_CMD_FUNC, NULL, NULL, wise_session_cmd_cb);
-        }
-        g_free(wi->sessions);
-        wi->sessions = 0;
+    HASH_REMOVE(wih_, shards[wi->shard].itemHash[(int)wi->type], wi);
+    if (wi->waiters) {
+        wise_release_waiters(wi, NULL);
     }
     arkime_free_later(wi, (GDestroyNotify) wise_free_item);
 }
 /******************************************************************************/
+// Drop expired items from the tail of a list, the lists are in load order
+LOCAL void wise_expire_list_locked(WiseItemHead_t *list, uint32_t secs)
+{
+    WiseItem_t *wi;
+
+    while ((wi = list->wil_prev) != (WiseItem_t *)list && wi->loadTime + secs <= wiseNow) {
+        DLL_REMOVE(wil_, list, wi);
+        wise_remove_item_locked(wi);
+    }
+}
+/******************************************************************************/
 LOCAL void wise_cb(int UNUSED(code), uint8_t *data, int data_len, gpointer uw)
 {
 
@@ -243,7 +429,7 @@ LOCAL void wise_cb(int UNUSED(code), uint8_t *data, int data_len, gpointer uw)
     WiseRequest_t *request = uw;
     int             i;
 
-    inflight -= request->numItems;
+    __sync_sub_and_fetch(&inflight, request->numItems);
 
     BSB_INIT(bsb, data, data_len);
 
@@ -252,11 +438,12 @@ LOCAL void wise_cb(int UNUSED(code), uint8_t *data, int data_len, gpointer uw)
     BSB_IMPORT_u32(bsb, ver);
 
     if (BSB_IS_ERROR(bsb) || (ver != 0 && ver != 2)) {
-        ARKIME_LOCK(item);
         for (i = 0; i < request->numItems; i++) {
+            WiseShard_t *shard = &shards[request->items[i]->shard];
+            ARKIME_LOCK(shard->lock);
             wise_remove_item_locked(request->items[i]);
+            ARKIME_UNLOCK(shard->lock);
         }
-        ARKIME_UNLOCK(item);
         ARKIME_TYPE_FREE(WiseRequest_t, request);
         return;
     }
@@ -272,7 +459,7 @@ LOCAL void wise_cb(int UNUSED(code), uint8_t *data, int data_len, gpointer uw)
         int cnt = 0;
         BSB_IMPORT_u16(bsb, cnt);
 
-        ARKIME_LOCK(item);
+        ARKIME_LOCK(fieldsMap);
         for (hashPos = 0; hashPos < fieldsMapCnt; hashPos++) {
             if (memcmp(hash, fieldsMapHash[hashPos], 32) == 0)
                 break;
@@ -312,18 +499,28 @@ LOCAL void wise_cb(int UNUSED(code), uint8_t *data, int data_len, gpointer uw)
             }
             BSB_IMPORT_skip(bsb, len);
         }
-        ARKIME_UNLOCK(item);
+        ARKIME_UNLOCK(fieldsMap);
     }
 
-    struct timeval currentTime;
-    gettimeofday(&currentTime, NULL);
+    struct timespec currentTime;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &currentTime);
+    uint64_t tookMS = currentTime.tv_sec * 1000 + currentTime.tv_nsec / 1000000 - request->sentMS;
+    int      bucket = 0;
+    while (tookMS > 1 && bucket < WISE_LATENCY_BUCKETS - 1) {
+        tookMS >>= 1;
+        bucket++;
+    }
 
     for (i = 0; i < request->numItems; i++) {
-        ARKIME_LOCK(item);
         WiseItem_t    *wi = request->items[i];
+        WiseShard_t   *shard = &shards[wi->shard];
         int numOps = 0;
         BSB_IMPORT_u08(bsb, numOps);
 
+        latency[(int)wi->type][bucket]++;
+
+        ARKIME_LOCK(shard->lock);
+
         arkime_field_ops_init(&wi->ops, numOps, ARKIME_FIELD_OPS_FLAGS_COPY);
         for (int o = 0; o < numOps && !BSB_IS_ERROR(bsb); o++) {
 
@@ -349,93 +546,310 @@ LOCAL void wise_cb(int UNUSED(code), uint8_t *data, int data_len, gpointer uw)
             arkime_field_ops_add(&wi->ops, fieldPos, str, len - 1);
         }
 
-        wi->loadTime = currentTime.tv_sec;
+        wi->loadTime = wiseNow;
+        wi->negative = wi->ops.num == 0;
 
-        // Schedule updates on waiting sessions
-        int s;
-        for (s = 0; s < wi->numSessions; s++) {
-            arkime_session_add_cmd(wi->sessions[s], ARKIME_SES_CMD_FUNC, wi, NULL, wise_session_cmd_cb);
-        }
-        g_free(wi->sessions);
-        wi->sessions = 0;
-        wi->numSessions = 0;
-
-        DLL_PUSH_HEAD(wil_, &types[(int)wi->type].itemList, wi);
-        // Cache needs to be reduced
-        if (types[(int)wi->type].itemList.wil_count > maxCache) {
-            DLL_POP_TAIL(wil_, &types[(int)wi->type].itemList, wi);
+        // Schedule updates on waiting sessions, nothing to do for negative answers
+        wise_release_waiters(wi, wi->negative ? NULL : wi);
+
+        WiseItemHead_t *itemList = &shard->itemList[(int)wi->type];
+        WiseItemHead_t *negList = &shard->negList[(int)wi->type];
+        DLL_PUSH_HEAD(wil_, wi->negative ? negList : itemList, wi);
+
+        // Cache needs to be reduced, drop the older of the two tails
+        if (DLL_COUNT(wil_, itemList) + DLL_COUNT(wil_, negList) > maxCacheShard) {
+            WiseItemHead_t *list = itemList;
+            if (DLL_COUNT(wil_, itemList) == 0 ||
+                (DLL_COUNT(wil_, negList) > 0 && negList->wil_prev->loadTime <= itemList->wil_prev->loadTime))
+                list = negList;
+            DLL_POP_TAIL(wil_, list, wi);
             wise_remove_item_locked(wi);
         }
-        ARKIME_UNLOCK(item);
+        ARKIME_UNLOCK(shard->lock);
     }
     ARKIME_TYPE_FREE(WiseRequest_t, request);
 }
 /******************************************************************************/
+LOCAL void wise_snapshot_free(WiseSnapshot_t *snap)
+{
+    munmap(snap->data, snap->size);
+    ARKIME_TYPE_FREE(WiseSnapshot_t, snap);
+}
+/******************************************************************************/
+LOCAL int wise_type_by_name(const char *name, int nameLen)
+{
+    for (int type = 0; type < numTypes; type++) {
+        if (types[type].nameLen == nameLen && strncmp(types[type].name, name, nameLen) == 0)
+            return type;
+    }
+    return -1;
+}
+/******************************************************************************/
+LOCAL WiseSnapshot_t *wise_snapshot_load(const char *file)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        LOG("ERROR - Couldn't open `%s` to load wise snapshot", file);
+        return NULL;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size < WISE_SNAPSHOT_HEADER_LEN) {
+        close(fd);
+        LOG("ERROR - `%s` corrupt", file);
+        return NULL;
+    }
+
+    uint8_t *data = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG("ERROR - Couldn't mmap `%s` to load wise snapshot", file);
+        return NULL;
+    }
+
+    WiseSnapshot_t *snap = ARKIME_TYPE_ALLOC0(WiseSnapshot_t);
+    snap->data = data;
+    snap->size = sb.st_size;
+    memset(snap->fieldsMap, -1, sizeof(snap->fieldsMap));
+
+    BSB      bsb;
+    uint32_t numFields = 0, numSTypes = 0;
+    uint64_t fileSize = 0;
+
+    BSB_INIT(bsb, data, sb.st_size);
+    if (memcmp(data, WISE_SNAPSHOT_MAGIC, 8) != 0) {
+        LOG("ERROR - `%s` isn't a wise snapshot", file);
+        goto bad;
+    }
+    BSB_IMPORT_skip(bsb, 8);
+    BSB_IMPORT_u32(bsb, numFields);
+    BSB_IMPORT_u32(bsb, numSTypes);
+    BSB_IMPORT_u64(bsb, fileSize);
+
+    // A size mismatch is usually a snapshot still being written, it is retried when it changes
+    if (fileSize != (uint64_t)sb.st_size || numFields > 256) {
+        LOG("ERROR - `%s` corrupt or incomplete, size %" PRIu64 " expected %" PRIu64, file, (uint64_t)sb.st_size, fileSize);
+        goto bad;
+    }
+
+    for (uint32_t f = 0; f < numFields; f++) {
+        int len = 0;
+        BSB_IMPORT_u16(bsb, len);
+        char *def = (char *)BSB_WORK_PTR(bsb);
+        BSB_IMPORT_skip(bsb, len);
+        if (BSB_IS_ERROR(bsb) || len == 0 || def[len - 1] != 0) {
+            LOG("ERROR - `%s` corrupt field %u", file, f);
+            goto bad;
+        }
+        snap->fieldsMap[f] = arkime_field_define_text(def, NULL);
+        if (snap->fieldsMap[f] == -1)
+            LOG("WARNING - Couldn't define wise snapshot field %s", def);
+    }
+
+    for (uint32_t t = 0; t < numSTypes; t++) {
+        int      nameLen = 0, flags = 0;
+        uint32_t numKeys = 0;
+        uint64_t indexOffset = 0;
+
+        BSB_IMPORT_u08(bsb, nameLen);
+        char *name = (char *)BSB_WORK_PTR(bsb);
+        BSB_IMPORT_skip(bsb, nameLen);
+        BSB_IMPORT_u08(bsb, flags);
+        BSB_IMPORT_u32(bsb, numKeys);
+        BSB_IMPORT_u64(bsb, indexOffset);
+
+        if (BSB_IS_ERROR(bsb) || indexOffset > snap->size || (snap->size - indexOffset) / 8 < numKeys) {
+            LOG("ERROR - `%s` corrupt type %u", file, t);
+            goto bad;
+        }
+
+        int type = wise_type_by_name(name, nameLen);
+        if (type == -1) {
+            LOG("WARNING - Ignoring wise snapshot type %.*s that isn't in wise-types", nameLen, name);
+            continue;
+        }
+        snap->types[type].index = data + indexOffset;
+        snap->types[type].numKeys = numKeys;
+        snap->types[type].flags = flags;
+    }
+    return snap;
+
+bad:
+    wise_snapshot_free(snap);
+    return NULL;
+}
+/******************************************************************************/
+// Called from the timer, swaps in the snapshot file when it has changed
+LOCAL void wise_snapshot_check()
+{
+    struct stat sb;
+
+    if (stat(snapshotFile, &sb) != 0)
+        return;
+
+    if (sb.st_ino == snapshotStat.st_ino && sb.st_size == snapshotStat.st_size && sb.st_mtime == snapshotStat.st_mtime)
+        return;
+    snapshotStat = sb;
+
+    WiseSnapshot_t *snap = wise_snapshot_load(snapshotFile);
+    if (!snap)
+        return;
+
+    WiseSnapshot_t *old = __atomic_exchange_n(&snapshot, snap, __ATOMIC_ACQ_REL);
+    if (old)
+        arkime_free_later(old, (GDestroyNotify) wise_snapshot_free);
+
+    if (config.debug)
+        LOG("Loaded wise snapshot %s", snapshotFile);
+}
+/******************************************************************************/
+LOCAL void wise_snapshot_run(ArkimeSession_t *session, WiseSnapshot_t *snap, BSB *bsb)
+{
+    ArkimeFieldOp_t  opsBuf[256];
+    ArkimeFieldOps_t ops;
+    int              numOps = 0;
+
+    // Values point into the mmap, nothing to free
+    ops.ops = opsBuf;
+    ops.size = 256;
+    ops.num = 0;
+    ops.flags = 0;
+
+    BSB_IMPORT_u08(*bsb, numOps);
+    for (int o = 0; o < numOps; o++) {
+        int field = 0, len = 0;
+        BSB_IMPORT_u08(*bsb, field);
+        BSB_IMPORT_u08(*bsb, len);
+        char *str = (char *)BSB_WORK_PTR(*bsb);
+        BSB_IMPORT_skip(*bsb, len);
+
+        if (BSB_IS_ERROR(*bsb) || len == 0 || str[len - 1] != 0)
+            break;
+
+        if (snap->fieldsMap[field] == -1)
+            continue;
+
+        arkime_field_ops_add(&ops, snap->fieldsMap[field], str, len - 1);
+    }
+    arkime_field_ops_run(session, &ops);
+}
+/******************************************************************************/
+// Returns TRUE if the snapshot has the final answer, hit or miss
+LOCAL gboolean wise_snapshot_lookup(ArkimeSession_t *session, uint32_t *tstats, const char *value, int type)
+{
+    WiseSnapshot_t *snap = __atomic_load_n(&snapshot, __ATOMIC_ACQUIRE);
+    if (!snap || !snap->types[type].index)
+        return FALSE;
+
+    const WiseSnapshotType_t *st = &snap->types[type];
+    const int                 len = strlen(value);
+    uint32_t                  lo = 0, hi = st->numKeys;
+    BSB                       bsb;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint64_t offset = 0;
+
+        BSB_INIT(bsb, (uint8_t *)st->index + (uint64_t)mid * 8, 8);
+        BSB_IMPORT_u64(bsb, offset);
+        if (offset >= snap->size)
+            break;
+
+        int keyLen = 0;
+        BSB_INIT(bsb, snap->data + offset, snap->size - offset);
+        BSB_IMPORT_u16(bsb, keyLen);
+        if (BSB_REMAINING(bsb) < keyLen)
+            break;
+
+        int cmp = memcmp(value, BSB_WORK_PTR(bsb), MIN(len, keyLen));
+        if (cmp == 0)
+            cmp = len - keyLen;
+
+        if (cmp < 0) {
+            hi = mid;
+        } else if (cmp > 0) {
+            lo = mid + 1;
+        } else {
+            BSB_IMPORT_skip(bsb, keyLen);
+            wise_snapshot_run(session, snap, &bsb);
+            tstats[INTEL_STAT_SNAPSHOT]++;
+            break;
+        }
+    }
+
+    return (st->flags & WISE_SNAPSHOT_COMPLETE) != 0;
+}
+/******************************************************************************/
 LOCAL void wise_lookup(ArkimeSession_t *session, WiseRequest_t *request, char *value, int type)
 {
 
     if (*value == 0)
         return;
 
-    if (request->numItems >= WISE_MAX_REQUEST_ITEMS)
-        return;
+    uint32_t *tstats = stats[session->thread][type];
+    iRequests[session->thread].lookups++;
+    tstats[INTEL_STAT_LOOKUP]++;
 
-    static int lookups = 0;
+    if (snapshot && wise_snapshot_lookup(session, tstats, value, type))
+        return;
 
-    lookups++;
-    if (logEvery != 0 && (lookups % logEvery) == 0)
-        wise_print_stats();
+    if (request->numItems >= WISE_MAX_REQUEST_ITEMS)
+        return;
 
-    stats[type][INTEL_STAT_LOOKUP]++;
+    const uint32_t hash = arkime_string_hash(value);
+    WiseShard_t   *shard = &shards[hash % WISE_SHARDS];
 
-    struct timeval currentTime;
-    gettimeofday(&currentTime, NULL);
+    ARKIME_LOCK(shard->lock);
+    if (!shard->itemHash[type].buckets) {
+        HASHP_INIT(wih_, shard->itemHash[type], WISE_SHARD_BUCKETS, arkime_string_hash, wise_item_cmp);
+    }
 
-    ARKIME_LOCK(item);
     WiseItem_t *wi;
-    HASH_FIND(wih_, types[type].itemHash, value, wi);
+    HASH_FIND_HASH(wih_, shard->itemHash[type], hash, value, wi);
 
     if (wi) {
         // Already being looked up
-        if (wi->sessions) {
-            if (wi->numSessions >= 4096) {
-                stats[type][INTEL_STAT_FAIL]++;
+        if (wi->waiters) {
+            if (wi->numSessions >= WISE_MAX_WAITERS) {
+                tstats[INTEL_STAT_FAIL]++;
                 goto cleanup;
             }
 
-            if (wi->numSessions >= wi->sessionsSize) {
-                wi->sessionsSize = MIN(wi->sessionsSize * 2, 4096);
-                wi->sessions = realloc(wi->sessions, sizeof(ArkimeSession_t *) * wi->sessionsSize);
-            }
-            wi->sessions[wi->numSessions++] = session;
-            arkime_session_incr_outstanding(session);
-            stats[type][INTEL_STAT_INPROGRESS]++;
+            wise_add_waiter(wi, session);
+            tstats[INTEL_STAT_INPROGRESS]++;
             goto cleanup;
         }
 
-        if (wi->loadTime + cacheSecs > currentTime.tv_sec) {
-            arkime_field_ops_run(session, &wi->ops);
-            stats[type][INTEL_STAT_CACHE]++;
-            goto cleanup;
-        }
+        if (wi->negative) {
+            if (wi->loadTime + negativeCacheSecs > wiseNow) {
+                tstats[INTEL_STAT_NEGATIVE]++;
+                goto cleanup;
+            }
+            DLL_REMOVE(wil_, &shard->negList[type], wi);
+            arkime_field_ops_free(&wi->ops);
+        } else {
+            if (wi->loadTime + cacheSecs > wiseNow) {
+                arkime_field_ops_run(session, &wi->ops);
+                tstats[INTEL_STAT_CACHE]++;
+                goto cleanup;
+            }
 
-        /* Had it in cache, but it is too old */
-        DLL_REMOVE(wil_, &types[type].itemList, wi);
-        arkime_field_ops_free(&wi->ops);
+            /* Had it in cache, but it is too old */
+            DLL_REMOVE(wil_, &shard->itemList[type], wi);
+            arkime_field_ops_free(&wi->ops);
+        }
     } else {
         // Know nothing about it
         wi = ARKIME_TYPE_ALLOC0(WiseItem_t);
         wi->key          = g_strdup(value);
         wi->type         = type;
-        wi->sessionsSize = 4;
-        HASH_ADD(wih_, types[type].itemHash, wi->key, wi);
+        wi->shard        = hash % WISE_SHARDS;
+        HASH_ADD_HASH(wih_, shard->itemHash[type], hash, wi->key, wi);
     }
 
-    wi->sessions = malloc(sizeof(ArkimeSession_t *) * wi->sessionsSize);
-    wi->sessions[wi->numSessions++] = session;
-    arkime_session_incr_outstanding(session);
+    wise_add_waiter(wi, session);
 
-    stats[type][INTEL_STAT_REQUEST]++;
+    tstats[INTEL_STAT_REQUEST]++;
 
     if (type < INTEL_TYPE_NUM_PRE) {
         BSB_EXPORT_u08(request->bsb, type);
@@ -450,7 +864,7 @@ LOCAL void wise_lookup(ArkimeSession_t *session, WiseRequest_t *request, char *v
     request->items[request->numItems++] = wi;
 
 cleanup:
-    ARKIME_UNLOCK(item);
+    ARKIME_UNLOCK(shard->lock);
 }
 /******************************************************************************/
 LOCAL void wise_lookup_domain(ArkimeSession_t *session, WiseRequest_t *request, char *domain)
@@ -602,41 +1016,76 @@ void wise_lookup_url(ArkimeSession_t *session, WiseRequest_t *request, char *url
     }
 }
 /******************************************************************************/
-LOCAL void wise_flush_locked()
+LOCAL void wise_flush_locked(WiseThreadRequest_t *tr)
 {
-    if (!iRequest || iRequest->numItems == 0)
+    WiseRequest_t *request = tr->request;
+
+    if (!request || request->numItems == 0)
         return;
 
-    inflight += iRequest->numItems;
-    if (arkime_http_send(wiseService, "POST", wiseGetURI, -1, iBuf, BSB_LENGTH(iRequest->bsb), NULL, TRUE, wise_cb, iRequest) != 0) {
-        LOG("Wise - request failed %p for %d items", iRequest, iRequest->numItems);
-        wise_cb(500, NULL, 0, iRequest);
+    struct timespec currentTime;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &currentTime);
+    request->sentMS = currentTime.tv_sec * 1000 + currentTime.tv_nsec / 1000000;
+
+    __sync_add_and_fetch(&inflight, request->numItems);
+    if (arkime_http_send(wiseService, "POST", wiseGetURI, -1, tr->buf, BSB_LENGTH(request->bsb), NULL, TRUE, wise_cb, request) != 0) {
+        LOG("Wise - request failed %p for %d items", request, request->numItems);
+        wise_cb(500, NULL, 0, request);
     }
 
-    iRequest = 0;
-    iBuf     = 0;
+    tr->request = 0;
+    tr->buf     = 0;
 }
 /******************************************************************************/
 LOCAL gboolean wise_flush(gpointer UNUSED(user_data))
 {
-    ARKIME_LOCK(iRequest);
-    wise_flush_locked();
-    ARKIME_UNLOCK(iRequest);
+    static uint32_t lastLookups;
+
+    struct timespec currentTime;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &currentTime);
+    wiseNow = currentTime.tv_sec;
+
+    if (snapshotFile)
+        wise_snapshot_check();
+
+    uint32_t lookups = 0;
+    for (int t = 0; t < config.packetThreads; t++) {
+        ARKIME_LOCK(iRequests[t].lock);
+        wise_flush_locked(&iRequests[t]);
+        ARKIME_UNLOCK(iRequests[t].lock);
+        lookups += iRequests[t].lookups;
+    }
+
+    if (logEvery != 0 && lookups / logEvery != lastLookups / logEvery)
+        wise_print_stats();
+    lastLookups = lookups;
+
+    // Expire old items so they don't sit around until pushed out by new ones
+    for (int s = 0; s < WISE_SHARDS; s++) {
+        ARKIME_LOCK(shards[s].lock);
+        for (int type = 0; type < numTypes; type++) {
+            wise_expire_list_locked(&shards[s].itemList[type], cacheSecs);
+            wise_expire_list_locked(&shards[s].negList[type], negativeCacheSecs);
+        }
+        ARKIME_UNLOCK(shards[s].lock);
+    }
     return G_SOURCE_CONTINUE;
 }
 /******************************************************************************/
 
 void wise_plugin_pre_save(ArkimeSession_t *session, int UNUSED(final))
 {
-    ArkimeString_t *hstring = NULL;
-
-    ARKIME_LOCK(iRequest);
-    if (!iRequest) {
-        iRequest = ARKIME_TYPE_ALLOC(WiseRequest_t);
-        iBuf = arkime_http_get_buffer(0xffff);
-        BSB_INIT(iRequest->bsb, iBuf, 0xffff);
-        iRequest->numItems = 0;
+    ArkimeString_t      *hstring = NULL;
+    WiseThreadRequest_t *tr = &iRequests[session->thread];
+
+    ARKIME_LOCK(tr->lock);
+    if (!tr->request) {
+        tr->request = ARKIME_TYPE_ALLOC(WiseRequest_t);
+        tr->buf = arkime_http_get_buffer(0xffff);
+        BSB_INIT(tr->request->bsb, tr->buf, 0xffff);
+        tr->request->numItems = 0;
     }
+    WiseRequest_t *iRequest = tr->request;
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
@@ -800,19 +1249,25 @@ void wise_plugin_pre_save(ArkimeSession_t *session, int UNUSED(final))
     }
 
     if (iRequest->numItems > WISE_MAX_REQUEST_ITEMS / 2) {
-        wise_flush_locked();
+        wise_flush_locked(tr);
     }
-    ARKIME_UNLOCK(iRequest);
+    ARKIME_UNLOCK(tr->lock);
 }
 /******************************************************************************/
 LOCAL void wise_plugin_exit()
 {
-    ARKIME_LOCK(item);
-    for (int type = 0; type < INTEL_TYPE_SIZE; type++) {
-        WiseItem_t *wi;
-        while (DLL_POP_TAIL(wil_, &types[type].itemList, wi)) {
-            wise_remove_item_locked(wi);
+    for (int s = 0; s < WISE_SHARDS; s++) {
+        ARKIME_LOCK(shards[s].lock);
+        for (int type = 0; type < INTEL_TYPE_SIZE; type++) {
+            WiseItem_t *wi;
+            while (DLL_POP_TAIL(wil_, &shards[s].itemList[type], wi)) {
+                wise_remove_item_locked(wi);
+            }
+            while (DLL_POP_TAIL(wil_, &shards[s].negList[type], wi)) {
+                wise_remove_item_locked(wi);
+            }
         }
+        ARKIME_UNLOCK(shards[s].lock);
     }
 
     if (wiseHost)
@@ -822,15 +1277,22 @@ LOCAL void wise_plugin_exit()
         g_free(wiseURL);
 
     arkime_http_free_server(wiseService);
-    ARKIME_UNLOCK(item);
+
+    if (snapshot) {
+        wise_snapshot_free(snapshot);
+        snapshot = 0;
+    }
+    g_free(snapshotFile);
 }
 /******************************************************************************/
 LOCAL uint32_t wise_plugin_outstanding()
 {
-    int count;
-    ARKIME_LOCK(iRequest);
-    count = inflight + (iRequest ? iRequest->numItems : 0) + arkime_http_queue_length(wiseService);
-    ARKIME_UNLOCK(iRequest);
+    int count = inflight + arkime_http_queue_length(wiseService);
+    for (int t = 0; t < config.packetThreads; t++) {
+        ARKIME_LOCK(iRequests[t].lock);
+        count += iRequests[t].request ? iRequests[t].request->numItems : 0;
+        ARKIME_UNLOCK(iRequests[t].lock);
+    }
     LOG("wise: %d", count);
     return count;
 }
@@ -944,15 +1406,21 @@ void arkime_plugin_init()
 {
     int i;
 
-    if (config.dryRun) {
+    // The tests run with dryRun set, they still want wise when checking a snapshot
+    snapshotFile = arkime_config_str(NULL, "wiseSnapshotFile", NULL);
+    if (config.dryRun && !(config.tests && snapshotFile)) {
         LOG("Not enabling in dryRun mode");
+        g_free(snapshotFile);
+        snapshotFile = NULL;
         return;
     }
 
     maxConns = arkime_config_int(NULL, "wiseMaxConns", 10, 1, 60);
     maxRequests = arkime_config_int(NULL, "wiseMaxRequests", 100, 1, 50000);
     maxCache = arkime_config_int(NULL, "wiseMaxCache", 100000, 1, 500000);
+    maxCacheShard = MAX(1, (maxCache + WISE_SHARDS - 1) / WISE_SHARDS);
     cacheSecs = arkime_config_int(NULL, "wiseCacheSecs", 600, 1, 5000);
+    negativeCacheSecs = arkime_config_int(NULL, "wiseNegativeCacheSecs", cacheSecs, 1, 5000);
     tcpTuple = arkime_config_boolean(NULL, "wiseTcpTupleLookups", FALSE);
     udpTuple = arkime_config_boolean(NULL, "wiseUdpTupleLookups", FALSE);
     logEvery = arkime_config_int(NULL, "wiseLogEvery", 10000, 0, 10000000);
@@ -1000,14 +1468,30 @@ void arkime_plugin_init()
                          );
 
     arkime_plugins_set_outstanding_cb("wise", wise_plugin_outstanding);
-
-    int type;
-    for (type = 0; type < INTEL_TYPE_SIZE; type++) {
-        HASH_INIT(wih_, types[type].itemHash, arkime_string_hash, wise_item_cmp);
-        DLL_INIT(wil_, &types[type].itemList);
+    arkime_plugins_set_stats_cb("wise", wise_plugin_stats);
+
+    // Hashes are allocated by wise_lookup the first time a type is used in a shard
+    for (int s = 0; s < WISE_SHARDS; s++) {
+        ARKIME_LOCK_INIT(shards[s].lock);
+        for (int type = 0; type < INTEL_TYPE_SIZE; type++) {
+            DLL_INIT(wil_, &shards[s].itemList[type]);
+            DLL_INIT(wil_, &shards[s].negList[type]);
+        }
     }
+    for (int t = 0; t < ARKIME_MAX_PACKET_THREADS; t++) {
+        ARKIME_LOCK_INIT(iRequests[t].lock);
+    }
+
+    struct timespec currentTime;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &currentTime);
+    wiseNow = currentTime.tv_sec;
+
     g_timeout_add_seconds(1, wise_flush, 0);
     wise_load_fields();
 
+    // Load any snapshot now so the first sessions can use it, it needs wise-types loaded
+    if (snapshotFile)
+        wise_snapshot_check();
+
     g_strlcpy(wiseGetURI, "/get?ver=2", sizeof(wiseGetURI));
 }
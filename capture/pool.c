@@ -0,0 +1,198 @@
+/* pool.c  -- per thread object pools for the hot fixed size types
+ *
+ * Each thread that allocates gets its own cache per pool type and hands out
+ * objects from slabs that it carved itself, so with the kernel's first touch
+ * policy the memory lives on the NUMA node of the thread that allocates it.
+ * Objects freed on the owning thread go right back on its free list.  Objects
+ * freed on another thread, packets allocated by a reader and freed by a packet
+ * thread for example, are pushed on the owner's lock free return stack and the
+ * owner takes the whole stack at once when its free list runs dry.
+ *
+ * Slabs are never given back, so the slab memory is also the high water mark.
+ *
+ * Copyright 2023 All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "arkime.h"
+
+/******************************************************************************/
+extern ArkimeConfig_t        config;
+
+#define ARKIME_POOL_SLAB_SIZE  (256 * 1024)
+#define ARKIME_POOL_MAX_CACHES 256
+
+typedef struct arkime_pool_obj {
+    struct arkime_pool_obj   *next;
+} ArkimePoolObj_t;
+
+typedef struct {
+    ArkimePoolObj_t          *freeList;
+    uint8_t                  *carve;
+    uint8_t                  *carveEnd;
+    uint64_t                  allocs;
+    uint64_t                  frees;       // Frees done by this thread, local or remote
+    uint64_t                  slabs;
+    char                      pad[16];
+
+    // Other threads push here, keep it off the owner's cache line
+    ArkimePoolObj_t          *returned;
+} ArkimePoolCache_t;
+
+typedef struct {
+    ArkimePoolCache_t        *cache;
+} ArkimePoolSlab_t;
+
+LOCAL int                    usePools;
+LOCAL uint32_t               poolSize[ARKIME_POOL_MAX];
+LOCAL const char            *poolNames[ARKIME_POOL_MAX] = {"packet", "tcpData", "session", "field", "arena"};
+
+LOCAL ArkimePoolCache_t     *poolCaches[ARKIME_POOL_MAX][ARKIME_POOL_MAX_CACHES];
+LOCAL int                    poolNumCaches[ARKIME_POOL_MAX];
+LOCAL uint64_t               poolHighWater[ARKIME_POOL_MAX];
+
+LOCAL __thread ArkimePoolCache_t *myCaches[ARKIME_POOL_MAX];
+
+/******************************************************************************/
+LOCAL ArkimePoolCache_t *arkime_pool_cache_create(ArkimePoolType type)
+{
+    ArkimePoolCache_t *cache;
+
+    if (posix_memalign((void **)&cache, 64, sizeof(ArkimePoolCache_t)) != 0)
+        LOGEXIT("ERROR - Couldn't allocate pool cache");
+    memset(cache, 0, sizeof(*cache));
+
+    int num = __sync_fetch_and_add(&poolNumCaches[type], 1);
+    if (num < ARKIME_POOL_MAX_CACHES) {
+        poolCaches[type][num] = cache;
+    } else if (num == ARKIME_POOL_MAX_CACHES) {
+        LOG("WARNING - More than %d threads using %s pool, stats will be off", ARKIME_POOL_MAX_CACHES, poolNames[type]);
+    }
+
+    myCaches[type] = cache;
+    return cache;
+}
+/******************************************************************************/
+LOCAL void *arkime_pool_carve(ArkimePoolCache_t *cache, ArkimePoolType type)
+{
+    if (cache->carve + poolSize[type] > cache->carveEnd) {
+        uint8_t *slab;
+        if (posix_memalign((void **)&slab, ARKIME_POOL_SLAB_SIZE, ARKIME_POOL_SLAB_SIZE) != 0)
+            LOGEXIT("ERROR - Couldn't allocate %s pool slab", poolNames[type]);
+
+        ((ArkimePoolSlab_t *)slab)->cache = cache;
+        cache->carve = slab + 64;
+        cache->carveEnd = slab + ARKIME_POOL_SLAB_SIZE;
+        cache->slabs++;
+    }
+
+    void *mem = cache->carve;
+    cache->carve += poolSize[type];
+    return mem;
+}
+/******************************************************************************/
+void *arkime_pool_alloc(ArkimePoolType type, int zero)
+{
+    if (!usePools)
+        return zero ? calloc(1, poolSize[type]) : malloc(poolSize[type]);
+
+    ArkimePoolCache_t *cache = myCaches[type];
+    if (unlikely(!cache))
+        cache = arkime_pool_cache_create(type);
+
+    ArkimePoolObj_t *obj = cache->freeList;
+    if (!obj && cache->returned) {
+        obj = __sync_lock_test_and_set(&cache->returned, NULL);
+    }
+
+    void *mem;
+    if (obj) {
+        cache->freeList = obj->next;
+        mem = obj;
+    } else {
+        mem = arkime_pool_carve(cache, type);
+    }
+
+    cache->allocs++;
+
+    if (zero)
+        memset(mem, 0, poolSize[type]);
+    return mem;
+}
+/******************************************************************************/
+void arkime_pool_free(ArkimePoolType type, void *mem)
+{
+    if (!usePools) {
+        free(mem);
+        return;
+    }
+
+    ArkimePoolCache_t *cache = myCaches[type];
+    if (unlikely(!cache))
+        cache = arkime_pool_cache_create(type);
+    cache->frees++;
+
+    ArkimePoolObj_t   *obj = mem;
+    ArkimePoolCache_t *owner = ((ArkimePoolSlab_t *)((uintptr_t)mem & ~(uintptr_t)(ARKIME_POOL_SLAB_SIZE - 1)))->cache;
+
+    if (owner == cache) {
+        obj->next = cache->freeList;
+        cache->freeList = obj;
+        return;
+    }
+
+    ArkimePoolObj_t *head;
+    do {
+        head = owner->returned;
+        obj->next = head;
+    } while (!__sync_bool_compare_and_swap(&owner->returned, head, obj));
+}
+/******************************************************************************/
+/* Called from the stats thread, counters are read without locks so may be slightly off */
+void arkime_pool_stats(ArkimePoolType type, uint64_t *inUse, uint64_t *highWater, uint64_t *memory)
+{
+    uint64_t allocs = 0, frees = 0, slabs = 0;
+    int num = MIN(poolNumCaches[type], ARKIME_POOL_MAX_CACHES);
+
+    for (int i = 0; i < num; i++) {
+        ArkimePoolCache_t *cache = poolCaches[type][i];
+        if (!cache)
+            continue;
+        allocs += cache->allocs;
+        frees += cache->frees;
+        slabs += cache->slabs;
+    }
+
+    *inUse = (allocs > frees) ? allocs - frees : 0;
+    if (*inUse > poolHighWater[type])
+        poolHighWater[type] = *inUse;
+    *highWater = poolHighWater[type];
+    *memory = slabs * ARKIME_POOL_SLAB_SIZE;
+}
+/******************************************************************************/
+const char *arkime_pool_name(ArkimePoolType type)
+{
+    return poolNames[type];
+}
+/******************************************************************************/
+void arkime_pool_init()
+{
+#ifdef __SANITIZE_ADDRESS__
+    // Pools hide use after free from ASAN
+    usePools = arkime_config_boolean(NULL, "objectPools", FALSE);
+#else
+    usePools = arkime_config_boolean(NULL, "objectPools", TRUE);
+#endif
+
+    poolSize[ARKIME_POOL_PACKET]  = sizeof(ArkimePacket_t);
+    poolSize[ARKIME_POOL_TCPDATA] = sizeof(ArkimeTcpData_t);
+    poolSize[ARKIME_POOL_SESSION] = sizeof(ArkimeSession_t);
+    poolSize[ARKIME_POOL_FIELD]   = sizeof(ArkimeField_t);
+    poolSize[ARKIME_POOL_ARENA]   = ARKIME_FIELD_ARENA_SIZE;
+
+    // Keep objects 16 byte aligned and big enough for the free list pointer
+    for (int t = 0; t < ARKIME_POOL_MAX; t++) {
+        poolSize[t] = MAX((poolSize[t] + 15) & ~15U, sizeof(ArkimePoolObj_t));
+    }
+}
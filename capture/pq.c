@@ -1,4 +1,9 @@
 /* pq.c  -- Priority Q
+ *
+ * Each item is a timer on its session's packet thread wheel, so adding,
+ * moving and expiring are O(1) no matter how many items there are. The
+ * items for a session are linked off the session so they can be found
+ * without a hash lookup.
  *
  * Copyright 2012-2017 AOL Inc. All rights reserved.
  *
@@ -13,57 +18,82 @@ extern time_t                lastPacketSecs[ARKIME_MAX_PACKET_THREADS];
 
 LOCAL int         numPQs;
 LOCAL ArkimePQ_t *pqs[10];
-LOCAL uint32_t    pqEntries;
 
 
 /******************************************************************************/
 typedef struct arkimepqitem {
-    struct arkimepqitem *pql_next, *pql_prev;
-    struct arkimepqitem *pqh_next, *pqh_prev;
+    struct arkimepqitem *pqi_next, *pqi_prev;
+    ArkimeWheelEntry_t   timer;
+    struct arkimepqitem *snext;
 
+    ArkimePQ_t          *pq;
     ArkimeSession_t     *session;
     void                *uw;
-    time_t               expire;
-    uint32_t             pqh_hash;
-    uint32_t             pqh_bucket;
 } ArkimePQItem_t;
 
 typedef struct {
-    struct arkimepqitem *pql_next, *pql_prev;
-    struct arkimepqitem *pqh_next, *pqh_prev;
-    int                  pql_count;
-    int                  pqh_count;
+    struct arkimepqitem *pqi_next, *pqi_prev;
+    int                  pqi_count;
 } ArkimePQHead_t;
 
-typedef HASH_VAR(s_, ArkimePQHash_t, ArkimePQHead_t, 51);
+// All the items for each thread, used for flushing
+LOCAL ArkimePQHead_t     pqItems[ARKIME_MAX_PACKET_THREADS];
 
 struct ArkimePQ_t {
-    ArkimePQHead_t     *buckets[ARKIME_MAX_PACKET_THREADS];
-    ArkimePQHash_t      keys[ARKIME_MAX_PACKET_THREADS];
     ArkimePQ_cb         cb;
-    time_t              bucket0[ARKIME_MAX_PACKET_THREADS];
     uint32_t            maxSeconds;
 };
 
 /******************************************************************************/
-LOCAL int arkime_pq_cmp(const void *keyv, const ArkimePQItem_t *item)
+LOCAL ArkimePQItem_t *arkime_pq_find(const ArkimePQ_t *pq, ArkimeSession_t *session, ArkimePQItem_t ***prevp)
+{
+    ArkimePQItem_t **prev = &session->pqItems;
+
+    for (; *prev; prev = &(*prev)->snext) {
+        if ((*prev)->pq == pq) {
+            if (prevp)
+                *prevp = prev;
+            return *prev;
+        }
+    }
+    return NULL;
+}
+/******************************************************************************/
+LOCAL void arkime_pq_item_free(ArkimePQItem_t *item, ArkimePQItem_t **prev)
+{
+    const int thread = item->session->thread;
+
+    *prev = item->snext;
+    arkime_wheel_remove(thread, &item->timer);
+    DLL_REMOVE(pqi_, &pqItems[thread], item);
+    ARKIME_TYPE_FREE(ArkimePQItem_t, item);
+}
+/******************************************************************************/
+LOCAL void arkime_pq_timer_cb(ArkimeWheelEntry_t *entry, int UNUSED(thread), uint32_t UNUSED(now))
 {
-    return memcmp(keyv, item->session->sessionId, MIN(((uint8_t *)keyv)[0], item->session->sessionId[0])) == 0;
+    ArkimePQItem_t  *item = (ArkimePQItem_t *)((char *)entry - offsetof(ArkimePQItem_t, timer));
+    ArkimePQ_t      *pq = item->pq;
+    ArkimeSession_t *session = item->session;
+    void            *uw = item->uw;
+    ArkimePQItem_t **prev;
+
+    // The callback might free the session, so be done with the item first
+    arkime_pq_find(pq, session, &prev);
+    arkime_pq_item_free(item, prev);
+    pq->cb(session, uw);
 }
 /******************************************************************************/
 ArkimePQ_t *arkime_pq_alloc(int maxSeconds, ArkimePQ_cb cb)
 {
     ArkimePQ_t *pq = ARKIME_TYPE_ALLOC0(ArkimePQ_t);
 
-    pq->maxSeconds = maxSeconds;
-    int t, i;
-    for (t = 0; t < config.packetThreads; t++) {
-        pq->bucket0[t] = 0;
-        pq->buckets[t] = malloc(sizeof(ArkimePQHead_t) * (maxSeconds + 1));
-        HASH_INIT(pqh_, pq->keys[t], arkime_string_hash, (HASH_CMP_FUNC)arkime_pq_cmp);
-        for (i = 0; i <= maxSeconds; i++)
-            DLL_INIT(pql_, &pq->buckets[t][i]);
+    if (numPQs == 0) {
+        for (int t = 0; t < ARKIME_MAX_PACKET_THREADS; t++)
+            DLL_INIT(pqi_, &pqItems[t]);
+        arkime_wheel_register(ARKIME_WHEEL_PQ, arkime_pq_timer_cb);
     }
+
+    pq->maxSeconds = maxSeconds;
     pq->cb = cb;
     pqs[numPQs] = pq;
     numPQs++;
@@ -71,131 +101,60 @@ ArkimePQ_t *arkime_pq_alloc(int maxSeconds, ArkimePQ_cb cb)
     return pq;
 }
 /******************************************************************************/
-LOCAL void arkime_pq_shift(ArkimePQ_t *pq, int thread)
-{
-    uint32_t shift = lastPacketSecs[thread] - pq->bucket0[thread];
-
-    if (shift > pq->maxSeconds)
-        shift = pq->maxSeconds;
-
-    for (uint32_t i = 1; i <= pq->maxSeconds; i++) {
-        if (i <= shift) {
-            DLL_PUSH_TAIL_DLL(pql_, &pq->buckets[thread][0], &pq->buckets[thread][i]);
-        }
-        if (i + shift <= pq->maxSeconds) {
-            DLL_PUSH_TAIL_DLL(pql_, &pq->buckets[thread][i], &pq->buckets[thread][i + shift]);
-        }
-    }
-    pq->bucket0[thread] = lastPacketSecs[thread];
-}
-/******************************************************************************/
 void arkime_pq_upsert(ArkimePQ_t *pq, ArkimeSession_t *session, uint32_t timeout, void *uw)
 {
-    // timeout is relative to lastPacketSecs, figure out time
-    time_t expire = lastPacketSecs[session->thread] + timeout;
-
-    // Now recalculate bucket0 if we need to
-    if (lastPacketSecs[session->thread] > pq->bucket0[session->thread])
-        arkime_pq_shift(pq, session->thread);
-
-    // In the past, just run now
-    if (expire < pq->bucket0[session->thread])
-        timeout = 0;
-    else {
-        timeout = expire - pq->bucket0[session->thread];
-
-        // To far in the future for this PQ
-        if (timeout > pq->maxSeconds)
-            timeout = pq->maxSeconds;
+    // timeout is relative to lastPacketSecs, to far in the future for this PQ is capped
+    const uint32_t expire = lastPacketSecs[session->thread] + MIN(timeout, pq->maxSeconds);
+
+    ArkimePQItem_t *item = arkime_pq_find(pq, session, NULL);
+    if (!item) {
+        item = ARKIME_TYPE_ALLOC0(ArkimePQItem_t);
+        item->timer.type = ARKIME_WHEEL_PQ;
+        item->pq = pq;
+        item->session = session;
+        item->uw = uw;
+        item->snext = session->pqItems;
+        session->pqItems = item;
+        DLL_PUSH_TAIL(pqi_, &pqItems[session->thread], item);
     }
 
-    ArkimePQItem_t *item;
-    HASH_FIND(pqh_, (pq->keys[session->thread]), session->sessionId, item);
-    if (item) {
-        uint32_t bucket = item->expire - pq->bucket0[session->thread];
-        if (bucket > pq->maxSeconds)
-            bucket = pq->maxSeconds;
-
-        // Same bucket
-        if (bucket == timeout) {
-            return;
-        }
-
-        // Move the item from 1 bucket to another
-        DLL_REMOVE(pql_, &pq->buckets[session->thread][bucket], item);
-        DLL_PUSH_TAIL(pql_, &pq->buckets[session->thread][timeout], item);
-        item->expire = expire;
-        return;
-    }
-
-    // This is a new item
-    item = ARKIME_TYPE_ALLOC(ArkimePQItem_t);
-    DLL_PUSH_TAIL(pql_, &pq->buckets[session->thread][timeout], item);
-    HASH_ADD(pqh_, pq->keys[session->thread], session->sessionId, item);
-    item->expire = expire;
-    item->session = session;
-    item->uw = uw;
-    session->pq = 1;
-    pqEntries++;
+    arkime_wheel_add(session->thread, &item->timer, expire);
 }
 /******************************************************************************/
 void arkime_pq_remove(ArkimePQ_t *pq, ArkimeSession_t *session)
 {
-    ArkimePQItem_t *item;
-    HASH_FIND(pqh_, pq->keys[session->thread], session->sessionId, item);
+    ArkimePQItem_t **prev;
+    ArkimePQItem_t  *item = arkime_pq_find(pq, session, &prev);
     if (!item)
         return;
 
-    int bucket = item->expire - pq->bucket0[session->thread];
-    if (bucket < 0) bucket = 0;
-    DLL_REMOVE(pql_, &pq->buckets[session->thread][bucket], item);
-    HASH_REMOVE(pqh_, pq->keys[session->thread], item);
-    ARKIME_TYPE_FREE(ArkimePQItem_t, item);
-    pqEntries--;
+    arkime_pq_item_free(item, prev);
 }
 /******************************************************************************/
+/* pq timers are on the packet thread wheel with the session timers */
 void arkime_pq_run(int thread, int max)
 {
-    if (pqEntries == 0)
+    if (DLL_COUNT(pqi_, &pqItems[thread]) == 0)
         return;
 
-    int i;
-    for (i = 0; i < numPQs; i++) {
-        if (lastPacketSecs[thread] > pqs[i]->bucket0[thread])
-            arkime_pq_shift(pqs[i], thread);
-
-        int cnt = max;
-        ArkimePQItem_t *item = 0;
-        while (cnt > 0 && DLL_POP_HEAD(pql_, &pqs[i]->buckets[thread][0], item)) {
-            HASH_REMOVE(pqh_, pqs[i]->keys[thread], item);
-            pqs[i]->cb(item->session, item->uw);
-            ARKIME_TYPE_FREE(ArkimePQItem_t, item);
-            cnt--;
-        }
-    }
+    arkime_wheel_run(thread, lastPacketSecs[thread], max);
 }
 /******************************************************************************/
 /* Remove this session from all PQs */
 void arkime_pq_free(ArkimeSession_t *session)
 {
-    int i;
-    for (i = 0; i < numPQs; i++) {
-        arkime_pq_remove(pqs[i], session);
+    while (session->pqItems) {
+        arkime_pq_item_free(session->pqItems, &session->pqItems);
     }
 }
 /******************************************************************************/
-/* Reset the bucket0 time */
+/* Drop all the items for this thread without calling the callbacks */
 void arkime_pq_flush(int thread)
 {
-    for (int i = 0; i < numPQs; i++) {
-        for (uint32_t b = 0; b < pqs[i]->maxSeconds; b++) {
-            ArkimePQItem_t *item = 0;
-            while (DLL_POP_HEAD(pql_, &pqs[i]->buckets[thread][b], item)) {
-                HASH_REMOVE(pqh_, pqs[i]->keys[thread], item);
-                ARKIME_TYPE_FREE(ArkimePQItem_t, item);
-            }
-        }
-        pqs[i]->bucket0[thread] = 0;
+    ArkimePQItem_t *item;
+
+    while ((item = DLL_PEEK_HEAD(pqi_, &pqItems[thread]))) {
+        arkime_pq_free(item->session);
     }
 }
 /******************************************************************************/
@@ -203,17 +162,6 @@ void arkime_pq_flush(int thread)
 #ifdef TESTPQ
 #include <assert.h>
 
-SUPPRESS_UNSIGNED_INTEGER_OVERFLOW
-uint32_t arkime_string_hash(const void *key)
-{
-    uint8_t *p = (uint8_t *)key;
-    uint32_t n = 0;
-    while (*p) {
-        n = (n << 5) - n + *p;
-        p++;
-    }
-    return n;
-}
 int callbacks;
 LOCAL void pq_cb(ArkimeSession_t *session, void UNUSED(*uw))
 {
@@ -224,117 +172,100 @@ ArkimeConfig_t         config;
 time_t                 lastPacketSecs[ARKIME_MAX_PACKET_THREADS];
 int main()
 {
-    ArkimePQ_t pq;
     ArkimeSession_t session1;
-    session1.sessionId[0] = 2;
-    session1.sessionId[1] = 'A';
+    memset(&session1, 0, sizeof(session1));
     session1.thread = 0;
     config.packetThreads = 1;
+    arkime_wheel_init();
+
+    ArkimePQ_t *pq = arkime_pq_alloc(1, pq_cb);
 
     // Big jump
     LOG("**TEST1");
-    arkime_pq_init(&pq, 1, pq_cb);
     lastPacketSecs[0] = 0;
     arkime_pq_run(0, 10);
     lastPacketSecs[0] = 1259261324;
     arkime_pq_run(0, 10);
     lastPacketSecs[0] = 1259261324;
-    arkime_pq_upsert(&pq, &session1, 5, NULL);
+    arkime_pq_upsert(pq, &session1, 5, NULL);
     lastPacketSecs[0] = 1259261384;
-    arkime_pq_upsert(&pq, &session1, 5, NULL);
+    arkime_pq_upsert(pq, &session1, 5, NULL);
     lastPacketSecs[0] = 1259261384;
-    arkime_pq_upsert(&pq, &session1, 5, NULL);
+    arkime_pq_upsert(pq, &session1, 5, NULL);
     lastPacketSecs[0] = 1259261384;
     arkime_pq_run(0, 10);
     lastPacketSecs[0] = 1259261385;
     arkime_pq_run(0, 10);
     assert(callbacks == 1);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 0);
+    assert(session1.pqItems == NULL);
 
     // Move from 1 to 0 and run
     LOG("**TEST2");
     callbacks = 0;
-    pq.bucket0[0] = lastPacketSecs[0] = 100;
-    arkime_pq_upsert(&pq, &session1, 1, NULL);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][0]) == 0);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][1]) == 1);
-    arkime_pq_upsert(&pq, &session1, 0, NULL);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][0]) == 1);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][1]) == 0);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 1);
+    lastPacketSecs[0] = 1259261386;
+    arkime_pq_upsert(pq, &session1, 1, NULL);
+    arkime_pq_run(0, 10);
+    assert(callbacks == 0);
+    arkime_pq_upsert(pq, &session1, 0, NULL);
+    assert(arkime_wheel_count(0) == 1);
     arkime_pq_run(0, 10);
     assert(callbacks == 1);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 0);
+    assert(session1.pqItems == NULL);
 
     // Move from 0 to 1 and run
     LOG("**TEST3");
     callbacks = 0;
-    pq.bucket0[0] = lastPacketSecs[0] = 100;
-    arkime_pq_upsert(&pq, &session1, 0, NULL);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][0]) == 1);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][1]) == 0);
-    arkime_pq_upsert(&pq, &session1, 1, NULL);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][0]) == 0);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][1]) == 1);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 1);
+    arkime_pq_upsert(pq, &session1, 0, NULL);
+    arkime_pq_upsert(pq, &session1, 1, NULL);
+    assert(session1.pqItems != NULL);
     arkime_pq_run(0, 10);
     assert(callbacks == 0);
-    lastPacketSecs[0] = 101;
+    lastPacketSecs[0]++;
     arkime_pq_run(0, 10);
     assert(callbacks == 1);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 0);
-
+    assert(session1.pqItems == NULL);
 
     // Keep moving 0 ahead
     LOG("**TEST4");
     callbacks = 0;
-    pq.bucket0[0] = lastPacketSecs[0] = 100;
-    arkime_pq_upsert(&pq, &session1, 0, NULL);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 0, NULL);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 0, NULL);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 0, NULL);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 0, NULL);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 0, NULL);
+    for (int i = 0; i < 6; i++) {
+        lastPacketSecs[0]++;
+        arkime_pq_upsert(pq, &session1, 0, NULL);
+    }
     assert(callbacks == 0);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 1);
+    assert(arkime_wheel_count(0) == 1);
     arkime_pq_run(0, 10);
     assert(callbacks == 1);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 0);
+    assert(session1.pqItems == NULL);
 
     // Keep re adding
     LOG("**TEST5");
     callbacks = 0;
-    lastPacketSecs[0] = 100;
-    arkime_pq_upsert(&pq, &session1, 1, NULL);
+    arkime_pq_upsert(pq, &session1, 1, NULL);
+    for (int i = 0; i < 5; i++) {
+        lastPacketSecs[0]++;
+        arkime_pq_upsert(pq, &session1, 1, NULL);
+        arkime_pq_run(0, 10);
+    }
     assert(callbacks == 0);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][0]) == 0);
-    assert(DLL_COUNT(pql_, &pq.buckets[0][1]) == 1);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 1);
+    assert(session1.pqItems != NULL);
     lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 1, NULL);
     arkime_pq_run(0, 10);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 1, NULL);
-    arkime_pq_run(0, 10);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 1, NULL);
-    arkime_pq_run(0, 10);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 1, NULL);
-    arkime_pq_run(0, 10);
-    lastPacketSecs[0]++;
-    arkime_pq_upsert(&pq, &session1, 1, NULL);
+    assert(callbacks == 1);
+    assert(session1.pqItems == NULL);
+
+    // Remove and flush
+    LOG("**TEST6");
+    callbacks = 0;
+    arkime_pq_upsert(pq, &session1, 1, NULL);
+    arkime_pq_remove(pq, &session1);
+    assert(session1.pqItems == NULL);
+    arkime_pq_upsert(pq, &session1, 1, NULL);
+    arkime_pq_flush(0);
+    assert(session1.pqItems == NULL);
+    lastPacketSecs[0] += 10;
     arkime_pq_run(0, 10);
     assert(callbacks == 0);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 1);
-    lastPacketSecs[0]++;
-    arkime_pq_run(0, 10);
-    assert(callbacks == 1);
-    assert(HASH_COUNT(pqh_, pq.keys[0]) == 0);
+    assert(arkime_wheel_count(0) == 0);
 }
 #endif
@@ -14,6 +14,8 @@
 #include <pwd.h>
 #include <grp.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 extern ArkimePcapFileHdr_t   pcapFileHeader;
 
@@ -29,6 +31,8 @@ LOCAL  char                  offlinePcapFilename[PATH_MAX + 1];
 LOCAL  int                   pktsToRead;
 
 LOCAL void reader_libpcapfile_opened();
+LOCAL int reader_libpcapfile_mmap_open(const char *filename);
+LOCAL gboolean reader_libpcapfile_mmap_check(gpointer user_data);
 
 LOCAL ArkimePacketBatch_t   batch;
 LOCAL uint8_t               readerPos;
@@ -37,6 +41,7 @@ extern ArkimeFieldOps_t     readerFieldOps[256];
 extern uint32_t             readerOutputIds[256];
 
 LOCAL  int                  offlineDispatchAfter;
+LOCAL  int                  mmapThreads;
 
 LOCAL struct {
     GRegex    *regex;
@@ -250,6 +255,10 @@ process:
     errbuf[0] = 0;
     LOG ("Processing %s", filename);
     pktsToRead = config.pktsToRead;
+
+    if (mmapThreads)
+        return reader_libpcapfile_mmap_open(filename);
+
     pcap = pcap_open_offline(filename, errbuf);
 
     if (!pcap) {
@@ -463,7 +472,7 @@ LOCAL int reader_libpcapfile_stats(ArkimeReaderStats_t *stats)
 /******************************************************************************/
 LOCAL void reader_libpcapfile_pcap_cb(u_char *UNUSED(user), const struct pcap_pkthdr *h, const u_char *bytes)
 {
-    ArkimePacket_t *packet = ARKIME_TYPE_ALLOC0(ArkimePacket_t);
+    ArkimePacket_t *packet = ARKIME_POOL_ALLOC0(ARKIME_POOL_PACKET);
 
     if (unlikely(h->caplen != h->len)) {
         if (!config.readTruncatedPackets && !config.ignoreErrors) {
@@ -485,6 +494,47 @@ LOCAL void reader_libpcapfile_pcap_cb(u_char *UNUSED(user), const struct pcap_pk
     arkime_packet_batch(&batch, packet);
 }
 /******************************************************************************/
+/* Give the file the next readerPos and set up its filename and filenameOps */
+LOCAL void reader_libpcapfile_reader_pos(const char *filename)
+{
+    readerPos++;
+    // We've wrapped around all 256 reader items, clear the previous file information
+    if (readerFileName[readerPos]) {
+        g_free(readerFileName[readerPos]);
+        readerOutputIds[readerPos] = 0;
+    }
+    readerFileName[readerPos] = g_strdup(filename);
+
+    if (filenameOpsNum > 0) {
+
+        // Free any previously allocated
+        if (readerFieldOps[readerPos].size > 0)
+            arkime_field_ops_free(&readerFieldOps[readerPos]);
+
+        arkime_field_ops_init(&readerFieldOps[readerPos], filenameOpsNum, ARKIME_FIELD_OPS_FLAGS_COPY);
+
+        // Go thru all the filename ops looking for matches and then expand the value string
+        int i;
+        for (i = 0; i < filenameOpsNum; i++) {
+            GMatchInfo *match_info = 0;
+            g_regex_match(filenameOps[i].regex, filename, 0, &match_info);
+            if (g_match_info_matches(match_info)) {
+                GError *error = 0;
+                char *expand = g_match_info_expand_references(match_info, filenameOps[i].expand, &error);
+                if (error) {
+                    LOG("Error expanding '%s' with '%s' - %s", filename, filenameOps[i].expand, error->message);
+                    g_error_free(error);
+                }
+                if (expand) {
+                    arkime_field_ops_add(&readerFieldOps[readerPos], filenameOps[i].field, expand, -1);
+                    g_free(expand);
+                }
+            }
+            g_match_info_free(match_info);
+        }
+    }
+}
+/******************************************************************************/
 LOCAL gboolean reader_libpcapfile_read()
 {
     // pause reading if too many waiting disk operations
@@ -532,6 +582,14 @@ LOCAL gboolean reader_libpcapfile_read()
                 LOG("Failed to delete file %s %s (%d)", offlinePcapFilename, strerror(errno), errno);
         }
         pcap_close(pcap);
+        pcap = 0;
+
+        // Let the mmap readers pick up with the files after this one
+        if (mmapThreads) {
+            g_timeout_add(10, reader_libpcapfile_mmap_check, 0);
+            return G_SOURCE_REMOVE;
+        }
+
         if (reader_libpcapfile_next()) {
             return G_SOURCE_REMOVE;
         }
@@ -583,13 +641,7 @@ LOCAL void reader_libpcapfile_opened()
         pcap_freecode(&bpf);
     }
 
-    readerPos++;
-    // We've wrapped around all 256 reader items, clear the previous file information
-    if (readerFileName[readerPos]) {
-        g_free(readerFileName[readerPos]);
-        readerOutputIds[readerPos] = 0;
-    }
-    readerFileName[readerPos] = g_strdup(offlinePcapFilename);
+    reader_libpcapfile_reader_pos(offlinePcapFilename);
 
     int fd = pcap_fileno(pcap);
     if (fd == -1) {
@@ -597,37 +649,774 @@ LOCAL void reader_libpcapfile_opened()
     } else {
         arkime_watch_fd(fd, ARKIME_GIO_READ_COND, reader_libpcapfile_read, NULL);
     }
+}
+/******************************************************************************/
+/* With offlineReaderThreads set, pcap and pcapng files are mmapped and read by
+ * arkime-file# threads instead of pcap_dispatch on the main thread. Up to
+ * offlineFilesAtOnce files are open at once. Every reader thread walks the
+ * records of all the open files merged by timestamp, but only batches the
+ * packets whose ip pair hashes to its partition, so all the packets of a flow
+ * come from one reader thread in timestamp order. Packets point into the map
+ * and hold a reference on the file until the packet threads are done with them.
+ */
+#define ARKIME_MMAP_MAX_FILES    16
+#define ARKIME_MMAP_MAX_THREADS  16
+#define ARKIME_MMAP_MAX_IF       32
+// How far in usecs a reader thread can get ahead of the others
+#define ARKIME_MMAP_SKEW         1000000
+
+#define ARKIME_MMAP_PCAP         0
+#define ARKIME_MMAP_PCAP_NSEC    1
+#define ARKIME_MMAP_PCAPNG       2
+
+typedef struct {
+    ArkimePacketBlock_t  pb;            // must be first
+    char                *filename;
+    uint8_t             *map;
+    uint64_t             size;
+    uint64_t             start;         // offset of the first record
+    uint64_t             startTime;
+    uint64_t             packets;
+    uint64_t             oversized;     // records too large for a packet that were skipped
+    uint8_t             *parts;         // partition + 1 of each packet record, 0 until a thread works it out
+    uint64_t             partsSize;
+    pcap_t              *pcap;          // not a format we mmap, handed to libpcap
+    struct bpf_program   bpf;
+    uint32_t             gen;
+    uint32_t             threadsDone;
+    uint32_t             linktype;      // pcapng packets from other linktypes are skipped
+    int                  dlt;
+    int                  snaplen;
+    uint8_t              format;
+    uint8_t              swapped;
+    uint8_t              hasBpf;
+    uint8_t              truncated;
+    uint8_t              readerPos;
+} ArkimeMmapFile_t;
+
+typedef struct {
+    ArkimeMmapFile_t    *file;
+    uint32_t             gen;
+    uint32_t             credit;        // refs taken on the file not given to a packet yet
+    uint64_t             pos;           // offset of the next record
+    uint64_t             packets;
+    uint64_t             oversized;
+    // Current record
+    uint64_t             index;         // packet records before this one
+    const uint8_t       *data;
+    uint64_t             recordPos;
+    uint64_t             ts;            // usecs
+    uint32_t             caplen;
+    uint32_t             len;
+    // pcapng state
+    uint8_t              swapped;
+    uint32_t             ifNum;
+    uint64_t             ifUnits[ARKIME_MMAP_MAX_IF]; // 0 if skipping interface
+} ArkimeMmapCursor_t;
+
+typedef struct {
+    volatile uint64_t    ts;
+} __attribute__((aligned(64))) ArkimeMmapThreadTs_t;
+
+LOCAL  int                  mmapFilesAtOnce;
+LOCAL  ArkimeMmapFile_t    *mmapFiles[ARKIME_MMAP_MAX_FILES];
+LOCAL  ArkimeMmapThreadTs_t mmapThreadTs[ARKIME_MMAP_MAX_THREADS];
+LOCAL  volatile int         mmapPaused;
+
+// Only used on the main thread
+LOCAL  ArkimeMmapFile_t    *mmapPending;
+LOCAL  int                  mmapActive;
+LOCAL  uint32_t             mmapGen;
+LOCAL  int                  mmapStarted;
 
-    if (filenameOpsNum > 0) {
+/******************************************************************************/
+LOCAL inline uint32_t reader_libpcapfile_mmap_u32(const uint8_t *p, int swapped)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swapped ? GUINT32_SWAP_LE_BE(v) : v;
+}
+/******************************************************************************/
+LOCAL inline uint16_t reader_libpcapfile_mmap_u16(const uint8_t *p, int swapped)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swapped ? GUINT16_SWAP_LE_BE(v) : v;
+}
+/******************************************************************************/
+LOCAL uint64_t reader_libpcapfile_mmap_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+/******************************************************************************/
+LOCAL void reader_libpcapfile_mmap_release(ArkimePacketBlock_t *pb)
+{
+    ArkimeMmapFile_t *file = (ArkimeMmapFile_t *)pb;
 
-        // Free any previously allocated
-        if (readerFieldOps[readerPos].size > 0)
-            arkime_field_ops_free(&readerFieldOps[readerPos]);
+    munmap(file->map, file->size);
+    if (file->hasBpf)
+        pcap_freecode(&file->bpf);
+    g_free(file->filename);
+    ARKIME_TYPE_FREE(ArkimeMmapFile_t, file);
+}
+/******************************************************************************/
+/* Symmetric hash of the outer ip pair, the same partition for both directions
+ * and all the fragments. Anything that isn't ip goes to partition 0.
+ */
+SUPPRESS_UNSIGNED_INTEGER_OVERFLOW
+LOCAL uint32_t reader_libpcapfile_mmap_partition(int dlt, const uint8_t *data, uint32_t len)
+{
+    uint32_t off;
+    uint32_t h = 0;
+    uint32_t v;
+    int      version = 0;
+
+    switch (dlt) {
+    case DLT_EN10MB: {
+        if (len < 14)
+            return 0;
+        off = 12;
+        uint16_t type = (data[off] << 8) | data[off + 1];
+        while ((type == 0x8100 || type == 0x88a8) && off + 6 <= len) {
+            off += 4;
+            type = (data[off] << 8) | data[off + 1];
+        }
+        off += 2;
+        if (type == 0x0800)
+            version = 4;
+        else if (type == 0x86dd)
+            version = 6;
+        break;
+    }
+    case DLT_LINUX_SLL:
+        off = 16;
+        if (len < off)
+            return 0;
+        if (data[14] == 0x08 && data[15] == 0x00)
+            version = 4;
+        else if (data[14] == 0x86 && data[15] == 0xdd)
+            version = 6;
+        break;
+    case DLT_NULL:
+    case DLT_LOOP:
+        off = 4;
+        break;
+    case DLT_RAW:
+#ifdef DLT_IPV4
+    case DLT_IPV4:
+#endif
+#ifdef DLT_IPV6
+    case DLT_IPV6:
+#endif
+        off = 0;
+        break;
+    default:
+        return 0;
+    }
 
-        arkime_field_ops_init(&readerFieldOps[readerPos], filenameOpsNum, ARKIME_FIELD_OPS_FLAGS_COPY);
+    if (!version && off < len)
+        version = data[off] >> 4;
 
-        // Go thru all the filename ops looking for matches and then expand the value string
+    if (version == 4 && off + 20 <= len) {
+        memcpy(&v, data + off + 12, 4);
+        h = v;
+        memcpy(&v, data + off + 16, 4);
+        h ^= v;
+    } else if (version == 6 && off + 40 <= len) {
         int i;
-        for (i = 0; i < filenameOpsNum; i++) {
-            GMatchInfo *match_info = 0;
-            g_regex_match(filenameOps[i].regex, offlinePcapFilename, 0, &match_info);
-            if (g_match_info_matches(match_info)) {
-                GError *error = 0;
-                char *expand = g_match_info_expand_references(match_info, filenameOps[i].expand, &error);
-                if (error) {
-                    LOG("Error expanding '%s' with '%s' - %s", offlinePcapFilename, filenameOps[i].expand, error->message);
-                    g_error_free(error);
+        for (i = 8; i < 40; i += 4) {
+            memcpy(&v, data + off + i, 4);
+            h ^= v;
+        }
+    } else {
+        return 0;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+/******************************************************************************/
+LOCAL uint64_t reader_libpcapfile_mmap_pcapng_units(const uint8_t *opt, const uint8_t *end, int swapped)
+{
+    while (opt + 4 <= end) {
+        uint16_t code = reader_libpcapfile_mmap_u16(opt, swapped);
+        uint16_t olen = reader_libpcapfile_mmap_u16(opt + 2, swapped);
+        if (code == 0 || opt + 4 + olen > end)
+            break;
+
+        // if_tsresol
+        if (code == 9 && olen == 1) {
+            uint8_t  res = opt[4];
+            uint64_t units = 1;
+            int      i;
+            if (res & 0x80) {
+                if ((res & 0x7f) > 40)
+                    break;
+                units = 1ULL << (res & 0x7f);
+            } else {
+                if (res > 12)
+                    break;
+                for (i = 0; i < res; i++)
+                    units *= 10;
+            }
+            return units;
+        }
+        opt += 4 + ((olen + 3) & ~3);
+    }
+    return 1000000;
+}
+/******************************************************************************/
+/* Move the cursor to the next packet record, returns 0 at the end of the file */
+LOCAL int reader_libpcapfile_mmap_next(ArkimeMmapCursor_t *c)
+{
+    ArkimeMmapFile_t *file = c->file;
+    const uint8_t    *map = file->map;
+
+    if (file->format != ARKIME_MMAP_PCAPNG) {
+        const uint8_t *h;
+        uint32_t       caplen;
+
+        while (1) {
+            if (c->pos + 16 > file->size) {
+                if (c->pos != file->size)
+                    file->truncated = 1;
+                return 0;
+            }
+
+            h = map + c->pos;
+            caplen = reader_libpcapfile_mmap_u32(h + 8, file->swapped);
+            if (c->pos + 16 + caplen > file->size) {
+                file->truncated = 1;
+                return 0;
+            }
+
+            // Too large for a packet, skip it and keep reading
+            if (caplen <= 0xffff)
+                break;
+            c->oversized++;
+            c->pos += 16 + caplen;
+        }
+
+        uint32_t frac = reader_libpcapfile_mmap_u32(h + 4, file->swapped);
+        c->ts = reader_libpcapfile_mmap_u32(h, file->swapped) * 1000000ULL +
+                (file->format == ARKIME_MMAP_PCAP_NSEC ? frac / 1000 : frac);
+        c->caplen = caplen;
+        c->len = reader_libpcapfile_mmap_u32(h + 12, file->swapped);
+        c->data = h + 16;
+        c->recordPos = c->pos;
+        c->pos += 16 + caplen;
+        c->index++;
+        return 1;
+    }
+
+    while (c->pos + 12 <= file->size) {
+        const uint8_t *b = map + c->pos;
+        uint32_t       type;
+
+        // The section header type reads the same in both byte orders
+        memcpy(&type, b, 4);
+        if (type == 0x0A0D0D0A) {
+            uint32_t magic;
+            memcpy(&magic, b + 8, 4);
+            if (magic == 0x1A2B3C4D)
+                c->swapped = 0;
+            else if (magic == 0x4D3C2B1A)
+                c->swapped = 1;
+            else
+                break;
+            c->ifNum = 0;
+        }
+
+        uint32_t blen = reader_libpcapfile_mmap_u32(b + 4, c->swapped);
+        if (blen < 12 || (blen & 3) || c->pos + blen > file->size)
+            break;
+
+        type = reader_libpcapfile_mmap_u32(b, c->swapped);
+        c->recordPos = c->pos;
+        c->pos += blen;
+
+        switch (type) {
+        case 1: // Interface Description
+            if (blen < 20)
+                break;
+            if (c->ifNum < ARKIME_MMAP_MAX_IF) {
+                if (reader_libpcapfile_mmap_u16(b + 8, c->swapped) == file->linktype)
+                    c->ifUnits[c->ifNum] = reader_libpcapfile_mmap_pcapng_units(b + 16, b + blen - 4, c->swapped);
+                else
+                    c->ifUnits[c->ifNum] = 0;
+            }
+            c->ifNum++;
+            break;
+        case 6: { // Enhanced Packet
+            if (blen < 32)
+                break;
+            uint32_t ifid = reader_libpcapfile_mmap_u32(b + 8, c->swapped);
+            if (ifid >= c->ifNum || ifid >= ARKIME_MMAP_MAX_IF || !c->ifUnits[ifid])
+                break;
+
+            uint32_t caplen = reader_libpcapfile_mmap_u32(b + 20, c->swapped);
+            if (caplen > blen - 32) {
+                file->truncated = 1;
+                return 0;
+            }
+            if (caplen > 0xffff) {
+                c->oversized++;
+                break;
+            }
+
+            uint64_t t = ((uint64_t)reader_libpcapfile_mmap_u32(b + 12, c->swapped) << 32) | reader_libpcapfile_mmap_u32(b + 16, c->swapped);
+            uint64_t units = c->ifUnits[ifid];
+            if (units <= 1000000)
+                c->ts = (t / units) * 1000000 + (t % units) * 1000000 / units;
+            else
+                c->ts = (t / units) * 1000000 + (t % units) / (units / 1000000);
+            c->caplen = caplen;
+            c->len = reader_libpcapfile_mmap_u32(b + 24, c->swapped);
+            c->data = b + 28;
+            c->index++;
+            return 1;
+        }
+        case 3: // Simple Packet, no timestamp so use the previous one
+            if (blen < 16 || c->ifNum == 0 || !c->ifUnits[0])
+                break;
+            c->len = reader_libpcapfile_mmap_u32(b + 8, c->swapped);
+            c->caplen = MIN(c->len, blen - 16);
+            if (c->caplen > 0xffff) {
+                c->oversized++;
+                break;
+            }
+            c->data = b + 12;
+            c->index++;
+            return 1;
+        }
+    }
+
+    if (c->pos != file->size)
+        file->truncated = 1;
+    return 0;
+}
+/******************************************************************************/
+LOCAL void reader_libpcapfile_mmap_finish(ArkimeMmapCursor_t *c)
+{
+    ArkimeMmapFile_t *file = c->file;
+
+    // Main thread still holds its own ref so this can't be the last one
+    if (c->credit)
+        __sync_sub_and_fetch(&file->pb.refs, c->credit);
+    __sync_add_and_fetch(&file->packets, c->packets);
+    // Every thread walks every record, so they all skip the same ones
+    __atomic_store_n(&file->oversized, c->oversized, __ATOMIC_RELAXED);
+    __sync_add_and_fetch(&file->threadsDone, 1);
+
+    c->file = NULL;
+    c->credit = 0;
+}
+/******************************************************************************/
+LOCAL void reader_libpcapfile_mmap_packet(ArkimePacketBatch_t *batch, ArkimeMmapCursor_t *c)
+{
+    ArkimeMmapFile_t *file = c->file;
+    ArkimePacket_t   *packet = ARKIME_POOL_ALLOC0(ARKIME_POOL_PACKET);
+
+    if (unlikely(c->caplen != c->len)) {
+        if (!config.readTruncatedPackets && !config.ignoreErrors) {
+            LOGEXIT("ERROR - Arkime requires full packet captures caplen: %u pktlen: %u. "
+                    "If using tcpdump use the \"-s0\" option, or set readTruncatedPackets in ini file",
+                    c->caplen, c->len);
+        }
+    }
+
+    // Take refs on the file in bulk so the threads don't fight over the counter
+    if (!c->credit) {
+        __sync_add_and_fetch(&file->pb.refs, 1024);
+        c->credit = 1024;
+    }
+    c->credit--;
+    c->packets++;
+
+    packet->block         = &file->pb;
+    packet->pkt           = (uint8_t *)c->data;
+    packet->pktlen        = c->caplen;
+    packet->ts.tv_sec     = c->ts / 1000000;
+    packet->ts.tv_usec    = c->ts % 1000000;
+    packet->readerFilePos = c->recordPos;
+    packet->readerPos     = file->readerPos;
+    arkime_packet_batch(batch, packet);
+}
+/******************************************************************************/
+/* Start reading any files the main thread has added since we last looked */
+LOCAL int reader_libpcapfile_mmap_refresh(ArkimeMmapCursor_t *cursors)
+{
+    int active = 0;
+    int s;
+
+    for (s = 0; s < mmapFilesAtOnce; s++) {
+        ArkimeMmapCursor_t *c = &cursors[s];
+        if (!c->file) {
+            ArkimeMmapFile_t *file = __atomic_load_n(&mmapFiles[s], __ATOMIC_ACQUIRE);
+            if (!file || file->gen == c->gen)
+                continue;
+
+            c->file = file;
+            c->gen = file->gen;
+            c->pos = file->start;
+            c->packets = 0;
+            c->oversized = 0;
+            c->index = UINT64_MAX; // first record is 0
+            c->swapped = file->swapped;
+            c->ifNum = 0;
+            c->ts = 0;
+            if (!reader_libpcapfile_mmap_next(c)) {
+                reader_libpcapfile_mmap_finish(c);
+                continue;
+            }
+        }
+        active++;
+    }
+    return active;
+}
+/******************************************************************************/
+/* Partition of the current record. Every thread walks every record, but only
+ * the first one to get to a record hashes it, the rest use its answer.
+ */
+LOCAL inline uint32_t reader_libpcapfile_mmap_part(ArkimeMmapCursor_t *c)
+{
+    ArkimeMmapFile_t *file = c->file;
+
+    if (!file->parts || c->index >= file->partsSize)
+        return reader_libpcapfile_mmap_partition(file->dlt, c->data, c->caplen) % mmapThreads;
+
+    uint8_t part = __atomic_load_n(&file->parts[c->index], __ATOMIC_RELAXED);
+    if (part)
+        return part - 1;
+
+    part = reader_libpcapfile_mmap_partition(file->dlt, c->data, c->caplen) % mmapThreads;
+    __atomic_store_n(&file->parts[c->index], part + 1, __ATOMIC_RELAXED);
+    return part;
+}
+/******************************************************************************/
+LOCAL uint64_t reader_libpcapfile_mmap_min_ts(int t)
+{
+    uint64_t min = UINT64_MAX;
+    int      i;
+
+    for (i = 0; i < mmapThreads; i++) {
+        if (i != t && mmapThreadTs[i].ts < min)
+            min = mmapThreadTs[i].ts;
+    }
+    return min;
+}
+/******************************************************************************/
+LOCAL void *reader_libpcapfile_mmap_thread(gpointer tv)
+{
+    const int            t = (long)tv;
+    ArkimeMmapCursor_t  *cursors = g_new0(ArkimeMmapCursor_t, mmapFilesAtOnce);
+    ArkimePacketBatch_t  batch;
+    uint64_t             minTs = 0;
+
+    arkime_packet_batch_init(&batch);
+
+    while (!config.quitting) {
+        if (!reader_libpcapfile_mmap_refresh(cursors)) {
+            mmapThreadTs[t].ts = UINT64_MAX;
+            usleep(5000);
+            continue;
+        }
+
+        if (mmapPaused) {
+            usleep(1000);
+            continue;
+        }
+
+        ArkimeMmapCursor_t *c;
+        int blocked = 0;
+        int n, s;
+        for (n = 0; n < offlineDispatchAfter; n++) {
+            c = NULL;
+            for (s = 0; s < mmapFilesAtOnce; s++) {
+                if (cursors[s].file && (!c || cursors[s].ts < c->ts))
+                    c = &cursors[s];
+            }
+            if (!c)
+                break;
+
+            // Don't get too far ahead of the other threads, the packet threads time out sessions using packet time
+            if (c->ts > minTs && c->ts - minTs > ARKIME_MMAP_SKEW) {
+                minTs = reader_libpcapfile_mmap_min_ts(t);
+                if (c->ts > minTs && c->ts - minTs > ARKIME_MMAP_SKEW) {
+                    blocked = 1;
+                    break;
                 }
-                if (expand) {
-                    arkime_field_ops_add(&readerFieldOps[readerPos], filenameOps[i].field, expand, -1);
-                    g_free(expand);
+            }
+
+            ArkimeMmapFile_t *file = c->file;
+            if (mmapThreads == 1 || reader_libpcapfile_mmap_part(c) == (uint32_t)t) {
+                int keep = 1;
+                if (file->hasBpf) {
+                    struct pcap_pkthdr hdr;
+                    hdr.ts.tv_sec = c->ts / 1000000;
+                    hdr.ts.tv_usec = c->ts % 1000000;
+                    hdr.caplen = c->caplen;
+                    hdr.len = c->len;
+                    keep = pcap_offline_filter(&file->bpf, &hdr, c->data);
                 }
+                if (keep)
+                    reader_libpcapfile_mmap_packet(&batch, c);
             }
-            g_match_info_free(match_info);
+
+            if (!reader_libpcapfile_mmap_next(c))
+                reader_libpcapfile_mmap_finish(c);
         }
+
+        uint64_t next = UINT64_MAX;
+        for (s = 0; s < mmapFilesAtOnce; s++) {
+            if (cursors[s].file && cursors[s].ts < next)
+                next = cursors[s].ts;
+        }
+        mmapThreadTs[t].ts = next;
+
+        arkime_packet_batch_flush(&batch);
+
+        if (blocked)
+            usleep(100);
     }
+    g_free(cursors);
+    return NULL;
 }
+/******************************************************************************/
+LOCAL int reader_libpcapfile_mmap_open(const char *filename)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+
+    errbuf[0] = 0;
+    pcap_t *p = pcap_open_offline(filename, errbuf);
+    if (!p) {
+        LOG("Couldn't process '%s' error '%s'", filename, errbuf);
+        return 1;
+    }
 
+    ArkimeMmapFile_t *file = ARKIME_TYPE_ALLOC0(ArkimeMmapFile_t);
+    file->filename = g_strdup(offlinePcapFilename);
+    file->dlt = pcap_datalink(p);
+    file->snaplen = pcap_snapshot(p);
+    file->map = MAP_FAILED;
+
+    struct stat st;
+    int fd = strcmp(filename, "-") == 0 ? -1 : open(filename, O_RDONLY);
+    if (fd >= 0) {
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= 24) {
+            file->size = st.st_size;
+            // Private writable mapping since the packet code is allowed to modify packets
+            file->map = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+    }
+
+    if (file->map != MAP_FAILED) {
+        uint32_t magic;
+        memcpy(&magic, file->map, 4);
+        file->start = 24;
+        switch (magic) {
+        case 0xa1b2c3d4:
+            file->format = ARKIME_MMAP_PCAP;
+            break;
+        case 0xd4c3b2a1:
+            file->format = ARKIME_MMAP_PCAP;
+            file->swapped = 1;
+            break;
+        case 0xa1b23c4d:
+            file->format = ARKIME_MMAP_PCAP_NSEC;
+            break;
+        case 0x4d3cb2a1:
+            file->format = ARKIME_MMAP_PCAP_NSEC;
+            file->swapped = 1;
+            break;
+        case 0x0A0D0D0A: {
+            // Packets are only read from interfaces with the linktype of the first one, what libpcap reported
+            uint64_t pos = 0;
+            int      swapped = 0;
+            file->format = ARKIME_MMAP_PCAPNG;
+            file->start = 0;
+            file->linktype = 0xffffffff;
+            while (pos + 20 <= file->size) {
+                uint32_t type;
+                memcpy(&type, file->map + pos, 4);
+                if (type == 0x0A0D0D0A) {
+                    uint32_t bom;
+                    memcpy(&bom, file->map + pos + 8, 4);
+                    swapped = bom == 0x4D3C2B1A;
+                    if (pos == 0)
+                        file->swapped = swapped;
+                }
+                uint32_t blen = reader_libpcapfile_mmap_u32(file->map + pos + 4, swapped);
+                if (blen < 12 || pos + blen > file->size)
+                    break;
+                if (reader_libpcapfile_mmap_u32(file->map + pos, swapped) == 1) {
+                    file->linktype = reader_libpcapfile_mmap_u16(file->map + pos + 8, swapped);
+                    break;
+                }
+                pos += blen;
+            }
+            if (file->linktype != 0xffffffff)
+                break;
+            // Fall through to libpcap
+        }
+        default:
+            munmap(file->map, file->size);
+            file->map = MAP_FAILED;
+        }
+    }
+
+    if (file->map == MAP_FAILED) {
+        file->pcap = p;
+    } else {
+        madvise(file->map, file->size, MADV_SEQUENTIAL);
+        if (mmapThreads > 1) {
+            // Every packet record is at least 16 bytes, only the pages touched are used
+            file->partsSize = file->size / 16;
+            file->parts = mmap(NULL, file->partsSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (file->parts == MAP_FAILED)
+                file->parts = NULL;
+        }
+        if (config.bpf && file->dlt != DLT_NFLOG) {
+            if (pcap_compile(p, &file->bpf, config.bpf, 1, PCAP_NETMASK_UNKNOWN) == -1) {
+                LOGEXIT("ERROR - Couldn't compile bpf filter: '%s' with %s", config.bpf, pcap_geterr(p));
+            }
+            file->hasBpf = 1;
+        }
+        pcap_close(p);
+        file->pb.refs = 1;
+        file->pb.release = reader_libpcapfile_mmap_release;
+    }
+
+    mmapPending = file;
+    return 0;
+}
+/******************************************************************************/
+/* Try to start the pending file, returns 0 if it has to wait, 1 if started
+ * and 2 if it was handed to the regular libpcap reader.
+ */
+LOCAL int reader_libpcapfile_mmap_start_pending()
+{
+    ArkimeMmapFile_t *file = mmapPending;
+    int change = !mmapStarted || file->dlt != (int)pcapFileHeader.dlt || file->snaplen > (int)pcapFileHeader.snaplen;
+
+    // The dlt is global, so a file with a different one or a file for libpcap waits for everything before it to finish
+    if (file->pcap || change) {
+        if (mmapActive > 0 || arkime_packet_outstanding() > 0)
+            return 0;
+    } else if (mmapActive >= mmapFilesAtOnce) {
+        return 0;
+    }
+
+    mmapPending = NULL;
+
+    if (file->pcap) {
+        pcap = file->pcap;
+        g_strlcpy(offlinePcapFilename, file->filename, sizeof(offlinePcapFilename));
+        g_free(file->filename);
+        ARKIME_TYPE_FREE(ArkimeMmapFile_t, file);
+        reader_libpcapfile_opened();
+        mmapStarted = 1;
+        return 2;
+    }
+
+    if (change)
+        arkime_packet_set_dltsnap(file->dlt, file->snaplen);
+    mmapStarted = 1;
+
+    reader_libpcapfile_reader_pos(file->filename);
+    file->readerPos = readerPos;
+    file->gen = ++mmapGen;
+    file->startTime = reader_libpcapfile_mmap_now();
+
+    int s;
+    for (s = 0; s < mmapFilesAtOnce; s++) {
+        if (!mmapFiles[s]) {
+            __atomic_store_n(&mmapFiles[s], file, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    mmapActive++;
+    return 1;
+}
+/******************************************************************************/
+LOCAL void reader_libpcapfile_mmap_done(ArkimeMmapFile_t *file)
+{
+    double secs = (reader_libpcapfile_mmap_now() - file->startTime) / 1000000.0;
+    if (secs < 0.001)
+        secs = 0.001;
+
+    LOG("Finished %s %" PRIu64 " packets %.1f MB in %.2fs, %.1f MB/s %.1f Kpps%s",
+        file->filename, file->packets, file->size / 1000000.0, secs,
+        file->size / 1000000.0 / secs, file->packets / 1000.0 / secs,
+        file->truncated ? " (truncated)" : "");
+
+    if (file->oversized)
+        LOG("WARNING - %s skipped %" PRIu64 " records larger than 65535 bytes", file->filename, file->oversized);
+
+    if (config.pcapDelete && !file->truncated) {
+        if (config.debug)
+            LOG("Deleting %s", file->filename);
+        int rc = unlink(file->filename);
+        if (rc != 0)
+            LOG("Failed to delete file %s %s (%d)", file->filename, strerror(errno), errno);
+    }
+
+    if (file->parts) {
+        munmap(file->parts, file->partsSize);
+        file->parts = NULL;
+    }
+
+    mmapActive--;
+    arkime_packet_block_unref(&file->pb);
+}
+/******************************************************************************/
+/* Main thread timer that retires finished files, opens new ones and pauses
+ * the reader threads when the rest of capture is backed up.
+ */
+LOCAL gboolean reader_libpcapfile_mmap_check(gpointer UNUSED(user_data))
+{
+    mmapPaused = arkime_writer_queue_length() > 10 ||
+                 arkime_http_queue_length(esServer) > 30 ||
+                 arkime_packet_outstanding() > (int)(config.maxPacketsInQueue - offlineDispatchAfter);
+
+    int s;
+    for (s = 0; s < mmapFilesAtOnce; s++) {
+        ArkimeMmapFile_t *file = mmapFiles[s];
+        if (file && __atomic_load_n(&file->threadsDone, __ATOMIC_ACQUIRE) == (uint32_t)mmapThreads) {
+            mmapFiles[s] = NULL;
+            reader_libpcapfile_mmap_done(file);
+        }
+    }
+
+    while (1) {
+        if (mmapPending) {
+            int rc = reader_libpcapfile_mmap_start_pending();
+            if (rc == 0)
+                return G_SOURCE_CONTINUE;
+            if (rc == 2)
+                return G_SOURCE_REMOVE;
+        }
+
+        if (mmapActive >= mmapFilesAtOnce)
+            return G_SOURCE_CONTINUE;
+
+        if (!reader_libpcapfile_next())
+            break;
+    }
+
+    if (mmapActive > 0 || config.pcapMonitor)
+        return G_SOURCE_CONTINUE;
+
+    arkime_quit();
+    return G_SOURCE_REMOVE;
+}
 /******************************************************************************/
 LOCAL void reader_libpcapfile_start() {
 
@@ -680,6 +1469,16 @@ LOCAL void reader_libpcapfile_start() {
     }
     g_strfreev(filenameOpsStr);
 
+    if (mmapThreads) {
+        for (i = 0; i < mmapThreads; i++) {
+            char name[100];
+            snprintf(name, sizeof(name), "arkime-file%d", i);
+            g_thread_unref(g_thread_new(name, &reader_libpcapfile_mmap_thread, (gpointer)(long)i));
+        }
+        g_timeout_add(10, reader_libpcapfile_mmap_check, 0);
+        return;
+    }
+
     // Now actually start
     reader_libpcapfile_next();
     if (!pcap) {
@@ -699,6 +1498,14 @@ void reader_libpcapfile_init(char *UNUSED(name))
         CONFIGEXIT("offlineDispatchAfter (%d) must be less than maxPacketsInQueue (%u) + 1000", offlineDispatchAfter, config.maxPacketsInQueue);
     }
 
+    mmapThreads                 = arkime_config_int(NULL, "offlineReaderThreads", 0, 0, ARKIME_MMAP_MAX_THREADS);
+    mmapFilesAtOnce             = arkime_config_int(NULL, "offlineFilesAtOnce", 4, 1, ARKIME_MMAP_MAX_FILES);
+
+    if (mmapThreads && (config.pktsToRead > 0 || config.flushBetween)) {
+        LOG("WARNING - offlineReaderThreads doesn't support --packetcnt or --flush, reading one file at a time");
+        mmapThreads = 0;
+    }
+
     arkime_reader_start         = reader_libpcapfile_start;
     arkime_reader_stats         = reader_libpcapfile_stats;
 
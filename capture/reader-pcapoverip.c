@@ -96,7 +96,7 @@ gboolean pcapoverip_client_read_cb(gint UNUSED(fd), GIOCondition cond, gpointer
         BSB bsb;
         BSB_INIT(bsb, poic->data + pos, poic->len - pos);
 
-        ArkimePacket_t *packet = ARKIME_TYPE_ALLOC0(ArkimePacket_t);
+        ArkimePacket_t *packet = ARKIME_POOL_ALLOC0(ARKIME_POOL_PACKET);
 
         uint32_t caplen = 0;
         uint32_t origlen = 0;
@@ -124,7 +124,7 @@ gboolean pcapoverip_client_read_cb(gint UNUSED(fd), GIOCondition cond, gpointer
             if (!config.ignoreErrors) {
                 LOGEXIT("ERROR - The packet length %u is too large.", caplen);
             } else {
-                ARKIME_TYPE_FREE(ArkimePacket_t, packet);
+                ARKIME_POOL_FREE(ARKIME_POOL_PACKET, packet);
                 pcapoverip_client_free(poic);
                 return FALSE;
             }
@@ -132,7 +132,7 @@ gboolean pcapoverip_client_read_cb(gint UNUSED(fd), GIOCondition cond, gpointer
         }
 
         if (poic->len - pos < 16 + caplen) { // Not enough data for packet
-            ARKIME_TYPE_FREE(ArkimePacket_t, packet);
+            ARKIME_POOL_FREE(ARKIME_POOL_PACKET, packet);
             break;
         }
 
@@ -141,7 +141,7 @@ gboolean pcapoverip_client_read_cb(gint UNUSED(fd), GIOCondition cond, gpointer
         packet->readerPos     = poic->interface;
 
         if (config.bpf && bpf_filter(bpfp.bf_insns, packet->pkt, packet->pktlen, packet->pktlen)) {
-            ARKIME_TYPE_FREE(ArkimePacket_t, packet);
+            ARKIME_POOL_FREE(ARKIME_POOL_PACKET, packet);
         } else {
             arkime_packet_batch(&batch, packet);
         }
@@ -32,6 +32,7 @@ void reader_tpacketv3_init(char *UNUSED(name))
 #include <sys/mman.h>
 #include <errno.h>
 #include <poll.h>
+#include <inttypes.h>
 
 #ifndef TPACKET3_HDRLEN
 void reader_tpacketv3_init(char *UNUSED(name))
@@ -44,16 +45,25 @@ void reader_tpacketv3_init(char *UNUSED(name))
 #define MAX_TPACKETV3_THREADS 12
 
 typedef struct {
-    int                  fd;
-    struct tpacket_req3  req;
-    uint8_t             *map;
-    struct iovec        *rd;
-    uint8_t              interfacePos;
+    ArkimePacketBlock_t        pb;
+    struct tpacket_block_desc *tbd;
+    int                        held;    // Packets still point into block, don't give back to kernel
+} ArkimeTPacketV3Block_t;
+
+typedef struct {
+    int                     fd;
+    struct tpacket_req3     req;
+    uint8_t                *map;
+    struct iovec           *rd;
+    ArkimeTPacketV3Block_t *blocks;
+    uint8_t                 interfacePos;
 } ArkimeTPacketV3_t;
 
 LOCAL ArkimeTPacketV3_t infos[MAX_INTERFACES][MAX_TPACKETV3_THREADS];
 
 LOCAL int numThreads;
+LOCAL int zeroCopy;
+LOCAL uint64_t heldBlockWaits;
 
 extern ArkimePcapFileHdr_t   pcapFileHeader;
 LOCAL struct bpf_program     bpf;
@@ -81,6 +91,17 @@ int reader_tpacketv3_stats(ArkimeReaderStats_t *stats)
     return 0;
 }
 /******************************************************************************/
+/* Last packet pointing into the block is done, hand it back to the kernel.
+ * Called from a packet thread or the reader thread.
+ */
+LOCAL void reader_tpacketv3_block_release(ArkimePacketBlock_t *pb)
+{
+    ArkimeTPacketV3Block_t *block = (ArkimeTPacketV3Block_t *)pb;
+
+    __atomic_store_n(&block->tbd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    __atomic_store_n(&block->held, 0, __ATOMIC_RELEASE);
+}
+/******************************************************************************/
 LOCAL void *reader_tpacketv3_thread(gpointer infov)
 {
     ArkimeTPacketV3_t *info = (ArkimeTPacketV3_t *)infov;
@@ -113,6 +134,13 @@ LOCAL void *reader_tpacketv3_thread(gpointer infov)
             LOG("Stats pos:%d info:%d status:%x waiting:%d total cnt:%d total waiting:%d", pos, info->interfacePos, tbd->hdr.bh1.block_status, tbd->hdr.bh1.num_pkts, cnt, waiting);
         }
 
+        // Packet threads still have packets pointing into this block from the last time around
+        if (zeroCopy && __atomic_load_n(&info->blocks[pos].held, __ATOMIC_ACQUIRE)) {
+            heldBlockWaits++;
+            usleep(100);
+            continue;
+        }
+
         // Wait until the block is owned by capture
         if ((tbd->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
             poll(&pfd, 1, -1);
@@ -124,6 +152,14 @@ LOCAL void *reader_tpacketv3_thread(gpointer infov)
         th = (struct tpacket3_hdr *) ((uint8_t *) tbd + tbd->hdr.bh1.offset_to_first_pkt);
         uint32_t p;
 
+        // One reference per packet plus one for us until the batch is flushed
+        ArkimePacketBlock_t *pb = NULL;
+        if (zeroCopy) {
+            info->blocks[pos].held = 1;
+            pb = &info->blocks[pos].pb;
+            pb->refs = tbd->hdr.bh1.num_pkts + 1;
+        }
+
         for (p = 0; p < tbd->hdr.bh1.num_pkts; p++) {
             if (unlikely(th->tp_snaplen != th->tp_len)) {
                 LOGEXIT("ERROR - Arkime requires full packet captures caplen: %d pktlen: %d\n"
@@ -131,12 +167,13 @@ LOCAL void *reader_tpacketv3_thread(gpointer infov)
                         th->tp_snaplen, th->tp_len);
             }
 
-            ArkimePacket_t *packet = ARKIME_TYPE_ALLOC0(ArkimePacket_t);
+            ArkimePacket_t *packet = ARKIME_POOL_ALLOC0(ARKIME_POOL_PACKET);
             packet->pkt           = (u_char *)th + th->tp_mac;
             packet->pktlen        = th->tp_len;
             packet->ts.tv_sec     = th->tp_sec;
             packet->ts.tv_usec    = th->tp_nsec / 1000;
             packet->readerPos     = info->interfacePos;
+            packet->block         = pb;
 
             if ((th->tp_status & TP_STATUS_VLAN_VALID) && th->hv1.tp_vlan_tci) {
                 packet->vlan = th->hv1.tp_vlan_tci & 0xfff;
@@ -148,7 +185,11 @@ LOCAL void *reader_tpacketv3_thread(gpointer infov)
         }
         arkime_packet_batch_flush(&batch);
 
-        tbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        if (pb) {
+            arkime_packet_block_unref(pb);
+        } else {
+            tbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        }
         pos = (pos + 1) % info->req.tp_block_nr;
     }
     return NULL;
@@ -166,6 +207,9 @@ void reader_tpacketv3_start() {
 /******************************************************************************/
 void reader_tpacketv3_exit()
 {
+    if (zeroCopy && heldBlockWaits)
+        LOG("Waited %" PRIu64 " times for packet threads to release tpacketv3 blocks", heldBlockWaits);
+
     for (int i = 0; i < MAX_INTERFACES && config.interface[i]; i++) {
         for (int t = 0; t < numThreads; t++) {
             close(infos[i][t].fd);
@@ -177,6 +221,7 @@ void reader_tpacketv3_init(char *UNUSED(name))
 {
     int blocksize = arkime_config_int(NULL, "tpacketv3BlockSize", 1 << 21, 1 << 16, 1U << 31);
     numThreads = arkime_config_int(NULL, "tpacketv3NumThreads", 2, 1, MAX_TPACKETV3_THREADS);
+    zeroCopy = arkime_config_boolean(NULL, "tpacketv3ZeroCopy", FALSE);
 
     if (blocksize % getpagesize() != 0) {
         CONFIGEXIT("tpacketv3BlockSize=%d not divisible by pagesize %d", blocksize, getpagesize());
@@ -248,6 +293,14 @@ void reader_tpacketv3_init(char *UNUSED(name))
                 infos[i][t].rd[j].iov_len = infos[i][t].req.tp_block_size;
             }
 
+            if (zeroCopy) {
+                infos[i][t].blocks = calloc(infos[i][t].req.tp_block_nr, sizeof(ArkimeTPacketV3Block_t));
+                for (j = 0; j < infos[i][t].req.tp_block_nr; j++) {
+                    infos[i][t].blocks[j].tbd = infos[i][t].rd[j].iov_base;
+                    infos[i][t].blocks[j].pb.release = reader_tpacketv3_block_release;
+                }
+            }
+
             struct sockaddr_ll ll;
             memset(&ll, 0, sizeof(ll));
             ll.sll_family = PF_PACKET;
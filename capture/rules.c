@@ -52,8 +52,8 @@ typedef struct {
     struct bpf_program   bpfp;
     GHashTable          *hash[ARKIME_FIELDS_MAX];  // For each non ip field in rule
     GPtrArray           *match[ARKIME_FIELDS_MAX]; // For any string fields with , modifier or int fields range
-    patricia_tree_t     *tree4[ARKIME_FIELDS_MAX];
-    patricia_tree_t     *tree6[ARKIME_FIELDS_MAX];
+    ArkimeLpm_t         *tree4[ARKIME_FIELDS_MAX];
+    ArkimeLpm_t         *tree6[ARKIME_FIELDS_MAX];
     ArkimeFieldOps_t     ops;                      // Ops to run on match
     uint64_t             matched;                  // How many times was matched
     uint16_t            *fields;                   // fieldsLen length array of field pos
@@ -62,7 +62,39 @@ typedef struct {
     uint8_t              log;                      // should we log or not
 } ArkimeRule_t;
 
-#define ARKIME_RULES_MAX     100
+/* The head, tail and contains string matches for a field are compiled into
+ * byte tries when the rules are loaded. Head walks the value forwards, tail
+ * walks it backwards over patterns that were added reversed, and contains
+ * also gets Aho-Corasick fail and dictionary links so the value is only
+ * walked once no matter how many patterns there are. Node 0 is the root and
+ * the children of each node are sorted in one flat edge array.
+ */
+typedef struct {
+    uint32_t             fail;      // Longest proper suffix also in the trie, contains only
+    uint32_t             dict;      // Next node on the fail chain that has rules, contains only
+    uint32_t             child;     // Index into edgeChar/edgeNode of first child
+    uint16_t             childCnt;
+    GPtrArray           *rules;     // Rules for the pattern ending here, owned by fieldsMatch
+} ArkimeRulesTrieNode_t;
+
+typedef struct {
+    ArkimeRulesTrieNode_t *nodes;
+    uint8_t               *edgeChar;
+    uint32_t              *edgeNode;
+    uint32_t               rootNext[256]; // Root transitions, the most used ones with contains
+    uint32_t               nodesLen;
+} ArkimeRulesTrie_t;
+
+/* Integer ranges for a field, sorted by min with the largest max of each
+ * implicit subtree, so a lookup only visits ranges that could hold the value.
+ */
+typedef struct {
+    uint32_t            *min;
+    uint32_t            *max;
+    uint32_t            *subMax;
+    GPtrArray          **rules;     // Owned by fieldsMatch
+    int                  cnt;
+} ArkimeRulesIntervals_t;
 
 /* All the information about the rules.  To support reloading while running
  * there can be multiple info variables.
@@ -75,12 +107,18 @@ typedef struct {
  */
 typedef struct {
     GHashTable            *fieldsHash[ARKIME_FIELDS_MAX];
-    patricia_tree_t       *fieldsTree4[ARKIME_FIELDS_MAX];
-    patricia_tree_t       *fieldsTree6[ARKIME_FIELDS_MAX];
+    ArkimeLpm_t           *fieldsTree4[ARKIME_FIELDS_MAX];
+    ArkimeLpm_t           *fieldsTree6[ARKIME_FIELDS_MAX];
     GHashTable            *fieldsMatch[ARKIME_FIELDS_MAX];
 
+    // Compiled from fieldsMatch in arkime_rules_load_complete
+    ArkimeRulesTrie_t     *fieldsHead[ARKIME_FIELDS_MAX];
+    ArkimeRulesTrie_t     *fieldsTail[ARKIME_FIELDS_MAX];
+    ArkimeRulesTrie_t     *fieldsContains[ARKIME_FIELDS_MAX];
+    ArkimeRulesIntervals_t *fieldsRange[ARKIME_FIELDS_MAX];
+
     int                    rulesLen[ARKIME_RULE_TYPE_NUM];
-    ArkimeRule_t          *rules[ARKIME_RULE_TYPE_NUM][ARKIME_RULES_MAX + 1];
+    ArkimeRule_t         **rules[ARKIME_RULE_TYPE_NUM];    // NULL terminated
 } ArkimeRulesInfo_t;
 
 LOCAL ArkimeRulesInfo_t    current;
@@ -102,8 +140,24 @@ typedef union {
     uint64_t        num;
 } ArkimeRuleIntMatch_t;
 
+typedef void (*ArkimeRulesMatchFunc)(ArkimeSession_t *session, int pos, GPtrArray *rules);
+
+LOCAL int                  rulesBenchmark;
+
 LOCAL void arkime_rules_load_add_field_range_match(ArkimeRule_t *rule, int pos, char *key);
 /******************************************************************************/
+// Add a new rule of type to loading, the rules lists have no fixed size
+LOCAL ArkimeRule_t *arkime_rules_alloc(int type)
+{
+    int n = loading.rulesLen[type]++;
+
+    // Keep the list NULL terminated for the arkime_rules_run_* functions
+    loading.rules[type] = g_renew(ArkimeRule_t *, loading.rules[type], n + 2);
+    ArkimeRule_t *rule = loading.rules[type][n] = ARKIME_TYPE_ALLOC0(ArkimeRule_t);
+    loading.rules[type][n + 1] = NULL;
+    return rule;
+}
+/******************************************************************************/
 LOCAL void arkime_rules_free_array(gpointer data)
 {
     g_ptr_array_free(data, TRUE);
@@ -318,22 +372,22 @@ LOCAL void arkime_rules_load_add_field(ArkimeRule_t *rule, int pos, char *key)
     case ARKIME_FIELD_TYPE_IP:
     case ARKIME_FIELD_TYPE_IP_GHASH:
         if (!loading.fieldsTree4[pos]) {
-            loading.fieldsTree4[pos] = New_Patricia(32);
-            loading.fieldsTree6[pos] = New_Patricia(128);
+            loading.fieldsTree4[pos] = arkime_lpm_new(32, arkime_rules_free_array);
+            loading.fieldsTree6[pos] = arkime_lpm_new(128, arkime_rules_free_array);
         }
 
         if (strcmp(key, "ipv4") == 0) {
-            make_and_lookup(rule->tree4[pos], "0.0.0.0/0");
-            node = make_and_lookup(loading.fieldsTree4[pos], "0.0.0.0/0");
+            make_and_lookup(arkime_lpm_tree(rule->tree4[pos]), "0.0.0.0/0");
+            node = make_and_lookup(arkime_lpm_tree(loading.fieldsTree4[pos]), "0.0.0.0/0");
         } else if (strcmp(key, "ipv6") == 0) {
-            make_and_lookup(rule->tree6[pos], "::/0");
-            node = make_and_lookup(loading.fieldsTree6[pos], "::/0");
+            make_and_lookup(arkime_lpm_tree(rule->tree6[pos]), "::/0");
+            node = make_and_lookup(arkime_lpm_tree(loading.fieldsTree6[pos]), "::/0");
         } else if (strchr(key, '.') != 0) {
-            make_and_lookup(rule->tree4[pos], key);
-            node = make_and_lookup(loading.fieldsTree4[pos], key);
+            make_and_lookup(arkime_lpm_tree(rule->tree4[pos]), key);
+            node = make_and_lookup(arkime_lpm_tree(loading.fieldsTree4[pos]), key);
         } else {
-            make_and_lookup(rule->tree6[pos], key);
-            node = make_and_lookup(loading.fieldsTree6[pos], key);
+            make_and_lookup(arkime_lpm_tree(rule->tree6[pos]), key);
+            node = make_and_lookup(arkime_lpm_tree(loading.fieldsTree6[pos]), key);
         }
         if (node->data) {
             rules = node->data;
@@ -396,7 +450,7 @@ LOCAL void arkime_rules_load_add_field_range_match(ArkimeRule_t *rule, int pos,
     g_ptr_array_add(rule->match[pos], (gpointer)match.num);
 
     if (!loading.fieldsMatch[pos])
-        loading.fieldsMatch[pos] = g_hash_table_new_full(g_direct_hash, g_direct_equal, g_free, arkime_rules_free_array);
+        loading.fieldsMatch[pos] = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, arkime_rules_free_array);
 
     GPtrArray *rules = g_hash_table_lookup(loading.fieldsMatch[pos], (gpointer)match.num);
     if (!rules) {
@@ -498,11 +552,7 @@ LOCAL void arkime_rules_parser_load_rule(char *filename, YamlNode_t *parent)
         CONFIGEXIT("%s: Unknown when '%s'", filename, when);
     }
 
-    if (loading.rulesLen[type] >= ARKIME_RULES_MAX)
-        CONFIGEXIT("Too many %s rules", when);
-
-    int n = loading.rulesLen[type]++;
-    ArkimeRule_t *rule = loading.rules[type][n] = ARKIME_TYPE_ALLOC0(ArkimeRule_t);
+    ArkimeRule_t *rule = arkime_rules_alloc(type);
     rule->name = g_strdup(name);
     rule->filename = filename;
     rule->saveFlags = saveFlags;
@@ -568,8 +618,8 @@ LOCAL void arkime_rules_parser_load_rule(char *filename, YamlNode_t *parent)
                     CONFIGEXIT("Rule field %s doesn't support modifier %s", node->key, comma);
 
                 if (!rule->tree4[pos]) {
-                    rule->tree4[pos] = New_Patricia(32);
-                    rule->tree6[pos] = New_Patricia(128);
+                    rule->tree4[pos] = arkime_lpm_new(32, NULL);
+                    rule->tree6[pos] = arkime_lpm_new(128, NULL);
                 }
                 break;
 
@@ -640,19 +690,459 @@ LOCAL void arkime_rules_parser_load_file(char *filename, YamlNode_t *parent)
     }
 }
 /******************************************************************************/
+typedef struct {
+    uint32_t             first;     // First edge, 0 for none
+    GPtrArray           *rules;
+} ArkimeRulesTrieBuildNode_t;
+
+typedef struct {
+    uint32_t             next;      // Next sibling edge, 0 for none
+    uint32_t             node;
+    uint8_t              c;
+} ArkimeRulesTrieBuildEdge_t;
+
+typedef struct {
+    GArray              *nodes;
+    GArray              *edges;
+} ArkimeRulesTrieBuild_t;
+
+#define TRIE_BNODE(_b, _n) g_array_index((_b)->nodes, ArkimeRulesTrieBuildNode_t, _n)
+#define TRIE_BEDGE(_b, _e) g_array_index((_b)->edges, ArkimeRulesTrieBuildEdge_t, _e)
+/******************************************************************************/
+LOCAL void arkime_rules_trie_build_init(ArkimeRulesTrieBuild_t *b)
+{
+    ArkimeRulesTrieBuildNode_t root = {0, NULL};
+    ArkimeRulesTrieBuildEdge_t unused = {0, 0, 0};
+
+    b->nodes = g_array_new(FALSE, FALSE, sizeof(ArkimeRulesTrieBuildNode_t));
+    b->edges = g_array_new(FALSE, FALSE, sizeof(ArkimeRulesTrieBuildEdge_t));
+    g_array_append_val(b->nodes, root);
+    g_array_append_val(b->edges, unused); // So edge 0 can mean none
+}
+/******************************************************************************/
+LOCAL void arkime_rules_trie_build_add(ArkimeRulesTrieBuild_t *b, const uint8_t *str, int len, int reverse, GPtrArray *rules)
+{
+    uint32_t n = 0;
+
+    for (int i = 0; i < len; i++) {
+        const uint8_t c = reverse ? str[len - 1 - i] : str[i];
+        uint32_t e;
+
+        for (e = TRIE_BNODE(b, n).first; e; e = TRIE_BEDGE(b, e).next) {
+            if (TRIE_BEDGE(b, e).c == c)
+                break;
+        }
+
+        if (e) {
+            n = TRIE_BEDGE(b, e).node;
+            continue;
+        }
+
+        ArkimeRulesTrieBuildNode_t nnode = {0, NULL};
+        g_array_append_val(b->nodes, nnode);
+
+        ArkimeRulesTrieBuildEdge_t nedge = {TRIE_BNODE(b, n).first, b->nodes->len - 1, c};
+        g_array_append_val(b->edges, nedge);
+
+        TRIE_BNODE(b, n).first = b->edges->len - 1;
+        n = b->nodes->len - 1;
+    }
+    TRIE_BNODE(b, n).rules = rules;
+}
+/******************************************************************************/
+LOCAL inline uint32_t arkime_rules_trie_next(const ArkimeRulesTrie_t *trie, uint32_t n, uint8_t c)
+{
+    if (n == 0)
+        return trie->rootNext[c];
+
+    const ArkimeRulesTrieNode_t *node = &trie->nodes[n];
+    const uint8_t *chars = trie->edgeChar + node->child;
+    int lo = 0;
+    int hi = node->childCnt;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (chars[mid] < c)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < node->childCnt && chars[lo] == c)
+        return trie->edgeNode[node->child + lo];
+    return 0;
+}
+/******************************************************************************/
+// Flatten the build trie into sorted edge arrays, add the Aho-Corasick links for contains
+LOCAL ArkimeRulesTrie_t *arkime_rules_trie_build_finish(ArkimeRulesTrieBuild_t *b, gboolean contains)
+{
+    ArkimeRulesTrie_t *trie = ARKIME_TYPE_ALLOC0(ArkimeRulesTrie_t);
+    uint32_t           e = 0;
+
+    trie->nodesLen = b->nodes->len;
+    trie->nodes = g_new0(ArkimeRulesTrieNode_t, trie->nodesLen);
+    trie->edgeChar = g_malloc(b->edges->len);
+    trie->edgeNode = g_new(uint32_t, b->edges->len);
+
+    for (uint32_t n = 0; n < trie->nodesLen; n++) {
+        ArkimeRulesTrieNode_t *node = &trie->nodes[n];
+        node->rules = TRIE_BNODE(b, n).rules;
+        node->child = e;
+
+        for (uint32_t be = TRIE_BNODE(b, n).first; be; be = TRIE_BEDGE(b, be).next) {
+            // Insertion sort by char
+            uint32_t i = e;
+            while (i > node->child && trie->edgeChar[i - 1] > TRIE_BEDGE(b, be).c) {
+                trie->edgeChar[i] = trie->edgeChar[i - 1];
+                trie->edgeNode[i] = trie->edgeNode[i - 1];
+                i--;
+            }
+            trie->edgeChar[i] = TRIE_BEDGE(b, be).c;
+            trie->edgeNode[i] = TRIE_BEDGE(b, be).node;
+            e++;
+            node->childCnt++;
+        }
+    }
+
+    for (int i = 0; i < trie->nodes[0].childCnt; i++) {
+        trie->rootNext[trie->edgeChar[i]] = trie->edgeNode[i];
+    }
+
+    g_array_free(b->nodes, TRUE);
+    g_array_free(b->edges, TRUE);
+
+    if (!contains)
+        return trie;
+
+    // Breadth first so fail always points at a node already done
+    uint32_t *queue = g_new(uint32_t, trie->nodesLen);
+    uint32_t  head = 0, tail = 0;
+
+    for (int i = 0; i < trie->nodes[0].childCnt; i++) {
+        queue[tail++] = trie->edgeNode[i];
+    }
+
+    while (head < tail) {
+        const ArkimeRulesTrieNode_t *parent = &trie->nodes[queue[head++]];
+
+        for (int i = 0; i < parent->childCnt; i++) {
+            const uint8_t  c = trie->edgeChar[parent->child + i];
+            const uint32_t n = trie->edgeNode[parent->child + i];
+            uint32_t       f = parent->fail;
+            uint32_t       next;
+
+            queue[tail++] = n;
+
+            while ((next = arkime_rules_trie_next(trie, f, c)) == 0 && f != 0)
+                f = trie->nodes[f].fail;
+
+            trie->nodes[n].fail = next;
+            trie->nodes[n].dict = trie->nodes[next].rules ? next : trie->nodes[next].dict;
+        }
+    }
+    g_free(queue);
+
+    return trie;
+}
+/******************************************************************************/
+LOCAL void arkime_rules_trie_free(ArkimeRulesTrie_t *trie)
+{
+    if (!trie)
+        return;
+
+    g_free(trie->nodes);
+    g_free(trie->edgeChar);
+    g_free(trie->edgeNode);
+    ARKIME_TYPE_FREE(ArkimeRulesTrie_t, trie);
+}
+/******************************************************************************/
+// Patterns that are a prefix of value
+LOCAL void arkime_rules_trie_head(const ArkimeRulesTrie_t *trie, ArkimeSession_t *session, int pos, const uint8_t *value, int len, ArkimeRulesMatchFunc func)
+{
+    uint32_t n = 0;
+
+    for (int i = 0; ; i++) {
+        if (trie->nodes[n].rules)
+            func(session, pos, trie->nodes[n].rules);
+        if (i == len || (n = arkime_rules_trie_next(trie, n, value[i])) == 0)
+            break;
+    }
+}
+/******************************************************************************/
+// Patterns that are a suffix of value, the trie was built from the reversed patterns
+LOCAL void arkime_rules_trie_tail(const ArkimeRulesTrie_t *trie, ArkimeSession_t *session, int pos, const uint8_t *value, int len, ArkimeRulesMatchFunc func)
+{
+    uint32_t n = 0;
+
+    for (int i = len - 1; ; i--) {
+        if (trie->nodes[n].rules)
+            func(session, pos, trie->nodes[n].rules);
+        if (i < 0 || (n = arkime_rules_trie_next(trie, n, value[i])) == 0)
+            break;
+    }
+}
+/******************************************************************************/
+LOCAL int arkime_rules_uint32_cmp(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+/******************************************************************************/
+// Patterns found anywhere in value, each pattern reported once no matter how often it occurs
+LOCAL void arkime_rules_trie_contains(const ArkimeRulesTrie_t *trie, ArkimeSession_t *session, int pos, const uint8_t *value, int len, ArkimeRulesMatchFunc func)
+{
+    uint32_t  foundBuf[64];
+    uint32_t *found = foundBuf;
+    int       foundLen = 0;
+    int       foundSize = 64;
+    uint32_t  n = 0;
+
+    // Empty pattern
+    if (trie->nodes[0].rules)
+        func(session, pos, trie->nodes[0].rules);
+
+    for (int i = 0; i < len; i++) {
+        uint32_t next;
+        while ((next = arkime_rules_trie_next(trie, n, value[i])) == 0 && n != 0)
+            n = trie->nodes[n].fail;
+        n = next;
+
+        for (uint32_t o = trie->nodes[n].rules ? n : trie->nodes[n].dict; o; o = trie->nodes[o].dict) {
+            if (foundLen == foundSize) {
+                foundSize *= 2;
+                if (found == foundBuf) {
+                    found = g_new(uint32_t, foundSize);
+                    memcpy(found, foundBuf, sizeof(foundBuf));
+                } else {
+                    found = g_renew(uint32_t, found, foundSize);
+                }
+            }
+            found[foundLen++] = o;
+        }
+    }
+
+    if (foundLen > 1)
+        qsort(found, foundLen, sizeof(uint32_t), arkime_rules_uint32_cmp);
+
+    for (int i = 0; i < foundLen; i++) {
+        if (i > 0 && found[i] == found[i - 1])
+            continue;
+        func(session, pos, trie->nodes[found[i]].rules);
+    }
+
+    if (found != foundBuf)
+        g_free(found);
+}
+/******************************************************************************/
+// Build the head, tail and contains tries for a string field from its fieldsMatch
+LOCAL void arkime_rules_str_compile(ArkimeRulesInfo_t *info, int pos)
+{
+    ArkimeRulesTrieBuild_t builds[3];
+    int                    cnts[3] = {0, 0, 0};
+    GHashTableIter         iter;
+    uint8_t               *akey;
+    GPtrArray             *rules;
+
+    for (int i = 0; i < 3; i++)
+        arkime_rules_trie_build_init(&builds[i]);
+
+    g_hash_table_iter_init (&iter, info->fieldsMatch[pos]);
+    while (g_hash_table_iter_next (&iter, (gpointer *)&akey, (gpointer *)&rules)) {
+        // akey[0] is the match type 1-3
+        const int t = akey[0] - 1;
+        arkime_rules_trie_build_add(&builds[t], akey + 2, akey[1], akey[0] == ARKIME_RULES_STR_MATCH_TAIL, rules);
+        cnts[t]++;
+    }
+
+    ArkimeRulesTrie_t *tries[3];
+    for (int i = 0; i < 3; i++) {
+        if (cnts[i]) {
+            tries[i] = arkime_rules_trie_build_finish(&builds[i], i + 1 == ARKIME_RULES_STR_MATCH_CONTAINS);
+        } else {
+            tries[i] = NULL;
+            g_array_free(builds[i].nodes, TRUE);
+            g_array_free(builds[i].edges, TRUE);
+        }
+    }
+
+    info->fieldsHead[pos] = tries[ARKIME_RULES_STR_MATCH_HEAD - 1];
+    info->fieldsTail[pos] = tries[ARKIME_RULES_STR_MATCH_TAIL - 1];
+    info->fieldsContains[pos] = tries[ARKIME_RULES_STR_MATCH_CONTAINS - 1];
+}
+/******************************************************************************/
+typedef struct {
+    ArkimeRuleIntMatch_t match;
+    GPtrArray           *rules;
+} ArkimeRulesInterval_t;
+
+LOCAL int arkime_rules_interval_cmp(const void *a, const void *b)
+{
+    const ArkimeRulesInterval_t *x = a;
+    const ArkimeRulesInterval_t *y = b;
+
+    if (x->match.min != y->match.min)
+        return (x->match.min > y->match.min) - (x->match.min < y->match.min);
+    return (x->match.max > y->match.max) - (x->match.max < y->match.max);
+}
+/******************************************************************************/
+LOCAL uint32_t arkime_rules_intervals_fill(ArkimeRulesIntervals_t *iv, int lo, int hi)
+{
+    if (lo >= hi)
+        return 0;
+
+    int mid = (lo + hi) / 2;
+    uint32_t m = iv->max[mid];
+    m = MAX(m, arkime_rules_intervals_fill(iv, lo, mid));
+    m = MAX(m, arkime_rules_intervals_fill(iv, mid + 1, hi));
+    iv->subMax[mid] = m;
+    return m;
+}
+/******************************************************************************/
+LOCAL ArkimeRulesIntervals_t *arkime_rules_intervals_compile(GHashTable *fieldsMatch)
+{
+    ArkimeRulesIntervals_t *iv = ARKIME_TYPE_ALLOC0(ArkimeRulesIntervals_t);
+    GHashTableIter          iter;
+    gpointer                num;
+    GPtrArray              *rules;
+
+    iv->cnt = g_hash_table_size(fieldsMatch);
+    ArkimeRulesInterval_t *sorted = g_new(ArkimeRulesInterval_t, iv->cnt);
+
+    int i = 0;
+    g_hash_table_iter_init (&iter, fieldsMatch);
+    while (g_hash_table_iter_next (&iter, &num, (gpointer *)&rules)) {
+        sorted[i].match.num = (uint64_t)num;
+        sorted[i].rules = rules;
+        i++;
+    }
+    qsort(sorted, iv->cnt, sizeof(ArkimeRulesInterval_t), arkime_rules_interval_cmp);
+
+    iv->min = g_new(uint32_t, iv->cnt);
+    iv->max = g_new(uint32_t, iv->cnt);
+    iv->subMax = g_new(uint32_t, iv->cnt);
+    iv->rules = g_new(GPtrArray *, iv->cnt);
+    for (i = 0; i < iv->cnt; i++) {
+        iv->min[i] = sorted[i].match.min;
+        iv->max[i] = sorted[i].match.max;
+        iv->rules[i] = sorted[i].rules;
+    }
+    g_free(sorted);
+
+    arkime_rules_intervals_fill(iv, 0, iv->cnt);
+    return iv;
+}
+/******************************************************************************/
+LOCAL void arkime_rules_intervals_free(ArkimeRulesIntervals_t *iv)
+{
+    if (!iv)
+        return;
+
+    g_free(iv->min);
+    g_free(iv->max);
+    g_free(iv->subMax);
+    g_free(iv->rules);
+    ARKIME_TYPE_FREE(ArkimeRulesIntervals_t, iv);
+}
+/******************************************************************************/
+LOCAL void arkime_rules_intervals_find(const ArkimeRulesIntervals_t *iv, int lo, int hi, ArkimeSession_t *session, int pos, uint32_t value, ArkimeRulesMatchFunc func)
+{
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        // Nothing in this subtree reaches value
+        if (iv->subMax[mid] < value)
+            return;
+
+        arkime_rules_intervals_find(iv, lo, mid, session, pos, value, func);
+
+        // Everything to the right starts after value
+        if (iv->min[mid] > value)
+            return;
+
+        if (iv->max[mid] >= value)
+            func(session, pos, iv->rules[mid]);
+
+        lo = mid + 1;
+    }
+}
+/******************************************************************************/
+/* Generate rulesBenchmark fieldSet rules, a mix of host head/tail/contains
+ * matches and port ranges, the first few common enough to match real traffic.
+ */
+LOCAL void arkime_rules_bench_generate()
+{
+    static const char *words[] = {"google", "yahoo", "facebook", "akamai", "cdn", "mail", "api", "static", "img", "www"};
+    const int          hostPos[2] = {arkime_field_by_exp("host.http"), arkime_field_by_exp("host.dns")};
+    const int          portPos = arkime_field_by_exp("port.dst");
+    char               key[100];
+
+    if (hostPos[0] == -1 || hostPos[1] == -1 || portPos == -1)
+        CONFIGEXIT("rulesBenchmark needs the host.http, host.dns and port.dst fields");
+
+    for (int i = 0; i < rulesBenchmark; i++) {
+        const char *word = words[i % 10];
+        const int   n = i < 40 ? 0 : i;
+        const int   pos = (i % 4 == 3) ? portPos : hostPos[(i / 4) % 2];
+
+        ArkimeRule_t *rule = arkime_rules_alloc(ARKIME_RULE_TYPE_FIELD_SET);
+        rule->name = g_strdup_printf("bench%d", i);
+        rule->filename = "rulesBenchmark";
+        rule->fields = malloc(2);
+        rule->fields[rule->fieldsLen++] = pos;
+        arkime_field_ops_init(&rule->ops, 0, ARKIME_FIELD_OPS_FLAGS_COPY);
+
+        if (pos != portPos && !rule->match[pos])
+            rule->match[pos] = g_ptr_array_new_with_free_func(g_free);
+
+        switch (i % 4) {
+        case 0:
+            if (n)
+                snprintf(key, sizeof(key), ".%s%d.com", word, n);
+            else
+                snprintf(key, sizeof(key), ".%s.com", word);
+            arkime_rules_load_add_field_match(rule, pos, ARKIME_RULES_STR_MATCH_TAIL, key);
+            break;
+        case 1:
+            if (n)
+                snprintf(key, sizeof(key), "%s%d.", word, n);
+            else
+                snprintf(key, sizeof(key), "%s.", word);
+            arkime_rules_load_add_field_match(rule, pos, ARKIME_RULES_STR_MATCH_HEAD, key);
+            break;
+        case 2:
+            if (n)
+                snprintf(key, sizeof(key), "%s%d", word, n);
+            else
+                snprintf(key, sizeof(key), "%s", word);
+            arkime_rules_load_add_field_match(rule, pos, ARKIME_RULES_STR_MATCH_CONTAINS, key);
+            break;
+        case 3: {
+            const uint32_t min = (i * 37) % 60000;
+            rule->hash[pos] = g_hash_table_new_full(NULL, NULL, NULL, NULL);
+            snprintf(key, sizeof(key), "%u-%u", min, min + 21 + i % 500);
+            arkime_rules_load_add_field_range_match(rule, pos, key);
+            break;
+        }
+        }
+    }
+}
+/******************************************************************************/
 LOCAL void arkime_rules_load_complete()
 {
     char      **bpfs;
     GRegex     *regex = g_regex_new(":\\s*(\\d+)\\s*$", 0, 0, 0);
     int         i;
 
+    if (rulesBenchmark)
+        arkime_rules_bench_generate();
+
     bpfs = arkime_config_str_list(NULL, "dontSaveBPFs", NULL);
     int pos = arkime_field_by_exp("_maxPacketsToSave");
     gint start_pos;
     if (bpfs) {
         for (i = 0; bpfs[i]; i++) {
-            int n = loading.rulesLen[ARKIME_RULE_TYPE_SESSION_SETUP]++;
-            ArkimeRule_t *rule = loading.rules[ARKIME_RULE_TYPE_SESSION_SETUP][n] = ARKIME_TYPE_ALLOC0(ArkimeRule_t);
+            ArkimeRule_t *rule = arkime_rules_alloc(ARKIME_RULE_TYPE_SESSION_SETUP);
             rule->filename = "dontSaveBPFs";
             arkime_field_ops_init(&rule->ops, 1, ARKIME_FIELD_OPS_FLAGS_COPY);
 
@@ -675,8 +1165,7 @@ LOCAL void arkime_rules_load_complete()
     pos = arkime_field_by_exp("_minPacketsBeforeSavingSPI");
     if (bpfs) {
         for (i = 0; bpfs[i]; i++) {
-            int n = loading.rulesLen[ARKIME_RULE_TYPE_SESSION_SETUP]++;
-            ArkimeRule_t *rule = loading.rules[ARKIME_RULE_TYPE_SESSION_SETUP][n] = ARKIME_TYPE_ALLOC0(ArkimeRule_t);
+            ArkimeRule_t *rule = arkime_rules_alloc(ARKIME_RULE_TYPE_SESSION_SETUP);
             rule->filename = "minPacketsSaveBPFs";
             arkime_field_ops_init(&rule->ops, 1, ARKIME_FIELD_OPS_FLAGS_COPY);
 
@@ -696,6 +1185,34 @@ LOCAL void arkime_rules_load_complete()
     }
     g_regex_unref(regex);
 
+    for (i = 0; i < ARKIME_FIELDS_MAX; i++) {
+        if (loading.fieldsTree4[i]) {
+            arkime_lpm_compile(loading.fieldsTree4[i]);
+            arkime_lpm_compile(loading.fieldsTree6[i]);
+        }
+    }
+
+    for (int t = 0; t < ARKIME_RULE_TYPE_NUM; t++) {
+        for (int r = 0; r < loading.rulesLen[t]; r++) {
+            ArkimeRule_t *rule = loading.rules[t][r];
+            for (i = 0; i < ARKIME_FIELDS_MAX; i++) {
+                if (rule->tree4[i]) {
+                    arkime_lpm_compile(rule->tree4[i]);
+                    arkime_lpm_compile(rule->tree6[i]);
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < ARKIME_FIELDS_MAX; i++) {
+        if (!loading.fieldsMatch[i])
+            continue;
+        if (ARKIME_FIELD_TYPE_IS_INT(config.fields[i]->type))
+            loading.fieldsRange[i] = arkime_rules_intervals_compile(loading.fieldsMatch[i]);
+        else
+            arkime_rules_str_compile(&loading, i);
+    }
+
     memcpy(&current, &loading, sizeof(loading));
     memset(&loading, 0, sizeof(loading));
 }
@@ -708,15 +1225,15 @@ LOCAL void arkime_rules_free(ArkimeRulesInfo_t *freeing)
         if (freeing->fieldsHash[i]) {
             g_hash_table_destroy(freeing->fieldsHash[i]);
         }
-        if (freeing->fieldsTree4[i]) {
-            Destroy_Patricia(freeing->fieldsTree4[i], arkime_rules_free_array);
-        }
-        if (freeing->fieldsTree6[i]) {
-            Destroy_Patricia(freeing->fieldsTree6[i], arkime_rules_free_array);
-        }
+        arkime_lpm_free(freeing->fieldsTree4[i]);
+        arkime_lpm_free(freeing->fieldsTree6[i]);
         if (freeing->fieldsMatch[i]) {
             g_hash_table_destroy(freeing->fieldsMatch[i]);
         }
+        arkime_rules_trie_free(freeing->fieldsHead[i]);
+        arkime_rules_trie_free(freeing->fieldsTail[i]);
+        arkime_rules_trie_free(freeing->fieldsContains[i]);
+        arkime_rules_intervals_free(freeing->fieldsRange[i]);
     }
 
     for (t = 0; t < ARKIME_RULE_TYPE_NUM; t++) {
@@ -731,12 +1248,8 @@ LOCAL void arkime_rules_free(ArkimeRulesInfo_t *freeing)
                 if (rule->hash[i]) {
                     g_hash_table_destroy(rule->hash[i]);
                 }
-                if (rule->tree4[i]) {
-                    Destroy_Patricia(rule->tree4[i], arkime_rules_free_array);
-                }
-                if (rule->tree6[i]) {
-                    Destroy_Patricia(rule->tree6[i], arkime_rules_free_array);
-                }
+                arkime_lpm_free(rule->tree4[i]);
+                arkime_lpm_free(rule->tree6[i]);
                 if (rule->match[i]) {
                     g_ptr_array_free(rule->match[i], TRUE);
                 }
@@ -745,6 +1258,7 @@ LOCAL void arkime_rules_free(ArkimeRulesInfo_t *freeing)
             arkime_field_ops_free(&rule->ops);
             ARKIME_TYPE_FREE(ArkimeRule_t, rule);
         }
+        g_free(freeing->rules[t]);
     }
 
     ARKIME_TYPE_FREE(ArkimeRulesInfo_t, freeing);
@@ -800,6 +1314,8 @@ void arkime_rules_recompile()
     deadPcap = pcap_open_dead(pcapFileHeader.dlt, pcapFileHeader.snaplen);
     ArkimeRule_t *rule;
     for (t = 0; t < ARKIME_RULE_TYPE_NUM; t++) {
+        if (!current.rules[t])
+            continue;
         for (r = 0; (rule = current.rules[t][r]); r++) {
             if (!rule->bpf)
                 continue;
@@ -819,7 +1335,7 @@ void arkime_rules_recompile()
 LOCAL gboolean arkime_rules_check_ip(const ArkimeRule_t *const rule, const int p, const struct in6_addr *ip, BSB *logStr)
 {
     if (IN6_IS_ADDR_V4MAPPED(ip)) {
-        patricia_node_t *node = patricia_search_best3 (rule->tree4[p], ((u_char *)ip->s6_addr) + 12, 32);
+        patricia_node_t *node = arkime_lpm_search_best(rule->tree4[p], ip->s6_addr + 12);
         if (!node)
             return FALSE;
         if (!logStr)
@@ -832,7 +1348,7 @@ LOCAL gboolean arkime_rules_check_ip(const ArkimeRule_t *const rule, const int p
                            (node->prefix->add.sin.s_addr >> 24) & 0xff,
                            node->prefix->bitlen);
     } else {
-        patricia_node_t *node = patricia_search_best3 (rule->tree6[p], (u_char *)ip->s6_addr, 128);
+        patricia_node_t *node = arkime_lpm_search_best(rule->tree6[p], ip->s6_addr);
         if (!node)
             return FALSE;
         if (!logStr)
@@ -1245,6 +1761,101 @@ void arkime_rules_run_field_set_rules(ArkimeSession_t *session, int pos, GPtrArr
     }
 }
 /******************************************************************************/
+/* The value matches for a non ip field, string head/tail/contains or integer
+ * ranges, using the structures compiled in arkime_rules_load_complete
+ */
+LOCAL void arkime_rules_field_matches(const ArkimeRulesInfo_t *info, ArkimeSession_t *session, int pos, const gpointer value, ArkimeRulesMatchFunc func)
+{
+    if (info->fieldsRange[pos]) {
+        arkime_rules_intervals_find(info->fieldsRange[pos], 0, info->fieldsRange[pos]->cnt, session, pos, (uint32_t)(long)value, func);
+        return;
+    }
+
+    const int len = strlen(value);
+
+    if (info->fieldsHead[pos])
+        arkime_rules_trie_head(info->fieldsHead[pos], session, pos, value, len, func);
+    if (info->fieldsTail[pos])
+        arkime_rules_trie_tail(info->fieldsTail[pos], session, pos, value, len, func);
+    if (info->fieldsContains[pos])
+        arkime_rules_trie_contains(info->fieldsContains[pos], session, pos, value, len, func);
+}
+/******************************************************************************/
+/* The old way of checking every match, only used to check
+ * arkime_rules_field_matches and to compare against with rulesBenchmark
+ */
+LOCAL void arkime_rules_field_matches_linear(const ArkimeRulesInfo_t *info, ArkimeSession_t *session, int pos, const gpointer value, ArkimeRulesMatchFunc func)
+{
+    GHashTableIter         iter;
+    GPtrArray             *rules;
+
+    g_hash_table_iter_init (&iter, info->fieldsMatch[pos]);
+    if (info->fieldsRange[pos]) {
+        gpointer               num;
+
+        while (g_hash_table_iter_next (&iter, &num, (gpointer *)&rules)) {
+            ArkimeRuleIntMatch_t match;
+            match.num = (uint64_t)num;
+            uint32_t test = (uint32_t)(long)value;
+            if (test >= match.min && test <= match.max) {
+                func(session, pos, rules);
+            }
+        }
+    } else {
+        uint8_t               *akey;
+        int                    len = strlen(value);
+
+        while (g_hash_table_iter_next (&iter, (gpointer *)&akey, (gpointer *)&rules)) {
+            if (len < akey[1])
+                continue;
+
+            switch (akey[0]) {
+            case ARKIME_RULES_STR_MATCH_TAIL:
+                if (memcmp(akey + 2, value + len - akey[1], akey[1]) == 0)
+                    func(session, pos, rules);
+                break;
+            case ARKIME_RULES_STR_MATCH_HEAD:
+                if (memcmp(akey + 2, value, akey[1]) == 0)
+                    func(session, pos, rules);
+                break;
+            case ARKIME_RULES_STR_MATCH_CONTAINS:
+                if (arkime_memstr(value, len, (char * )akey + 2, akey[1]) != 0)
+                    func(session, pos, rules);
+            }
+        }
+    }
+}
+/******************************************************************************/
+typedef struct {
+    int                  pos;
+    gpointer             value;
+} ArkimeRulesBenchSample_t;
+
+LOCAL GArray              *rulesBenchSamples;
+LOCAL ARKIME_LOCK_DEFINE(rulesBench);
+
+#define RULES_BENCH_MAX_SAMPLES 100000
+/******************************************************************************/
+LOCAL void arkime_rules_bench_save(int pos, const gpointer value)
+{
+    ArkimeRulesBenchSample_t sample;
+
+    sample.pos = pos;
+    if (current.fieldsRange[pos])
+        sample.value = value;
+    else
+        sample.value = g_strdup(value);
+
+    ARKIME_LOCK(rulesBench);
+    if (!rulesBenchSamples)
+        rulesBenchSamples = g_array_new(FALSE, FALSE, sizeof(ArkimeRulesBenchSample_t));
+    if (rulesBenchSamples->len < RULES_BENCH_MAX_SAMPLES)
+        g_array_append_val(rulesBenchSamples, sample);
+    else if (sample.value != value)
+        g_free(sample.value);
+    ARKIME_UNLOCK(rulesBench);
+}
+/******************************************************************************/
 void arkime_rules_run_field_set(ArkimeSession_t *session, int pos, const gpointer value)
 {
     if (ARKIME_FIELD_TYPE_IS_IP(config.fields[pos]->type)) {
@@ -1253,9 +1864,9 @@ void arkime_rules_run_field_set(ArkimeSession_t *session, int pos, const gpointe
 
         int cnt;
         if (IN6_IS_ADDR_V4MAPPED((struct in6_addr *)value)) {
-            cnt = patricia_search_all2(current.fieldsTree4[pos], ((u_char *)value) + 12, 32, nodes, PATRICIA_MAXBITS);
+            cnt = arkime_lpm_search_all(current.fieldsTree4[pos], ((uint8_t *)value) + 12, nodes, PATRICIA_MAXBITS);
         } else {
-            cnt = patricia_search_all2(current.fieldsTree6[pos], (u_char *)value, 128, nodes, PATRICIA_MAXBITS);
+            cnt = arkime_lpm_search_all(current.fieldsTree6[pos], (uint8_t *)value, nodes, PATRICIA_MAXBITS);
         }
         if (cnt == 0)
             return;
@@ -1270,43 +1881,10 @@ void arkime_rules_run_field_set(ArkimeSession_t *session, int pos, const gpointe
 
         // See if this value matches anything in our matching list
         if (current.fieldsMatch[pos]) {
-            GHashTableIter         iter;
-
-            g_hash_table_iter_init (&iter, current.fieldsMatch[pos]);
-            if (ARKIME_FIELD_TYPE_IS_INT(config.fields[pos]->type)) {
-                uint64_t               num;
-
-                while (g_hash_table_iter_next (&iter, (gpointer *)&num, (gpointer *)&rules)) {
-                    ArkimeRuleIntMatch_t match;
-                    match.num = num;
-                    uint32_t test = (uint32_t)(long)value;
-                    if (test >= match.min && test <= match.max) {
-                        arkime_rules_run_field_set_rules(session, pos, rules);
-                    }
-                }
-            } else {
-                uint8_t               *akey;
-                int                    len = strlen(value);
-
-                while (g_hash_table_iter_next (&iter, (gpointer *)&akey, (gpointer *)&rules)) {
-                    if (len < akey[1])
-                        continue;
-
-                    switch (akey[0]) {
-                    case ARKIME_RULES_STR_MATCH_TAIL:
-                        if (memcmp(akey + 2, value + len - akey[1], akey[1]) == 0)
-                            arkime_rules_run_field_set_rules(session, pos, rules);
-                        break;
-                    case ARKIME_RULES_STR_MATCH_HEAD:
-                        if (memcmp(akey + 2, value, akey[1]) == 0)
-                            arkime_rules_run_field_set_rules(session, pos, rules);
-                        break;
-                    case ARKIME_RULES_STR_MATCH_CONTAINS:
-                        if (arkime_memstr(value, len, (char * )akey + 2, akey[1]) != 0)
-                            arkime_rules_run_field_set_rules(session, pos, rules);
-                    }
-                }
-            }
+            if (unlikely(rulesBenchmark))
+                arkime_rules_bench_save(pos, value);
+
+            arkime_rules_field_matches(&current, session, pos, value, arkime_rules_run_field_set_rules);
         }
 
         // See if this value is in the hash table of values we are watching for
@@ -1322,7 +1900,10 @@ void arkime_rules_run_session_setup(ArkimeSession_t *session, ArkimePacket_t *pa
 {
     int r;
     ArkimeRule_t *rule;
-    for (r = 0; (rule = current.rules[ARKIME_RULE_TYPE_SESSION_SETUP][r]); r++) {
+    ArkimeRule_t **rules = current.rules[ARKIME_RULE_TYPE_SESSION_SETUP];
+    if (!rules)
+        return;
+    for (r = 0; (rule = rules[r]); r++) {
         if (rule->fieldsLen) {
             arkime_rules_check_rule_fields(session, rule, -1, NULL);
         } else if (rule->bpfp.bf_len && bpf_filter(rule->bpfp.bf_insns, packet->pkt, packet->pktlen, packet->pktlen)) {
@@ -1335,7 +1916,10 @@ void arkime_rules_run_after_classify(ArkimeSession_t *session)
 {
     int r;
     ArkimeRule_t *rule;
-    for (r = 0; (rule = current.rules[ARKIME_RULE_TYPE_AFTER_CLASSIFY][r]); r++) {
+    ArkimeRule_t **rules = current.rules[ARKIME_RULE_TYPE_AFTER_CLASSIFY];
+    if (!rules)
+        return;
+    for (r = 0; (rule = rules[r]); r++) {
         if (rule->fieldsLen) {
             arkime_rules_check_rule_fields(session, rule, -1, NULL);
         }
@@ -1347,7 +1931,10 @@ void arkime_rules_run_before_save(ArkimeSession_t *session, int final)
     int r;
     final = 1 << final;
     ArkimeRule_t *rule;
-    for (r = 0; (rule = current.rules[ARKIME_RULE_TYPE_BEFORE_SAVE][r]); r++) {
+    ArkimeRule_t **rules = current.rules[ARKIME_RULE_TYPE_BEFORE_SAVE];
+    if (!rules)
+        return;
+    for (r = 0; (rule = rules[r]); r++) {
         if ((rule->saveFlags & final) == 0) {
             continue;
         }
@@ -1404,8 +1991,92 @@ void arkime_rules_stats()
     }
 }
 /******************************************************************************/
+LOCAL uint64_t rulesBenchMatched;
+LOCAL uint64_t rulesBenchSum;
+
+LOCAL void arkime_rules_bench_count(ArkimeSession_t *UNUSED(session), int UNUSED(pos), GPtrArray *rules)
+{
+    rulesBenchMatched += rules->len;
+    for (guint i = 0; i < rules->len; i++)
+        rulesBenchSum += (uintptr_t)g_ptr_array_index(rules, i);
+}
+/******************************************************************************/
+typedef void (*ArkimeRulesMatchesFunc)(const ArkimeRulesInfo_t *info, ArkimeSession_t *session, int pos, const gpointer value, ArkimeRulesMatchFunc func);
+
+LOCAL double arkime_rules_bench_replay(ArkimeRulesMatchesFunc matches, uint64_t *matched)
+{
+    struct timespec startTime, endTime;
+
+    rulesBenchMatched = 0;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (guint i = 0; i < rulesBenchSamples->len; i++) {
+        const ArkimeRulesBenchSample_t *sample = &g_array_index(rulesBenchSamples, ArkimeRulesBenchSample_t, i);
+        if (current.fieldsMatch[sample->pos])
+            matches(&current, NULL, sample->pos, sample->value, arkime_rules_bench_count);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    *matched = rulesBenchMatched;
+    uint64_t ns = (endTime.tv_sec - startTime.tv_sec) * 1000000000ULL + endTime.tv_nsec - startTime.tv_nsec;
+    return (double)ns / rulesBenchSamples->len;
+}
+/******************************************************************************/
+// Replay the field values seen thru both the compiled matchers and the old linear checks
+LOCAL void arkime_rules_bench_exit()
+{
+    if (!rulesBenchSamples || rulesBenchSamples->len == 0) {
+        LOG("rules: %d rules, no matching field values seen", current.rulesLen[ARKIME_RULE_TYPE_FIELD_SET]);
+        return;
+    }
+
+    uint64_t compiledMatched, linearMatched;
+    double compiledNs = arkime_rules_bench_replay(arkime_rules_field_matches, &compiledMatched);
+    double linearNs = arkime_rules_bench_replay(arkime_rules_field_matches_linear, &linearMatched);
+
+    // Each value must match the same rules both ways, the order they are found in doesn't matter
+    uint32_t mismatches = 0;
+    for (guint i = 0; i < rulesBenchSamples->len; i++) {
+        const ArkimeRulesBenchSample_t *sample = &g_array_index(rulesBenchSamples, ArkimeRulesBenchSample_t, i);
+        if (!current.fieldsMatch[sample->pos])
+            continue;
+
+        rulesBenchMatched = rulesBenchSum = 0;
+        arkime_rules_field_matches(&current, NULL, sample->pos, sample->value, arkime_rules_bench_count);
+        const uint64_t cnt = rulesBenchMatched, sum = rulesBenchSum;
+
+        rulesBenchMatched = rulesBenchSum = 0;
+        arkime_rules_field_matches_linear(&current, NULL, sample->pos, sample->value, arkime_rules_bench_count);
+        if (cnt != rulesBenchMatched || sum != rulesBenchSum) {
+            if (mismatches++ < 10) {
+                if (current.fieldsRange[sample->pos])
+                    LOG("rules: %s %u compiled matched %" PRIu64 " linear matched %" PRIu64, config.fields[sample->pos]->expression, (uint32_t)(long)sample->value, cnt, rulesBenchMatched);
+                else
+                    LOG("rules: %s %s compiled matched %" PRIu64 " linear matched %" PRIu64, config.fields[sample->pos]->expression, (char *)sample->value, cnt, rulesBenchMatched);
+            }
+        }
+    }
+
+    LOG("rules: %d fieldSet rules, %u field values, compiled %.1fns per value %" PRIu64 " matches, linear %.1fns per value %" PRIu64 " matches, %u mismatches",
+        current.rulesLen[ARKIME_RULE_TYPE_FIELD_SET], rulesBenchSamples->len,
+        compiledNs, compiledMatched, linearNs, linearMatched, mismatches);
+
+    if (mismatches)
+        LOGEXIT("ERROR - rules compiled matchers don't match the linear checks for %u field values", mismatches);
+
+    for (guint i = 0; i < rulesBenchSamples->len; i++) {
+        const ArkimeRulesBenchSample_t *sample = &g_array_index(rulesBenchSamples, ArkimeRulesBenchSample_t, i);
+        if (!current.fieldsRange[sample->pos])
+            g_free(sample->value);
+    }
+    g_array_free(rulesBenchSamples, TRUE);
+    rulesBenchSamples = NULL;
+}
+/******************************************************************************/
 void arkime_rules_init()
 {
+    // Hidden and only with --tests since it adds generated rules
+    if (config.tests)
+        rulesBenchmark = arkime_config_int(NULL, "rulesBenchmark", 0, 0, 1000000);
     rulesFiles = arkime_config_str_list(NULL, "rulesFiles", NULL);
 
     if (rulesFiles) {
@@ -1416,5 +2087,8 @@ void arkime_rules_init()
 /******************************************************************************/
 void arkime_rules_exit()
 {
+    if (rulesBenchmark)
+        arkime_rules_bench_exit();
+
     g_strfreev(rulesFiles);
 }
@@ -7,6 +7,11 @@
 
 #include <arpa/inet.h>
 #include "arkime.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /******************************************************************************/
 extern ArkimeConfig_t        config;
@@ -20,7 +25,6 @@ LOCAL int                   protocolField;
 extern uint32_t             hashSalt;
 
 LOCAL ArkimeSessionHead_t   closingQ[ARKIME_MAX_PACKET_THREADS];
-ArkimeSessionHead_t         tcpWriteQ[ARKIME_MAX_PACKET_THREADS];
 
 typedef HASHP_VAR(h_, ArkimeSessionHash_t, ArkimeSessionHead_t);
 
@@ -29,8 +33,63 @@ LOCAL ArkimeSessionHash_t   sessions[ARKIME_MAX_PACKET_THREADS][SESSION_MAX];
 LOCAL int needSave[ARKIME_MAX_PACKET_THREADS];
 LOCAL int tcpClosingTimeout;
 
+// Most timer callbacks to run per call of process_commands
+#define SESSION_WHEEL_MAX 100
+
+#define SESSION_FROM_ENTRY(entry, member) ((ArkimeSession_t *)((char *)(entry) - offsetof(ArkimeSession_t, member)))
+
+/******************************************************************************/
+/* sessionIndex=open - Open addressing session index made of 16 slot groups, each
+ * slot has a one byte tag that is probed 16 at a time with SIMD and the first 16
+ * bytes of the session id inline.  IPv4 session ids fit completely inline so most
+ * lookups never touch the session.  When the table gets full a new table is
+ * allocated and a few groups are migrated on each insert, so there is no long
+ * rehash pause and no need to size it from maxStreams.
+ */
+#define SI_GROUP      16
+#define SI_KEY_LEN    16
+#define SI_EMPTY      0x80
+#define SI_DELETED    0xfe
+#define SI_MIGRATE    4
+#define SI_MIN_GROUPS 64
+
+typedef struct {
+    uint8_t               tags[SI_GROUP];
+    uint8_t               keys[SI_GROUP][SI_KEY_LEN];
+    ArkimeSession_t      *sessions[SI_GROUP];
+} ArkimeSessionGroup_t;
+
+typedef struct {
+    ArkimeSessionGroup_t *groups;
+    uint32_t              mask;         // Number of groups - 1
+    uint32_t              used;         // Live and deleted slots
+} ArkimeSessionTable_t;
+
+typedef struct {
+    ArkimeSessionTable_t  cur;
+    ArkimeSessionTable_t  old;          // Being migrated into cur when groups is set
+    uint32_t              migrated;     // Next old group to migrate
+    uint32_t              count;
+} ArkimeSessionIndex_t;
+
+// The counters from when a mid save started waiting on the writer, so the
+// saved counts match the packet positions saved
+typedef struct arkime_session_counts {
+    struct timeval        lastPacket;
+    uint64_t              bytes[2];
+    uint64_t              databytes[2];
+    uint32_t              packets[2];
+    uint16_t              tcpFlagCnt[ARKIME_TCPFLAG_MAX];
+} ArkimeSessionCounts_t;
+
+LOCAL int                   sessionIndexOpen;
+LOCAL ArkimeSessionIndex_t  sessionIndex[ARKIME_MAX_PACKET_THREADS][SESSION_MAX];
+
+void arkime_session_save(ArkimeSession_t *session);
+LOCAL gboolean arkime_session_writer_ready(ArkimeSession_t *session, guint len);
+
 typedef struct arkimesescmd {
-    struct arkimesescmd *cmd_next, *cmd_prev;
+    struct arkimesescmd *cmd_next;
 
     ArkimeSession_t *session;
     ArkimeSesCmd     cmd;
@@ -39,13 +98,21 @@ typedef struct arkimesescmd {
     ArkimeCmd_func   func;
 } ArkimeSesCmd_t;
 
+/* Commands for a packet thread from any thread.  Producers push a chain of
+ * commands onto pushed with one CAS, the packet thread takes everything at
+ * once and reverses it onto its own FIFO list, so neither side locks.
+ */
 typedef struct {
-    struct arkimesescmd *cmd_next, *cmd_prev;
-    int                  cmd_count;
-    ARKIME_LOCK_EXTERN(lock);
-} ArkimeSesCmdHead_t;
+    ArkimeSesCmd_t      *pushed;
+    int                  count;     // Pushed and not yet run
+    ArkimeSesCmd_t      *head;      // Oldest first, only touched by the packet thread
+} __attribute__ ((aligned(64))) ArkimeSesCmdQ_t;
+
+// Run at least MIN commands per call, more as the backlog grows
+#define SESSION_CMD_MIN 50
+#define SESSION_CMD_MAX 2000
 
-LOCAL ArkimeSesCmdHead_t   sessionCmds[ARKIME_MAX_PACKET_THREADS];
+LOCAL ArkimeSesCmdQ_t      sessionCmds[ARKIME_MAX_PACKET_THREADS];
 
 struct {
     GHashTable  *old;
@@ -209,7 +276,216 @@ LOCAL int arkime_session_cmp(const void *keyv, const ArkimeSession_t *session)
     return memcmp(keyv, session->sessionId, MIN(((uint8_t *)keyv)[0], session->sessionId[0])) == 0;
 }
 /******************************************************************************/
-void arkime_session_add_cmd(ArkimeSession_t *session, ArkimeSesCmd sesCmd, gpointer uw1, gpointer uw2, ArkimeCmd_func func)
+// Bitmask of the slots in a group whose tag matches
+LOCAL inline uint32_t arkime_session_index_match(const uint8_t *tags, uint8_t tag)
+{
+#if defined(__SSE2__)
+    const __m128i t = _mm_loadu_si128((const __m128i *)tags);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(t, _mm_set1_epi8(tag)));
+#elif defined(__ARM_NEON)
+    static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8(tags), vdupq_n_u8(tag)), vld1q_u8(bits));
+    return vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8);
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < SI_GROUP; i++) {
+        if (tags[i] == tag)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+/******************************************************************************/
+// The session hash is also used to pick the packet thread, so mix it before using the low bits
+LOCAL inline uint32_t arkime_session_index_mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+/******************************************************************************/
+LOCAL void arkime_session_index_table_alloc(ArkimeSessionTable_t *table, uint32_t groups)
+{
+    table->groups = malloc(groups * sizeof(ArkimeSessionGroup_t));
+    for (uint32_t g = 0; g < groups; g++) {
+        memset(table->groups[g].tags, SI_EMPTY, SI_GROUP);
+    }
+    table->mask = groups - 1;
+    table->used = 0;
+}
+/******************************************************************************/
+LOCAL ArkimeSession_t *arkime_session_index_table_find(ArkimeSessionTable_t *table, uint32_t h, const uint8_t *key, const uint8_t *sessionId, uint32_t *pos)
+{
+    const uint8_t tag = h >> 25;
+    uint32_t      g = h & table->mask;
+
+    for (uint32_t probe = 1; probe <= table->mask + 1; probe++) {
+        ArkimeSessionGroup_t *group = &table->groups[g];
+        uint32_t match = arkime_session_index_match(group->tags, tag);
+        while (match) {
+            const int i = __builtin_ctz(match);
+            if (memcmp(group->keys[i], key, SI_KEY_LEN) == 0 &&
+                (sessionId[0] <= SI_KEY_LEN || memcmp(group->sessions[i]->sessionId, sessionId, sessionId[0]) == 0)) {
+                *pos = g * SI_GROUP + i;
+                return group->sessions[i];
+            }
+            match &= match - 1;
+        }
+
+        // Inserts never skip a group with an empty slot
+        if (arkime_session_index_match(group->tags, SI_EMPTY))
+            return NULL;
+
+        g = (g + probe) & table->mask;
+    }
+    return NULL;
+}
+/******************************************************************************/
+LOCAL void arkime_session_index_table_insert(ArkimeSessionTable_t *table, uint32_t h, const uint8_t *key, ArkimeSession_t *session)
+{
+    uint32_t g = h & table->mask;
+
+    for (uint32_t probe = 1; ; probe++) {
+        ArkimeSessionGroup_t *group = &table->groups[g];
+        uint32_t avail = arkime_session_index_match(group->tags, SI_EMPTY) | arkime_session_index_match(group->tags, SI_DELETED);
+        if (avail) {
+            const int i = __builtin_ctz(avail);
+            if (group->tags[i] == SI_EMPTY)
+                table->used++;
+            group->tags[i] = h >> 25;
+            memcpy(group->keys[i], key, SI_KEY_LEN);
+            group->sessions[i] = session;
+            return;
+        }
+        g = (g + probe) & table->mask;
+    }
+}
+/******************************************************************************/
+LOCAL void arkime_session_index_table_delete(ArkimeSessionTable_t *table, uint32_t pos)
+{
+    ArkimeSessionGroup_t *group = &table->groups[pos / SI_GROUP];
+
+    // If the group still has an empty slot no probe ever went past it, so the slot can be empty again
+    if (arkime_session_index_match(group->tags, SI_EMPTY)) {
+        group->tags[pos % SI_GROUP] = SI_EMPTY;
+        table->used--;
+    } else {
+        group->tags[pos % SI_GROUP] = SI_DELETED;
+    }
+}
+/******************************************************************************/
+LOCAL inline void arkime_session_index_key(const uint8_t *sessionId, uint8_t *key)
+{
+    if (sessionId[0] >= SI_KEY_LEN) {
+        memcpy(key, sessionId, SI_KEY_LEN);
+    } else {
+        memcpy(key, sessionId, sessionId[0]);
+        memset(key + sessionId[0], 0, SI_KEY_LEN - sessionId[0]);
+    }
+}
+/******************************************************************************/
+LOCAL void arkime_session_index_migrate(ArkimeSessionIndex_t *index, int num)
+{
+    while (num-- > 0 && index->old.groups) {
+        ArkimeSessionGroup_t *group = &index->old.groups[index->migrated];
+        for (int i = 0; i < SI_GROUP; i++) {
+            if (group->tags[i] & 0x80)
+                continue;
+            ArkimeSession_t *session = group->sessions[i];
+            arkime_session_index_table_insert(&index->cur, arkime_session_index_mix(session->h_hash), group->keys[i], session);
+
+            // Deleted and not empty so lookups of entries not migrated yet still probe past
+            group->tags[i] = SI_DELETED;
+        }
+
+        index->migrated++;
+        if (index->migrated > index->old.mask) {
+            free(index->old.groups);
+            index->old.groups = NULL;
+        }
+    }
+}
+/******************************************************************************/
+LOCAL ArkimeSession_t *arkime_session_index_find(ArkimeSessionIndex_t *index, uint32_t hash, const uint8_t *sessionId, uint32_t *pos, int *inOld)
+{
+    uint8_t          key[SI_KEY_LEN];
+    const uint32_t   h = arkime_session_index_mix(hash);
+    ArkimeSession_t *session;
+
+    arkime_session_index_key(sessionId, key);
+
+    *inOld = 0;
+    session = arkime_session_index_table_find(&index->cur, h, key, sessionId, pos);
+    if (session || !index->old.groups)
+        return session;
+
+    *inOld = 1;
+    return arkime_session_index_table_find(&index->old, h, key, sessionId, pos);
+}
+/******************************************************************************/
+LOCAL void arkime_session_index_add(ArkimeSessionIndex_t *index, ArkimeSession_t *session)
+{
+    uint8_t key[SI_KEY_LEN];
+
+    if (index->old.groups) {
+        arkime_session_index_migrate(index, SI_MIGRATE);
+    } else if (index->cur.used + 1 > (index->cur.mask + 1) * SI_GROUP / 8 * 7) {
+        // Double if more then half live, otherwise just rehash the same size to clear out deleted slots
+        uint32_t groups = index->cur.mask + 1;
+        if (index->count * 2 > groups * SI_GROUP)
+            groups *= 2;
+
+        index->old = index->cur;
+        index->migrated = 0;
+        arkime_session_index_table_alloc(&index->cur, groups);
+        arkime_session_index_migrate(index, SI_MIGRATE);
+    }
+
+    arkime_session_index_key(session->sessionId, key);
+    arkime_session_index_table_insert(&index->cur, arkime_session_index_mix(session->h_hash), key, session);
+    session->h_bucket = 1;
+    index->count++;
+}
+/******************************************************************************/
+LOCAL void arkime_session_index_remove(ArkimeSessionIndex_t *index, ArkimeSession_t *session)
+{
+    uint32_t pos;
+    int      inOld;
+
+    if (arkime_session_index_find(index, session->h_hash, session->sessionId, &pos, &inOld) != session)
+        return;
+
+    arkime_session_index_table_delete(inOld ? &index->old : &index->cur, pos);
+    session->h_bucket = 0;
+    index->count--;
+}
+/******************************************************************************/
+LOCAL void arkime_session_index_save_all(ArkimeSessionIndex_t *index)
+{
+    ArkimeSessionTable_t *tables[2] = {&index->cur, &index->old};
+
+    for (int t = 0; t < 2; t++) {
+        ArkimeSessionTable_t *table = tables[t];
+        if (!table->groups)
+            continue;
+        for (uint32_t g = 0; g <= table->mask; g++) {
+            ArkimeSessionGroup_t *group = &table->groups[g];
+            for (int i = 0; i < SI_GROUP; i++) {
+                if (group->tags[i] & 0x80)
+                    continue;
+                group->tags[i] = SI_DELETED;
+                group->sessions[i]->h_bucket = 0;
+                index->count--;
+                arkime_session_save(group->sessions[i]);
+            }
+        }
+    }
+}
+/******************************************************************************/
+LOCAL ArkimeSesCmd_t *arkime_session_cmd_alloc(ArkimeSession_t *session, ArkimeSesCmd sesCmd, gpointer uw1, gpointer uw2, ArkimeCmd_func func)
 {
     ArkimeSesCmd_t *cmd = ARKIME_TYPE_ALLOC(ArkimeSesCmd_t);
     cmd->cmd = sesCmd;
@@ -217,10 +493,62 @@ void arkime_session_add_cmd(ArkimeSession_t *session, ArkimeSesCmd sesCmd, gpoin
     cmd->uw1 = uw1;
     cmd->uw2 = uw2;
     cmd->func = func;
-    ARKIME_LOCK(sessionCmds[session->thread].lock);
-    DLL_PUSH_TAIL(cmd_, &sessionCmds[session->thread], cmd);
-    arkime_packet_thread_wake(session->thread);
-    ARKIME_UNLOCK(sessionCmds[session->thread].lock);
+    return cmd;
+}
+/******************************************************************************/
+/* Push the chain first..last, which is newest first, and wake the packet thread
+ * if it had nothing pushed.
+ */
+LOCAL void arkime_session_cmd_push(int thread, ArkimeSesCmd_t *first, ArkimeSesCmd_t *last, int num)
+{
+    ArkimeSesCmdQ_t *q = &sessionCmds[thread];
+    ArkimeSesCmd_t  *head;
+
+    __sync_add_and_fetch(&q->count, num);
+    do {
+        head = q->pushed;
+        last->cmd_next = head;
+    } while (!__sync_bool_compare_and_swap(&q->pushed, head, first));
+
+    if (!head)
+        arkime_packet_thread_wake(thread);
+}
+/******************************************************************************/
+void arkime_session_add_cmd(ArkimeSession_t *session, ArkimeSesCmd sesCmd, gpointer uw1, gpointer uw2, ArkimeCmd_func func)
+{
+    ArkimeSesCmd_t *cmd = arkime_session_cmd_alloc(session, sesCmd, uw1, uw2, func);
+    arkime_session_cmd_push(session->thread, cmd, cmd, 1);
+}
+/******************************************************************************/
+/* Same as calling arkime_session_add_cmd for each session, but each packet
+ * thread gets one push and at most one wake up for the whole batch.
+ */
+void arkime_session_add_cmds(ArkimeSession_t **sessions, int num, ArkimeSesCmd sesCmd, gpointer uw1, gpointer uw2, ArkimeCmd_func func)
+{
+    ArkimeSesCmd_t *first[ARKIME_MAX_PACKET_THREADS];
+    ArkimeSesCmd_t *last[ARKIME_MAX_PACKET_THREADS];
+    int             cnt[ARKIME_MAX_PACKET_THREADS];
+    int             t;
+
+    for (t = 0; t < config.packetThreads; t++) {
+        first[t] = NULL;
+        cnt[t] = 0;
+    }
+
+    for (int i = 0; i < num; i++) {
+        t = sessions[i]->thread;
+        ArkimeSesCmd_t *cmd = arkime_session_cmd_alloc(sessions[i], sesCmd, uw1, uw2, func);
+        cmd->cmd_next = first[t];
+        if (!first[t])
+            last[t] = cmd;
+        first[t] = cmd;
+        cnt[t]++;
+    }
+
+    for (t = 0; t < config.packetThreads; t++) {
+        if (cnt[t])
+            arkime_session_cmd_push(t, first[t], last[t], cnt[t]);
+    }
 }
 /******************************************************************************/
 void arkime_session_add_cmd_thread(int thread, gpointer uw1, gpointer uw2, ArkimeCmd_func func)
@@ -229,16 +557,8 @@ void arkime_session_add_cmd_thread(int thread, gpointer uw1, gpointer uw2, Arkim
 
     fakeSessions[thread].thread = thread;
 
-    ArkimeSesCmd_t *cmd = ARKIME_TYPE_ALLOC(ArkimeSesCmd_t);
-    cmd->cmd = ARKIME_SES_CMD_FUNC;
-    cmd->session = &fakeSessions[thread];
-    cmd->uw1 = uw1;
-    cmd->uw2 = uw2;
-    cmd->func = func;
-    ARKIME_LOCK(sessionCmds[thread].lock);
-    DLL_PUSH_TAIL(cmd_, &sessionCmds[thread], cmd);
-    arkime_packet_thread_wake(thread);
-    ARKIME_UNLOCK(sessionCmds[thread].lock);
+    ArkimeSesCmd_t *cmd = arkime_session_cmd_alloc(&fakeSessions[thread], ARKIME_SES_CMD_FUNC, uw1, uw2, func);
+    arkime_session_cmd_push(thread, cmd, cmd, 1);
 }
 /******************************************************************************/
 void arkime_session_add_protocol(ArkimeSession_t *session, const char *protocol)
@@ -270,16 +590,14 @@ void arkime_session_mark_for_close (ArkimeSession_t *session, SessionTypes ses)
     DLL_REMOVE(q_, &sessionsQ[session->thread][ses], session);
     DLL_PUSH_TAIL(q_, &closingQ[session->thread], session);
 
-    if (session->tcp_next) {
-        DLL_REMOVE(tcp_, &tcpWriteQ[session->thread], session);
-    }
+    arkime_wheel_remove(session->thread, &session->saveTimer);
+    arkime_wheel_add(session->thread, &session->timer, session->saveTime + 1);
 }
 /******************************************************************************/
 LOCAL void arkime_session_free (ArkimeSession_t *session)
 {
-    if (session->tcp_next) {
-        DLL_REMOVE(tcp_, &tcpWriteQ[session->thread], session);
-    }
+    arkime_wheel_remove(session->thread, &session->timer);
+    arkime_wheel_remove(session->thread, &session->saveTimer);
 
     g_array_free(session->filePosArray, TRUE);
     if (config.enablePacketLen) {
@@ -306,21 +624,27 @@ LOCAL void arkime_session_free (ArkimeSession_t *session)
     if (mProtocols[session->mProtocol].sFree)
         mProtocols[session->mProtocol].sFree(session);
 
-    if (session->pq)
+    if (session->pqItems)
         arkime_pq_free(session);
 
+    if (session->midSaveCounts)
+        ARKIME_TYPE_FREE(ArkimeSessionCounts_t, session->midSaveCounts);
+
     if (session->inStoppedSave) {
         ARKIME_LOCK(stoppedSessions[session->thread].lock);
         g_hash_table_remove(stoppedSessions[session->thread].new, session->sessionId);
         ARKIME_UNLOCK(stoppedSessions[session->thread].lock);
     }
 
-    ARKIME_TYPE_FREE(ArkimeSession_t, session);
+    ARKIME_POOL_FREE(ARKIME_POOL_SESSION, session);
 }
 /******************************************************************************/
 void arkime_session_save(ArkimeSession_t *session)
 {
-    if (session->h_next) {
+    if (sessionIndexOpen) {
+        if (session->h_bucket)
+            arkime_session_index_remove(&sessionIndex[session->thread][session->ses], session);
+    } else if (session->h_next) {
         HASH_REMOVE(h_, sessions[session->thread][session->ses], session);
     }
 
@@ -343,11 +667,10 @@ void arkime_session_save(ArkimeSession_t *session)
     if (pluginsCbs & ARKIME_PLUGIN_PRE_SAVE)
         arkime_plugins_cb_pre_save(session, TRUE);
 
-    if (session->tcp_next) {
-        DLL_REMOVE(tcp_, &tcpWriteQ[session->thread], session);
-    }
+    arkime_wheel_remove(session->thread, &session->timer);
+    arkime_wheel_remove(session->thread, &session->saveTimer);
 
-    if (session->outstandingQueries > 0) {
+    if (session->outstandingQueries > 0 || !arkime_session_writer_ready(session, session->filePosArray->len)) {
         session->needSave = 1;
         needSave[session->thread]++;
         return;
@@ -358,8 +681,161 @@ void arkime_session_save(ArkimeSession_t *session)
     arkime_session_free(session);
 }
 /******************************************************************************/
+LOCAL void arkime_session_counts_get(const ArkimeSession_t *session, ArkimeSessionCounts_t *counts)
+{
+    counts->lastPacket = session->lastPacket;
+    memcpy(counts->bytes, session->bytes, sizeof(counts->bytes));
+    memcpy(counts->databytes, session->databytes, sizeof(counts->databytes));
+    memcpy(counts->packets, session->packets, sizeof(counts->packets));
+    memcpy(counts->tcpFlagCnt, session->tcpFlagCnt, sizeof(counts->tcpFlagCnt));
+}
+/******************************************************************************/
+LOCAL void arkime_session_counts_set(ArkimeSession_t *session, const ArkimeSessionCounts_t *counts)
+{
+    session->lastPacket = counts->lastPacket;
+    memcpy(session->bytes, counts->bytes, sizeof(counts->bytes));
+    memcpy(session->databytes, counts->databytes, sizeof(counts->databytes));
+    memcpy(session->packets, counts->packets, sizeof(counts->packets));
+    memcpy(session->tcpFlagCnt, counts->tcpFlagCnt, sizeof(counts->tcpFlagCnt));
+}
+/******************************************************************************/
+/* Save the first len packet positions, positions added while waiting on the
+ * writer are moved to the next save.
+ */
+LOCAL void arkime_session_mid_save_finish(ArkimeSession_t *session, guint len)
+{
+    GArray  *restPos = NULL;
+    GArray  *restLen = NULL;
+    uint32_t fileNum = session->lastFileNum;
+    guint    i, files = 0;
+
+    if (len < session->filePosArray->len) {
+        guint rest = session->filePosArray->len - len;
+        restPos = g_array_sized_new(FALSE, FALSE, sizeof(int64_t), rest);
+        g_array_append_vals(restPos, &g_array_index(session->filePosArray, int64_t, len), rest);
+        g_array_set_size(session->filePosArray, len);
+        if (config.enablePacketLen) {
+            restLen = g_array_sized_new(FALSE, FALSE, sizeof(uint16_t), rest);
+            g_array_append_vals(restLen, &g_array_index(session->fileLenArray, uint16_t, len), rest);
+            g_array_set_size(session->fileLenArray, len);
+        }
+
+        // fileNumArray has an entry for each file marker
+        for (i = 0; i < len; i++) {
+            if (g_array_index(session->filePosArray, int64_t, i) < 0) {
+                fileNum = -g_array_index(session->filePosArray, int64_t, i);
+                files++;
+            }
+        }
+        g_array_set_size(session->fileNumArray, files);
+    }
+
+    // Save the counts from when the mid save started, anything newer goes with the leftover positions
+    ArkimeSessionCounts_t *counts = session->midSaveCounts;
+    ArkimeSessionCounts_t  current;
+    if (counts) {
+        arkime_session_counts_get(session, &current);
+        arkime_session_counts_set(session, counts);
+    }
+
+    arkime_rules_run_before_save(session, 0);
+    arkime_db_save_session(session, FALSE);
+    g_array_set_size(session->filePosArray, 0);
+    if (config.enablePacketLen) {
+        g_array_set_size(session->fileLenArray, 0);
+    }
+    g_array_set_size(session->fileNumArray, 0);
+    session->lastFileNum = 0;
+
+    if (restPos) {
+        for (i = 0; i < restPos->len; i++) {
+            int64_t  pos = g_array_index(restPos, int64_t, i);
+            uint16_t plen = 0;
+
+            if (pos < 0)
+                fileNum = -pos;
+
+            if (session->lastFileNum != fileNum) {
+                session->lastFileNum = fileNum;
+                g_array_append_val(session->fileNumArray, fileNum);
+                int64_t mark = -1LL * fileNum;
+                g_array_append_val(session->filePosArray, mark);
+                if (config.enablePacketLen)
+                    g_array_append_val(session->fileLenArray, plen);
+            }
+
+            if (pos < 0)
+                continue;
+
+            g_array_append_val(session->filePosArray, pos);
+            if (config.enablePacketLen) {
+                plen = g_array_index(restLen, uint16_t, i);
+                g_array_append_val(session->fileLenArray, plen);
+            }
+        }
+        g_array_free(restPos, TRUE);
+        if (restLen)
+            g_array_free(restLen, TRUE);
+    }
+
+    if (counts) {
+        // Keep what arrived while waiting for the next save
+        for (i = 0; i < 2; i++) {
+            current.bytes[i] -= counts->bytes[i];
+            current.databytes[i] -= counts->databytes[i];
+            current.packets[i] -= counts->packets[i];
+        }
+        for (i = 0; i < ARKIME_TCPFLAG_MAX; i++)
+            current.tcpFlagCnt[i] -= counts->tcpFlagCnt[i];
+        arkime_session_counts_set(session, &current);
+        ARKIME_TYPE_FREE(ArkimeSessionCounts_t, counts);
+        session->midSaveCounts = NULL;
+    } else {
+        session->bytes[0] = 0;
+        session->bytes[1] = 0;
+        session->databytes[0] = 0;
+        session->databytes[1] = 0;
+        session->packets[0] = 0;
+        session->packets[1] = 0;
+        memset(session->tcpFlagCnt, 0, sizeof(session->tcpFlagCnt));
+    }
+    session->midSave = 0;
+    session->ackTime = 0;
+    session->synTime = 0;
+}
+/******************************************************************************/
+// The writer has the positions ready, finish the mid save and/or final save
+LOCAL void arkime_session_writer_cb(ArkimeSession_t *session, gpointer uw1, gpointer UNUSED(uw2))
+{
+    if (session->midSaveWait) {
+        guint len = (long)uw1;
+        if (arkime_session_writer_ready(session, len)) {
+            session->midSaveWait = 0;
+            arkime_session_mid_save_finish(session, len);
+        }
+    }
+    arkime_session_decr_outstanding(session);
+}
+/******************************************************************************/
+/* The writer may need to fix up packet positions before they can be saved,
+ * returns FALSE and holds an outstanding query until arkime_session_writer_cb
+ * if they aren't ready.
+ */
+LOCAL gboolean arkime_session_writer_ready(ArkimeSession_t *session, guint len)
+{
+    if (!arkime_writer_resolve || arkime_writer_resolve(session, len, arkime_session_writer_cb))
+        return TRUE;
+
+    session->outstandingQueries++;
+    return FALSE;
+}
+/******************************************************************************/
 void arkime_session_mid_save(ArkimeSession_t *session, uint32_t tv_sec)
 {
+    // Already saving, waiting on the writer
+    if (session->midSaveWait)
+        return;
+
     if (session->parserInfo) {
         int i;
         for (i = 0; i < session->parserNum; i++) {
@@ -375,40 +851,34 @@ void arkime_session_mid_save(ArkimeSession_t *session, uint32_t tv_sec)
         session->rootId = (void *)1L;
     }
 
-    arkime_rules_run_before_save(session, 0);
-    arkime_db_save_session(session, FALSE);
-    g_array_set_size(session->filePosArray, 0);
-    if (config.enablePacketLen) {
-        g_array_set_size(session->fileLenArray, 0);
+    // Don't change change saveTime if already closing
+    if (!session->closingQ) {
+        session->saveTime = tv_sec + config.tcpSaveTimeout;
     }
-    g_array_set_size(session->fileNumArray, 0);
-    session->lastFileNum = 0;
 
-    if (session->tcp_next) {
-        DLL_MOVE_TAIL(tcp_, &tcpWriteQ[session->thread], session);
+    if (session->saveTimer.tw_slot) {
+        arkime_wheel_add(session->thread, &session->saveTimer, session->saveTime + 1);
     }
 
-    // Don't change change saveTime if already closing
-    if (!session->closingQ) {
-        session->saveTime = tv_sec + config.tcpSaveTimeout;
+    // Don't hold up the packet thread, the rest of the save happens once the writer is ready
+    guint len = session->filePosArray->len;
+    if (!arkime_session_writer_ready(session, len)) {
+        session->midSaveCounts = ARKIME_TYPE_ALLOC(ArkimeSessionCounts_t);
+        arkime_session_counts_get(session, session->midSaveCounts);
+        session->midSaveWait = 1;
+        return;
     }
 
-    session->bytes[0] = 0;
-    session->bytes[1] = 0;
-    session->databytes[0] = 0;
-    session->databytes[1] = 0;
-    session->packets[0] = 0;
-    session->packets[1] = 0;
-    session->midSave = 0;
-    session->ackTime = 0;
-    session->synTime = 0;
-    memset(session->tcpFlagCnt, 0, sizeof(session->tcpFlagCnt));
+    arkime_session_mid_save_finish(session, len);
 }
 /******************************************************************************/
 gboolean arkime_session_decr_outstanding(ArkimeSession_t *session)
 {
     session->outstandingQueries--;
     if (session->needSave && session->outstandingQueries == 0) {
+        if (!arkime_session_writer_ready(session, session->filePosArray->len))
+            return TRUE;
+
         needSave[session->thread]--;
         session->needSave = 0; /* Stop endless loop if plugins add tags */
 
@@ -436,13 +906,19 @@ int arkime_session_cmd_outstanding()
     int count = 0;
     int t;
     for (t = 0; t < config.packetThreads; t++) {
-        if (DLL_COUNT(cmd_, &sessionCmds[t]))
+        const int cnt = sessionCmds[t].count;
+        if (cnt)
             arkime_packet_thread_wake(t);
-        count += DLL_COUNT(cmd_, &sessionCmds[t]);
+        count += cnt;
     }
     return count;
 }
 /******************************************************************************/
+int arkime_session_cmd_queue_length(int thread)
+{
+    return sessionCmds[thread].count;
+}
+/******************************************************************************/
 int arkime_session_need_save_outstanding()
 {
     int count = 0;
@@ -614,6 +1090,12 @@ ArkimeSession_t *arkime_session_find(int ses, uint8_t *sessionId)
     uint32_t hash = arkime_session_hash(sessionId);
     int      thread = hash % config.packetThreads;
 
+    if (sessionIndexOpen) {
+        uint32_t pos;
+        int      inOld;
+        return arkime_session_index_find(&sessionIndex[thread][ses], hash, sessionId, &pos, &inOld);
+    }
+
     HASH_FIND_HASH(h_, sessions[thread][ses], hash, sessionId, session);
     return session;
 }
@@ -630,7 +1112,13 @@ ArkimeSession_t *arkime_session_find_or_create(int mProtocol, uint32_t hash, uin
     int          thread = hash % config.packetThreads;
     SessionTypes ses = mProtocols[mProtocol].ses;
 
-    HASH_FIND_HASH(h_, sessions[thread][ses], hash, sessionId, session);
+    if (sessionIndexOpen) {
+        uint32_t pos;
+        int      inOld;
+        session = arkime_session_index_find(&sessionIndex[thread][ses], hash, sessionId, &pos, &inOld);
+    } else {
+        HASH_FIND_HASH(h_, sessions[thread][ses], hash, sessionId, session);
+    }
 
     if (session) {
         if (!session->closingQ) {
@@ -641,17 +1129,27 @@ ArkimeSession_t *arkime_session_find_or_create(int mProtocol, uint32_t hash, uin
     }
     *isNew = 1;
 
-    session = ARKIME_TYPE_ALLOC0(ArkimeSession_t);
+    session = ARKIME_POOL_ALLOC0(ARKIME_POOL_SESSION);
     session->ses = ses;
     session->mProtocol = mProtocol;
     session->stopSaving = 0xffff;
 
     memcpy(session->sessionId, sessionId, sessionId[0]);
 
-    HASH_ADD_HASH(h_, sessions[thread][ses], hash, sessionId, session);
+    if (sessionIndexOpen) {
+        session->h_hash = hash;
+        arkime_session_index_add(&sessionIndex[thread][ses], session);
+    } else {
+        HASH_ADD_HASH(h_, sessions[thread][ses], hash, sessionId, session);
+    }
     DLL_PUSH_TAIL(q_, &sessionsQ[thread][ses], session);
 
-    if (HASH_BUCKET_COUNT(h_, sessions[thread][ses], hash) > 15) {
+    // Pushed back each time it fires until the session is really idle, so nothing is done per packet
+    session->timer.type = ARKIME_WHEEL_SESSION;
+    session->saveTimer.type = ARKIME_WHEEL_SESSION_SAVE;
+    arkime_wheel_add(thread, &session->timer, lastPacketSecs[thread] + config.timeouts[ses] + 1);
+
+    if (!sessionIndexOpen && HASH_BUCKET_COUNT(h_, sessions[thread][ses], hash) > 15) {
         struct timeval  currentTime;
         static uint32_t lastError;
 
@@ -695,7 +1193,10 @@ uint32_t arkime_session_monitoring()
 
     for (t = 0; t < config.packetThreads; t++) {
         for (s = 0; s < SESSION_MAX; s++) {
-            count += HASH_COUNT(h_, sessions[t][s]);
+            if (sessionIndexOpen)
+                count += sessionIndex[t][s].count;
+            else
+                count += HASH_COUNT(h_, sessions[t][s]);
         }
     }
     return count;
@@ -703,63 +1204,84 @@ uint32_t arkime_session_monitoring()
 /******************************************************************************/
 void arkime_session_process_commands(int thread)
 {
-    // Commands
-    int count;
-    for (count = 0; count < 50; count++) {
-        ArkimeSesCmd_t *cmd = 0;
-        ARKIME_LOCK(sessionCmds[thread].lock);
-        DLL_POP_HEAD(cmd_, &sessionCmds[thread], cmd);
-        ARKIME_UNLOCK(sessionCmds[thread].lock);
-        if (!cmd)
-            break;
-
-        switch (cmd->cmd) {
-        case ARKIME_SES_CMD_FUNC:
-            cmd->func(cmd->session, cmd->uw1, cmd->uw2);
-            break;
-        default:
-            LOG ("Unknown cmd %d", cmd->cmd);
+    // Commands, take everything pushed when our list runs out
+    ArkimeSesCmdQ_t *q = &sessionCmds[thread];
+    if (!q->head && q->pushed) {
+        ArkimeSesCmd_t *cmd = __sync_lock_test_and_set(&q->pushed, NULL);
+        while (cmd) {
+            ArkimeSesCmd_t *next = cmd->cmd_next;
+            cmd->cmd_next = q->head;
+            q->head = cmd;
+            cmd = next;
         }
-        ARKIME_TYPE_FREE(ArkimeSesCmd_t, cmd);
     }
 
-    // Closing Q
-    for (count = 0; count < 10; count++) {
-        ArkimeSession_t *session = DLL_PEEK_HEAD(q_, &closingQ[thread]);
-
-        if (session && session->saveTime < (uint64_t)lastPacketSecs[thread]) {
-            arkime_session_save(session);
-        } else {
-            break;
+    int count;
+    if (q->head) {
+        const int max = MIN(MAX(SESSION_CMD_MIN, q->count / 4), SESSION_CMD_MAX);
+        for (count = 0; count < max && q->head; count++) {
+            ArkimeSesCmd_t *cmd = q->head;
+            q->head = cmd->cmd_next;
+
+            switch (cmd->cmd) {
+            case ARKIME_SES_CMD_FUNC:
+                cmd->func(cmd->session, cmd->uw1, cmd->uw2);
+                break;
+            default:
+                LOG ("Unknown cmd %d", cmd->cmd);
+            }
+            ARKIME_TYPE_FREE(ArkimeSesCmd_t, cmd);
         }
+        __sync_sub_and_fetch(&q->count, count);
     }
 
-    // Sessions Idle Long Time
+    // Closing, idle and tcp mid save timers
+    arkime_wheel_run(thread, lastPacketSecs[thread], SESSION_WHEEL_MAX);
+
+    // Too many sessions, save the least recently used
     int ses;
     for (ses = 0; ses < SESSION_MAX; ses++) {
         for (count = 0; count < 10; count++) {
             ArkimeSession_t *session = DLL_PEEK_HEAD(q_, &sessionsQ[thread][ses]);
 
-            if (session && (DLL_COUNT(q_, &sessionsQ[thread][ses]) > (int)config.maxStreams[ses] ||
-                            ((uint64_t)session->lastPacket.tv_sec + config.timeouts[ses] < (uint64_t)lastPacketSecs[thread]))) {
-
+            if (session && DLL_COUNT(q_, &sessionsQ[thread][ses]) > (int)config.maxStreams[ses]) {
                 arkime_session_save(session);
             } else {
                 break;
             }
         }
     }
+}
+/******************************************************************************/
+/* The idle timer is only moved when it fires, so check if the session really
+ * is idle or closed and if not push it back out.
+ */
+LOCAL void arkime_session_timer_cb(ArkimeWheelEntry_t *entry, int thread, uint32_t now)
+{
+    ArkimeSession_t *session = SESSION_FROM_ENTRY(entry, timer);
+    uint32_t         expire;
 
-    // TCP Sessions Open Long Time
-    for (count = 0; count < 50; count++) {
-        ArkimeSession_t *session = DLL_PEEK_HEAD(tcp_, &tcpWriteQ[thread]);
+    if (session->closingQ)
+        expire = session->saveTime + 1;
+    else
+        expire = session->lastPacket.tv_sec + config.timeouts[session->ses] + 1;
 
-        if (session && (uint64_t)session->saveTime < (uint64_t)lastPacketSecs[thread]) {
-            arkime_session_mid_save(session, lastPacketSecs[thread]);
-        } else {
-            break;
-        }
+    if ((int32_t)(expire - now) > 0) {
+        arkime_wheel_add(thread, entry, expire);
+        return;
+    }
+
+    arkime_session_save(session);
+}
+/******************************************************************************/
+LOCAL void arkime_session_save_timer_cb(ArkimeWheelEntry_t *entry, int thread, uint32_t now)
+{
+    ArkimeSession_t *session = SESSION_FROM_ENTRY(entry, saveTimer);
+
+    if ((int32_t)(session->saveTime + 1 - now) <= 0) {
+        arkime_session_mid_save(session, now);
     }
+    arkime_wheel_add(thread, entry, session->saveTime + 1);
 }
 
 /******************************************************************************/
@@ -804,6 +1326,19 @@ void arkime_session_init()
 
     tcpClosingTimeout = arkime_config_int(NULL, "tcpClosingTimeout", 5, 1, 255);
 
+    arkime_wheel_register(ARKIME_WHEEL_SESSION, arkime_session_timer_cb);
+    arkime_wheel_register(ARKIME_WHEEL_SESSION_SAVE, arkime_session_save_timer_cb);
+
+    char *strIndex = arkime_config_str(NULL, "sessionIndex", "chained");
+    if (strcmp(strIndex, "chained") == 0) {
+        sessionIndexOpen = 0;
+    } else if (strcmp(strIndex, "open") == 0) {
+        sessionIndexOpen = 1;
+    } else {
+        CONFIGEXIT("Unknown sessionIndex '%s'", strIndex);
+    }
+    g_free(strIndex);
+
     int primes[SESSION_MAX];
     int s;
     for (s = 0; s < SESSION_MAX; s++) {
@@ -816,14 +1351,14 @@ void arkime_session_init()
     int t;
     for (t = 0; t < config.packetThreads; t++) {
         for (s = 0; s < SESSION_MAX; s++) {
-            HASHP_INIT(h_, sessions[t][s], primes[s], arkime_session_hash, (HASH_CMP_FUNC)arkime_session_cmp);
+            if (sessionIndexOpen)
+                arkime_session_index_table_alloc(&sessionIndex[t][s].cur, SI_MIN_GROUPS);
+            else
+                HASHP_INIT(h_, sessions[t][s], primes[s], arkime_session_hash, (HASH_CMP_FUNC)arkime_session_cmp);
             DLL_INIT(q_, &sessionsQ[t][s]);
         }
 
-        DLL_INIT(tcp_, &tcpWriteQ[t]);
         DLL_INIT(q_, &closingQ[t]);
-        DLL_INIT(cmd_, &sessionCmds[t]);
-        ARKIME_LOCK_INIT(sessionCmds[t].lock);
 
 
         ARKIME_LOCK_INIT(stoppedSessions[t].lock);
@@ -847,6 +1382,10 @@ LOCAL void arkime_session_flush_close(ArkimeSession_t *session, gpointer UNUSED(
     int i;
 
     for (i = 0; i < SESSION_MAX; i++) {
+        if (sessionIndexOpen) {
+            arkime_session_index_save_all(&sessionIndex[thread][i]);
+            continue;
+        }
         HASH_FORALL_POP_HEAD2(h_, sessions[thread][i], session) {
             arkime_session_save(session);
         }
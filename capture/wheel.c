@@ -0,0 +1,286 @@
+/* wheel.c  -- per packet thread hierarchical timing wheel
+ *
+ * Session idle timeouts, closing sessions, tcp mid saves and the pq.c timers
+ * all live on their packet thread's wheel, so nothing here is locked.  Time
+ * is lastPacketSecs, one tick per second.
+ *
+ * Level 0 has 256 one second slots, levels 1 to 3 have 64 slots each covering
+ * 256, 16384 and 1048576 seconds, so the wheel spans 2^26 seconds and
+ * anything further out sits in the last slot and is put back when it comes
+ * around.  Adding, moving and removing an entry is O(1).  When time moves
+ * forward the expired level 0 slots are moved to the due list and a higher
+ * level slot is redistributed each time the level below wraps, empty level 0
+ * slots are skipped with a bitmap.  Callbacks are run from the due list at
+ * most max per call, so a big jump in time is worked off over several calls.
+ *
+ * Entries are embedded in the owning struct, the callback for an entry is
+ * picked by its type and is passed lastPacketSecs.
+ *
+ * lastPacketSecs can go backwards, reading an older pcap after a newer one,
+ * but the wheel's own time only moves forward.  It is moved by how far
+ * lastPacketSecs moved forward since the last run, and expire times are
+ * converted relative to that run, so a jump back just delays things the way
+ * comparing against lastPacketSecs would.  Entries added with a time already
+ * behind the wheel fire right away, callbacks must check against the
+ * lastPacketSecs they are passed and add themselves back if not done.
+ *
+ * Copyright 2024 All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "arkime.h"
+
+/******************************************************************************/
+extern ArkimeConfig_t        config;
+
+#define WHEEL_L0_BITS       8
+#define WHEEL_L0_SIZE       (1 << WHEEL_L0_BITS)
+#define WHEEL_LN_BITS       6
+#define WHEEL_LN_SIZE       (1 << WHEEL_LN_BITS)
+#define WHEEL_LN            3
+#define WHEEL_SHIFT(l)      (WHEEL_L0_BITS + (l) * WHEEL_LN_BITS)
+#define WHEEL_SPAN          (1U << WHEEL_SHIFT(WHEEL_LN))
+
+typedef struct {
+    ArkimeWheelEntry_t *tw_next, *tw_prev;
+    int                 tw_count;
+} ArkimeWheelSlot_t;
+
+typedef struct {
+    ArkimeWheelSlot_t   l0[WHEEL_L0_SIZE];
+    ArkimeWheelSlot_t   ln[WHEEL_LN][WHEEL_LN_SIZE];
+    ArkimeWheelSlot_t   due;
+    uint64_t            l0Bits[4];
+    uint32_t            now;
+    uint32_t            last;       // lastPacketSecs at the last run, when the wheel was at now
+    uint32_t            count;      // Entries in the slots, not counting due
+} ArkimeWheel_t;
+
+LOCAL ArkimeWheel_t    *wheels[ARKIME_MAX_PACKET_THREADS];
+LOCAL ArkimeWheelCb     wheelCbs[ARKIME_WHEEL_MAX];
+
+/******************************************************************************/
+void arkime_wheel_register(ArkimeWheelType type, ArkimeWheelCb cb)
+{
+    wheelCbs[type] = cb;
+}
+/******************************************************************************/
+LOCAL void arkime_wheel_insert(ArkimeWheel_t *w, ArkimeWheelEntry_t *entry)
+{
+    ArkimeWheelSlot_t *slot;
+
+    if ((int32_t)(entry->expire - w->now) <= 0) {
+        DLL_PUSH_TAIL(tw_, &w->due, entry);
+        entry->tw_slot = &w->due;
+        return;
+    }
+
+    const uint32_t delta = entry->expire - w->now;
+    if (delta < WHEEL_L0_SIZE) {
+        const uint32_t i = entry->expire & (WHEEL_L0_SIZE - 1);
+        slot = &w->l0[i];
+        w->l0Bits[i / 64] |= 1ULL << (i % 64);
+    } else {
+        int l = 0;
+        while (l < WHEEL_LN - 1 && delta >= (1U << WHEEL_SHIFT(l + 1)))
+            l++;
+
+        // Past the end of the wheel, park in the last slot it can reach and redo it then
+        const uint32_t when = (delta >= WHEEL_SPAN) ? w->now + WHEEL_SPAN - 1 : entry->expire;
+        slot = &w->ln[l][(when >> WHEEL_SHIFT(l)) & (WHEEL_LN_SIZE - 1)];
+    }
+
+    DLL_PUSH_TAIL(tw_, slot, entry);
+    entry->tw_slot = slot;
+    w->count++;
+}
+/******************************************************************************/
+void arkime_wheel_remove(int thread, ArkimeWheelEntry_t *entry)
+{
+    ArkimeWheelSlot_t *slot = entry->tw_slot;
+    if (!slot)
+        return;
+
+    ArkimeWheel_t *w = wheels[thread];
+    DLL_REMOVE(tw_, slot, entry);
+    entry->tw_slot = NULL;
+
+    if (slot == &w->due)
+        return;
+
+    w->count--;
+    if (slot >= w->l0 && slot < w->l0 + WHEEL_L0_SIZE && slot->tw_count == 0) {
+        const uint32_t i = slot - w->l0;
+        w->l0Bits[i / 64] &= ~(1ULL << (i % 64));
+    }
+}
+/******************************************************************************/
+// expire is in lastPacketSecs time
+void arkime_wheel_add(int thread, ArkimeWheelEntry_t *entry, uint32_t expire)
+{
+    ArkimeWheel_t *w = wheels[thread];
+    const uint32_t wexpire = w->now + (int32_t)(expire - w->last);
+
+    if (entry->tw_slot) {
+        if (entry->expire == wexpire)
+            return;
+        arkime_wheel_remove(thread, entry);
+    }
+
+    entry->expire = wexpire;
+    arkime_wheel_insert(w, entry);
+}
+/******************************************************************************/
+LOCAL void arkime_wheel_redistribute(ArkimeWheel_t *w, ArkimeWheelSlot_t *slot)
+{
+    ArkimeWheelEntry_t *entry;
+
+    w->count -= slot->tw_count;
+    while (DLL_POP_HEAD(tw_, slot, entry)) {
+        arkime_wheel_insert(w, entry);
+    }
+}
+/******************************************************************************/
+LOCAL void arkime_wheel_expire_l0(ArkimeWheel_t *w, uint32_t i)
+{
+    ArkimeWheelSlot_t  *slot = &w->l0[i];
+    ArkimeWheelEntry_t *entry;
+
+    w->count -= slot->tw_count;
+    DLL_FOREACH(tw_, slot, entry) {
+        entry->tw_slot = &w->due;
+    }
+    DLL_PUSH_TAIL_DLL(tw_, &w->due, slot);
+    w->l0Bits[i / 64] &= ~(1ULL << (i % 64));
+}
+/******************************************************************************/
+// Next non empty level 0 slot at or after i, or WHEEL_L0_SIZE
+LOCAL uint32_t arkime_wheel_next_l0(const ArkimeWheel_t *w, uint32_t i)
+{
+    while (i < WHEEL_L0_SIZE) {
+        const uint64_t bits = w->l0Bits[i / 64] >> (i % 64);
+        if (bits)
+            return i + __builtin_ctzll(bits);
+        i = (i | 63) + 1;
+    }
+    return WHEEL_L0_SIZE;
+}
+/******************************************************************************/
+LOCAL void arkime_wheel_advance(ArkimeWheel_t *w, uint32_t now)
+{
+    if (w->count == 0) {
+        w->now = now;
+        return;
+    }
+
+    // Everything has expired, skip walking the wheel
+    if (now - w->now >= WHEEL_SPAN) {
+        for (uint32_t i = 0; i < WHEEL_L0_SIZE; i++) {
+            if (w->l0[i].tw_count)
+                arkime_wheel_expire_l0(w, i);
+        }
+        w->now = now;
+
+        // Pull everything off the higher levels first, they may land back in the same slots
+        ArkimeWheelSlot_t all;
+        DLL_INIT(tw_, &all);
+        for (int l = 0; l < WHEEL_LN; l++) {
+            for (int i = 0; i < WHEEL_LN_SIZE; i++) {
+                if (w->ln[l][i].tw_count)
+                    DLL_PUSH_TAIL_DLL(tw_, &all, &w->ln[l][i]);
+            }
+        }
+        arkime_wheel_redistribute(w, &all);
+        return;
+    }
+
+    while (w->now != now) {
+        uint32_t next = w->now + 1;
+
+        if (w->l0Bits[0] | w->l0Bits[1] | w->l0Bits[2] | w->l0Bits[3]) {
+            // Jump to the next level 0 slot with something in it, or where level 0 wraps
+            if (next & (WHEEL_L0_SIZE - 1)) {
+                const uint32_t i = arkime_wheel_next_l0(w, next & (WHEEL_L0_SIZE - 1));
+                next = (next & ~(WHEEL_L0_SIZE - 1)) + i;
+            }
+        } else {
+            // Level 0 is empty, jump to the next wrap that brings something down
+            uint32_t block = (w->now >> WHEEL_L0_BITS) + 1;
+            while ((block & (WHEEL_LN_SIZE - 1)) && w->ln[0][block & (WHEEL_LN_SIZE - 1)].tw_count == 0)
+                block++;
+            next = block << WHEEL_L0_BITS;
+        }
+
+        if ((int32_t)(next - now) > 0) {
+            w->now = now;
+            return;
+        }
+        w->now = next;
+
+        // Level 0 wrapped, bring down the next slot of each level that also wrapped
+        if ((next & (WHEEL_L0_SIZE - 1)) == 0) {
+            int l = 0;
+            while (l < WHEEL_LN - 1 && ((next >> WHEEL_SHIFT(l)) & (WHEEL_LN_SIZE - 1)) == 0)
+                l++;
+            for (; l >= 0; l--) {
+                arkime_wheel_redistribute(w, &w->ln[l][(next >> WHEEL_SHIFT(l)) & (WHEEL_LN_SIZE - 1)]);
+            }
+        }
+
+        const uint32_t i = next & (WHEEL_L0_SIZE - 1);
+        if (w->l0[i].tw_count)
+            arkime_wheel_expire_l0(w, i);
+
+        if (w->count == 0) {
+            w->now = now;
+            return;
+        }
+    }
+}
+/******************************************************************************/
+int arkime_wheel_run(int thread, uint32_t now, int max)
+{
+    ArkimeWheel_t *w = wheels[thread];
+
+    // Only forward moves of lastPacketSecs move the wheel
+    if ((int32_t)(now - w->last) > 0)
+        arkime_wheel_advance(w, w->now + (now - w->last));
+    w->last = now;
+
+    int cnt = 0;
+    ArkimeWheelEntry_t *entry;
+    while (cnt < max && DLL_POP_HEAD(tw_, &w->due, entry)) {
+        entry->tw_slot = NULL;
+        wheelCbs[entry->type](entry, thread, now);
+        cnt++;
+    }
+    return cnt;
+}
+/******************************************************************************/
+uint32_t arkime_wheel_count(int thread)
+{
+    return wheels[thread]->count + wheels[thread]->due.tw_count;
+}
+/******************************************************************************/
+void arkime_wheel_init()
+{
+    for (int t = 0; t < config.packetThreads; t++) {
+        ArkimeWheel_t *w = wheels[t] = g_new0(ArkimeWheel_t, 1);
+        for (int i = 0; i < WHEEL_L0_SIZE; i++)
+            DLL_INIT(tw_, &w->l0[i]);
+        for (int l = 0; l < WHEEL_LN; l++) {
+            for (int i = 0; i < WHEEL_LN_SIZE; i++)
+                DLL_INIT(tw_, &w->ln[l][i]);
+        }
+        DLL_INIT(tw_, &w->due);
+    }
+}
+/******************************************************************************/
+void arkime_wheel_exit()
+{
+    for (int t = 0; t < config.packetThreads; t++) {
+        g_free(wheels[t]);
+        wheels[t] = NULL;
+    }
+}
@@ -4,6 +4,27 @@
  * This writer just creates a file per packet thread and queues buffers
  * to be written to disk in a single output thread.
  *
+ * With pcapWriteMethod=simple-uring the output thread submits the page
+ * aligned buffers through io_uring instead, at explicit file offsets, so
+ * up to simpleUringDepth writes across all the open files are in flight
+ * at once. A file is only closed once all of its writes have completed.
+ *
+ * With localPcapIndex the packet positions are encoded on the packet thread,
+ * which also hands out where in the index file each session's entry goes, so
+ * the offsets can be saved with the session right away.  The encoded entries
+ * are queued to a separate index thread that does the disk io, writing runs
+ * of entries for the same index file with one pwritev.
+ *
+ * With simpleCompressionThreads the packet threads only copy records into
+ * uncompressed blocks, a pool of compression threads compresses each block on
+ * its own and appends them to the file in order. Since a block's compressed
+ * start isn't known when its packets are written, packet positions are saved
+ * as block numbers and turned into real positions when the session is saved.
+ *
+ * With simpleEncryptThreads the output thread splits the buffers it takes off
+ * the queue into chunks, which it and the encrypt threads encrypt in any order
+ * using the file offset for the aes-256-ctr counter, before writing in order.
+ *
  * Copyright 2012-2017 AOL Inc. All rights reserved.
  *
  * SPDX-License-Identifier: Apache-2.0
@@ -15,6 +36,7 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <zlib.h>
 #ifdef HAVE_ZSTD
 #include <zstd.h>
@@ -22,6 +44,13 @@
 #include <math.h>
 #include "openssl/rand.h"
 #include "openssl/evp.h"
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define ARKIME_SIMPLE_URING 1
+#endif
+#endif
 
 #ifndef O_NOATIME
 #define O_NOATIME 0
@@ -44,7 +73,6 @@ LOCAL  int                   simpleFreeOutputBuffers;
 
 // Information about the current file being written to, all items that are constant per file should be here
 typedef struct {
-    EVP_CIPHER_CTX      *cipher_ctx;
     uint64_t             pos;
     uint64_t             blockStart;
     uint64_t             packetBytesWritten;
@@ -52,7 +80,8 @@ typedef struct {
     uint32_t             posInBlock;
     uint32_t             id;
     int                  fd;
-    uint8_t              dek[256];
+    uint8_t              dek[256];  // xor key, or aes key in the first 32 bytes
+    uint8_t              iv[16];    // aes iv, the last 4 bytes are the block counter
     z_stream             z_strm;
     uint8_t              thread;
 #ifdef HAVE_ZSTD
@@ -61,6 +90,14 @@ typedef struct {
     ZSTD_inBuffer        zstd_in;
     uint64_t             zstd_completedBlockStart;
 #endif
+    uint64_t             writePos;  // file offset of the next buffer written
+    uint32_t             inflight;  // uring: buffers submitted but not completed
+    struct arkimesimple *closeInfo; // uring: closing buffer waiting on inflight buffers
+    struct arkimesimpleblocks *blocks; // compress: compressed block starts
+    struct arkimesimple *out;       // compress: compressed data not queued to write yet
+    struct arkimesimple *pending;   // compress: compressed blocks waiting on earlier blocks, by seq
+    uint32_t             crc;       // compress: gzip crc of everything so far
+    uint32_t             uncompressed; // compress: gzip isize
 } ArkimeSimpleFile_t;
 
 // Information about the current buffer being written to, there can be multiple buffers per file
@@ -71,6 +108,17 @@ typedef struct arkimesimple {
     ArkimeSimpleFile_t  *file;
     uint32_t             bufpos;  // Where in buf we are writing to
     uint8_t              closing; // This is the last block, close file when done
+    uint32_t             total;   // Bytes to write, bufpos rounded up for the last block
+    uint32_t             written; // uring: bytes written so far
+    uint64_t             offset;  // file offset of buf
+    uint64_t             start;   // When the write was submitted in usec, for latency
+    struct iovec         iov;     // uring: what is being written
+    uint32_t             seq;     // compress: block number in file
+    uint8_t              last;    // compress: last block of the file
+    uint8_t              flush;   // compress: queue the compressed data to write right away
+    uint8_t             *out;     // compress: compressed block
+    uint32_t             outlen;  // compress: compressed block length
+    uint32_t             crc;     // compress: gzip crc of block
 } ArkimeSimple_t;
 
 typedef struct {
@@ -96,11 +144,76 @@ LOCAL struct timeval         lastSave[ARKIME_MAX_PACKET_THREADS];
 LOCAL struct timeval         fileAge[ARKIME_MAX_PACKET_THREADS];
 LOCAL uint32_t               firstPacket[ARKIME_MAX_PACKET_THREADS];
 
-#define INDEX_FILES_CACHE_SIZE (ARKIME_MAX_PACKET_THREADS-1)
-struct {
+// log2 usec buckets of how long each buffer took to write, only the output thread updates
+#define SIMPLE_LATENCY_BUCKETS 24
+LOCAL uint64_t               writeLatency[SIMPLE_LATENCY_BUCKETS];
+LOCAL uint64_t               writeLatencyTotal;
+LOCAL uint32_t               writeLatencyLast;
+
+#ifdef ARKIME_SIMPLE_URING
+LOCAL uint32_t               uringInflight;
+#endif
+
+// Where the next entry goes in each index file, only the owning packet thread uses
+typedef struct {
+    int64_t              fileNum;
+    uint64_t             offset;
+    uint32_t             pending;   // entries queued but not written yet, index thread decrements
+    uint32_t             lastUsed;
+} ArkimeSimpleIndexFile_t;
+
+typedef struct arkimesimpleindex {
+    struct arkimesimpleindex *sindex_next, *sindex_prev;
+    ArkimeSimpleIndexFile_t  *file;
+    uint64_t                  offset;
+    uint32_t                  len;
+    uint8_t                   buf[];
+} ArkimeSimpleIndex_t;
+
+typedef struct {
+    struct arkimesimpleindex *sindex_next, *sindex_prev;
+    int                       sindex_count;
+} ArkimeSimpleIndexHead_t;
+
+// Index files not used in this many seconds and with nothing pending are forgotten
+#define INDEX_FILES_IDLE       3600
+// Open index files the index thread keeps
+#define INDEX_FDS_CACHE_SIZE   8
+// Most entries written with one pwritev
+#define INDEX_IOV_MAX          64
+
+LOCAL GHashTable              *indexFiles[ARKIME_MAX_PACKET_THREADS];
+LOCAL ArkimeSimpleIndexHead_t  indexQ;
+LOCAL ARKIME_LOCK_DEFINE(indexQ);
+LOCAL ARKIME_COND_DEFINE(indexQ);
+LOCAL uint32_t                 indexInflight;
+LOCAL struct {
     int64_t  fileNum;
-    FILE    *fp;
-} indexFiles[ARKIME_MAX_PACKET_THREADS][INDEX_FILES_CACHE_SIZE];
+    int      fd;
+    uint32_t lastUsed;
+} indexFds[INDEX_FDS_CACHE_SIZE];
+
+// Buffers are split into chunks this size so several threads can encrypt one buffer
+#define SIMPLE_ENCRYPT_CHUNK  (128 * 1024)
+// Most buffers the simple thread takes off the queue at once
+#define SIMPLE_ENCRYPT_BATCH  16
+
+typedef struct {
+    ArkimeSimple_t      *info;
+    uint32_t             pos;
+    uint32_t             len;
+} ArkimeSimpleChunk_t;
+
+// Only the output thread publishes chunks, tickets in [encryptBase, encryptEnd) are the current ones
+LOCAL int                  simpleEncryptThreads;
+LOCAL ArkimeSimpleChunk_t *encryptChunks;
+LOCAL uint32_t             encryptChunksSize;
+LOCAL uint64_t             encryptBase;
+LOCAL uint64_t             encryptNext;
+LOCAL uint64_t             encryptEnd;
+LOCAL uint64_t             encryptDone;
+LOCAL ARKIME_LOCK_DEFINE(encrypt);
+LOCAL ARKIME_COND_DEFINE(encrypt);
 
 /*
  * Compression design inspired by Philip Gladstone and others.
@@ -118,10 +231,54 @@ struct {
 LOCAL int      uncompressedBits;    // Number of bits used in filepos to store location in block
 LOCAL uint32_t simpleCompressionBlockSize; // Max data that we try and compress, can be represented by uncompressedBits
 
+// A session save waiting for a block to have its start
+typedef struct arkimesimplewaiter {
+    struct arkimesimplewaiter *next;
+    ArkimeSession_t           *session;
+    ArkimeCmd_func             func;
+    guint                      len;
+    uint32_t                   seq;
+} ArkimeSimpleWaiter_t;
+
+// Where each block of a file ended up once compressed. The packet thread keeps
+// it until every position it handed out for the file has been resolved.
+typedef struct arkimesimpleblocks {
+    uint64_t            *starts;
+    ArkimeSimpleWaiter_t *waiters;   // under lock
+    uint32_t             size;
+    uint32_t             done;       // blocks with a start, compression threads set under lock
+    uint32_t             unresolved; // packet thread: positions handed out but not resolved
+    uint32_t             refs;       // packet thread and compression threads
+    uint32_t             id;
+    uint8_t              closed;     // packet thread: last block handed off
+    ARKIME_LOCK_EXTERN(lock);
+} ArkimeSimpleBlocks_t;
+
+// Per thread compression state
+typedef struct {
+    z_stream             z_strm;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx           *zstd_ctx;
+#endif
+} ArkimeSimpleCtx_t;
+
+LOCAL  int                 simpleCompressionThreads;
+LOCAL  ArkimeSimpleHead_t  compressQ;
+LOCAL  ARKIME_LOCK_DEFINE(compressQ);
+LOCAL  ARKIME_COND_DEFINE(compressQ);
+LOCAL  uint32_t            compressInflight;
+LOCAL  GHashTable         *blockTables[ARKIME_MAX_PACKET_THREADS];
+LOCAL  uint8_t             blockWanted[ARKIME_MAX_PACKET_THREADS];
+
 /******************************************************************************/
 LOCAL uint32_t writer_simple_queue_length()
 {
-    return DLL_COUNT(simple_, &simpleQ);
+    uint32_t compressing = DLL_COUNT(simple_, &compressQ) + compressInflight;
+#ifdef ARKIME_SIMPLE_URING
+    return DLL_COUNT(simple_, &simpleQ) + uringInflight + compressing;
+#else
+    return DLL_COUNT(simple_, &simpleQ) + compressing;
+#endif
 }
 /******************************************************************************/
 /*
@@ -144,6 +301,9 @@ LOCAL ArkimeSimple_t *writer_simple_alloc(int thread, ArkimeSimple_t *previous)
     } else {
         info->bufpos = 0;
         info->closing = 0;
+        info->last = 0;
+        info->flush = 0;
+        info->seq = 0;
     }
 
     if (previous) {
@@ -157,16 +317,7 @@ LOCAL void writer_simple_free(ArkimeSimple_t *info)
     int thread = info->file->thread;
 
     if (info->closing) {
-        switch(simpleMode) {
-        case ARKIME_SIMPLE_NORMAL:
-            break;
-        case ARKIME_SIMPLE_XOR2048:
-            break;
-        case ARKIME_SIMPLE_AES256CTR:
-            EVP_CIPHER_CTX_free(info->file->cipher_ctx);
-            break;
-        }
-        switch(compressionMode) {
+        switch(simpleCompressionThreads ? ARKIME_COMPRESSION_NONE : compressionMode) {
         case ARKIME_COMPRESSION_GZIP:
             deflateEnd(&info->file->z_strm);
             break;
@@ -381,6 +532,15 @@ LOCAL void writer_simple_write_output(int thread, const uint8_t *data, int len)
 {
     ArkimeSimple_t *info = currentInfo[thread];
 
+    // Compression threads will compress the block later
+    if (simpleCompressionThreads) {
+        memcpy(info->buf + info->bufpos, data, len);
+        info->bufpos += len;
+        info->file->posInBlock += len;
+        info->file->packetBytesWritten += len;
+        return;
+    }
+
     switch(compressionMode) {
     case ARKIME_COMPRESSION_NONE:
         memcpy(info->buf + info->bufpos, data, len);
@@ -454,9 +614,339 @@ LOCAL void writer_simple_zstd_make_new_block(int thread)
 #endif
 }
 /******************************************************************************/
+LOCAL ArkimeSimpleCtx_t *writer_simple_ctx_new()
+{
+    ArkimeSimpleCtx_t *ctx = ARKIME_TYPE_ALLOC0(ArkimeSimpleCtx_t);
+
+    switch(compressionMode) {
+    case ARKIME_COMPRESSION_GZIP:
+        // Raw deflate, the gzip header and trailer are added around the blocks
+        deflateInit2(&ctx->z_strm, simpleGzipLevel, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY);
+        break;
+#ifdef HAVE_ZSTD
+    case ARKIME_COMPRESSION_ZSTD:
+        ctx->zstd_ctx = ZSTD_createCCtx();
+        ZSTD_CCtx_setParameter(ctx->zstd_ctx, ZSTD_c_compressionLevel, simpleZstdLevel);
+        break;
+#endif
+    default:
+        break;
+    }
+    return ctx;
+}
+/******************************************************************************/
+LOCAL void writer_simple_blocks_unref(ArkimeSimpleBlocks_t *blocks)
+{
+    if (__sync_sub_and_fetch(&blocks->refs, 1) == 0) {
+        free(blocks->starts);
+        ARKIME_TYPE_FREE(ArkimeSimpleBlocks_t, blocks);
+    }
+}
+/******************************************************************************/
+// Packet thread, forget the file once it is closed and every position is resolved
+LOCAL void writer_simple_blocks_check(int thread, ArkimeSimpleBlocks_t *blocks)
+{
+    if (blocks->closed && blocks->unresolved == 0) {
+        g_hash_table_remove(blockTables[thread], (gpointer)(long)blocks->id);
+        writer_simple_blocks_unref(blocks);
+    }
+}
+/******************************************************************************/
+/* Move the page aligned part of the file's compressed data to toWrite, or all
+ * of it if closing. Caller holds the blocks lock.
+ */
+LOCAL void writer_simple_out_push(ArkimeSimpleFile_t *file, int closing, ArkimeSimpleHead_t *toWrite)
+{
+    ArkimeSimple_t *out = file->out;
+
+    if (closing) {
+        out->closing = 1;
+        file->out = NULL;
+    } else {
+        uint32_t writeSize = (out->bufpos / pageSize) * pageSize;
+        if (writeSize == 0)
+            return;
+
+        ArkimeSimple_t *nout = file->out = writer_simple_alloc(file->thread, out);
+        memcpy(nout->buf, out->buf + writeSize, out->bufpos - writeSize);
+        nout->bufpos = out->bufpos - writeSize;
+        out->bufpos = writeSize;
+    }
+    DLL_PUSH_TAIL(simple_, toWrite, out);
+}
+/******************************************************************************/
+LOCAL void writer_simple_out_append(ArkimeSimpleFile_t *file, const uint8_t *data, uint32_t len, ArkimeSimpleHead_t *toWrite)
+{
+    while (len > 0) {
+        ArkimeSimple_t *out = file->out;
+        uint32_t n = MIN(len, config.pcapWriteSize - out->bufpos);
+
+        memcpy(out->buf + out->bufpos, data, n);
+        out->bufpos += n;
+        file->pos += n;
+        data += n;
+        len -= n;
+
+        if (out->bufpos >= config.pcapWriteSize)
+            writer_simple_out_push(file, 0, toWrite);
+    }
+}
+/******************************************************************************/
+LOCAL void writer_simple_compress_block(ArkimeSimpleCtx_t *ctx, ArkimeSimple_t *info)
+{
+    switch(compressionMode) {
+    case ARKIME_COMPRESSION_GZIP: {
+        // Each block is deflated on its own and ends on a byte boundary, so the
+        // blocks concatenated are a single deflate stream that can be read from any block start
+        uint32_t bound = deflateBound(&ctx->z_strm, info->bufpos) + 16;
+        info->out = malloc(bound);
+        deflateReset(&ctx->z_strm);
+        ctx->z_strm.next_in = info->buf;
+        ctx->z_strm.avail_in = info->bufpos;
+        ctx->z_strm.next_out = info->out;
+        ctx->z_strm.avail_out = bound;
+        deflate(&ctx->z_strm, info->last ? Z_FINISH : Z_FULL_FLUSH);
+        info->outlen = bound - ctx->z_strm.avail_out;
+        info->crc = crc32(0, info->buf, info->bufpos);
+        break;
+    }
+#ifdef HAVE_ZSTD
+    case ARKIME_COMPRESSION_ZSTD: {
+        // Each block is its own frame, same as ZSTD_e_end in the streaming case
+        size_t bound = ZSTD_compressBound(info->bufpos);
+        info->out = malloc(bound);
+        size_t rc = ZSTD_compress2(ctx->zstd_ctx, info->out, bound, info->buf, info->bufpos);
+        if (ZSTD_isError(rc))
+            LOGEXIT("ERROR - zstd compress failed %s", ZSTD_getErrorName(rc));
+        info->outlen = rc;
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+}
+/******************************************************************************/
+/* Add a compressed block to the file once every block before it has been, and
+ * queue full buffers to the output thread in file order.
+ */
+LOCAL void writer_simple_sequence(ArkimeSimple_t *info)
+{
+    ArkimeSimpleFile_t   *file = info->file;
+    ArkimeSimpleBlocks_t *blocks = file->blocks;
+    ArkimeSimpleHead_t    toWrite;
+    ArkimeSimpleWaiter_t *ready = NULL;
+    int                   last = 0;
+
+    DLL_INIT(simple_, &toWrite);
+
+    ARKIME_LOCK(blocks->lock);
+    ArkimeSimple_t **pp = &file->pending;
+    while (*pp && (*pp)->seq < info->seq)
+        pp = &(*pp)->simple_next;
+    info->simple_next = *pp;
+    *pp = info;
+
+    while (file->pending && file->pending->seq == blocks->done) {
+        ArkimeSimple_t *block = file->pending;
+        file->pending = block->simple_next;
+
+        if (blocks->done >= blocks->size) {
+            blocks->size *= 2;
+            blocks->starts = realloc(blocks->starts, blocks->size * sizeof(uint64_t));
+        }
+        blocks->starts[blocks->done] = file->pos;
+        writer_simple_out_append(file, block->out, block->outlen, &toWrite);
+
+        if (compressionMode == ARKIME_COMPRESSION_GZIP) {
+            file->crc = crc32_combine(file->crc, block->crc, block->bufpos);
+            file->uncompressed += block->bufpos;
+        }
+
+        if (block->last) {
+            if (compressionMode == ARKIME_COMPRESSION_GZIP) {
+                uint32_t trailer[2] = {htole32(file->crc), htole32(file->uncompressed)};
+                writer_simple_out_append(file, (uint8_t *)trailer, 8, &toWrite);
+            }
+            writer_simple_out_push(file, 1, &toWrite);
+            last = 1;
+        } else if (block->flush) {
+            writer_simple_out_push(file, 0, &toWrite);
+        }
+
+        __atomic_store_n(&blocks->done, blocks->done + 1, __ATOMIC_RELEASE);
+        free(block->out);
+        block->out = NULL;
+        writer_simple_free(block);
+    }
+
+    // Must queue while locked so buffers for the same file stay in order, file may be freed once queued
+    if (DLL_COUNT(simple_, &toWrite) > 0) {
+        ArkimeSimple_t *out;
+        ARKIME_LOCK(simpleQ);
+        while (DLL_POP_HEAD(simple_, &toWrite, out)) {
+            DLL_PUSH_TAIL(simple_, &simpleQ, out);
+        }
+        ARKIME_COND_SIGNAL(simpleQ);
+        ARKIME_UNLOCK(simpleQ);
+    }
+
+    ArkimeSimpleWaiter_t **wp = &blocks->waiters;
+    while (*wp) {
+        ArkimeSimpleWaiter_t *waiter = *wp;
+        if (waiter->seq < blocks->done) {
+            *wp = waiter->next;
+            waiter->next = ready;
+            ready = waiter;
+        } else {
+            wp = &waiter->next;
+        }
+    }
+    ARKIME_UNLOCK(blocks->lock);
+
+    // Finish the saves on their packet threads
+    while (ready) {
+        ArkimeSimpleWaiter_t *waiter = ready;
+        ready = waiter->next;
+        arkime_session_add_cmd(waiter->session, ARKIME_SES_CMD_FUNC, (gpointer)(long)waiter->len, NULL, waiter->func);
+        ARKIME_TYPE_FREE(ArkimeSimpleWaiter_t, waiter);
+    }
+
+    if (last)
+        writer_simple_blocks_unref(blocks);
+}
+/******************************************************************************/
+LOCAL void *writer_simple_compress_thread(void *UNUSED(arg))
+{
+    ArkimeSimpleCtx_t *ctx = writer_simple_ctx_new();
+    ArkimeSimple_t    *info;
+
+    while (1) {
+        ARKIME_LOCK(compressQ);
+        while (DLL_COUNT(simple_, &compressQ) == 0) {
+            ARKIME_COND_WAIT(compressQ);
+        }
+        DLL_POP_HEAD(simple_, &compressQ, info);
+        __sync_add_and_fetch(&compressInflight, 1);
+        ARKIME_UNLOCK(compressQ);
+
+        writer_simple_compress_block(ctx, info);
+        writer_simple_sequence(info);
+        __sync_sub_and_fetch(&compressInflight, 1);
+    }
+    return NULL;
+}
+/******************************************************************************/
+/* Packet thread, hand the current block to the compression threads and start
+ * the next one unless this is the last block of the file.
+ */
+LOCAL void writer_simple_block_submit(int thread, int last, int flush)
+{
+    ArkimeSimple_t     *info = currentInfo[thread];
+    ArkimeSimpleFile_t *file = info->file;
+
+    info->last = last;
+    info->flush = flush;
+    blockWanted[thread] = 0;
+    gettimeofday(&lastSave[thread], NULL);
+
+    if (last) {
+        currentInfo[thread] = NULL; // This will cause a new file to be allocated on next packet
+        file->blocks->closed = 1;
+        writer_simple_blocks_check(thread, file->blocks);
+    } else {
+        ArkimeSimple_t *ninfo = currentInfo[thread] = writer_simple_alloc(thread, info);
+        ninfo->seq = info->seq + 1;
+        file->posInBlock = 0;
+    }
+
+    ARKIME_LOCK(compressQ);
+    DLL_PUSH_TAIL(simple_, &compressQ, info);
+    ARKIME_COND_SIGNAL(compressQ);
+    ARKIME_UNLOCK(compressQ);
+}
+/******************************************************************************/
+/* Called before a session is saved, turn the first len block number positions
+ * handed out for compressed files into blockStart << uncompressedBits positions.
+ * If a block doesn't have its start yet nothing is changed and func is queued
+ * for the session once it does, so the packet thread never waits.
+ */
+LOCAL gboolean writer_simple_resolve(ArkimeSession_t *session, guint len, ArkimeCmd_func func)
+{
+    const int  thread = session->thread;
+    GArray    *array = session->filePosArray;
+    guint      i = 0;
+
+    while (i < len) {
+        int64_t fileNum = g_array_index(array, int64_t, i);
+        guint   first = ++i;
+
+        while (i < len && g_array_index(array, int64_t, i) >= 0)
+            i++;
+
+        ArkimeSimpleBlocks_t *blocks = g_hash_table_lookup(blockTables[thread], (gpointer)(long)(-fileNum));
+        if (!blocks || first == i)
+            continue;
+
+        // Positions are in order, so the last block covers them all
+        uint32_t seq = (uint64_t)g_array_index(array, int64_t, i - 1) >> uncompressedBits;
+        if (__atomic_load_n(&blocks->done, __ATOMIC_ACQUIRE) > seq)
+            continue;
+
+        ARKIME_LOCK(blocks->lock);
+        if (blocks->done > seq) {
+            ARKIME_UNLOCK(blocks->lock);
+            continue;
+        }
+        ArkimeSimpleWaiter_t *waiter = ARKIME_TYPE_ALLOC(ArkimeSimpleWaiter_t);
+        waiter->session = session;
+        waiter->func = func;
+        waiter->len = len;
+        waiter->seq = seq;
+        waiter->next = blocks->waiters;
+        blocks->waiters = waiter;
+        ARKIME_UNLOCK(blocks->lock);
+
+        // Still filling the block, writer_simple_check sends it off if it doesn't fill soon
+        const ArkimeSimple_t *info = currentInfo[thread];
+        if (info && info->file->blocks == blocks && info->seq <= seq) {
+            if (config.quitting)
+                writer_simple_block_submit(thread, 0, 0);
+            else
+                blockWanted[thread] = 1;
+        }
+        return FALSE;
+    }
+
+    const uint64_t mask = (1ULL << uncompressedBits) - 1;
+    i = 0;
+    while (i < len) {
+        int64_t fileNum = g_array_index(array, int64_t, i);
+        guint   first = ++i;
+
+        while (i < len && g_array_index(array, int64_t, i) >= 0)
+            i++;
+
+        ArkimeSimpleBlocks_t *blocks = g_hash_table_lookup(blockTables[thread], (gpointer)(long)(-fileNum));
+        if (!blocks || first == i)
+            continue;
+
+        ARKIME_LOCK(blocks->lock);
+        for (guint j = first; j < i; j++) {
+            uint64_t pos = g_array_index(array, int64_t, j);
+            g_array_index(array, int64_t, j) = (blocks->starts[pos >> uncompressedBits] << uncompressedBits) | (pos & mask);
+        }
+        ARKIME_UNLOCK(blocks->lock);
+
+        blocks->unresolved -= i - first;
+        writer_simple_blocks_check(thread, blocks);
+    }
+    return TRUE;
+}
+/******************************************************************************/
 LOCAL void writer_simple_write(const ArkimeSession_t *const session, ArkimePacket_t *const packet)
 {
-    if (DLL_COUNT(simple_, &simpleQ) > simpleMaxQ) {
+    if (DLL_COUNT(simple_, &simpleQ) + DLL_COUNT(simple_, &compressQ) > simpleMaxQ) {
         static uint32_t lastError;
         static uint32_t notSaved;
         packet->writerFilePos = 0;
@@ -493,7 +983,7 @@ LOCAL void writer_simple_write(const ArkimeSession_t *const session, ArkimePacke
         info->file = ARKIME_TYPE_ALLOC0(ArkimeSimpleFile_t);
         info->file->thread = thread;
 
-        switch(compressionMode) {
+        switch(simpleCompressionThreads ? ARKIME_COMPRESSION_NONE : compressionMode) {
         case ARKIME_COMPRESSION_GZIP:
             uncompressedBitsArg = (gpointer)(long)uncompressedBits;
             compressionArg = "gzip";
@@ -516,6 +1006,10 @@ LOCAL void writer_simple_write(const ArkimeSession_t *const session, ArkimePacke
             break;
 #endif
         default:
+            if (compressionMode != ARKIME_COMPRESSION_NONE) {
+                uncompressedBitsArg = (gpointer)(long)uncompressedBits;
+                compressionArg = compressionMode == ARKIME_COMPRESSION_GZIP ? "gzip" : "zstd";
+            }
             break;
         }
 
@@ -553,18 +1047,13 @@ LOCAL void writer_simple_write(const ArkimeSession_t *const session, ArkimePacke
             g_free(kekId);
             break;
         case ARKIME_SIMPLE_AES256CTR: {
-            info->file->cipher_ctx = EVP_CIPHER_CTX_new();
             name = ".arkime";
-            uint8_t dek[32];
-            uint8_t iv[16];
             char    ivhex[33];
-            RAND_bytes(iv, 12);
-            RAND_bytes(dek, 32);
-            memset(iv + 12, 0, 4);
+            RAND_bytes(info->file->iv, 12);
+            RAND_bytes(info->file->dek, 32);
             kekId = writer_simple_get_kekId();
-            writer_simple_encrypt_key(kekId, dek, 32, dekhex);
-            arkime_sprint_hex_string(ivhex, iv, 12);
-            EVP_EncryptInit(info->file->cipher_ctx, cipher, dek, iv);
+            writer_simple_encrypt_key(kekId, info->file->dek, 32, dekhex);
+            arkime_sprint_hex_string(ivhex, info->file->iv, 12);
             name = arkime_db_create_file_full(packet->ts.tv_sec, name, 0, 0, &info->file->id,
                                               "encoding", "aes-256-ctr",
                                               "iv", ivhex,
@@ -609,8 +1098,26 @@ LOCAL void writer_simple_write(const ArkimeSession_t *const session, ArkimePacke
             LOG("opened %d %s %d", thread, name, info->file->fd);
         g_free(name);
 
-        // Make a new block for start of packets
-        if (compressionMode == ARKIME_COMPRESSION_GZIP)
+        if (simpleCompressionThreads) {
+            ArkimeSimpleFile_t   *file = info->file;
+            ArkimeSimpleBlocks_t *blocks = file->blocks = ARKIME_TYPE_ALLOC0(ArkimeSimpleBlocks_t);
+            blocks->id = file->id;
+            blocks->refs = 2;
+            blocks->size = 64;
+            blocks->starts = malloc(blocks->size * sizeof(uint64_t));
+            ARKIME_LOCK_INIT(blocks->lock);
+            g_hash_table_insert(blockTables[thread], (gpointer)(long)blocks->id, blocks);
+
+            file->out = writer_simple_alloc(thread, info);
+            if (compressionMode == ARKIME_COMPRESSION_GZIP) {
+                // Blocks are raw deflate, so write the gzip header ourselves
+                static const uint8_t gzipHeader[10] = {0x1f, 0x8b, 0x08, 0, 0, 0, 0, 0, 0, 0x03};
+                memcpy(file->out->buf, gzipHeader, 10);
+                file->out->bufpos = 10;
+                file->pos = 10;
+            }
+            file->crc = crc32(0, NULL, 0);
+        } else if (compressionMode == ARKIME_COMPRESSION_GZIP) // Make a new block for start of packets
             writer_simple_gzip_make_new_block(thread);
         else if (compressionMode == ARKIME_COMPRESSION_ZSTD)
             writer_simple_zstd_make_new_block(thread);
@@ -619,7 +1126,17 @@ LOCAL void writer_simple_write(const ArkimeSession_t *const session, ArkimePacke
 
     packet->writerFileNum = currentInfo[thread]->file->id;
 
-    if (compressionMode == ARKIME_COMPRESSION_GZIP) {
+    if (simpleCompressionThreads) {
+        // A block is one raw buffer, so also cut it before the record could run past the buffer
+        if (currentInfo[thread]->file->posInBlock >= simpleCompressionBlockSize ||
+            (currentInfo[thread]->bufpos > 0 && currentInfo[thread]->bufpos + 16 + packet->pktlen > config.pcapWriteSize)) {
+            writer_simple_block_submit(thread, 0, 0);
+        }
+
+        // Block number for now, writer_simple_resolve changes to the block start
+        packet->writerFilePos = ((uint64_t)currentInfo[thread]->seq << uncompressedBits) + currentInfo[thread]->file->posInBlock;
+        currentInfo[thread]->file->blocks->unresolved++;
+    } else if (compressionMode == ARKIME_COMPRESSION_GZIP) {
         if (currentInfo[thread]->file->posInBlock >= simpleCompressionBlockSize) {
             writer_simple_gzip_make_new_block(thread);
         }
@@ -665,74 +1182,444 @@ LOCAL void writer_simple_write(const ArkimeSession_t *const session, ArkimePacke
     }
     writer_simple_write_output(thread, packet->pkt, packet->pktlen);
 
-    if (currentInfo[thread]->bufpos > config.pcapWriteSize) {
+    if (simpleCompressionThreads) {
+        if (currentInfo[thread]->file->packetBytesWritten >= config.maxFileSizeB) {
+            writer_simple_block_submit(thread, 1, 0);
+        }
+    } else if (currentInfo[thread]->bufpos > config.pcapWriteSize) {
         writer_simple_process_buf(thread, 0);
     } else if (currentInfo[thread]->file->packetBytesWritten >= config.maxFileSizeB) {
         writer_simple_process_buf(thread, 1);
     }
 }
 /******************************************************************************/
-LOCAL void *writer_simple_thread(void *UNUSED(arg))
+LOCAL uint64_t writer_simple_now()
 {
-    ArkimeSimple_t *info;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+/******************************************************************************/
+LOCAL void writer_simple_latency_add(uint64_t start)
+{
+    uint64_t usec = writer_simple_now() - start;
+    int      bucket = 0;
 
-    if (config.debug)
-        LOG("THREAD %p", (gpointer)pthread_self());
+    while (usec > 1 && bucket < SIMPLE_LATENCY_BUCKETS - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+    writeLatency[bucket]++;
+    writeLatencyTotal++;
+}
+/******************************************************************************/
+LOCAL void writer_simple_latency_log()
+{
+    char     buf[SIMPLE_LATENCY_BUCKETS * 40];
+    BSB      bsb;
+
+    BSB_INIT(bsb, buf, sizeof(buf));
+    for (int i = 0; i < SIMPLE_LATENCY_BUCKETS; i++) {
+        if (writeLatency[i])
+            BSB_EXPORT_sprintf(bsb, " <%" PRIu64 "us:%" PRIu64, (uint64_t)1 << (i + 1), writeLatency[i]);
+    }
+    BSB_EXPORT_u08(bsb, 0);
+
+    LOG("write latency writes: %" PRIu64 "%s", writeLatencyTotal, buf);
+}
+/******************************************************************************/
+/* Encrypt part of a buffer. Every buffer but the last of a file is a multiple
+ * of the page size and chunks are multiples of 256, so the xor key and aes
+ * counter only depend on where the chunk is in the file, and chunks can be
+ * done in any order on any thread.
+ */
+LOCAL void writer_simple_encrypt(EVP_CIPHER_CTX *ctx, const ArkimeSimpleChunk_t *chunk)
+{
+    ArkimeSimple_t *info = chunk->info;
+    uint8_t        *buf = info->buf + chunk->pos;
+    uint32_t        len = chunk->len;
+
+    switch(simpleMode) {
+    case ARKIME_SIMPLE_NORMAL:
+        break;
+    case ARKIME_SIMPLE_XOR2048: {
+        uint64_t key[32];
+        uint32_t i;
+
+        // 8 bytes at a time, which the compiler turns into vector xors
+        memcpy(key, info->file->dek, 256);
+        for (i = 0; i + 256 <= len; i += 256) {
+            for (int j = 0; j < 32; j++) {
+                uint64_t v;
+                memcpy(&v, buf + i + j * 8, 8);
+                v ^= key[j];
+                memcpy(buf + i + j * 8, &v, 8);
+            }
+        }
+        for (; i < len; i++)
+            buf[i] ^= info->file->dek[i % 256];
+        break;
+    }
+    case ARKIME_SIMPLE_AES256CTR: {
+        uint8_t  iv[16];
+        uint32_t counter = htobe32((info->offset + chunk->pos) / 16);
+        int      outl;
+
+        memcpy(iv, info->file->iv, 12);
+        memcpy(iv + 12, &counter, 4);
+        if (!EVP_EncryptInit_ex(ctx, cipher, NULL, info->file->dek, iv) ||
+            !EVP_EncryptUpdate(ctx, buf, &outl, buf, len))
+            LOGEXIT("ERROR - Encrypting data failed");
+        if ((int)len != outl)
+            LOGEXIT("ERROR - Encryption in (%u) and out (%d) didn't match", len, outl);
+        break;
+    }
+    }
+}
+/******************************************************************************/
+/* Claim and encrypt the next published chunk, returns FALSE if there are none.
+ * Tickets only go up, so a thread that is late can't claim a chunk twice.
+ */
+LOCAL gboolean writer_simple_encrypt_claim(EVP_CIPHER_CTX *ctx)
+{
+    uint64_t ticket = __atomic_load_n(&encryptNext, __ATOMIC_RELAXED);
+
+    do {
+        if (ticket >= __atomic_load_n(&encryptEnd, __ATOMIC_ACQUIRE))
+            return FALSE;
+    } while (!__atomic_compare_exchange_n(&encryptNext, &ticket, ticket + 1, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    writer_simple_encrypt(ctx, &encryptChunks[ticket - encryptBase]);
+    __atomic_add_fetch(&encryptDone, 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+/******************************************************************************/
+LOCAL void *writer_simple_encrypt_thread(void *UNUSED(arg))
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
 
     while (1) {
-        ARKIME_LOCK(simpleQ);
-        while (DLL_COUNT(simple_, &simpleQ) == 0) {
-            ARKIME_COND_WAIT(simpleQ);
+        ARKIME_LOCK(encrypt);
+        while (__atomic_load_n(&encryptNext, __ATOMIC_RELAXED) >= encryptEnd) {
+            ARKIME_COND_WAIT(encrypt);
         }
-        DLL_POP_HEAD(simple_, &simpleQ, info);
-        ARKIME_UNLOCK(simpleQ);
+        ARKIME_UNLOCK(encrypt);
 
-        uint32_t pos = 0;
+        while (writer_simple_encrypt_claim(ctx));
+    }
+    return NULL;
+}
+/******************************************************************************/
+/*
+ * Work out how much of each buffer to write, where in the file it goes and
+ * encrypt it, must be called in queue order.  The encryption is split into
+ * chunks that the encrypt threads help with.
+ */
+LOCAL void writer_simple_prepare(ArkimeSimple_t **batch, int cnt)
+{
+    static EVP_CIPHER_CTX *ctx;
+    uint32_t               chunks = 0;
+
+    for (int i = 0; i < cnt; i++) {
+        ArkimeSimple_t *info = batch[i];
         uint32_t total = info->bufpos;
         if (info->closing) {
             // Round up to next page size
             if (total % pageSize != 0)
                 total = ((total / pageSize) + 1) * pageSize;
         }
+        info->total = total;
+        info->offset = info->file->writePos;
+        info->file->writePos += total;
 
-        switch(simpleMode) {
-        case ARKIME_SIMPLE_NORMAL:
-            break;
-        case ARKIME_SIMPLE_XOR2048: {
-            uint32_t i;
-            for (i = 0; i < total; i++)
-                info->buf[i] ^= info->file->dek[i % 256];
-            break;
+        if (simpleMode == ARKIME_SIMPLE_NORMAL)
+            continue;
+
+        uint32_t need = chunks + (total + SIMPLE_ENCRYPT_CHUNK - 1) / SIMPLE_ENCRYPT_CHUNK;
+        if (need > encryptChunksSize) {
+            encryptChunksSize = need * 2;
+            encryptChunks = realloc(encryptChunks, encryptChunksSize * sizeof(ArkimeSimpleChunk_t));
         }
-        case ARKIME_SIMPLE_AES256CTR: {
-            int outl;
-            if (!EVP_EncryptUpdate(info->file->cipher_ctx, (uint8_t *)info->buf, &outl, (uint8_t *)info->buf, total))
-                LOGEXIT("ERROR - Encrypting data failed");
-            if ((int)total != outl)
-                LOGEXIT("ERROR - Encryption in (%u) and out (%d) didn't match", total, outl);
-            break;
+        for (uint32_t pos = 0; pos < total; pos += SIMPLE_ENCRYPT_CHUNK) {
+            encryptChunks[chunks].info = info;
+            encryptChunks[chunks].pos = pos;
+            encryptChunks[chunks].len = MIN(SIMPLE_ENCRYPT_CHUNK, total - pos);
+            chunks++;
         }
+    }
+
+    if (chunks == 0)
+        return;
+
+    if (!ctx)
+        ctx = EVP_CIPHER_CTX_new();
+
+    if (simpleEncryptThreads == 0 || chunks == 1) {
+        for (uint32_t c = 0; c < chunks; c++)
+            writer_simple_encrypt(ctx, &encryptChunks[c]);
+        return;
+    }
+
+    // Every earlier ticket is done, so encryptNext is where this batch starts
+    ARKIME_LOCK(encrypt);
+    encryptBase = encryptNext;
+    __atomic_store_n(&encryptEnd, encryptBase + chunks, __ATOMIC_RELEASE);
+    ARKIME_COND_BROADCAST(encrypt);
+    ARKIME_UNLOCK(encrypt);
+
+    while (writer_simple_encrypt_claim(ctx));
+
+    while (__atomic_load_n(&encryptDone, __ATOMIC_ACQUIRE) < encryptBase + chunks) {
+        sched_yield();
+    }
+}
+/******************************************************************************/
+LOCAL void writer_simple_finish_file(ArkimeSimpleFile_t *file)
+{
+    if (ftruncate(file->fd, file->pos) < 0 && config.debug)
+        LOG("Truncate failed");
+    close(file->fd);
+    arkime_db_update_filesize(file->id, file->pos, file->packetBytesWritten, file->packets);
+}
+/******************************************************************************/
+LOCAL void *writer_simple_thread(void *UNUSED(arg))
+{
+    ArkimeSimple_t *batch[SIMPLE_ENCRYPT_BATCH];
+
+    if (config.debug)
+        LOG("THREAD %p", (gpointer)pthread_self());
+
+    while (1) {
+        int cnt = 0;
+
+        ARKIME_LOCK(simpleQ);
+        while (DLL_COUNT(simple_, &simpleQ) == 0) {
+            ARKIME_COND_WAIT(simpleQ);
         }
+        while (cnt < SIMPLE_ENCRYPT_BATCH && DLL_POP_HEAD(simple_, &simpleQ, batch[cnt])) {
+            cnt++;
+        }
+        ARKIME_UNLOCK(simpleQ);
 
-        while (pos < total) {
-            int len = write(info->file->fd, info->buf + pos, total - pos);
-            if (len >= 0) {
-                pos += len;
-            } else {
-                LOGEXIT("ERROR - writing %d %s", len, strerror(errno));
+        writer_simple_prepare(batch, cnt);
+
+        for (int i = 0; i < cnt; i++) {
+            ArkimeSimple_t *info = batch[i];
+            uint32_t pos = 0;
+            uint64_t start = writer_simple_now();
+            while (pos < info->total) {
+                int len = write(info->file->fd, info->buf + pos, info->total - pos);
+                if (len >= 0) {
+                    pos += len;
+                } else {
+                    LOGEXIT("ERROR - writing %d %s", len, strerror(errno));
+                }
             }
+            writer_simple_latency_add(start);
+
+            if (info->closing) {
+                writer_simple_finish_file(info->file);
+            }
+
+            writer_simple_free(info);
         }
-        if (info->closing) {
-            if (ftruncate(info->file->fd, info->file->pos) < 0 && config.debug)
-                LOG("Truncate failed");
-            close(info->file->fd);
-            arkime_db_update_filesize(info->file->id, info->file->pos, info->file->packetBytesWritten, info->file->packets);
+    }
+    return NULL;
+}
+#ifdef ARKIME_SIMPLE_URING
+/******************************************************************************/
+/* The ring is set up and used with the raw syscalls so there is no liburing
+ * dependency. Only the output thread touches it.
+ */
+LOCAL struct {
+    int                  fd;
+    unsigned            *sqHead;
+    unsigned            *sqTail;
+    unsigned            *sqMask;
+    unsigned            *sqArray;
+    unsigned            *cqHead;
+    unsigned            *cqTail;
+    unsigned            *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    uint32_t             toSubmit;
+} uring;
+
+LOCAL uint32_t simpleUringDepth;
+
+/******************************************************************************/
+LOCAL gboolean writer_simple_uring_setup()
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    uring.fd = syscall(__NR_io_uring_setup, simpleUringDepth, &p);
+    if (uring.fd < 0) {
+        LOG("WARNING - io_uring_setup failed, using blocking writes: %s", strerror(errno));
+        return FALSE;
+    }
+
+    size_t sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        sqLen = cqLen = MAX(sqLen, cqLen);
+
+    uint8_t *sq = mmap(0, sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING);
+    uint8_t *cq = sq;
+    if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP))
+        cq = mmap(0, cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_CQ_RING);
+    uring.sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+
+    if (sq == MAP_FAILED || cq == MAP_FAILED || uring.sqes == MAP_FAILED) {
+        LOG("WARNING - io_uring mmap failed, using blocking writes: %s", strerror(errno));
+        close(uring.fd);
+        return FALSE;
+    }
+
+    uring.sqHead  = (unsigned *)(sq + p.sq_off.head);
+    uring.sqTail  = (unsigned *)(sq + p.sq_off.tail);
+    uring.sqMask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    uring.sqArray = (unsigned *)(sq + p.sq_off.array);
+    uring.cqHead  = (unsigned *)(cq + p.cq_off.head);
+    uring.cqTail  = (unsigned *)(cq + p.cq_off.tail);
+    uring.cqMask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    uring.cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // Kernel may have rounded up
+    simpleUringDepth = p.sq_entries;
+
+    if (config.debug)
+        LOG("io_uring depth %u", simpleUringDepth);
+    return TRUE;
+}
+/******************************************************************************/
+// Queue the unwritten part of info, actually submitted by writer_simple_uring_enter
+LOCAL void writer_simple_uring_queue(ArkimeSimple_t *info)
+{
+    unsigned tail = *uring.sqTail;
+    unsigned idx = tail & *uring.sqMask;
+    struct io_uring_sqe *sqe = &uring.sqes[idx];
+
+    info->iov.iov_base = info->buf + info->written;
+    info->iov.iov_len = info->total - info->written;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_WRITEV;
+    sqe->fd        = info->file->fd;
+    sqe->off       = info->offset + info->written;
+    sqe->addr      = (uint64_t)(uintptr_t)&info->iov;
+    sqe->len       = 1;
+    sqe->user_data = (uint64_t)(uintptr_t)info;
+
+    uring.sqArray[idx] = idx;
+    __atomic_store_n(uring.sqTail, tail + 1, __ATOMIC_RELEASE);
+    uring.toSubmit++;
+}
+/******************************************************************************/
+LOCAL void writer_simple_uring_enter(uint32_t minComplete)
+{
+    while (uring.toSubmit > 0 || minComplete > 0) {
+        int rc = syscall(__NR_io_uring_enter, uring.fd, uring.toSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            LOGEXIT("ERROR - io_uring_enter %s", strerror(errno));
         }
+        uring.toSubmit -= rc;
+        minComplete = 0;
+    }
+}
+/******************************************************************************/
+LOCAL void writer_simple_uring_complete(ArkimeSimple_t *info, int res)
+{
+    if (res < 0) {
+        if (res == -EINTR || res == -EAGAIN) {
+            writer_simple_uring_queue(info);
+            return;
+        }
+        LOGEXIT("ERROR - writing %d %s", res, strerror(-res));
+    }
+
+    // Short write, send the rest
+    info->written += res;
+    if (info->written < info->total) {
+        writer_simple_uring_queue(info);
+        return;
+    }
 
+    writer_simple_latency_add(info->start);
+    __sync_sub_and_fetch(&uringInflight, 1);
+
+    ArkimeSimpleFile_t *file = info->file;
+    file->inflight--;
+
+    // Buffers for the same file can complete out of order, hold the closing one until the rest are done
+    if (info->closing) {
+        file->closeInfo = info;
+    } else {
         writer_simple_free(info);
     }
+
+    if (file->inflight == 0 && file->closeInfo) {
+        writer_simple_finish_file(file);
+        writer_simple_free(file->closeInfo);
+    }
+}
+/******************************************************************************/
+LOCAL void writer_simple_uring_reap()
+{
+    unsigned head = *uring.cqHead;
+
+    while (head != __atomic_load_n(uring.cqTail, __ATOMIC_ACQUIRE)) {
+        const struct io_uring_cqe *cqe = &uring.cqes[head & *uring.cqMask];
+        ArkimeSimple_t *info = (ArkimeSimple_t *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+
+        head++;
+        __atomic_store_n(uring.cqHead, head, __ATOMIC_RELEASE);
+
+        writer_simple_uring_complete(info, res);
+    }
+}
+/******************************************************************************/
+LOCAL void *writer_simple_uring_thread(void *UNUSED(arg))
+{
+    ArkimeSimple_t *batch[simpleUringDepth];
+
+    if (config.debug)
+        LOG("THREAD %p", (gpointer)pthread_self());
+
+    while (1) {
+        int cnt = 0;
+
+        ARKIME_LOCK(simpleQ);
+        while (uringInflight == 0 && DLL_COUNT(simple_, &simpleQ) == 0) {
+            ARKIME_COND_WAIT(simpleQ);
+        }
+        while (uringInflight + cnt < simpleUringDepth && DLL_POP_HEAD(simple_, &simpleQ, batch[cnt])) {
+            cnt++;
+        }
+        ARKIME_UNLOCK(simpleQ);
+
+        // Offsets and encryption are assigned in queue order, the writes themselves can finish in any order
+        writer_simple_prepare(batch, cnt);
+        uint64_t start = writer_simple_now();
+        for (int i = 0; i < cnt; i++) {
+            ArkimeSimple_t *info = batch[i];
+            info->written = 0;
+            info->start = start;
+            info->file->inflight++;
+            writer_simple_uring_queue(info);
+        }
+        __sync_add_and_fetch(&uringInflight, cnt);
+
+        // Only block for a completion when there was nothing new to submit
+        writer_simple_uring_enter(cnt == 0 ? 1 : 0);
+        writer_simple_uring_reap();
+    }
     return NULL;
 }
+#endif
 /******************************************************************************/
 LOCAL void writer_simple_exit()
 {
@@ -740,7 +1627,10 @@ LOCAL void writer_simple_exit()
 
     for (thread = 0; thread < config.packetThreads; thread++) {
         if (currentInfo[thread]) {
-            writer_simple_process_buf(thread, 1);
+            if (simpleCompressionThreads)
+                writer_simple_block_submit(thread, 1, 0);
+            else
+                writer_simple_process_buf(thread, 1);
         }
     }
 
@@ -749,13 +1639,25 @@ LOCAL void writer_simple_exit()
         usleep(10000);
     }
 
-    for (thread = 0; thread < config.packetThreads; thread++) {
-        for (int p = 0; p < INDEX_FILES_CACHE_SIZE; p++) {
-            if (indexFiles[thread][p].fp) {
-                fclose(indexFiles[thread][p].fp);
-                indexFiles[thread][p].fp = 0;
+    if (writeLatencyTotal)
+        writer_simple_latency_log();
+
+    if (localPcapIndex) {
+        while (DLL_COUNT(sindex_, &indexQ) > 0 || indexInflight > 0) {
+            usleep(10000);
+        }
+
+        for (int p = 0; p < INDEX_FDS_CACHE_SIZE; p++) {
+            if (indexFds[p].fd > 0) {
+                close(indexFds[p].fd);
+                indexFds[p].fd = 0;
             }
         }
+
+        for (thread = 0; thread < config.packetThreads; thread++) {
+            g_hash_table_destroy(indexFiles[thread]);
+            indexFiles[thread] = NULL;
+        }
     }
 }
 /******************************************************************************/
@@ -765,14 +1667,17 @@ LOCAL void writer_simple_check(ArkimeSession_t *session, void *UNUSED(uw1), void
     struct timeval now;
     gettimeofday(&now, NULL);
 
-    // No data or not enough bytes, reset the time
-    if (!currentInfo[session->thread] || currentInfo[session->thread]->bufpos < (uint32_t)pageSize) {
+    // No data or not enough bytes unless a save is waiting on the block, reset the time
+    if (!currentInfo[session->thread] || (currentInfo[session->thread]->bufpos < (uint32_t)pageSize && !blockWanted[session->thread])) {
         lastSave[session->thread] = now;
         return;
     }
 
     if (config.maxFileTimeM > 0 && now.tv_sec - fileAge[session->thread].tv_sec >= config.maxFileTimeM * 60) {
-        writer_simple_process_buf(session->thread, 1);
+        if (simpleCompressionThreads)
+            writer_simple_block_submit(session->thread, 1, 0);
+        else
+            writer_simple_process_buf(session->thread, 1);
         return;
     }
 
@@ -780,8 +1685,10 @@ LOCAL void writer_simple_check(ArkimeSession_t *session, void *UNUSED(uw1), void
     if (now.tv_sec - lastSave[session->thread].tv_sec < 10)
         return;
 
-    // Don't force writes for gzip for now
-    if (compressionMode != ARKIME_COMPRESSION_GZIP) {
+    // Blocks are compressed on their own, so can cut one and write what is done
+    if (simpleCompressionThreads) {
+        writer_simple_block_submit(session->thread, 0, 1);
+    } else if (compressionMode != ARKIME_COMPRESSION_GZIP) { // Don't force writes for gzip for now
         writer_simple_process_buf(session->thread, 0);
     }
 }
@@ -804,65 +1711,237 @@ LOCAL gboolean writer_simple_check_gfunc (gpointer UNUSED(user_data))
     }
     ARKIME_UNLOCK(simpleQ);
 
+    if (config.debug && now.tv_sec - writeLatencyLast >= 60) {
+        writeLatencyLast = now.tv_sec;
+        writer_simple_latency_log();
+    }
+
     return G_SOURCE_CONTINUE;
 }
 /******************************************************************************/
-FILE *writer_simple_get_index(int thread, int64_t fileNum)
+// Index thread, returns the fd to use for an index file
+LOCAL int writer_simple_index_fd(int64_t fileNum, uint32_t now)
 {
-    const int p = fileNum % INDEX_FILES_CACHE_SIZE;
+    int p, oldest = 0;
 
-    if (indexFiles[thread][p].fp) {
-        // This is the fileNum we are looking for
-        if (indexFiles[thread][p].fileNum == fileNum) {
-            return indexFiles[thread][p].fp;
+    for (p = 0; p < INDEX_FDS_CACHE_SIZE; p++) {
+        if (indexFds[p].fd > 0 && indexFds[p].fileNum == fileNum) {
+            indexFds[p].lastUsed = now;
+            return indexFds[p].fd;
         }
-
-        // This isn't it, close the old one
-        fclose(indexFiles[thread][p].fp);
+        if (indexFds[p].lastUsed < indexFds[oldest].lastUsed)
+            oldest = p;
     }
 
+    if (indexFds[oldest].fd > 0)
+        close(indexFds[oldest].fd);
+
     char     filename[1024];
     snprintf(filename, sizeof(filename), "%s/%s-%" PRId64 ".index", config.pcapDir[0], config.nodeName, fileNum);
 
-    if ((indexFiles[thread][p].fp = fopen(filename, "a")) == NULL) {
-        LOGEXIT("ERROR - Couldn't open file %s", filename);
+    // Offsets are handed out by the packet threads, so no O_APPEND
+    int fd = open(filename, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd < 0) {
+        LOGEXIT("ERROR - Couldn't open file %s - %s", filename, strerror(errno));
     }
 
     if (!config.pcapReadOffline) {
-        fchmod(fileno(indexFiles[thread][p].fp), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+        fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
     }
 
-    return indexFiles[thread][p].fp;
+    indexFds[oldest].fileNum = fileNum;
+    indexFds[oldest].fd = fd;
+    indexFds[oldest].lastUsed = now;
+    return fd;
+}
+/******************************************************************************/
+// Index thread, write a run of entries that are next to each other in the same file
+LOCAL void writer_simple_index_write(ArkimeSimpleIndex_t **entries, int cnt, uint32_t now)
+{
+    struct iovec iov[INDEX_IOV_MAX];
+    uint64_t     total = 0;
+
+    for (int i = 0; i < cnt; i++) {
+        iov[i].iov_base = entries[i]->buf;
+        iov[i].iov_len = entries[i]->len;
+        total += entries[i]->len;
+    }
+
+    const int fd = writer_simple_index_fd(-entries[0]->file->fileNum, now);
+    uint64_t  offset = entries[0]->offset;
+    int       i = 0;
+
+    while (total > 0) {
+        ssize_t len = pwritev(fd, iov + i, cnt - i, offset);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGEXIT("ERROR - writing index %s", strerror(errno));
+        }
+        offset += len;
+        total -= len;
+
+        // Short write, skip what was written and go again
+        while (i < cnt && (size_t)len >= iov[i].iov_len) {
+            len -= iov[i].iov_len;
+            i++;
+        }
+        if (i < cnt) {
+            iov[i].iov_base = (uint8_t *)iov[i].iov_base + len;
+            iov[i].iov_len -= len;
+        }
+    }
+
+    for (i = 0; i < cnt; i++) {
+        __sync_sub_and_fetch(&entries[i]->file->pending, 1);
+        free(entries[i]);
+    }
+}
+/******************************************************************************/
+LOCAL void *writer_simple_index_thread(void *UNUSED(arg))
+{
+    ArkimeSimpleIndexHead_t  work;
+    ArkimeSimpleIndex_t     *entry;
+    ArkimeSimpleIndex_t     *run[INDEX_IOV_MAX];
+
+    if (config.debug)
+        LOG("THREAD %p", (gpointer)pthread_self());
+
+    DLL_INIT(sindex_, &work);
+
+    while (1) {
+        // Take everything queued so runs for the same file can be combined
+        ARKIME_LOCK(indexQ);
+        while (DLL_COUNT(sindex_, &indexQ) == 0) {
+            ARKIME_COND_WAIT(indexQ);
+        }
+        indexInflight = DLL_COUNT(sindex_, &indexQ);
+        DLL_PUSH_TAIL_DLL(sindex_, &work, &indexQ);
+        ARKIME_UNLOCK(indexQ);
+
+        const uint32_t now = time(NULL);
+        int            cnt = 0;
+        while (DLL_POP_HEAD(sindex_, &work, entry)) {
+            if (cnt > 0 && (cnt == INDEX_IOV_MAX ||
+                            entry->file != run[0]->file ||
+                            entry->offset != run[cnt - 1]->offset + run[cnt - 1]->len)) {
+                writer_simple_index_write(run, cnt, now);
+                cnt = 0;
+            }
+            run[cnt++] = entry;
+        }
+        if (cnt > 0)
+            writer_simple_index_write(run, cnt, now);
+
+        indexInflight = 0;
+    }
+    return NULL;
+}
+/******************************************************************************/
+// Packet thread, find the index file and reserve len bytes in it
+LOCAL uint64_t writer_simple_index_reserve(int thread, ArkimeSimpleIndexFile_t **filep, int64_t fileNum, uint32_t len)
+{
+    ArkimeSimpleIndexFile_t *file = g_hash_table_lookup(indexFiles[thread], &fileNum);
+    const uint32_t           now = time(NULL);
+
+    if (!file) {
+        // Forget files that are done with, nothing for them can still be in flight
+        if (g_hash_table_size(indexFiles[thread]) > INDEX_FDS_CACHE_SIZE) {
+            GHashTableIter           iter;
+            ArkimeSimpleIndexFile_t *old;
+            g_hash_table_iter_init(&iter, indexFiles[thread]);
+            while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&old)) {
+                if (old->lastUsed + INDEX_FILES_IDLE < now && old->pending == 0)
+                    g_hash_table_iter_remove(&iter);
+            }
+        }
+
+        file = ARKIME_TYPE_ALLOC0(ArkimeSimpleIndexFile_t);
+        file->fileNum = fileNum;
+
+        // Not new if it was forgotten about above, all its writes are done so the size is right
+        char        filename[1024];
+        struct stat sb;
+        snprintf(filename, sizeof(filename), "%s/%s-%" PRId64 ".index", config.pcapDir[0], config.nodeName, -fileNum);
+        if (stat(filename, &sb) == 0)
+            file->offset = sb.st_size;
+
+        g_hash_table_insert(indexFiles[thread], &file->fileNum, file);
+    }
+
+    const uint64_t offset = file->offset;
+    file->offset += len;
+    file->lastUsed = now;
+    __sync_add_and_fetch(&file->pending, 1);
+    *filep = file;
+    return offset;
+}
+/******************************************************************************/
+LOCAL void writer_simple_index_free(gpointer data)
+{
+    ARKIME_TYPE_FREE(ArkimeSimpleIndexFile_t, data);
+}
+/******************************************************************************/
+/* Each gap is little endian 7 bits per byte with the high bit set on the last
+ * byte.  The 8 possible bytes are spread with shifts and masks instead of a
+ * branch per byte, and always stored as 8 bytes, the caller leaves room.
+ * Supports gaps up to 2^56 - 1.
+ */
+LOCAL inline int writer_simple_index_varint(uint8_t *out, uint64_t val)
+{
+    const int bits = val ? 64 - __builtin_clzll(val) : 1;
+    const int len = bits >= 56 ? 8 : (bits + 6) / 7;
+
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (val << i) & (0x7fULL << (i * 8));
+    }
+    v |= 0x80ULL << ((len - 1) * 8);
+    v = htole64(v);
+    memcpy(out, &v, 8);
+
+    return len;
+}
+/******************************************************************************/
+// Packet thread, queue the entry for one pcap file and record where it will be
+LOCAL void writer_simple_index_queue(int thread, int64_t fileNum, const uint8_t *buf, uint32_t len, int64_t *filePos)
+{
+    ArkimeSimpleIndex_t *entry = malloc(sizeof(ArkimeSimpleIndex_t) + len);
+    entry->offset = writer_simple_index_reserve(thread, &entry->file, fileNum, len);
+    entry->len = len;
+    memcpy(entry->buf, buf, len);
+
+    filePos[1] = entry->offset;  // Where in index file
+    filePos[2] = len;
+
+    ARKIME_LOCK(indexQ);
+    DLL_PUSH_TAIL(sindex_, &indexQ, entry);
+    ARKIME_COND_SIGNAL(indexQ);
+    ARKIME_UNLOCK(indexQ);
 }
 /******************************************************************************/
 void writer_simple_index (ArkimeSession_t *session)
 {
-    uint8_t  buf[0xffff * 5];
-    BSB      bsb;
+    uint8_t  buf[0xffff * 5 + 8];
+    uint32_t pos = 0;
     int      files = 0;
     int64_t  filePos[1024];
+    int64_t  fileNum = 0;
 
-    BSB_INIT(bsb, buf, sizeof(buf));
-
-    FILE *fp = 0;
     uint64_t last = 0;
     uint64_t lastgap = 0;
     for(guint i = 0; i < session->filePosArray->len; i++) {
         int64_t packetPos = (int64_t)g_array_index(session->filePosArray, int64_t, i);
         if (packetPos < 0) {
-            if (fp) {
-                filePos[(files - 1) * 3 + 2] = BSB_LENGTH(bsb);
-                fwrite(buf, BSB_LENGTH(bsb), 1, fp);
+            if (fileNum) {
+                writer_simple_index_queue(session->thread, fileNum, buf, pos, filePos + (files - 1) * 3);
                 last = 0;
                 lastgap = 0;
             }
-            fp = writer_simple_get_index(session->thread, -packetPos);
-
+            fileNum = packetPos;
             filePos[files * 3] = packetPos;      // Which file
-            filePos[files * 3 + 1] = ftell(fp);  // Where in index file
             files++;
-
-            BSB_INIT(bsb, buf, sizeof(buf));
+            pos = 0;
         } else {
             uint64_t val = packetPos - last;
             if (val == lastgap) {
@@ -872,56 +1951,15 @@ void writer_simple_index (ArkimeSession_t *session)
             }
             last = packetPos;
 
-            if (val <= 0x7f) {
-                BSB_EXPORT_u08(bsb, 0x80 | val);
-                continue;
-            }
-            BSB_EXPORT_u08(bsb, (val & 0x7f));
-
-            if (val <= 0x3fff) {
-                BSB_EXPORT_u08(bsb, 0x80 | ((val >> 7) & 0x7f));
-                continue;
-            }
-            BSB_EXPORT_u08(bsb, ((val >> 7) & 0x7f));
-
-            if (val <= 0x1fffff) {
-                BSB_EXPORT_u08(bsb, 0x80 | ((val >> 14) & 0x7f));
-                continue;
-            }
-            BSB_EXPORT_u08(bsb, ((val >> 14) & 0x7f));
-
-            if (val <= 0x0fffffff) {
-                BSB_EXPORT_u08(bsb, 0x80 | ((val >> 21) & 0x7f));
+            // Always room for the 8 byte store, like BSB just stop if full
+            if (pos + 8 > sizeof(buf))
                 continue;
-            }
-            BSB_EXPORT_u08(bsb, ((val >> 21) & 0x7f));
-
-            if (val <= 0x07ffffffff) {
-                BSB_EXPORT_u08(bsb, 0x80 | ((val >> 28) & 0x7f));
-                continue;
-            }
-            BSB_EXPORT_u08(bsb, ((val >> 28) & 0x7f));
-
-            if (val <= 0x03ffffffffff) {
-                BSB_EXPORT_u08(bsb, 0x80 | ((val >> 35) & 0x7f));
-                continue;
-            }
-            BSB_EXPORT_u08(bsb, ((val >> 35) & 0x7f));
-
-            if (val <= 0x01ffffffffffff) {
-                BSB_EXPORT_u08(bsb, 0x80 | ((val >> 42) & 0x7f));
-                continue;
-            }
-            BSB_EXPORT_u08(bsb, ((val >> 42) & 0x7f));
-
-            // support up to 0xffffffffffffffUL (2^56 - 1)
-            BSB_EXPORT_u08(bsb, 0x80 | ((val >> 49) & 0x7f));
+            pos += writer_simple_index_varint(buf + pos, val);
         }
     }
 
-    if (fp) {
-        filePos[(files - 1) * 3 + 2] = BSB_LENGTH(bsb);
-        fwrite(buf, BSB_LENGTH(bsb), 1, fp);
+    if (fileNum) {
+        writer_simple_index_queue(session->thread, fileNum, buf, pos, filePos + (files - 1) * 3);
     }
 
     g_array_set_size(session->filePosArray, 0);
@@ -972,6 +2010,8 @@ void writer_simple_init(char *name)
 
         if (config.debug)
             LOG("Will compress - blocksize: %u bits: %d", simpleCompressionBlockSize, uncompressedBits);
+
+        simpleCompressionThreads = arkime_config_int(NULL, "simpleCompressionThreads", 0, 0, 32);
     }
 
     if (mode == NULL || !mode[0]) {
@@ -994,6 +2034,15 @@ void writer_simple_init(char *name)
         g_free(mode);
     }
 
+    if (simpleMode != ARKIME_SIMPLE_NORMAL) {
+        simpleEncryptThreads = arkime_config_int(NULL, "simpleEncryptThreads", 0, 0, 32);
+        for (int t = 0; t < simpleEncryptThreads; t++) {
+            char tname[100];
+            snprintf(tname, sizeof(tname), "arkime-encrypt%d", t);
+            g_thread_unref(g_thread_new(tname, &writer_simple_encrypt_thread, NULL));
+        }
+    }
+
     // Since we are doing direct IO must be a multiple of pagesize;
     pageSize = getpagesize();
     if (config.pcapWriteSize % pageSize != 0) {
@@ -1002,7 +2051,7 @@ void writer_simple_init(char *name)
     }
 
     openOptions = O_NOATIME | O_WRONLY | O_CREAT | O_TRUNC;
-    if (strcmp(name, "simple") == 0) {
+    if (strcmp(name, "simple") == 0 || strcmp(name, "simple-uring") == 0) {
 #ifdef O_DIRECT
         openOptions |= O_DIRECT;
 #else
@@ -1032,12 +2081,31 @@ void writer_simple_init(char *name)
 
         config.gapPacketPos = FALSE;
         arkime_writer_index = writer_simple_index;
+
+        for (int t = 0; t < config.packetThreads; t++) {
+            indexFiles[t] = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, writer_simple_index_free);
+        }
+        DLL_INIT(sindex_, &indexQ);
+        g_thread_unref(g_thread_new("arkime-index", &writer_simple_index_thread, NULL));
     }
 
     simpleFreeOutputBuffers  = arkime_config_int(NULL, "simpleFreeOutputBuffers", 16, 0, 0xffff);
 
     DLL_INIT(simple_, &simpleQ);
 
+    if (simpleCompressionThreads) {
+        arkime_writer_resolve = writer_simple_resolve;
+        DLL_INIT(simple_, &compressQ);
+        for (int t = 0; t < config.packetThreads; t++) {
+            blockTables[t] = g_hash_table_new(g_direct_hash, g_direct_equal);
+        }
+        for (int t = 0; t < simpleCompressionThreads; t++) {
+            char tname[100];
+            snprintf(tname, sizeof(tname), "arkime-compress%d", t);
+            g_thread_unref(g_thread_new(tname, &writer_simple_compress_thread, NULL));
+        }
+    }
+
     struct timeval now;
     gettimeofday(&now, NULL);
 
@@ -1049,6 +2117,19 @@ void writer_simple_init(char *name)
         ARKIME_LOCK_INIT(freeList[thread].lock);
     }
 
+    if (strcmp(name, "simple-uring") == 0) {
+#ifdef ARKIME_SIMPLE_URING
+        simpleUringDepth = arkime_config_int(NULL, "simpleUringDepth", 16, 1, 256);
+        if (writer_simple_uring_setup()) {
+            g_thread_unref(g_thread_new("arkime-simple", &writer_simple_uring_thread, NULL));
+            g_timeout_add_seconds(1, writer_simple_check_gfunc, 0);
+            return;
+        }
+#else
+        LOG("WARNING - Not compiled with io_uring support, using blocking writes");
+#endif
+    }
+
     g_thread_unref(g_thread_new("arkime-simple", &writer_simple_thread, NULL));
 
     g_timeout_add_seconds(1, writer_simple_check_gfunc, 0);
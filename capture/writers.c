@@ -13,6 +13,7 @@ ArkimeWriterQueueLength arkime_writer_queue_length;
 ArkimeWriterWrite arkime_writer_write;
 ArkimeWriterExit arkime_writer_exit;
 ArkimeWriterIndex arkime_writer_index;
+ArkimeWriterResolve arkime_writer_resolve;
 
 /******************************************************************************/
 extern ArkimeConfig_t        config;
@@ -54,4 +55,5 @@ void arkime_writers_init()
     arkime_writers_add("inplace", writer_inplace_init);
     arkime_writers_add("simple", writer_simple_init);
     arkime_writers_add("simple-nodirect", writer_simple_init);
+    arkime_writers_add("simple-uring", writer_simple_init);
 }
@@ -0,0 +1,160 @@
+/* Use this tool to decode the <pcapDir>/<node>-<num>.index files written with localPcapIndex
+ * and to benchmark decoding them, it is the same format viewer/db.js decodeLocalIndex reads.
+ *
+ * decodeIndex <file> [offset len]    - print the positions of one session's entry, offset and
+ *                                      len are the two packetPos values after the file number
+ * decodeIndex -b <file>              - time decoding the file
+ * decodeIndex -b                     - time decoding generated entries
+ *
+ * gcc -O2 -o decodeIndex decodeIndex.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/******************************************************************************/
+/* Gaps are 7 bits per byte, little endian, with the high bit set on the last
+ * byte. A gap of 0 means the same gap as last time.
+ */
+static int decode(const uint8_t *buf, size_t len, uint64_t *out)
+{
+    uint64_t last = 0;
+    uint64_t lastgap = 0;
+    uint64_t num = 0;
+    int      shift = 0;
+    int      cnt = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        const uint8_t x = buf[i];
+        if (x < 0x80) {
+            num |= (uint64_t)x << shift;
+            shift += 7;
+            continue;
+        }
+
+        num |= (uint64_t)(x & 0x7f) << shift;
+        if (num)
+            lastgap = num;
+        last += lastgap;
+        out[cnt++] = last;
+        num = 0;
+        shift = 0;
+    }
+    return cnt;
+}
+/******************************************************************************/
+static size_t encode(uint8_t *buf, uint64_t val)
+{
+    size_t n = 0;
+    while (val > 0x7f) {
+        buf[n++] = val & 0x7f;
+        val >>= 7;
+    }
+    buf[n++] = 0x80 | val;
+    return n;
+}
+/******************************************************************************/
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/******************************************************************************/
+static void bench(const uint8_t *buf, size_t len)
+{
+    uint64_t *out = malloc(len * sizeof(uint64_t));
+    uint64_t  total = 0;
+    int       loops = 0;
+    double    start = now();
+    double    elapsed;
+
+    do {
+        total += decode(buf, len, out);
+        loops++;
+        elapsed = now() - start;
+    } while (elapsed < 2.0);
+
+    printf("%zu bytes, %d loops, %.1f MB/s, %.1f M positions/s\n",
+           len, loops, (double)len * loops / elapsed / 1e6, total / elapsed / 1e6);
+    free(out);
+}
+/******************************************************************************/
+static uint8_t *load(const char *name, size_t *len)
+{
+    FILE *fp = fopen(name, "r");
+    if (!fp) {
+        printf("Couldn't open %s\n", name);
+        exit(1);
+    }
+
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    uint8_t *buf = malloc(*len + 1);
+    if (fread(buf, 1, *len, fp) != *len) {
+        printf("Couldn't read %s\n", name);
+        exit(1);
+    }
+    fclose(fp);
+    return buf;
+}
+/******************************************************************************/
+int main(int argc, char *argv[])
+{
+    size_t   len;
+    uint8_t *buf;
+
+    if (argc < 2) {
+        printf("Usage: %s <file> [offset len] | -b [file]\n", argv[0]);
+        exit(0);
+    }
+
+    if (strcmp(argv[1], "-b") == 0) {
+        if (argc > 2) {
+            buf = load(argv[2], &len);
+        } else {
+            // Packets of a few hundred bytes with the odd repeat gap and large gap
+            size_t size = 10000000;
+            buf = malloc(size + 16);
+            len = 0;
+            srandom(1);
+            while (len < size) {
+                uint64_t gap = random() % 16 == 0 ? 0 : 60 + random() % 1500;
+                if (random() % 64 == 0)
+                    gap = random() * 1000ULL;
+                len += encode(buf + len, gap);
+            }
+        }
+        bench(buf, len);
+        free(buf);
+        return 0;
+    }
+
+    buf = load(argv[1], &len);
+
+    uint8_t *entry = buf;
+    if (argc > 3) {
+        size_t offset = strtoull(argv[2], NULL, 10);
+        size_t elen = strtoull(argv[3], NULL, 10);
+        if (offset + elen > len) {
+            printf("offset %zu len %zu past end of file %zu\n", offset, elen, len);
+            exit(1);
+        }
+        entry = buf + offset;
+        len = elen;
+    }
+
+    uint64_t *out = malloc(len * sizeof(uint64_t));
+    int cnt = decode(entry, len, out);
+    for (int i = 0; i < cnt; i++) {
+        printf("%llu\n", (unsigned long long)out[i]);
+    }
+
+    free(out);
+    free(buf);
+    return 0;
+}
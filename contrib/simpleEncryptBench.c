@@ -0,0 +1,186 @@
+/* Use this tool to benchmark the simple writer simpleEncoding modes, it uses the
+ * same xor kernel and aes-256-ctr chunk offsets as capture/writer-simple.c and
+ * checks the chunked output matches encrypting the whole buffer in one go.
+ *
+ * simpleEncryptBench [threads [MB]]   - threads is like simpleEncryptThreads, default 4
+ *
+ * gcc -O2 -o simpleEncryptBench simpleEncryptBench.c -lcrypto -lpthread
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <endian.h>
+#include <pthread.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#define CHUNK (128 * 1024)
+
+static uint8_t  dek[256];
+static uint8_t  ivBase[16];
+static uint8_t *buf;
+static size_t   bufLen;
+static int      mode;
+static int      threads;
+static uint64_t next;
+
+/******************************************************************************/
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/******************************************************************************/
+static void xor_bytes(uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        data[i] ^= dek[i % 256];
+}
+/******************************************************************************/
+static void xor_wide(uint8_t *data, size_t len)
+{
+    uint64_t key[32];
+    size_t   i;
+
+    memcpy(key, dek, 256);
+    for (i = 0; i + 256 <= len; i += 256) {
+        for (int j = 0; j < 32; j++) {
+            uint64_t v;
+            memcpy(&v, data + i + j * 8, 8);
+            v ^= key[j];
+            memcpy(data + i + j * 8, &v, 8);
+        }
+    }
+    for (; i < len; i++)
+        data[i] ^= dek[i % 256];
+}
+/******************************************************************************/
+static void aes_at(EVP_CIPHER_CTX *ctx, uint8_t *data, size_t len, uint64_t offset)
+{
+    uint8_t  iv[16];
+    uint32_t counter = htobe32(offset / 16);
+    int      outl;
+
+    memcpy(iv, ivBase, 12);
+    memcpy(iv + 12, &counter, 4);
+    EVP_EncryptInit_ex(ctx, EVP_aes_256_ctr(), NULL, dek, iv);
+    EVP_EncryptUpdate(ctx, data, &outl, data, len);
+}
+/******************************************************************************/
+static void *worker(void *arg)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    (void)arg;
+
+    while (1) {
+        uint64_t pos = __atomic_fetch_add(&next, CHUNK, __ATOMIC_RELAXED);
+        if (pos >= bufLen)
+            break;
+        size_t len = bufLen - pos < CHUNK ? bufLen - pos : CHUNK;
+        if (mode == 1)
+            xor_wide(buf + pos, len);
+        else
+            aes_at(ctx, buf + pos, len, pos);
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    return NULL;
+}
+/******************************************************************************/
+static void run_threads(int m, int n)
+{
+    pthread_t tids[64];
+
+    mode = m;
+    next = 0;
+    for (int i = 0; i < n; i++)
+        pthread_create(&tids[i], NULL, worker, NULL);
+    for (int i = 0; i < n; i++)
+        pthread_join(tids[i], NULL);
+}
+/******************************************************************************/
+static void report(const char *name, double elapsed)
+{
+    printf("%-28s %8.1f MB/s\n", name, bufLen / elapsed / 1e6);
+}
+/******************************************************************************/
+int main(int argc, char *argv[])
+{
+    threads = argc > 1 ? atoi(argv[1]) : 4;
+    bufLen = (argc > 2 ? atoi(argv[2]) : 512) * 1024UL * 1024UL;
+    if (threads < 1 || threads > 64) {
+        printf("Usage: %s [threads [MB]], threads between 1 and 64\n", argv[0]);
+        exit(0);
+    }
+
+    RAND_bytes(dek, sizeof(dek));
+    RAND_bytes(ivBase, 12);
+    buf = malloc(bufLen);
+    uint8_t *orig = malloc(bufLen);
+    uint8_t *check = malloc(bufLen);
+    RAND_bytes(orig, bufLen);
+    memset(check, 0, bufLen);
+
+    double start;
+    char   name[100];
+
+    memcpy(buf, orig, bufLen);
+    start = now();
+    memcpy(check, buf, bufLen);
+    report("none (memcpy)", now() - start);
+
+    memcpy(check, orig, bufLen);
+    start = now();
+    xor_bytes(check, bufLen);
+    report("xor-2048 byte loop", now() - start);
+
+    memcpy(buf, orig, bufLen);
+    start = now();
+    xor_wide(buf, bufLen);
+    report("xor-2048 wide", now() - start);
+    if (memcmp(buf, check, bufLen) != 0)
+        printf("  xor-2048 wide MISMATCH\n");
+
+    memcpy(buf, orig, bufLen);
+    start = now();
+    run_threads(1, threads);
+    snprintf(name, sizeof(name), "xor-2048 wide %d threads", threads);
+    report(name, now() - start);
+    if (memcmp(buf, check, bufLen) != 0)
+        printf("  xor-2048 threads MISMATCH\n");
+
+    // One stream the way a single EVP_EncryptUpdate per buffer works
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    memcpy(check, orig, bufLen);
+    start = now();
+    EVP_EncryptInit_ex(ctx, EVP_aes_256_ctr(), NULL, dek, ivBase);
+    for (size_t pos = 0; pos < bufLen; pos += CHUNK) {
+        int outl;
+        EVP_EncryptUpdate(ctx, check + pos, &outl, check + pos, bufLen - pos < CHUNK ? bufLen - pos : CHUNK);
+    }
+    report("aes-256-ctr stream", now() - start);
+    EVP_CIPHER_CTX_free(ctx);
+
+    memcpy(buf, orig, bufLen);
+    start = now();
+    run_threads(2, 1);
+    report("aes-256-ctr chunks", now() - start);
+    if (memcmp(buf, check, bufLen) != 0)
+        printf("  aes-256-ctr chunks MISMATCH\n");
+
+    memcpy(buf, orig, bufLen);
+    start = now();
+    run_threads(2, threads);
+    snprintf(name, sizeof(name), "aes-256-ctr %d threads", threads);
+    report(name, now() - start);
+    if (memcmp(buf, check, bufLen) != 0)
+        printf("  aes-256-ctr threads MISMATCH\n");
+
+    free(buf);
+    free(orig);
+    free(check);
+    return 0;
+}
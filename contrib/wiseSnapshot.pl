@@ -0,0 +1,168 @@
+#!/usr/bin/perl
+# Use this tool to build a wise snapshot for capture's wiseSnapshotFile setting
+# from wise tagger format files, the same format the wise file source reads.
+#
+# wiseSnapshot.pl [--complete <type>]... <output> <type>:<file> [<type>:<file>...]
+#
+#   type        - a wise type like ip, domain, md5, email, url, ja3, sha256 or a
+#                 custom [wise-types] type, files with the same type are merged
+#   --complete  - every wise source for the type is in the snapshot, so capture
+#                 doesn't ask the wise service about keys that aren't found
+#
+# The snapshot is written to <output>.tmp and renamed, capture notices the new
+# file within a second and swaps it in.  See the format in capture/plugins/wise.c
+#
+# SPDX-License-Identifier: Apache-2.0
+
+use strict;
+use warnings;
+
+my %complete;
+while (@ARGV && $ARGV[0] =~ /^--/) {
+    my $opt = shift @ARGV;
+    if ($opt eq "--complete" && @ARGV) {
+        $complete{lc(shift @ARGV)} = 1;
+    } else {
+        die "Unknown option $opt\n";
+    }
+}
+
+die "Usage: $0 [--complete <type>]... <output> <type>:<file> [<type>:<file>...]\n" if (@ARGV < 2);
+
+my $output = shift @ARGV;
+
+my @fields;        # field definitions in snapshot order
+my %fieldPos;      # field definition or expression to snapshot field
+my %data;          # type -> key -> packed ops
+my %numOps;        # type -> key -> count of ops
+
+################################################################################
+sub addField {
+    my ($def) = @_;
+
+    return $fieldPos{$def} if (exists $fieldPos{$def});
+    die "Too many fields, a snapshot can only have 256\n" if (@fields == 256);
+
+    push(@fields, $def);
+    $fieldPos{$def} = $#fields;
+    if ($def =~ /^field:([^;]+)/) {
+        $fieldPos{$1} = $#fields if (!exists $fieldPos{$1});
+    }
+    return $#fields;
+}
+
+################################################################################
+sub loadTagger {
+    my ($type, $file) = @_;
+    my %shortcuts;
+
+    open(my $fh, "<", $file) or die "Couldn't open $file - $!\n";
+    binmode($fh);
+    while (my $line = <$fh>) {
+        $line =~ s/\r?\n$//;
+        next if ($line =~ /^\s*$/);
+
+        if ($line =~ /^#/) {
+            $line = substr($line, 1);
+            next if ($line !~ /^field:/);
+            my $pos = addField($line);
+            if ($line =~ /shortcut:([^;]+)/) {
+                my $shortcut = $1;
+                my $mod = 0;
+                $mod = 1 if ($line =~ /kind:lotermfield/);
+                $mod = 2 if ($line =~ /kind:uptermfield/);
+                $shortcuts{$shortcut} = {pos => $pos, mod => $mod};
+            }
+            next;
+        }
+
+        my ($key, @parts) = split(/;/, $line);
+        next if (!defined $key || $key eq "");
+        if (length($key) > 0xffff) {
+            print "WARNING - $file - ignoring key longer than 65535\n";
+            next;
+        }
+
+        foreach my $part (@parts) {
+            my ($name, $value) = split(/=/, $part, 2);
+            if (!defined $value) {
+                print "WARNING - $file - ignored extra piece '$part' from line '$line'\n";
+                next;
+            }
+
+            my $pos;
+            if (exists $shortcuts{$name}) {
+                $pos = $shortcuts{$name}->{pos};
+                $value = lc($value) if ($shortcuts{$name}->{mod} == 1);
+                $value = uc($value) if ($shortcuts{$name}->{mod} == 2);
+            } else {
+                $pos = $fieldPos{$name} // addField("field:$name");
+            }
+
+            if (length($value) > 254) {
+                print "WARNING - $file - truncating value for $key to 254 bytes\n";
+                $value = substr($value, 0, 254);
+            }
+
+            if (($numOps{$type}{$key} // 0) == 255) {
+                print "WARNING - $file - only 255 values allowed for $key\n";
+                last;
+            }
+
+            $data{$type}{$key} .= pack("CC", $pos, length($value) + 1) . $value . "\0";
+            $numOps{$type}{$key}++;
+        }
+    }
+    close($fh);
+}
+
+################################################################################
+foreach my $arg (@ARGV) {
+    my ($type, $file) = split(/:/, $arg, 2);
+    die "Expected <type>:<file> not $arg\n" if (!defined $file || $type eq "");
+    $type = lc($type);
+    die "Type name $type too long\n" if (length($type) > 255);
+    $data{$type} //= {};
+    loadTagger($type, $file);
+}
+
+my @types = sort keys %data;
+
+# Everything before the entries
+my $fieldsBlob = join("", map { pack("n", length($_) + 1) . $_ . "\0" } @fields);
+my $typesLen = 0;
+$typesLen += 1 + length($_) + 1 + 4 + 8 foreach (@types);
+
+my $entriesStart = 8 + 4 + 4 + 8 + length($fieldsBlob) + $typesLen;
+my $entries = "";
+my %index;
+
+foreach my $type (@types) {
+    my @offsets;
+    foreach my $key (sort keys %{$data{$type}}) {
+        push(@offsets, $entriesStart + length($entries));
+        $entries .= pack("n", length($key)) . $key . pack("C", $numOps{$type}{$key}) . $data{$type}{$key};
+    }
+    $index{$type} = pack("Q>*", @offsets);
+}
+
+my $indexOffset = $entriesStart + length($entries);
+my $typesBlob = "";
+foreach my $type (@types) {
+    $typesBlob .= pack("C", length($type)) . $type . pack("CNQ>", $complete{$type} ? 1 : 0, scalar(keys %{$data{$type}}), $indexOffset);
+    $indexOffset += length($index{$type});
+}
+
+my $fileSize = $indexOffset;
+
+open(my $out, ">", "$output.tmp") or die "Couldn't open $output.tmp - $!\n";
+binmode($out);
+print $out "ARKWISE1", pack("NNQ>", scalar(@fields), scalar(@types), $fileSize);
+print $out $fieldsBlob, $typesBlob, $entries;
+print $out $index{$_} foreach (@types);
+close($out) or die "Couldn't write $output.tmp - $!\n";
+rename("$output.tmp", $output) or die "Couldn't rename $output.tmp to $output - $!\n";
+
+foreach my $type (@types) {
+    printf("%-10s %8d keys%s\n", $type, scalar(keys %{$data{$type}}), $complete{$type} ? " complete" : "");
+}
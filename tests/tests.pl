@@ -112,7 +112,44 @@ sub doTests {
     my @files = @ARGV;
     @files = glob ("pcap/*.pcap") if ($#files == -1);
 
-    plan tests => scalar @files;
+    plan tests => scalar @files + 5;
+
+    # Randomized check of the vectorized json string escaping against the byte at a time version
+    my $selfTestCmd = "../capture/capture --tests -c config.test.ini -n test --js0nselftest 100000 2>/dev/null";
+    print "$selfTestCmd\n" if ($main::debug);
+    is(system($selfTestCmd), 0, "js0n self test");
+
+    # Reading a newer pcap before an older one must not split the older one's sessions
+    my $sessionCount = sub {
+        my $cmd = "../capture/capture --tests -c config.test.ini -n test " . join(" ", map {"-r $_"} @_) . " 2>&1 1>/dev/null";
+        print "$cmd\n" if ($main::debug);
+        my $out = from_json(`$cmd`, {relaxed => 1});
+        return scalar @{$out->{sessions3}};
+    };
+    is($sessionCount->("pcap/smtp-html.pcap", "pcap/irc.pcap"),
+       $sessionCount->("pcap/smtp-html.pcap") + $sessionCount->("pcap/irc.pcap"),
+       "pcaps out of time order");
+
+    # A flow moved to the elephant path part way thru the server certificates must keep the one already read
+    my $tlsSession = sub {
+        my $cmd = "../capture/capture --tests -c config.test.ini -n test -r pcap/openssl-tls1_2.pcap @_ 2>&1 1>/dev/null";
+        print "$cmd\n" if ($main::debug);
+        my $body = from_json(`$cmd`, {relaxed => 1})->{sessions3}->[0]->{body};
+        return ($body->{tags} // [], [map {$_->{hash}} @{$body->{cert} // []}]);
+    };
+    my ($elephantTags, $elephantCerts) = $tlsSession->("-o elephantPackets=8 -o elephantAlwaysHot=true");
+    my (undef, $allCerts) = $tlsSession->();
+    my %allCerts = map {$_ => 1} @{$allCerts};
+    ok((grep {$_ eq "elephant-flow"} @{$elephantTags}) && @{$elephantCerts} > 0 && !(grep {!$allCerts{$_}} @{$elephantCerts}),
+       "elephant flow keeps parser fields");
+
+    # The classify DFA must call the same classifiers as checking every pattern
+    my ($classifyRc, $classifyOut) = runClassifyBench(1, @files);
+    ok($classifyRc == 0 && $classifyOut =~ /classify tcp: .* 0 mismatches/, "classify dfa matches linear") or print $classifyOut;
+
+    # The fieldSet tries and interval trees must match the same rules as the linear checks
+    my ($rulesRc, $rulesOut) = runRulesBench(300, @files);
+    ok($rulesRc == 0 && $rulesOut =~ /rules: .* 0 mismatches/, "rules compiled matches linear") or print $rulesOut;
 
     foreach my $filename (@files) {
         $filename = substr($filename, 0, -5) if ($filename =~ /\.pcap$/);
@@ -150,6 +187,50 @@ sub doTests {
     }
 }
 ################################################################################
+# Replay the first payloads of every session thru the classify DFA and the
+# linear matcher, capture exits with an error if they don't agree
+sub runClassifyBench {
+    my ($reps, @files) = @_;
+
+    my $cmd = "../capture/capture --tests -c config.test.ini -n test -o classifyBenchmark=$reps " . join(" ", map {/\.pcap$/ ? "-r $_" : "-r $_.pcap"} @files) . " 2>/dev/null";
+    if ($main::debug) {
+        print "$cmd\n";
+    }
+    my $out = `$cmd`;
+    return ($?, $out);
+}
+################################################################################
+sub doClassifyBench {
+    my @files = @ARGV;
+    @files = glob ("pcap/*.pcap") if ($#files == -1);
+
+    my ($rc, $out) = runClassifyBench(1000, @files);
+    print grep {/classify/} split(/^/, $out);
+    exit ($rc == 0 ? 0 : 1);
+}
+################################################################################
+# Generate fieldSet rules and replay the field values thru the compiled
+# matchers and the linear checks, capture exits with an error if they don't agree
+sub runRulesBench {
+    my ($rules, @files) = @_;
+
+    my $cmd = "../capture/capture --tests -c config.test.ini -n test -o rulesBenchmark=$rules " . join(" ", map {/\.pcap$/ ? "-r $_" : "-r $_.pcap"} @files) . " 2>/dev/null";
+    if ($main::debug) {
+        print "$cmd\n";
+    }
+    my $out = `$cmd`;
+    return ($?, $out);
+}
+################################################################################
+sub doRulesBench {
+    my @files = @ARGV;
+    @files = glob ("pcap/*.pcap") if ($#files == -1);
+
+    my ($rc, $out) = runRulesBench(3000, @files);
+    print grep {/rules:/} split(/^/, $out);
+    exit ($rc == 0 ? 0 : 1);
+}
+################################################################################
 sub doFix {
     my $data = do { local $/; <> };
     my $json;
@@ -438,7 +519,7 @@ while (scalar (@ARGV) > 0) {
     } elsif ($ARGV[0] eq "--copy") {
         $main::copy = "--copy";
         shift @ARGV;
-    } elsif ($ARGV[0] =~ /^--(viewer|fix|make|capture|viewernostart|viewerstart|viewerhang|viewerload|help|reip|fuzz|fuzz2pcap)$/) {
+    } elsif ($ARGV[0] =~ /^--(viewer|fix|make|capture|viewernostart|viewerstart|viewerhang|viewerload|help|reip|fuzz|fuzz2pcap|classifybench|rulesbench)$/) {
         $main::cmd = $ARGV[0];
         shift @ARGV;
     } elsif ($ARGV[0] =~ /^--/) {
@@ -463,6 +544,12 @@ if ($main::cmd eq "--fix") {
     system($cmd);
 } elsif ($main::cmd eq "--fuzz2pcap") {
     doFuzz2Pcap();
+} elsif ($main::cmd eq "--classifybench") {
+    doGeo();
+    doClassifyBench();
+} elsif ($main::cmd eq "--rulesbench") {
+    doGeo();
+    doRulesBench();
 } elsif ($main::cmd eq "--help") {
     print "$ARGV[0] [OPTIONS] [COMMAND] <pcap> files\n";
     print "Options:\n";
@@ -479,6 +566,8 @@ if ($main::cmd eq "--fix") {
     print "  --viewerstart         Viewer tests without reloading pcap\n";
     print "  --fuzz [fuzzoptions]  Run fuzzloch\n";
     print "  --fuzz2pcap           Convert a fuzzloch crash file into a pcap file\n";
+    print "  --classifybench       Time just the classifiers against the first payloads of [pcap files]\n";
+    print "  --rulesbench          Time 3000 generated fieldSet rules against the field values of [pcap files]\n";
     print " [default] [pcap files] Run each .pcap (default pcap/*.pcap) file thru ../capture/capture and compare to .test file\n";
 } elsif ($main::cmd =~ "^--viewer") {
     doGeo();
@@ -0,0 +1,78 @@
+# WISE snapshot tests, capture answers domains from the snapshot without asking the wise service
+use Test::More tests => 7;
+use ArkimeTest;
+use Data::Dumper;
+use JSON -support_by_pp;
+use strict;
+
+my $snapshot = "/tmp/arkime-tests-wise.snapshot";
+my $monitorDir = "/tmp/arkime-tests-wise-monitor";
+
+sub buildSnapshot {
+    system("../contrib/wiseSnapshot.pl @_ > /dev/null");
+}
+
+# Tags of each www.example.com session in capture --tests output
+sub exampleTags {
+    my ($out) = @_;
+    my @tags;
+    foreach my $session (@{from_json($out, {relaxed => 1})->{sessions3}}) {
+        my $body = $session->{body};
+        next if (!grep {$_ eq "www.example.com"} @{$body->{http}->{host} // []});
+        push(@tags, {map {$_ => 1} @{$body->{tags} // []}});
+    }
+    return @tags;
+}
+
+sub runCapture {
+    return exampleTags(`../capture/capture --tests -c config.test.ini -n wisesnapshot -r pcap/socks-http-example.pcap 2>&1 1>/dev/null`);
+}
+
+my @tags;
+
+# Hit on a complete type, the snapshot has the tags and the wise service with domainwise isn't asked
+buildSnapshot("--complete domain $snapshot domain:domain.wise");
+@tags = runCapture();
+ok(@tags > 0 && !(grep {!$_->{wisebyhost2}} @tags), "snapshot hit");
+ok(!(grep {$_->{domainwise}} @tags), "snapshot hit complete not sent to wise");
+
+# Miss on a complete type isn't sent to the wise service either
+buildSnapshot("--complete domain $snapshot domain:/dev/null");
+@tags = runCapture();
+ok(@tags > 0 && !(grep {$_->{wisebyhost2} || $_->{domainwise}} @tags), "snapshot miss complete not sent to wise");
+
+# Miss on a type that isn't complete still asks the wise service
+buildSnapshot("$snapshot domain:/dev/null");
+@tags = runCapture();
+ok(@tags > 0 && !(grep {!$_->{wisebyhost2} || !$_->{domainwise}} @tags), "snapshot miss sent to wise");
+
+# Hot swap, --flush saves each file's sessions when the next file is opened.  The
+# first file is saved with the first snapshot and the rest after the swap.
+buildSnapshot("--complete domain $snapshot domain:domain.wise");
+system("rm -rf $monitorDir; mkdir -p $monitorDir");
+my $out = "/tmp/arkime-tests-wise-monitor.json";
+my $pid = fork();
+if ($pid == 0) {
+    exec("../capture/capture --tests -c config.test.ini -n wisesnapshot -R $monitorDir -m --flush 2>$out 1>/dev/null");
+}
+sleep 3;
+system("/bin/cp pcap/socks-http-example.pcap $monitorDir/1.pcap");
+sleep 2;
+system("/bin/cp pcap/socks-http-example.pcap $monitorDir/2.pcap");
+sleep 2;
+buildSnapshot("--complete domain $snapshot domain:/dev/null");
+sleep 3;
+system("/bin/cp pcap/socks-http-example.pcap $monitorDir/3.pcap");
+sleep 2;
+kill("INT", $pid);
+waitpid($pid, 0);
+
+my $json = do { local $/; open(my $fh, "<", $out); <$fh> };
+@tags = exampleTags($json);
+my $perFile = scalar(@tags) / 3;
+ok($perFile > 0 && @tags == $perFile * 3, "hot swap sessions");
+ok(!(grep {!$_->{wisebyhost2}} @tags[0 .. $perFile - 1]), "hot swap before");
+ok(!(grep {$_->{wisebyhost2} || $_->{domainwise}} @tags[$perFile .. $#tags]), "hot swap after");
+
+unlink($snapshot, $out);
+system("rm -rf $monitorDir");
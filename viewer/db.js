@@ -364,6 +364,35 @@ function fixSessionFields (fields, unflatten) {
   }
 }
 
+// Decode one localIndex entry, var length gaps with the high bit set on the last byte,
+// a gap of 0 is the same gap as last time. Positions are pushed onto out.
+// contrib/decodeIndex.c has a C version of this with a benchmark.
+Db.decodeLocalIndex = (buffer, out) => {
+  let last = 0;
+  let lastgap = 0;
+  let num = 0;
+  let mult = 1;
+  for (let i = 0, ilen = buffer.length; i < ilen; i++) {
+    const x = buffer[i];
+    if (x < 0x80) {
+      num += x * mult;
+      mult *= 128; // Javscript can't shift large numbers, so mult
+      continue;
+    }
+
+    // high bit set when last, most gaps are a single byte
+    num += (x & 0x7f) * mult;
+    if (num !== 0) {
+      lastgap = num;
+    }
+    last += lastgap;
+    out.push(last);
+    num = 0;
+    mult = 1;
+  }
+  return out;
+};
+
 // Get a session from OpenSearch/Elasticsearch and decode packetPos if requested
 Db.getSession = async (id, options, cb) => {
   if (internals.debug > 2) {
@@ -409,28 +438,8 @@ Db.getSession = async (id, options, cb) => {
                   if (!fd) { return nextCb(); }
                   const buffer = Buffer.alloc(fields.packetPos[key + 2]);
                   fs.readSync(fd, buffer, 0, buffer.length, fields.packetPos[key + 1]);
-                  let last = 0;
-                  let lastgap = 0;
-                  let num = 0;
-                  let mult = 1;
                   newPacketPos.push(item);
-                  for (let i = 0; i < buffer.length; i++) {
-                    const x = buffer.readUInt8(i);
-                    // high bit set when last
-                    if (x & 0x80) {
-                      num = num + (x & 0x7f) * mult;
-                      if (num !== 0) {
-                        lastgap = num;
-                      }
-                      last += lastgap;
-                      newPacketPos.push(last);
-                      num = 0;
-                      mult = 1;
-                    } else {
-                      num = num + x * mult;
-                      mult *= 128; // Javscript can't shift large numbers, so mult
-                    }
-                  }
+                  Db.decodeLocalIndex(buffer, newPacketPos);
                   fs.closeSync(fd);
                 } catch (e) {
                   console.log(e);